@@ -24,16 +24,9 @@ public class AddressBookIndex : NSObject {
   private struct IndexEntry : Equatable {
     
     let systemId : ABRecordID
+    let modified : NSDate?
     let names : Set<String>
     let aliases : Set<String>
-    let data : String
-    
-    init(systemId: ABRecordID, names: Set<String>, aliases: Set<String>) {
-      self.systemId = systemId
-      self.names = names
-      self.aliases = aliases
-      self.data = names.union(aliases).joinWithSeparator(" ")
-    }
     
   }
   
@@ -41,7 +34,9 @@ public class AddressBookIndex : NSObject {
   private let addressBook : AddressBook
   private let addressBookQueue = dispatch_queue_create("AddressBookIndex Access", DISPATCH_QUEUE_SERIAL)
   private var entries = [ABRecordID:IndexEntry]()
+  private var searchIndex = AddressBookSearchIndex()
   private let lockQueue = dispatch_queue_create("AddressBookIndex Lock", DISPATCH_QUEUE_SERIAL)
+  private let updateQueue = dispatch_queue_create("AddressBookIndex Update", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0))
   
   
   public init(ready: (() -> Void)?) {
@@ -51,11 +46,11 @@ public class AddressBookIndex : NSObject {
     super.init()
     
     self.addressBook.registerExternalChangeCallback {
-      GCD.userInitiatedQueue.async { self.rebuildIndex() }
+      self.updateQueue.async { self.applyUpdate(full: false) }
     }
     
-    GCD.backgroundQueue.async {
-      self.rebuildIndex()
+    updateQueue.async {
+      self.applyUpdate(full: true)
       ready?()
     }
   }
@@ -65,31 +60,43 @@ public class AddressBookIndex : NSObject {
   
   public func lookupPeopleWithAliases(aliases: [String]) -> [AddressBookPerson] {
     
-    return lockQueue.sync {
-      let matches = self.entries.values.filter { !$0.aliases.intersect(aliases).isEmpty }
-      return self.addressBookQueue.sync {
-        let mapped = matches.map { self.addressBook.personWithRecordId($0.systemId) }
-        let filtered = mapped.filter { $0 != nil }
-        return filtered.map { (person:AddressBookPerson?) -> AddressBookPerson in return person! }
-      }
-    }
+    let matches = lockQueue.sync { self.searchIndex.recordsWithAliases(aliases) }
+    
+    return peopleWithRecordIds(matches)
   }
   
   public func searchPeopleWithQuery(query: String) -> [AddressBookPerson] {
     
-    return lockQueue.sync {
-      let matches = self.entries.values.filter { $0.data.localizedCaseInsensitiveContainsString(query) }
-      return self.addressBookQueue.sync {
-        let mapped = matches.map { self.addressBook.personWithRecordId($0.systemId) }
-        let filtered = mapped.filter { $0 != nil }
-        return filtered.map { (person:AddressBookPerson?) -> AddressBookPerson in return person! }
-      }
+    let matches = lockQueue.sync { self.searchIndex.recordsMatchingQuery(query) }
+    
+    return peopleWithRecordIds(matches)
+  }
+  
+  private func peopleWithRecordIds(recordIds: Set<ABRecordID>) -> [AddressBookPerson] {
+    
+    return addressBookQueue.sync {
+      return recordIds.flatMap { self.addressBook.personWithRecordId($0) }
     }
   }
   
+  // Re-reads & re-indexes every record
   func rebuildIndex() {
+    updateQueue.sync { self.applyUpdate(full: true) }
+  }
+  
+  // Re-reads & re-indexes only records added or modified since the last update
+  func updateIndex() {
+    updateQueue.sync { self.applyUpdate(full: false) }
+  }
+  
+  /*
+    Runs on the update queue, the only place entries & the search index
+    are replaced. The update is applied to copies, so readers keep querying
+    the previous snapshot until the updated one is swapped in.
+  */
+  private func applyUpdate(full full: Bool) {
     
-    DDLogInfo("Rebuilding index")
+    DDLogInfo(full ? "Rebuilding index" : "Updating index")
     
     let startTime = CFAbsoluteTimeGetCurrent()
     
@@ -97,69 +104,93 @@ public class AddressBookIndex : NSObject {
       return self.addressBook.allPeople ?? []
     }
     
-    let mapped = people.map { person -> IndexEntry in
+    let previousEntries : [ABRecordID:IndexEntry] = lockQueue.sync { self.entries }
+    let previousSearchIndex : AddressBookSearchIndex = lockQueue.sync { self.searchIndex }
+    
+    var entries = full ? [ABRecordID:IndexEntry]() : previousEntries
+    var searchIndex = full ? AddressBookSearchIndex() : previousSearchIndex
+    
+    var added = [NSNumber]()
+    var updated = [NSNumber]()
+    var deletedIds = Set(previousEntries.keys)
+    
+    for person in people {
+      
+      let systemId = ABRecordID(person.recordID)
+      let modified = person.modificationDate
+      
+      deletedIds.remove(systemId)
       
-      let names = Set([
-        (person.firstName ?? ""),
-        (person.middleName ?? ""),
-        (person.lastName ?? ""),
-        (person.nickname ?? ""),
-        (person.organization ?? ""),
-        (person.department ?? ""),
-        (person.jobTitle ?? "")
-        ])
+      let previousEntry = previousEntries[systemId]
       
-      let phones = person.phoneNumbers?.map { $0.value as! String } ?? []
-      let emails = person.emails?.map { $0.value as! String } ?? []
+      // Records without a modification date are always re-read, & reported only when their content changed
+      if let previousEntry = previousEntry, previousModified = previousEntry.modified, modified = modified
+        where !full && previousModified == modified {
+        continue
+      }
       
-      let aliases = Set(phones + emails)
+      let entry = AddressBookIndex.entryForPerson(person, systemId: systemId, modified: modified)
       
-      return IndexEntry(systemId: ABRecordID(person.recordID), names: names, aliases: aliases)
+      if let previousEntry = previousEntry {
+        if entry != previousEntry {
+          updated.append(NSNumber(int: systemId))
+        }
+      }
+      else {
+        added.append(NSNumber(int: systemId))
+      }
       
+      entries[systemId] = entry
+      searchIndex.addRecord(systemId, names: entry.names, aliases: entry.aliases)
     }
     
-    let builtTime = CFAbsoluteTimeGetCurrent()
-    DDLogVerbose("Indexing built: \(builtTime - startTime) secs")
-    
-    var entries = [ABRecordID:IndexEntry]()
-    for entry in mapped {
-      entries[entry.systemId] = entry
+    for systemId in deletedIds {
+      entries.removeValueForKey(systemId)
+      searchIndex.removeRecord(systemId)
     }
     
     let updateTime = CFAbsoluteTimeGetCurrent()
-    DDLogVerbose("Indexing update: \(updateTime - builtTime) secs")
-
-    var oldEntries : [ABRecordID:IndexEntry]!
+    DDLogVerbose("Indexing update: \(updateTime - startTime) secs")
+    
     lockQueue.sync {
-      oldEntries = self.entries
       self.entries = entries
+      self.searchIndex = searchIndex
     }
     
-    var added = [NSNumber]()
-    var updated = [NSNumber]()
+    let deleted = deletedIds.map { NSNumber(int: $0) }
     
-    for entry in mapped {
-      if let oldEntry = oldEntries.removeValueForKey(entry.systemId) {
-        if entry != oldEntry {
-          updated.append(NSNumber(int: entry.systemId))
-        }
-      }
-      else {
-        added.append(NSNumber(int: entry.systemId))
-      }
+    if !added.isEmpty || !updated.isEmpty || !deleted.isEmpty {
+      
+      NSNotificationCenter.defaultCenter().postNotificationName(AddressBookIndexUpdateNotification,
+                                                                object: self,
+                                                                userInfo: [
+                                                                  AddressBookIndexUpdateNotificationAddedKey: added,
+                                                                  AddressBookIndexUpdateNotificationUpdatedKey: updated,
+                                                                  AddressBookIndexUpdateNotificationDeletedKey: deleted])
     }
     
-    let deleted = Array(oldEntries.keys.map { NSNumber(int: $0) })
+    let finishTime = CFAbsoluteTimeGetCurrent()
+    DDLogInfo("Indexing finished: \(finishTime - startTime) secs (\(added.count) added, \(updated.count) updated, \(deleted.count) deleted)")
+  }
+  
+  private static func entryForPerson(person: AddressBookPerson, systemId: ABRecordID, modified: NSDate?) -> IndexEntry {
+    
+    let names = Set([
+      (person.firstName ?? ""),
+      (person.middleName ?? ""),
+      (person.lastName ?? ""),
+      (person.nickname ?? ""),
+      (person.organization ?? ""),
+      (person.department ?? ""),
+      (person.jobTitle ?? "")
+      ])
     
-    NSNotificationCenter.defaultCenter().postNotificationName(AddressBookIndexUpdateNotification,
-                                                              object: self,
-                                                              userInfo: [
-                                                                AddressBookIndexUpdateNotificationAddedKey: added,
-                                                                AddressBookIndexUpdateNotificationUpdatedKey: updated,
-                                                                AddressBookIndexUpdateNotificationDeletedKey: deleted])
+    let phones = person.phoneNumbers?.map { $0.value as! String } ?? []
+    let emails = person.emails?.map { $0.value as! String } ?? []
     
-    let finishTime = CFAbsoluteTimeGetCurrent()
-    DDLogInfo("Indexing finished: \(finishTime - startTime) secs")
+    let aliases = Set(phones + emails)
+    
+    return IndexEntry(systemId: systemId, modified: modified, names: names, aliases: aliases)
   }
   
 }
@@ -170,7 +201,7 @@ public class AddressBookIndex : NSObject {
 private func ==(lhs: AddressBookIndex.IndexEntry, rhs: AddressBookIndex.IndexEntry) -> Bool {
   return
     lhs.systemId == rhs.systemId &&
+      lhs.modified == rhs.modified &&
       lhs.names == rhs.names &&
-      lhs.aliases == rhs.names &&
-      lhs.data == rhs.data
+      lhs.aliases == rhs.aliases
 }
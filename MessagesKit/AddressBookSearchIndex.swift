@@ -0,0 +1,194 @@
+//
+//  AddressBookSearchIndex.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import Foundation
+import AddressBook
+
+
+/*
+  AddressBookSearchIndex
+
+  Lookup tables for the address book index: normalized alias to
+  records, and an inverted index from every 1, 2 & 3 character gram of
+  the folded names & aliases to the records containing it.
+
+  A query word of up to 3 characters is answered exactly by its gram's
+  records; longer words start from the smallest of their grams' record
+  sets and verify those candidates, so lookups cost roughly the size of
+  the result instead of the size of the address book.
+
+  Records can be added & removed individually; being a value, a copy
+  taken before an update stays a consistent snapshot for its readers.
+*/
+struct AddressBookSearchIndex {
+
+  static let maxGramLength = 3
+
+  private var aliasRecords = [String: Set<ABRecordID>]()
+  private var gramRecords = [String: Set<ABRecordID>]()
+  private var recordTerms = [ABRecordID: [String]]()
+  private var recordAliases = [ABRecordID: [String]]()
+
+  var count : Int {
+    return recordTerms.count
+  }
+
+  // Adds the record, replacing any previously added with the same id
+  mutating func addRecord(systemId: ABRecordID, names: Set<String>, aliases: Set<String>) {
+
+    removeRecord(systemId)
+
+    let normalizedAliases = Set(aliases.map { AddressBookSearchIndex.normalizeAlias($0) })
+    for alias in normalizedAliases {
+      AddressBookSearchIndex.insert(systemId, forKey: alias, into: &aliasRecords)
+    }
+
+    let terms = names.union(aliases).filter { !$0.isEmpty }.map { AddressBookSearchIndex.fold($0) }
+
+    for gram in AddressBookSearchIndex.gramsOfTerms(terms) {
+      AddressBookSearchIndex.insert(systemId, forKey: gram, into: &gramRecords)
+    }
+
+    recordTerms[systemId] = terms
+    recordAliases[systemId] = Array(normalizedAliases)
+  }
+
+  mutating func removeRecord(systemId: ABRecordID) {
+
+    guard let terms = recordTerms.removeValueForKey(systemId) else {
+      return
+    }
+
+    for alias in recordAliases.removeValueForKey(systemId) ?? [] {
+      AddressBookSearchIndex.remove(systemId, forKey: alias, from: &aliasRecords)
+    }
+
+    for gram in AddressBookSearchIndex.gramsOfTerms(terms) {
+      AddressBookSearchIndex.remove(systemId, forKey: gram, from: &gramRecords)
+    }
+  }
+
+  func recordsWithAliases(aliases: [String]) -> Set<ABRecordID> {
+
+    var records = Set<ABRecordID>()
+
+    for alias in aliases {
+      if let matches = aliasRecords[AddressBookSearchIndex.normalizeAlias(alias)] {
+        records.unionInPlace(matches)
+      }
+    }
+
+    return records
+  }
+
+  // Records with a name or alias containing each word of the query
+  func recordsMatchingQuery(query: String) -> Set<ABRecordID> {
+
+    let words = AddressBookSearchIndex.fold(query)
+      .componentsSeparatedByCharactersInSet(NSCharacterSet.whitespaceCharacterSet())
+      .filter { !$0.isEmpty }
+
+    var records : Set<ABRecordID>?
+
+    // Longest words first, they select the fewest records
+    for word in words.sort({ $0.characters.count > $1.characters.count }) {
+
+      let matches = recordsMatchingWord(word, within: records)
+      if matches.isEmpty {
+        return []
+      }
+
+      records = matches
+    }
+
+    return records ?? []
+  }
+
+  private func recordsMatchingWord(word: String, within: Set<ABRecordID>?) -> Set<ABRecordID> {
+
+    let characters = Array(word.characters)
+
+    if characters.count <= AddressBookSearchIndex.maxGramLength {
+      let matches = gramRecords[word] ?? []
+      return within.map { $0.intersect(matches) } ?? matches
+    }
+
+    var smallest = within
+    var postings = [Set<ABRecordID>]()
+
+    for start in 0...(characters.count - AddressBookSearchIndex.maxGramLength) {
+
+      let gram = String(characters[start..<(start + AddressBookSearchIndex.maxGramLength)])
+
+      guard let records = gramRecords[gram] else {
+        return []
+      }
+
+      if records.count < smallest?.count ?? Int.max {
+        if let smallest = smallest {
+          postings.append(smallest)
+        }
+        smallest = records
+      }
+      else {
+        postings.append(records)
+      }
+    }
+
+    // Check candidates against the other grams before the (costlier) substring test
+
+    return Set(smallest!.filter { systemId in
+      !postings.contains { !$0.contains(systemId) } &&
+        (self.recordTerms[systemId]?.contains { $0.containsString(word) } ?? false)
+    })
+  }
+
+  // Removing the set while mutating it keeps it uniquely referenced, avoiding a copy per insert
+  private static func insert(systemId: ABRecordID, forKey key: String, inout into map: [String: Set<ABRecordID>]) {
+    var records = map.removeValueForKey(key) ?? Set()
+    records.insert(systemId)
+    map[key] = records
+  }
+
+  private static func remove(systemId: ABRecordID, forKey key: String, inout from map: [String: Set<ABRecordID>]) {
+    guard var records = map.removeValueForKey(key) else {
+      return
+    }
+    records.remove(systemId)
+    if !records.isEmpty {
+      map[key] = records
+    }
+  }
+
+  static func fold(string: String) -> String {
+    return string.stringByFoldingWithOptions([.CaseInsensitiveSearch, .DiacriticInsensitiveSearch], locale: NSLocale.currentLocale())
+  }
+
+  static func normalizeAlias(alias: String) -> String {
+    return alias.stringByTrimmingCharactersInSet(NSCharacterSet.whitespaceAndNewlineCharacterSet()).lowercaseString
+  }
+
+  static func gramsOfTerms(terms: [String]) -> Set<String> {
+
+    var grams = Set<String>()
+
+    for term in terms {
+
+      let characters = Array(term.characters)
+
+      for length in 1...maxGramLength where length <= characters.count {
+        for start in 0...(characters.count - length) {
+          grams.insert(String(characters[start..<(start + length)]))
+        }
+      }
+    }
+
+    return grams
+  }
+
+}
@@ -24,7 +24,7 @@ public protocol BackgroundSessionOperation {
 public protocol BackgroundSessionUploadOperation: BackgroundSessionOperation {
   
   
-  func taskCompletedWithData(data: NSData)
+  func taskCompletedWithResponse(response: NSHTTPURLResponse, data: NSData)
   
 }
 
@@ -101,17 +101,13 @@ public protocol BackgroundSessionDownloadOperation: BackgroundSessionOperation {
             
             do {
               
-              if let msgInfoHeader = request.allHTTPHeaderFields?[MsgInfoHTTPHeader],
-                let msgPack = try TBaseUtils.deserialize(MsgPack(), fromBase64String: msgInfoHeader) as? MsgPack,
-                let api = self.api {
+              let msgPack = try MessageTransmitHTTPOperation.restoreUploadForRequest(request).msgPack
+              
+              if let api = self.api {
                 
-                  backgroundTransferringMessageIds.append(msgPack.id)
-                  
-                  self.queue.addOperation(try MessageSendResurrectedOperation(msgPack: msgPack, task: upload, api: api))
-                  
-              }
-              else {
-                DDLogError("BackgroundSessionOperation: Error resurrecting send: missing or invalid header")
+                backgroundTransferringMessageIds.append(msgPack.id)
+                
+                self.queue.addOperation(try MessageSendResurrectedOperation(msgPack: msgPack, task: upload, api: api))
               }
               
             }
@@ -173,8 +169,8 @@ extension BackgroundSessionOperations: NSURLSessionTaskDelegate {
       if let uploadTask = task as? NSURLSessionUploadTask, let uploadOp = operation as? BackgroundSessionUploadOperation {
         
         do {
-          let data = try dataWithResponse(uploadTask.response, data: taskData[task.taskIdentifier], networkError: error)
-          uploadOp.taskCompletedWithData(data)
+          let (response, data) = try uploadResponse(uploadTask.response, data: taskData[task.taskIdentifier], networkError: error)
+          uploadOp.taskCompletedWithResponse(response, data: data)
         }
         catch let error as NSError {
           uploadOp.taskCompletedWithError(error)
@@ -273,7 +269,7 @@ extension BackgroundSessionOperations: NSURLSessionDelegate {
 }
 
 
-private func dataWithResponse(response: NSURLResponse?, data: NSData?, networkError: NSError?) throws -> NSData {
+private func uploadResponse(response: NSURLResponse?, data: NSData?, networkError: NSError?) throws -> (NSHTTPURLResponse, NSData) {
 
   if let networkError = networkError {
     throw networkError
@@ -281,11 +277,18 @@ private func dataWithResponse(response: NSURLResponse?, data: NSData?, networkEr
   
   var error = NSURLError.Unknown
   
-  if let response = response as? NSHTTPURLResponse, let data = data {
+  if let response = response as? NSHTTPURLResponse where response.statusCode == ChunkedUpload.ResumeIncompleteStatusCode {
+    
+    // Chunk acknowledgements carry no body
+    
+    return (response, data ?? NSData())
+    
+  }
+  else if let response = response as? NSHTTPURLResponse, let data = data {
     
     if response.statusCode == 200 {
       
-      return data
+      return (response, data)
       
     }
     else if response.statusCode == 401 {
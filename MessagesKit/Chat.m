@@ -10,6 +10,7 @@
 
 #import "ChatDAO.h"
 #import "MessageDAO.h"
+#import "DAO+Internal.h"
 #import "Messages+Exts.h"
 #import "NSObject+Utils.h"
 #import "NSDate+Utils.h"
@@ -27,12 +28,12 @@
 
 -(id) dbId
 {
-  return self.id.data;
+  return self.id;
 }
 
 -(void) setDbId:(id)dbId
 {
-  self.id = [Id idWithData:dbId];
+  self.id = dbId;
 }
 
 -(BOOL) load:(FMResultSet *)resultSet dao:(ChatDAO *)dao error:(NSError *__autoreleasing *)error
@@ -76,7 +77,7 @@
 
   [values setNillableObject:self.alias forKey:@"alias"];
   [values setNillableObject:self.localAlias forKey:@"localAlias"];
-  [values setNillableObject:self.lastMessage.dbId forKey:@"lastMessage"];
+  [values setNillableObject:[dao parameterForDbId:self.lastMessage.dbId] forKey:@"lastMessage"];
   [values setNillableObject:@(self.clarifiedCount) forKey:@"clarifiedCount"];
   [values setNillableObject:@(self.updatedCount) forKey:@"updatedCount"];
   [values setNillableObject:self.startedDate forKey:@"startedDate"];
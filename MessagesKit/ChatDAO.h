@@ -51,6 +51,13 @@ typedef NS_ENUM (int32_t, ChatType) {
 
 -(BOOL) resetUnreadCountsForChat:(Chat *)chat;
 
+-(int) countOfMessagesForChat:(Chat *)chat;
+-(int) countOfUnreadMessagesForChat:(Chat *)chat;
+-(int) countOfMessages;
+-(int) countOfUnreadMessages;
+
+-(BOOL) rebuildMessageCountsReturningCorrected:(nullable int *)corrected error:(NSError **)error;
+
 @end
 
 
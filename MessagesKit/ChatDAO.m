@@ -11,6 +11,7 @@
 #import "MessageDAO.h"
 #import "DAO+Internal.h"
 #import "NSObject+Utils.h"
+#import "FMResultSet+Utils.h"
 
 @import ObjectiveC;
 @import YOLOKit;
@@ -39,10 +40,7 @@
 
 -(instancetype) initWithDBManager:(DBManager *)dbManager
 {
-  __block DBTableInfo *tableInfo;
-  [dbManager.pool inReadableDatabase:^void(FMDatabase *db) {
-    tableInfo = [DBTableInfo loadTableInfo:db tableName:@"chat"];
-  }];
+  DBTableInfo *tableInfo = [dbManager tableInfoForTableName:@"chat" readOnlyFieldNames:@[@"unreadCount", @"messageCount"]];
   
   self = [super initWithDBManager:dbManager
                         tableInfo:tableInfo
@@ -78,9 +76,9 @@
   return @"Chat";
 }
 
--(id) dbIdForId:(id)id
+-(id) dbIdForColumnIndex:(int)columnIndex inResultSet:(FMResultSet *)resultSet
 {
-  return [id data];
+  return [resultSet idForColumnIndex:columnIndex];
 }
 
 -(BOOL) fetchChatForAlias:(NSString *)alias localAlias:(NSString *)localAlias returning:(Chat *__autoreleasing  _Nullable * _Nonnull)chat error:(NSError * _Nullable __autoreleasing * _Nullable)error
@@ -122,7 +120,7 @@
     chat.lastMessage = message;
 
     if (![db executeUpdate:@"UPDATE chat SET lastMessage = ?, totalMessages = ?, totalSent = ?  WHERE id = ?"
-              valuesArray:@[message.dbId, @(chat.totalMessages), @(chat.totalSent), chat.dbId]
+              valuesArray:@[message.id.data, @(chat.totalMessages), @(chat.totalSent), chat.id.data]
                      error:error]) {
       return;
     }
@@ -188,7 +186,7 @@
     chat.activeMembers = activeMembers;
 
     valid = [db executeUpdate:@"UPDATE chat SET members = ?, activeMembers = ? WHERE id = ?"
-                  valuesArray:@[members.join(@","), activeMembers.join(@","), chat.dbId]
+                  valuesArray:@[members.join(@","), activeMembers.join(@","), chat.id.data]
                         error:error];
     if (!valid) {
       return;
@@ -236,7 +234,7 @@
     chat.clarifiedCount = clarifiedCount;
 
     if ([db executeUpdate:@"UPDATE chat SET clarifiedCount = ? WHERE id = ?",
-         @(clarifiedCount), chat.dbId])
+         @(clarifiedCount), chat.id.data])
     {
       updated = db.changes > 0;
     }
@@ -260,7 +258,7 @@
     chat.updatedCount = updatedCount;
 
     if ([db executeUpdate:@"UPDATE chat SET updatedCount = ? WHERE id = ?",
-         @(updatedCount), chat.dbId])
+         @(updatedCount), chat.id.data])
     {
       updated = db.changes > 0;
     }
@@ -285,7 +283,7 @@
     chat.clarifiedCount = 0;
 
     if ([db executeUpdate:@"UPDATE chat SET updatedCount = ?, clarifiedCount = ? WHERE id = ?", @(chat.updatedCount),
-         @(chat.clarifiedCount), chat.dbId])
+         @(chat.clarifiedCount), chat.id.data])
     {
       updated = db.changes > 0;
     }
@@ -300,6 +298,106 @@
   return updated;
 }
 
+-(int) countOfMessagesForChat:(Chat *)chat
+{
+  __block int count = 0;
+
+  [self.dbManager.pool inReadableDatabase:^(FMDatabase *db) {
+
+    count = [db intForQuery:@"SELECT messageCount FROM chat WHERE id = ?", chat.id.data];
+
+  }];
+
+  return count;
+}
+
+-(int) countOfUnreadMessagesForChat:(Chat *)chat
+{
+  __block int count = 0;
+
+  [self.dbManager.pool inReadableDatabase:^(FMDatabase *db) {
+
+    count = [db intForQuery:@"SELECT unreadCount FROM chat WHERE id = ?", chat.id.data];
+
+  }];
+
+  return count;
+}
+
+-(int) countOfMessages
+{
+  __block int count = 0;
+
+  [self.dbManager.pool inReadableDatabase:^(FMDatabase *db) {
+
+    count = [db intForQuery:@"SELECT ifnull(SUM(messageCount), 0) FROM chat"];
+
+  }];
+
+  return count;
+}
+
+-(int) countOfUnreadMessages
+{
+  __block int count = 0;
+
+  [self.dbManager.pool inReadableDatabase:^(FMDatabase *db) {
+
+    count = [db intForQuery:@"SELECT ifnull(SUM(unreadCount), 0) FROM chat"];
+
+  }];
+
+  return count;
+}
+
+-(BOOL) rebuildMessageCountsReturningCorrected:(int *)corrected error:(NSError **)error
+{
+  __block BOOL valid = NO;
+  __block int count = 0;
+
+  [self.dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+
+    FMResultSet *resultSet = [db executeQuery:@"SELECT COUNT(id) FROM chat WHERE "
+                                              @"messageCount != (SELECT COUNT(id) FROM message WHERE message.chat = chat.id) OR "
+                                              @"unreadCount != (SELECT COUNT(id) FROM message WHERE message.chat = chat.id AND flags & ?)"
+                                  valuesArray:@[@(MessageFlagUnread)]
+                                        error:error];
+    if (!resultSet) {
+      *rollback = YES;
+      return;
+    }
+
+    if ([resultSet next]) {
+      count = [resultSet intForColumnIndex:0];
+    }
+
+    [resultSet close];
+
+    if (count == 0) {
+      valid = YES;
+      return;
+    }
+
+    valid = [db executeUpdate:@"UPDATE chat SET "
+                              @"messageCount = (SELECT COUNT(id) FROM message WHERE message.chat = chat.id), "
+                              @"unreadCount = (SELECT COUNT(id) FROM message WHERE message.chat = chat.id AND flags & ?)"
+                  valuesArray:@[@(MessageFlagUnread)]
+                        error:error];
+    if (!valid) {
+      *rollback = YES;
+      count = 0;
+      return;
+    }
+
+  }];
+
+  if (corrected) {
+    *corrected = count;
+  }
+
+  return valid;
+}
+
 @end
 
 
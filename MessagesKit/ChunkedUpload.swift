@@ -0,0 +1,315 @@
+//
+//  ChunkedUpload.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import Foundation
+import CocoaLumberjack
+
+
+/*
+  Resumable upload of a file
+
+  Each request is sent with a `Content-Range` header and carries
+  everything from the confirmed offset to the end. The server acknowledges
+  a partial upload with `308 Resume Incomplete` and a `Range` header naming
+  the bytes it has persisted, and answers a complete one with `200` and
+  the result. After an interruption a zero-length request with
+  `Content-Range: bytes */<length>` asks the server for its confirmed
+  offset before any more data is sent.
+
+  An optional preamble is sent ahead of the file's contents, in a request
+  of its own, so the file itself is the body of the main request and is
+  never copied. Only a request resuming part way through the file needs
+  its remainder copied into a body file (see `chunkURL`).
+
+  The confirmed offset (and preamble) is persisted beside the upload file so
+  retried and resurrected uploads continue where the server's confirmation
+  ended.
+*/
+class ChunkedUpload {
+
+  enum Error: ErrorType {
+    case InvalidResponse
+    case InvalidRange
+  }
+
+  enum Result {
+    case Incomplete(offset: UInt64)
+    case Complete(data: NSData)
+  }
+
+  static let ResumeIncompleteStatusCode = 308
+
+  let fileURL : NSURL
+  let length : UInt64
+  let digest : NSData?
+  private(set) var preamble = NSData()
+
+  private(set) var confirmedOffset = UInt64(0)
+
+  // Whether confirmedOffset was reported by the server during this session
+  private(set) var confirmed = false
+
+  // Whether data may have reached the server since its last confirmation
+  private var sent = false
+
+  var progressURL : NSURL {
+    return fileURL.URLByAppendingPathExtension("progress")
+  }
+
+  // Body of requests that are not the file itself (status queries, the preamble & resumed remainders)
+  var chunkURL : NSURL {
+    return fileURL.URLByAppendingPathExtension("chunk")
+  }
+
+  var completed : Bool {
+    return confirmed && confirmedOffset >= length
+  }
+
+  /*
+    `length` is the total body length, including any preamble. Passing a nil
+    preamble restores the one saved with matching progress, if any.
+  */
+  init(fileURL: NSURL, length: UInt64, digest: NSData?, preamble: NSData? = nil) {
+
+    self.fileURL = fileURL
+    self.length = length
+    self.digest = digest
+
+    // Only progress recorded for this exact payload is usable; the same
+    // message encrypted again produces different bytes
+
+    if let progress = NSDictionary(contentsOfURL: progressURL),
+      let savedLength = progress["length"] as? NSNumber,
+      let savedOffset = progress["offset"] as? NSNumber
+      where savedLength.unsignedLongLongValue == length && progress["digest"] as? NSData == digest
+    {
+      confirmedOffset = min(savedOffset.unsignedLongLongValue, length)
+      sent = (progress["sent"] as? NSNumber)?.boolValue ?? false
+      self.preamble = preamble ?? progress["preamble"] as? NSData ?? NSData()
+    }
+    else {
+      let _ = try? NSFileManager.defaultManager().removeItemAtURL(progressURL)
+
+      if let preamble = preamble where preamble.length > 0 {
+
+        self.preamble = preamble
+
+        // Resurrected uploads need the preamble before any chunk is confirmed
+        saveProgress()
+      }
+    }
+
+  }
+
+  /*
+    Builds the next request & returns its body file; a status query when
+    data may have reached the server since it last confirmed an offset
+  */
+  func nextRequest(baseRequest: NSURLRequest) throws -> (request: NSURLRequest, bodyURL: NSURL) {
+
+    let request = baseRequest.mutableCopy() as! NSMutableURLRequest
+
+    if let digest = digest {
+      request.setValue("SHA-256=\(digest.base64EncodedStringWithOptions([]))", forHTTPHeaderField: DigestHTTPHeader)
+    }
+
+    let bodyURL : NSURL
+    let bodyLength : UInt64
+
+    let preambleLength = UInt64(preamble.length)
+
+    if (!confirmed && (confirmedOffset > 0 || sent)) || length == 0 {
+
+      try NSData().writeToURL(chunkURL, options: .DataWritingAtomic)
+
+      bodyURL = chunkURL
+      bodyLength = 0
+
+      request.setValue("bytes */\(length)", forHTTPHeaderField: ContentRangeHTTPHeader)
+
+    }
+    else {
+
+      if confirmedOffset < preambleLength {
+
+        let range = NSRange(location: Int(confirmedOffset), length: Int(preambleLength - confirmedOffset))
+
+        try preamble.subdataWithRange(range).writeToURL(chunkURL, options: .DataWritingAtomic)
+
+        bodyURL = chunkURL
+        bodyLength = UInt64(range.length)
+      }
+      else if confirmedOffset == preambleLength {
+
+        // The common case, the whole file as is
+
+        bodyURL = fileURL
+        bodyLength = length - confirmedOffset
+      }
+      else {
+
+        try copyFileRemainderFromOffset(confirmedOffset - preambleLength, toURL: chunkURL)
+
+        bodyURL = chunkURL
+        bodyLength = length - confirmedOffset
+      }
+
+      request.setValue("bytes \(confirmedOffset)-\(confirmedOffset + bodyLength - 1)/\(length)", forHTTPHeaderField: ContentRangeHTTPHeader)
+
+      // Whatever part of this reaches the server must be asked about after an interruption
+
+      sent = true
+      confirmed = false
+
+      saveProgress()
+    }
+
+    request.setValue("\(bodyLength)", forHTTPHeaderField: ContentLengthHTTPHeader)
+
+    return (request, bodyURL)
+  }
+
+  private func copyFileRemainderFromOffset(offset: UInt64, toURL url: NSURL) throws {
+
+    let inHandle = try NSFileHandle(forReadingFromURL: fileURL)
+    defer { inHandle.closeFile() }
+
+    inHandle.seekToFileOffset(offset)
+
+    let _ = try? NSFileManager.defaultManager().removeItemAtURL(url)
+
+    guard NSFileManager.defaultManager().createFileAtPath(url.path!, contents: nil, attributes: nil) else {
+      throw NSError(domain: NSCocoaErrorDomain, code: NSFileWriteUnknownError, userInfo: [NSURLErrorKey: url])
+    }
+
+    let outHandle = try NSFileHandle(forWritingToURL: url)
+    defer { outHandle.closeFile() }
+
+    var copied = UInt64(0)
+
+    while true {
+
+      let block = inHandle.readDataOfLength(64 * 1024)
+      if block.length == 0 {
+        break
+      }
+
+      outHandle.writeData(block)
+      copied += UInt64(block.length)
+    }
+
+    if offset + copied != length - UInt64(preamble.length) {
+      throw NSError(domain: NSCocoaErrorDomain, code: NSFileReadUnknownError, userInfo: [NSURLErrorKey: fileURL])
+    }
+  }
+
+  /*
+    Records the server's acknowledgement of the last request
+  */
+  func processResponse(response: NSHTTPURLResponse, data: NSData) throws -> Result {
+
+    switch response.statusCode {
+
+    case 200, 201:
+
+      confirmed = true
+      confirmedOffset = length
+
+      cleanup()
+
+      return .Complete(data: data)
+
+    case ChunkedUpload.ResumeIncompleteStatusCode:
+
+      var offset = UInt64(0)
+
+      // No range means nothing has been persisted
+
+      if let range = response.allHeaderFields[RangeHTTPHeader] as? String {
+        offset = try ChunkedUpload.offsetFollowingRange(range)
+      }
+
+      if offset > length {
+        throw Error.InvalidRange
+      }
+
+      confirmed = true
+      confirmedOffset = offset
+      sent = false
+
+      removeChunk()
+
+      saveProgress()
+
+      return .Incomplete(offset: offset)
+
+    default:
+
+      throw Error.InvalidResponse
+    }
+
+  }
+
+  /*
+    Forgets the confirmation after a failed request so the next
+    request asks the server where to resume
+  */
+  func interrupted() {
+    confirmed = false
+
+    removeChunk()
+  }
+
+  // Removes the body file of the last request, once it is no longer in flight
+  func removeChunk() {
+    let _ = try? NSFileManager.defaultManager().removeItemAtURL(chunkURL)
+  }
+
+  func cleanup() {
+    removeChunk()
+    let _ = try? NSFileManager.defaultManager().removeItemAtURL(progressURL)
+  }
+
+  private func saveProgress() {
+
+    let progress = NSMutableDictionary()
+    progress["length"] = NSNumber(unsignedLongLong: length)
+    progress["offset"] = NSNumber(unsignedLongLong: confirmedOffset)
+    progress["sent"] = NSNumber(bool: sent)
+    progress["digest"] = digest
+    progress["preamble"] = preamble
+
+    if !progress.writeToURL(progressURL, atomically: true) {
+      DDLogError("ChunkedUpload: Unable to save progress for \(fileURL)")
+    }
+
+  }
+
+  /*
+    Parses a `Range` header value (e.g. "bytes=0-1023") returning
+    the offset of the first byte not included
+  */
+  class func offsetFollowingRange(range: String) throws -> UInt64 {
+
+    let scanner = NSScanner(string: range)
+
+    var start = Int64(0), end = Int64(0)
+
+    guard
+      scanner.scanString("bytes=", intoString: nil) &&
+      scanner.scanLongLong(&start) && start == 0 &&
+      scanner.scanString("-", intoString: nil) &&
+      scanner.scanLongLong(&end) && end >= start
+    else {
+      throw Error.InvalidRange
+    }
+
+    return UInt64(end) + 1
+  }
+
+}
@@ -28,12 +28,29 @@ NS_ASSUME_NONNULL_BEGIN
 -(nullable id) loadFrom:(FMResultSet *)resultSet withId:(id)objId error:(NSError **)error;
 -(nullable id) load:(FMResultSet *)resultSet error:(NSError **)error;
 -(NSArray<__kindof Model *> *) loadAll:(FMResultSet *)resultSet error:(NSError **)error;
+-(nullable NSArray *) loadAllDbIds:(FMResultSet *)resultSet error:(NSError **)error;
+
+// dbIds are kept in their model representation (e.g. Id) for cache
+// keys & equality, and converted to a bindable value only for SQL
+-(nullable id) dbIdForColumnIndex:(int)columnIndex inResultSet:(FMResultSet *)resultSet;
+-(id) parameterForDbId:(id)dbId;
+
+-(NSUInteger) typeIndexOfClass:(Class)derivedClass;
+
+-(BOOL) updateAllObjectsMatching:(NSString *)where
+                      parameters:(NSArray *)parameters
+                        settings:(NSString *)settings
+               settingParameters:(NSArray *)settingParameters
+                           patch:(nullable void (^)(id object))patch
+                           error:(NSError **)error;
 
 -(void) inserted:(Model *)model;
 -(void) updated:(Model *)model;
 -(void) updatedAll:(NSArray *)models;
 -(void) deleted:(Model *)model;
 -(void) deletedAll:(NSArray *)models;
+-(void) updatedAllWithDbIds:(NSArray *)dbIds;
+-(void) deletedAllWithDbIds:(NSArray *)dbIds;
 
 @end
 
@@ -45,6 +62,8 @@ NS_ASSUME_NONNULL_BEGIN
 -(void) modelObject:(Model *)model insertedInDAO:(DAO *)dao;
 -(void) modelObject:(Model *)model updatedInDAO:(DAO *)dao;
 -(void) modelObject:(Model *)model deletedInDAO:(DAO *)dao;
+-(void) modelObjectsWithDbIds:(NSArray *)dbIds updatedInDAO:(DAO *)dao;
+-(void) modelObjectsWithDbIds:(NSArray *)dbIds deletedInDAO:(DAO *)dao;
 -(void) modelObjectsDidChangeInDAO:(DAO *)dao;
 
 @end
@@ -26,6 +26,7 @@ NS_ASSUME_NONNULL_BEGIN
 -(nullable __kindof ObjectType) fetchObjectWithId:(id)id NS_REFINED_FOR_SWIFT;
 -(BOOL) fetchObjectWithId:(id)id returning:(ObjectType __nullable *__nonnull)msg error:(NSError **)error;
 -(NSArray<__kindof ObjectType> *) fetchAllObjectsMatching:(nullable NSString *)where error:(NSError **)error;
+-(nullable NSArray<__kindof ObjectType> *) fetchAllObjectsWithDbIds:(NSArray *)dbIds error:(NSError **)error;
 -(NSArray<__kindof ObjectType> *) fetchAllObjectsMatching:(nullable NSString *)where parameters:(nullable NSArray *)parameters error:(NSError **)error;
 -(NSArray<__kindof ObjectType> *) fetchAllObjectsMatching:(nullable NSString *)where parametersNamed:(nullable NSDictionary *)parameters error:(NSError **)error;;
 -(NSArray<__kindof ObjectType> *) fetchAllObjectsMatching:(NSPredicate *)predicate
@@ -92,14 +92,16 @@ MK_DECLARE_LOG_LEVEL()
   }
 
   Model *obj = [derivedClass new];
+  obj.dbId = objId;
 
   [_loadCache setObject:obj forKey:objId];
 
   if (![obj load:resultSet dao:self error:error]) {
+    [_loadCache removeObjectForKey:objId];
     return nil;
   }
 
-  [_loadCache removeObjectForKey:obj];
+  [_loadCache removeObjectForKey:objId];
 
   [_objectCache setObject:obj forKey:objId];
 
@@ -108,7 +110,7 @@ MK_DECLARE_LOG_LEVEL()
 
 -(Model *) load:(FMResultSet *)resultSet error:(NSError **)error
 {
-  id objId = [resultSet objectForColumnIndex:_tableInfo.idFieldIndex.intValue];
+  id objId = [self dbIdForColumnIndex:_tableInfo.idFieldIndex.intValue inResultSet:resultSet];
 
   // 1st - check cache
   //
@@ -144,12 +146,35 @@ MK_DECLARE_LOG_LEVEL()
   return results;
 }
 
+-(NSArray *) loadAllDbIds:(FMResultSet *)resultSet error:(NSError **)error
+{
+  NSMutableArray *results = [NSMutableArray array];
+
+  BOOL hasResult = NO;
+  while ([resultSet nextReturning:&hasResult error:error]) {
+
+    if (!hasResult) {
+      return results;
+    }
+
+    [results addObject:[self dbIdForColumnIndex:0 inResultSet:resultSet]];
+  }
+
+  return nil;
+}
+
+-(NSUInteger) typeIndexOfClass:(Class)derivedClass
+{
+  return [_derivedClasses indexOfObject:derivedClass];
+}
+
 -(NSMutableDictionary *) save:(Model *)model error:(NSError **)error
 {
   NSMutableDictionary *values = [NSMutableDictionary dictionaryWithCapacity:_tableInfo.fieldNames.count];
   for (NSString *fieldName in _tableInfo.fieldNames) {
     values[fieldName] = NSNull.null;
   }
+  [values removeObjectsForKeys:_tableInfo.readOnlyFieldNames];
 
   if(![model save:values dao:self error:error]) {
     return nil;
@@ -168,6 +193,21 @@ MK_DECLARE_LOG_LEVEL()
   return modelId;
 }
 
+-(id) dbIdForColumnIndex:(int)columnIndex inResultSet:(FMResultSet *)resultSet
+{
+  return [resultSet objectForColumnIndex:columnIndex];
+}
+
+-(id) parameterForDbId:(id)dbId
+{
+  // FMDB only binds NSData as a blob
+  if ([dbId isKindOfClass:[Id class]]) {
+    return [dbId data];
+  }
+
+  return dbId;
+}
+
 -(__kindof Model * _Nullable)fetchObjectWithId:(id)id {
   
   NSError *error = nil;
@@ -203,7 +243,7 @@ MK_DECLARE_LOG_LEVEL()
 
   [_dbManager.pool inReadableDatabase:^(FMDatabase *db) {
 
-    FMResultSet *resultSet = [db executeQuery:_tableInfo.fetchSQL valuesArray:@[dbId] error:error];
+    FMResultSet *resultSet = [db executeQuery:_tableInfo.fetchSQL valuesArray:@[[self parameterForDbId:dbId]] error:error];
     if (!resultSet) {
       return;
     }
@@ -230,6 +270,36 @@ MK_DECLARE_LOG_LEVEL()
   return [self fetchAllObjectsMatching:where parameters:@[] error:error];
 }
 
+-(NSArray *) fetchAllObjectsWithDbIds:(NSArray *)dbIds error:(NSError **)error
+{
+  static const NSUInteger maxParameters = 500;
+
+  NSMutableArray *results = [NSMutableArray arrayWithCapacity:dbIds.count];
+
+  for (NSUInteger start = 0; start < dbIds.count; start += maxParameters) {
+
+    NSArray *batchDbIds = [dbIds subarrayWithRange:NSMakeRange(start, MIN(maxParameters, dbIds.count - start))];
+
+    NSMutableArray *batch = [NSMutableArray arrayWithCapacity:batchDbIds.count];
+    NSMutableArray *paramSpecs = [NSMutableArray arrayWithCapacity:batchDbIds.count];
+    for (id dbId in batchDbIds) {
+      [batch addObject:[self parameterForDbId:dbId]];
+      [paramSpecs addObject:@"?"];
+    }
+
+    NSString *where = [NSString stringWithFormat:@"id IN (%@)", [paramSpecs componentsJoinedByString:@","]];
+
+    NSArray *loaded = [self fetchAllObjectsMatching:where parameters:batch error:error];
+    if (!loaded) {
+      return nil;
+    }
+
+    [results addObjectsFromArray:loaded];
+  }
+
+  return results;
+}
+
 -(NSArray *) fetchAllObjectsMatching:(NSString *)where parameters:(NSArray *)parameters error:(NSError **)error
 {
   NSString *sql = _tableInfo.fetchAllSQL;
@@ -307,14 +377,22 @@ MK_DECLARE_LOG_LEVEL()
 {
   __block BOOL inserted = NO;
 
-  [_dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+  if (![model willSaveInDAO:self error:error]) {
+    return NO;
+  }
+
+  // Transactional so anything models write while saving commits (or not) with them
+
+  [_dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
 
     if (![model willInsertIntoDAO:self error:error]) {
+      *rollback = YES;
       return;
     }
     
     NSMutableDictionary *values = [self save:model error:error];
     if (!values) {
+      *rollback = YES;
       return;
     }
     
@@ -336,6 +414,8 @@ MK_DECLARE_LOG_LEVEL()
       }
 
     }
+
+    *rollback = !inserted;
   }];
 
   if (inserted) {
@@ -352,14 +432,20 @@ MK_DECLARE_LOG_LEVEL()
 {
   __block BOOL updated = NO;
 
-  [_dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+  if (![model willSaveInDAO:self error:error]) {
+    return NO;
+  }
+
+  [_dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
 
     if (![model willUpdateInDAO:self error:error]) {
+      *rollback = YES;
       return;
     }
     
     NSMutableDictionary *values = [self save:model error:error];
     if (!values) {
+      *rollback = YES;
       return;
     }
     
@@ -370,6 +456,7 @@ MK_DECLARE_LOG_LEVEL()
       updated = db.changes > 0;
     }
 
+    *rollback = !updated;
   }];
 
   if (updated) {
@@ -386,6 +473,10 @@ MK_DECLARE_LOG_LEVEL()
 {
   __block BOOL updated = NO, inserted = NO;
 
+  if (![model willSaveInDAO:self error:error]) {
+    return NO;
+  }
+
   [_dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
 
     if (![model willUpdateInDAO:self error:error]) {
@@ -442,21 +533,86 @@ MK_DECLARE_LOG_LEVEL()
   return updated || inserted;
 }
 
--(BOOL) deleteObject:(Model *)model error:(NSError **)error
+-(BOOL) updateAllObjectsMatching:(NSString *)where
+                      parameters:(NSArray *)parameters
+                        settings:(NSString *)settings
+               settingParameters:(NSArray *)settingParameters
+                           patch:(void (^)(id object))patch
+                           error:(NSError **)error
 {
-  __block BOOL deleted = NO;
+  __block BOOL valid = NO;
+  __block NSArray *updatedIds;
 
-  [_dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+  [_dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
 
-    if ([db executeUpdate:_tableInfo.deleteSQL, model.dbId]) {
+    NSString *fetchSQL = [NSString stringWithFormat:@"SELECT id FROM %@ WHERE %@", _tableInfo.name, where];
 
-      if (![model didDeleteFromDAO:self error:error]) {
-        return;
+    FMResultSet *resultSet = [db executeQuery:fetchSQL valuesArray:parameters error:error];
+    if (!resultSet) {
+      *rollback = YES;
+      return;
+    }
+
+    updatedIds = [self loadAllDbIds:resultSet error:error];
+
+    [resultSet close];
+
+    if (!updatedIds) {
+      *rollback = YES;
+      return;
+    }
+
+    if (updatedIds.count == 0) {
+      valid = YES;
+      return;
+    }
+
+    NSString *updateSQL = [NSString stringWithFormat:@"UPDATE %@ SET %@ WHERE %@", _tableInfo.name, settings, where];
+
+    valid = [db executeUpdate:updateSQL
+                  valuesArray:[settingParameters arrayByAddingObjectsFromArray:parameters]
+                        error:error];
+    if (!valid) {
+      *rollback = YES;
+      return;
+    }
+
+    // Only instances already in memory are patched, everything
+    // else is materialized on demand by observers
+    if (patch) {
+      for (id dbId in updatedIds) {
+        Model *cached = [_objectCache objectForKey:dbId];
+        if (cached) {
+          patch(cached);
+        }
       }
+    }
+
+  }];
+
+  if (valid && updatedIds.count) {
+    [self updatedAllWithDbIds:updatedIds];
+  }
+
+  return valid;
+}
+
+-(BOOL) deleteObject:(Model *)model error:(NSError **)error
+{
+  __block BOOL deleted = NO;
+
+  [_dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+
+    if ([db executeUpdate:_tableInfo.deleteSQL, [self parameterForDbId:model.dbId]]) {
 
       deleted = db.changes > 0;
+
+      if (deleted && ![model didDeleteFromDAO:self error:error]) {
+        deleted = NO;
+      }
     }
 
+    *rollback = !deleted;
   }];
 
   if (deleted) {
@@ -699,4 +855,34 @@ MK_DECLARE_LOG_LEVEL()
   }
 }
 
+-(void) updatedAllWithDbIds:(NSArray *)dbIds
+{
+  @synchronized(_dbManager) {
+
+    [self willChange];
+
+    [_dbManager modelObjectsWithDbIds:dbIds updatedInDAO:self];
+
+    [self didChange];
+
+  }
+}
+
+-(void) deletedAllWithDbIds:(NSArray *)dbIds
+{
+  @synchronized(_dbManager) {
+
+    [self willChange];
+
+    [_dbManager modelObjectsWithDbIds:dbIds deletedInDAO:self];
+
+    [self didChange];
+
+  }
+
+  for (id dbId in dbIds) {
+    [_objectCache removeObjectForKey:dbId];
+  }
+}
+
 @end
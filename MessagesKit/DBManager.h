@@ -11,6 +11,9 @@
 
 @class Model;
 @class DAO;
+@class DBTableInfo;
+@class DBTracer;
+@class StartupTrace;
 
 
 NS_ASSUME_NONNULL_BEGIN
@@ -26,7 +29,18 @@ NS_ASSUME_NONNULL_BEGIN
 @property (readonly, nonatomic) FMDatabaseReadWritePool *pool;
 @property (readonly, nonatomic) NSDictionary<NSString *, NSString *> *classTableNames;
 
+// SQL & connection wait instrumentation, disabled until tracer.enabled is set
+@property (readonly, nonatomic) DBTracer *tracer;
+
+// Table info generated for the current schema, saved beside the database & reused until a migration changes the schema
+@property (readonly, nonatomic) NSURL *schemaCacheURL;
+
 -(nullable instancetype) initWithPath:(NSString *)dbPath kind:(NSString *)kind daoClasses:(NSArray *)daoClasses error:(NSError **)error;
+// Records the open, migrate, schema & DAO phases in trace; DAOs are initialized concurrently
+-(nullable instancetype) initWithPath:(NSString *)dbPath kind:(NSString *)kind daoClasses:(NSArray *)daoClasses trace:(nullable StartupTrace *)trace error:(NSError **)error;
+
+// Table info from the schema cache, loaded from the database when missing or stale
+-(DBTableInfo *) tableInfoForTableName:(NSString *)tableName readOnlyFieldNames:(nullable NSArray *)readOnlyFieldNames;
 
 -(__kindof DAO *) daoForClass:(Class)modelClass;
 
@@ -49,6 +63,8 @@ NS_ASSUME_NONNULL_BEGIN
 -(void) modelObject:(Model *)model insertedInDAO:(DAO *)dao;
 -(void) modelObject:(Model *)model updatedInDAO:(DAO *)dao;
 -(void) modelObject:(Model *)model deletedInDAO:(DAO *)dao;
+-(void) modelObjectsWithDbIds:(NSArray *)dbIds updatedInDAO:(DAO *)dao;
+-(void) modelObjectsWithDbIds:(NSArray *)dbIds deletedInDAO:(DAO *)dao;
 -(void) modelObjectsDidChangeInDAO:(DAO *)dao;
 
 @end
@@ -62,6 +78,7 @@ NS_ASSUME_NONNULL_BEGIN
 @property (copy, nonatomic, readonly) NSArray *fieldNames;
 @property (copy, nonatomic, readonly) NSArray *insertFieldNames;
 @property (copy, nonatomic, readonly) NSArray *updateFieldNames;
+@property (copy, nonatomic, readonly) NSArray *readOnlyFieldNames;
 
 @property (copy, nonatomic, readonly) NSNumber *idFieldIndex;
 @property (copy, nonatomic, readonly, nullable) NSNumber *typeFieldIndex;
@@ -75,6 +92,12 @@ NS_ASSUME_NONNULL_BEGIN
 @property (copy, nonatomic, readonly) NSString *deleteAllSQL;
 
 +(DBTableInfo *) loadTableInfo:(FMDatabase *)db tableName:(NSString *)tableName;
+// Read only fields are fetched but never inserted or updated (e.g. columns maintained by triggers)
++(DBTableInfo *) loadTableInfo:(FMDatabase *)db tableName:(NSString *)tableName readOnlyFieldNames:(nullable NSArray *)readOnlyFieldNames;
+
+// Property list form used by the schema cache; returns nil for a malformed property list
+-(nullable instancetype) initWithPropertyList:(NSDictionary *)propertyList;
+-(NSDictionary *) propertyList;
 
 -(int) findField:(NSString *)fieldName;
 
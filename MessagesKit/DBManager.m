@@ -10,6 +10,10 @@
 
 #import "WeakReference.h"
 #import "DAO+Internal.h"
+#import "DBTracer.h"
+#import "StartupTrace.h"
+#import "NSData+CommonDigest.h"
+#import "NSData+Encoding.h"
 #import "NSMutableArray+Utils.h"
 #import "NSString+Utils.h"
 #import "Log.h"
@@ -27,6 +31,9 @@ MK_DECLARE_LOG_LEVEL()
 
 static NSString *DBManagerMigrationsFolder = @"Migrations";
 
+// Bump when the generated table info changes without a schema change
+static const int DBTableInfoFormatVersion = 1;
+
 
 @interface DAO (Derived)
 
@@ -43,6 +50,7 @@ static NSString *DBManagerMigrationsFolder = @"Migrations";
 @property (copy, nonatomic, readwrite) NSArray *fieldNames;
 @property (copy, nonatomic, readwrite) NSArray *insertFieldNames;
 @property (copy, nonatomic, readwrite) NSArray *updateFieldNames;
+@property (copy, nonatomic, readwrite) NSArray *readOnlyFieldNames;
 
 @property (copy, nonatomic, readwrite) NSNumber *idFieldIndex;
 @property (copy, nonatomic, readwrite) NSNumber *typeFieldIndex;
@@ -64,6 +72,9 @@ static NSString *DBManagerMigrationsFolder = @"Migrations";
   NSMutableSet<WeakReference<id<DBManagerDelegate>> *> *_delegates;
   OSSpinLock _delegatesLock;
   NSMutableDictionary *_classTableNames;
+  NSString *_schemaFingerprint;
+  NSMutableDictionary<NSString *, DBTableInfo *> *_tableInfos;
+  BOOL _tableInfosChanged;
 }
 
 @end
@@ -72,6 +83,11 @@ static NSString *DBManagerMigrationsFolder = @"Migrations";
 @implementation DBManager
 
 -(instancetype) initWithPath:(NSString *)dbPath kind:(NSString *)kind daoClasses:(NSArray *)daoClasses error:(NSError * _Nullable __autoreleasing * _Nullable)error
+{
+  return [self initWithPath:dbPath kind:kind daoClasses:daoClasses trace:nil error:error];
+}
+
+-(instancetype) initWithPath:(NSString *)dbPath kind:(NSString *)kind daoClasses:(NSArray *)daoClasses trace:(StartupTrace *)trace error:(NSError * _Nullable __autoreleasing * _Nullable)error
 {
   if ((self = [super init])) {
 
@@ -79,13 +95,18 @@ static NSString *DBManagerMigrationsFolder = @"Migrations";
     _delegates = [NSMutableSet set];
     _classTableNames = [NSMutableDictionary dictionary];
 
-    _pool = [FMDatabaseReadWritePool.alloc initWithPath:dbPath error:error];
+    [trace beginPhase:@"db.open"];
+    _pool = [DBTracingPool.alloc initWithPath:dbPath error:error];
+    [trace endPhase:@"db.open"];
+
     if (!_pool) {
       return nil;
     }
 
     _pool.delegate = self;
 
+    [trace beginPhase:@"db.migrate"];
+
     __block BOOL initialized = NO;
     [_pool inWritableDatabase:^(FMDatabase *db) {
 
@@ -128,20 +149,36 @@ static NSString *DBManagerMigrationsFolder = @"Migrations";
         DDLogInfo(@"%@ database up-to-date", kind);
       }
 
+      _schemaFingerprint = [self schemaFingerprintOfDB:db];
+
       initialized = YES;
     }];
+
+    [trace endPhase:@"db.migrate"];
     
     if (!initialized) {
       return nil;
     }
 
-    for (Class daoClass in daoClasses) {
+    [trace tracePhase:@"db.schema" block:^{
+      [self loadSchemaCache];
+    }];
 
-      DAO *dao = [[daoClass alloc] initWithDBManager:self];
+    // DAOs are independent of each other, build them concurrently
+    [trace tracePhase:@"db.daos" block:^{
+      dispatch_apply(daoClasses.count, dispatch_get_global_queue(qos_class_self(), 0), ^(size_t idx) {
 
-      _daos[dao.name] = dao;
+        DAO *dao = [[daoClasses[idx] alloc] initWithDBManager:self];
 
-      [_classTableNames addEntriesFromDictionary:dao.classTableNames];
+        @synchronized(_daos) {
+          _daos[dao.name] = dao;
+          [_classTableNames addEntriesFromDictionary:dao.classTableNames];
+        }
+      });
+    }];
+
+    if (_tableInfosChanged) {
+      [self saveSchemaCache];
     }
     
   }
@@ -167,6 +204,11 @@ static NSString *DBManagerMigrationsFolder = @"Migrations";
   _pool = nil;
 }
 
+-(DBTracer *) tracer
+{
+  return ((DBTracingPool *)_pool).tracer;
+}
+
 -(NSURL *) URL
 {
   return [NSURL fileURLWithPath:_pool.path];
@@ -177,6 +219,100 @@ static NSString *DBManagerMigrationsFolder = @"Migrations";
   return _classTableNames;
 }
 
+-(NSURL *) schemaCacheURL
+{
+  NSString *fileName = [self.URL.lastPathComponent.stringByDeletingPathExtension stringByAppendingString:@"-schema.plist"];
+  return [self.URL.URLByDeletingLastPathComponent URLByAppendingPathComponent:fileName];
+}
+
+-(NSString *) schemaFingerprintOfDB:(FMDatabase *)db
+{
+  // Any schema change alters the stored definitions; the framework version covers changes to the generated SQL
+  NSString *version = [NSBundle bundleForClass:self.class].infoDictionary[@"CFBundleVersion"];
+
+  NSMutableString *schema = [NSMutableString stringWithFormat:@"%d:%@", DBTableInfoFormatVersion, version];
+
+  FMResultSet *resultSet = [db executeQuery:@"SELECT sql FROM sqlite_master WHERE sql IS NOT NULL ORDER BY type, name"];
+  while ([resultSet next]) {
+    [schema appendString:@"\n"];
+    [schema appendString:[resultSet stringForColumnIndex:0]];
+  }
+  [resultSet close];
+
+  return [schema dataUsingEncoding:NSUTF8StringEncoding].sha1.hexEncodedString;
+}
+
+-(void) loadSchemaCache
+{
+  _tableInfos = [NSMutableDictionary dictionary];
+
+  NSData *data = [NSData dataWithContentsOfURL:self.schemaCacheURL];
+  if (!data) {
+    return;
+  }
+
+  NSDictionary *cache = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:nil];
+  if (![cache isKindOfClass:NSDictionary.class] || ![cache[@"fingerprint"] isEqual:_schemaFingerprint]) {
+    DDLogInfo(@"Schema cache is stale, reloading table info");
+    return;
+  }
+
+  NSDictionary *tables = cache[@"tables"];
+  if (![tables isKindOfClass:NSDictionary.class]) {
+    return;
+  }
+
+  for (NSString *tableName in tables) {
+    DBTableInfo *tableInfo = [DBTableInfo.alloc initWithPropertyList:tables[tableName]];
+    if (tableInfo) {
+      _tableInfos[tableName] = tableInfo;
+    }
+  }
+}
+
+-(void) saveSchemaCache
+{
+  NSMutableDictionary *tables = [NSMutableDictionary dictionary];
+
+  @synchronized(_tableInfos) {
+    for (NSString *tableName in _tableInfos) {
+      tables[tableName] = _tableInfos[tableName].propertyList;
+    }
+    _tableInfosChanged = NO;
+  }
+
+  NSError *error;
+  NSData *data = [NSPropertyListSerialization dataWithPropertyList:@{@"fingerprint": _schemaFingerprint, @"tables": tables}
+                                                            format:NSPropertyListBinaryFormat_v1_0
+                                                           options:0
+                                                             error:&error];
+  if (!data || ![data writeToURL:self.schemaCacheURL options:NSDataWritingAtomic error:&error]) {
+    DDLogError(@"Unable to save schema cache: %@", error);
+  }
+}
+
+-(DBTableInfo *) tableInfoForTableName:(NSString *)tableName readOnlyFieldNames:(NSArray *)readOnlyFieldNames
+{
+  @synchronized(_tableInfos) {
+    DBTableInfo *tableInfo = _tableInfos[tableName];
+    if (tableInfo && [tableInfo.readOnlyFieldNames isEqualToArray:readOnlyFieldNames ?: @[]]) {
+      return tableInfo;
+    }
+  }
+
+  __block DBTableInfo *tableInfo;
+  [_pool inReadableDatabase:^(FMDatabase *db) {
+    tableInfo = [DBTableInfo loadTableInfo:db tableName:tableName readOnlyFieldNames:readOnlyFieldNames];
+  }];
+
+  @synchronized(_tableInfos) {
+    _tableInfos[tableName] = tableInfo;
+    _tableInfosChanged = YES;
+  }
+
+  return tableInfo;
+}
+
 -(void) installFunctionsIntoDB:(FMDatabase *)db
 {
   [db makeCollationNamed:@"NOCASE" encoding:NSUTF8StringEncoding withBlock:^NSComparisonResult (NSString *a, NSString *b) {
@@ -381,6 +517,58 @@ static NSString *DBManagerMigrationsFolder = @"Migrations";
   }];
 }
 
+-(void) modelObjectsWithDbIds:(NSArray *)dbIds updatedInDAO:(DAO *)dao
+{
+  __block NSArray *materialized;
+
+  [self enumerateDelegatesWithBlock:^(id<DBManagerDelegate> delegate) {
+    if ([delegate respondsToSelector:@selector(modelObjectsWithDbIds:updatedInDAO:)]) {
+      [delegate modelObjectsWithDbIds:dbIds updatedInDAO:dao];
+    }
+    else if ([delegate respondsToSelector:@selector(modelObject:updatedInDAO:)]) {
+
+      // Delegates not handling batches get the objects, materialized once for all of them
+      if (!materialized) {
+        materialized = [dao fetchAllObjectsWithDbIds:dbIds error:nil] ?: @[];
+      }
+
+      for (Model *model in materialized) {
+        [delegate modelObject:model updatedInDAO:dao];
+      }
+    }
+  }];
+}
+
+-(void) modelObjectsWithDbIds:(NSArray *)dbIds deletedInDAO:(DAO *)dao
+{
+  __block NSArray *cached;
+
+  [self enumerateDelegatesWithBlock:^(id<DBManagerDelegate> delegate) {
+    if ([delegate respondsToSelector:@selector(modelObjectsWithDbIds:deletedInDAO:)]) {
+      [delegate modelObjectsWithDbIds:dbIds deletedInDAO:dao];
+    }
+    else if ([delegate respondsToSelector:@selector(modelObject:deletedInDAO:)]) {
+
+      // Deleted rows cannot be materialized, delegates not handling batches only
+      // get the instances that were still cached
+      if (!cached) {
+        NSMutableArray *found = [NSMutableArray array];
+        for (id dbId in dbIds) {
+          Model *model = [dao.objectCache objectForKey:dbId];
+          if (model) {
+            [found addObject:model];
+          }
+        }
+        cached = found;
+      }
+
+      for (Model *model in cached) {
+        [delegate modelObject:model deletedInDAO:dao];
+      }
+    }
+  }];
+}
+
 -(void) modelObjectsDidChangeInDAO:(DAO *)dao
 {
   [self enumerateDelegatesWithBlock:^(id<DBManagerDelegate> delegate) {
@@ -405,6 +593,7 @@ static NSString *DBManagerMigrationsFolder = @"Migrations";
     _fieldNames = [NSMutableArray new];
     _insertFieldNames = [NSMutableArray new];
     _updateFieldNames = [NSMutableArray new];
+    _readOnlyFieldNames = [NSMutableArray new];
 
   }
 
@@ -412,6 +601,11 @@ static NSString *DBManagerMigrationsFolder = @"Migrations";
 }
 
 +(DBTableInfo *) loadTableInfo:(FMDatabase *)db tableName:(NSString *)tableName
+{
+  return [self loadTableInfo:db tableName:tableName readOnlyFieldNames:nil];
+}
+
++(DBTableInfo *) loadTableInfo:(FMDatabase *)db tableName:(NSString *)tableName readOnlyFieldNames:(NSArray *)readOnlyFieldNames
 {
   __block NSMutableArray *fieldNames = [NSMutableArray new];
   __block NSMutableArray *insertFieldNames = [NSMutableArray new];
@@ -442,6 +636,9 @@ static NSString *DBManagerMigrationsFolder = @"Migrations";
       typeFieldIndex = @(columnIndex);
       [insertFieldNames addObject:fieldName];
     }
+    else if ([readOnlyFieldNames containsObject:fieldName]) {
+      // Fetched only, never written
+    }
     else {
       [updateFieldNames addObject:fieldName];
       [insertFieldNames addObject:fieldName];
@@ -461,6 +658,7 @@ static NSString *DBManagerMigrationsFolder = @"Migrations";
   tableInfo.fieldNames = fieldNames;
   tableInfo.insertFieldNames = insertFieldNames;
   tableInfo.updateFieldNames = updateFieldNames;
+  tableInfo.readOnlyFieldNames = readOnlyFieldNames ?: @[];
 
   tableInfo.idFieldIndex = idFieldIndex;
   tableInfo.typeFieldIndex = typeFieldIndex;
@@ -513,6 +711,72 @@ static NSString *DBManagerMigrationsFolder = @"Migrations";
   return tableInfo;
 }
 
+-(instancetype) initWithPropertyList:(NSDictionary *)propertyList
+{
+  if (![propertyList isKindOfClass:NSDictionary.class]) {
+    return nil;
+  }
+
+  id (^value)(NSString *, Class) = ^id (NSString *key, Class class) {
+    id object = propertyList[key];
+    return [object isKindOfClass:class] ? object : nil;
+  };
+
+  if ((self = [super init])) {
+
+    _name = value(@"name", NSString.class);
+
+    _fieldNames = value(@"fieldNames", NSArray.class);
+    _insertFieldNames = value(@"insertFieldNames", NSArray.class);
+    _updateFieldNames = value(@"updateFieldNames", NSArray.class);
+    _readOnlyFieldNames = value(@"readOnlyFieldNames", NSArray.class);
+
+    _idFieldIndex = value(@"idFieldIndex", NSNumber.class);
+    _typeFieldIndex = value(@"typeFieldIndex", NSNumber.class);
+    _generatedId = [value(@"generatedId", NSNumber.class) boolValue];
+
+    _fetchSQL = value(@"fetchSQL", NSString.class);
+    _fetchAllSQL = value(@"fetchAllSQL", NSString.class);
+    _insertSQL = value(@"insertSQL", NSString.class);
+    _updateSQL = value(@"updateSQL", NSString.class);
+    _deleteSQL = value(@"deleteSQL", NSString.class);
+    _deleteAllSQL = value(@"deleteAllSQL", NSString.class);
+
+    if (!_name || !_fieldNames || !_insertFieldNames || !_updateFieldNames || !_readOnlyFieldNames || !_idFieldIndex ||
+        !_fetchSQL || !_fetchAllSQL || !_insertSQL || !_updateSQL || !_deleteSQL || !_deleteAllSQL) {
+      return nil;
+    }
+
+  }
+
+  return self;
+}
+
+-(NSDictionary *) propertyList
+{
+  NSMutableDictionary *propertyList = [NSMutableDictionary dictionary];
+
+  propertyList[@"name"] = _name;
+
+  propertyList[@"fieldNames"] = _fieldNames;
+  propertyList[@"insertFieldNames"] = _insertFieldNames;
+  propertyList[@"updateFieldNames"] = _updateFieldNames;
+  propertyList[@"readOnlyFieldNames"] = _readOnlyFieldNames;
+
+  propertyList[@"idFieldIndex"] = _idFieldIndex;
+  propertyList[@"typeFieldIndex"] = _typeFieldIndex;
+  propertyList[@"generatedId"] = @(_generatedId);
+
+  propertyList[@"fetchSQL"] = _fetchSQL;
+  propertyList[@"fetchAllSQL"] = _fetchAllSQL;
+  propertyList[@"insertSQL"] = _insertSQL;
+  propertyList[@"updateSQL"] = _updateSQL;
+  propertyList[@"deleteSQL"] = _deleteSQL;
+  propertyList[@"deleteAllSQL"] = _deleteAllSQL;
+
+  return propertyList;
+}
+
 -(int) findField:(NSString *)fieldName
 {
   NSUInteger idx = [_fieldNames indexOfObject:fieldName];
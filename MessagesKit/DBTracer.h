@@ -0,0 +1,118 @@
+//
+//  DBTracer.h
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+@import Foundation;
+@import FMDB;
+
+
+NS_ASSUME_NONNULL_BEGIN
+
+
+typedef NS_ENUM(NSInteger, DBTracerAccess) {
+  DBTracerAccessRead,
+  DBTracerAccessWrite,
+  DBTracerAccessTransaction,
+};
+
+
+/*
+ * DBTimingHistogram
+ *
+ * Counts of timings in fixed, roughly logarithmic buckets from 0.1ms
+ * to 30s (plus overflow).
+ */
+@interface DBTimingHistogram : NSObject <NSCopying>
+
+@property (readonly, nonatomic) NSUInteger count;
+@property (readonly, nonatomic) NSTimeInterval total;
+@property (readonly, nonatomic) NSTimeInterval maximum;
+
+@property (readonly, nonatomic) NSArray<NSNumber *> *bucketCounts;
+
+// Upper bound (exclusive) of each bucket; the last bucket is unbounded (INFINITY)
++(NSArray<NSNumber *> *) bucketBounds;
+
+-(void) addTiming:(NSTimeInterval)timing;
+
+// Upper bound of the bucket containing the percentile (0-1)
+-(NSTimeInterval) percentile:(double)percentile;
+
+@end
+
+
+@interface DBStatementStats : NSObject
+
+@property (readonly, nonatomic) NSString *sql;
+@property (readonly, nonatomic) DBTimingHistogram *timings;
+// Virtual machine & full table scan steps, summed over all executions
+@property (readonly, nonatomic) uint64_t steps;
+@property (readonly, nonatomic) uint64_t fullScanSteps;
+
+@end
+
+
+@interface DBSlowQuery : NSObject
+
+@property (readonly, nonatomic) NSString *sql;
+@property (readonly, nonatomic) NSTimeInterval duration;
+@property (readonly, nonatomic) uint64_t steps;
+@property (readonly, nonatomic) NSDate *date;
+// Filled in asynchronously, nil until then
+@property (readonly, nonatomic, nullable) NSString *queryPlan;
+
+@end
+
+
+/*
+ * DBTracer
+ *
+ * Opt-in SQL instrumentation for a DBManager's pool. While enabled it
+ * records the time of each statement (via SQLite's profile hook) and the
+ * time callers wait for & hold pool connections. Statements slower than
+ * slowQueryThreshold are logged with their EXPLAIN QUERY PLAN.
+ *
+ * Disabled (the default), pool calls pass straight through and installed
+ * hooks return immediately.
+ */
+@interface DBTracer : NSObject
+
+@property (assign, atomic) BOOL enabled;
+
+// Default 50ms
+@property (assign, atomic) NSTimeInterval slowQueryThreshold;
+// Number of slow queries kept, oldest are dropped first (default 100)
+@property (assign, atomic) NSUInteger slowQueryLimit;
+
+// Snapshots, statements are sorted by total time descending
+@property (readonly, nonatomic) NSArray<DBStatementStats *> *statementStats;
+@property (readonly, nonatomic) NSArray<DBSlowQuery *> *slowQueries;
+
+-(DBTimingHistogram *) waitTimingsForAccess:(DBTracerAccess)access;
+-(DBTimingHistogram *) holdTimingsForAccess:(DBTracerAccess)access;
+
+-(void) reset;
+
+// Multi-line summary of the slowest statements, pool waits & slow queries
+-(NSString *) report;
+
+@end
+
+
+/*
+ * DBTracingPool
+ *
+ * Pool reporting connection waits & statement timings to its tracer.
+ */
+@interface DBTracingPool : FMDatabaseReadWritePool
+
+@property (readonly, nonatomic) DBTracer *tracer;
+
+@end
+
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,555 @@
+//
+//  DBTracer.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "DBTracer.h"
+
+#import "Log.h"
+
+#import <sqlite3.h>
+
+@import Darwin;
+
+
+MK_DECLARE_LOG_LEVEL()
+
+
+static const NSTimeInterval kBucketBounds[] = {
+  0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, INFINITY
+};
+#define kBucketCount (sizeof(kBucketBounds) / sizeof(kBucketBounds[0]))
+
+// Ad hoc SQL (e.g. with inlined values) would grow the table without bound; past
+// this many distinct statements the rest are aggregated together
+static const NSUInteger kMaxStatements = 500;
+static NSString *const kOtherStatementsSQL = @"(other statements)";
+
+static const char kQueryPlanPrefix[] = "EXPLAIN QUERY PLAN ";
+
+
+static NSTimeInterval Now(void)
+{
+  static mach_timebase_info_data_t timebase;
+  static dispatch_once_t once;
+  dispatch_once(&once, ^{
+    mach_timebase_info(&timebase);
+  });
+  return (double)mach_absolute_time() * timebase.numer / timebase.denom / NSEC_PER_SEC;
+}
+
+
+
+@implementation DBTimingHistogram {
+  NSUInteger _buckets[kBucketCount];
+}
+
++(NSArray<NSNumber *> *) bucketBounds
+{
+  NSMutableArray *bounds = [NSMutableArray arrayWithCapacity:kBucketCount];
+  for (NSUInteger c = 0; c < kBucketCount; ++c) {
+    [bounds addObject:@(kBucketBounds[c])];
+  }
+  return bounds;
+}
+
+-(NSArray<NSNumber *> *) bucketCounts
+{
+  NSMutableArray *counts = [NSMutableArray arrayWithCapacity:kBucketCount];
+  for (NSUInteger c = 0; c < kBucketCount; ++c) {
+    [counts addObject:@(_buckets[c])];
+  }
+  return counts;
+}
+
+-(void) addTiming:(NSTimeInterval)timing
+{
+  NSUInteger bucket = 0;
+  while (timing >= kBucketBounds[bucket]) {
+    ++bucket;
+  }
+
+  _buckets[bucket] += 1;
+  _count += 1;
+  _total += timing;
+  _maximum = MAX(_maximum, timing);
+}
+
+-(NSTimeInterval) percentile:(double)percentile
+{
+  if (_count == 0) {
+    return 0;
+  }
+
+  NSUInteger target = MAX(1, (NSUInteger)ceil(percentile * _count));
+  NSUInteger seen = 0;
+
+  for (NSUInteger c = 0; c < kBucketCount; ++c) {
+    seen += _buckets[c];
+    if (seen >= target) {
+      // Never report more than was actually observed
+      return MIN(kBucketBounds[c], _maximum);
+    }
+  }
+
+  return _maximum;
+}
+
+-(id) copyWithZone:(NSZone *)zone
+{
+  DBTimingHistogram *copy = [DBTimingHistogram new];
+  copy->_count = _count;
+  copy->_total = _total;
+  copy->_maximum = _maximum;
+  memcpy(copy->_buckets, _buckets, sizeof(_buckets));
+  return copy;
+}
+
+-(NSString *) description
+{
+  return [NSString stringWithFormat:@"%lu x, p50 %.2fms, p99 %.2fms, max %.2fms",
+          (unsigned long)_count, [self percentile:0.5] * 1e3, [self percentile:0.99] * 1e3, _maximum * 1e3];
+}
+
+@end
+
+
+
+@interface DBStatementStats ()
+
+@property (copy, nonatomic) NSString *sql;
+@property (strong, nonatomic) DBTimingHistogram *timings;
+@property (assign, nonatomic) uint64_t steps;
+@property (assign, nonatomic) uint64_t fullScanSteps;
+
+-(DBStatementStats *) snapshot;
+
+@end
+
+
+@implementation DBStatementStats
+
+-(DBStatementStats *) snapshot
+{
+  DBStatementStats *copy = [DBStatementStats new];
+  copy.sql = _sql;
+  copy.timings = [_timings copy];
+  copy.steps = _steps;
+  copy.fullScanSteps = _fullScanSteps;
+  return copy;
+}
+
+@end
+
+
+
+@interface DBSlowQuery ()
+
+@property (copy, nonatomic) NSString *sql;
+@property (assign, nonatomic) NSTimeInterval duration;
+@property (assign, nonatomic) uint64_t steps;
+@property (strong, nonatomic) NSDate *date;
+@property (copy, atomic) NSString *queryPlan;
+
+@end
+
+
+@implementation DBSlowQuery
+
+@end
+
+
+
+// Profile hook context, one per traced connection
+@interface DBTracerConnection : NSObject
+
+@property (unsafe_unretained, nonatomic) DBTracer *tracer;
+@property (assign, nonatomic) sqlite3 *handle;
+
+@end
+
+
+@implementation DBTracerConnection
+
+@end
+
+
+
+@interface DBTracer () {
+  NSMutableDictionary<NSString *, DBStatementStats *> *_statements;
+  NSMutableArray<DBSlowQuery *> *_slowQueries;
+  DBTimingHistogram *_waitTimings[3];
+  DBTimingHistogram *_holdTimings[3];
+  NSMapTable<FMDatabase *, DBTracerConnection *> *_connections;
+  dispatch_queue_t _queue;
+}
+
+@property (weak, nonatomic) FMDatabaseReadWritePool *pool;
+
+-(instancetype) initWithPool:(FMDatabaseReadWritePool *)pool;
+
+-(void) prepareDatabase:(FMDatabase *)db;
+
+-(void) recordStatement:(const char *)sql duration:(NSTimeInterval)duration steps:(uint64_t)steps fullScanSteps:(uint64_t)fullScanSteps;
+-(void) recordAccess:(DBTracerAccess)access requested:(NSTimeInterval)requested acquired:(NSTimeInterval)acquired released:(NSTimeInterval)released;
+
+@end
+
+
+static void DBTracerProfile(void *context, const char *sql, sqlite3_uint64 nanoseconds)
+{
+  DBTracerConnection *connection = (__bridge DBTracerConnection *)context;
+
+  DBTracer *tracer = connection.tracer;
+  if (!tracer.enabled) {
+    return;
+  }
+
+  // Step counts of the statement that just completed, reset for its next execution
+  uint64_t steps = 0, fullScanSteps = 0;
+  for (sqlite3_stmt *stmt = sqlite3_next_stmt(connection.handle, NULL); stmt; stmt = sqlite3_next_stmt(connection.handle, stmt)) {
+    if (sqlite3_sql(stmt) == sql) {
+      steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+      fullScanSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+      break;
+    }
+  }
+
+  [tracer recordStatement:sql duration:nanoseconds / (double)NSEC_PER_SEC steps:steps fullScanSteps:fullScanSteps];
+}
+
+
+@implementation DBTracer
+
+-(instancetype) initWithPool:(FMDatabaseReadWritePool *)pool
+{
+  self = [super init];
+  if (self) {
+
+    _pool = pool;
+
+    _slowQueryThreshold = 0.05;
+    _slowQueryLimit = 100;
+
+    _statements = [NSMutableDictionary new];
+    _slowQueries = [NSMutableArray new];
+    for (int c = 0; c < 3; ++c) {
+      _waitTimings[c] = [DBTimingHistogram new];
+      _holdTimings[c] = [DBTimingHistogram new];
+    }
+
+    _connections = [NSMapTable weakToStrongObjectsMapTable];
+
+    _queue = dispatch_queue_create("DBTracer", DISPATCH_QUEUE_SERIAL);
+    dispatch_set_target_queue(_queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+
+  }
+  return self;
+}
+
+-(void) prepareDatabase:(FMDatabase *)db
+{
+  sqlite3 *handle = db.sqliteHandle;
+  if (!handle) {
+    return;
+  }
+
+  @synchronized(self) {
+
+    DBTracerConnection *connection = [_connections objectForKey:db];
+    if (connection.handle == handle) {
+      return;
+    }
+
+    connection = [DBTracerConnection new];
+    connection.tracer = self;
+    connection.handle = handle;
+
+    [_connections setObject:connection forKey:db];
+
+    sqlite3_profile(handle, DBTracerProfile, (__bridge void *)connection);
+  }
+}
+
+-(void) recordStatement:(const char *)sqlText duration:(NSTimeInterval)duration steps:(uint64_t)steps fullScanSteps:(uint64_t)fullScanSteps
+{
+  // Plans requested for slow queries are not themselves traced
+  if (strncmp(sqlText, kQueryPlanPrefix, sizeof(kQueryPlanPrefix) - 1) == 0) {
+    return;
+  }
+
+  NSString *sql = [NSString stringWithUTF8String:sqlText] ?: @"";
+
+  @synchronized(self) {
+
+    DBStatementStats *stats = _statements[sql];
+    if (!stats) {
+
+      NSString *key = _statements.count < kMaxStatements ? sql : kOtherStatementsSQL;
+
+      stats = _statements[key];
+      if (!stats) {
+        stats = [DBStatementStats new];
+        stats.sql = key;
+        stats.timings = [DBTimingHistogram new];
+        _statements[key] = stats;
+      }
+    }
+
+    [stats.timings addTiming:duration];
+    stats.steps += steps;
+    stats.fullScanSteps += fullScanSteps;
+  }
+
+  if (duration >= self.slowQueryThreshold) {
+    [self recordSlowQuery:sql duration:duration steps:steps];
+  }
+}
+
+-(void) recordSlowQuery:(NSString *)sql duration:(NSTimeInterval)duration steps:(uint64_t)steps
+{
+  DBSlowQuery *slowQuery = [DBSlowQuery new];
+  slowQuery.sql = sql;
+  slowQuery.duration = duration;
+  slowQuery.steps = steps;
+  slowQuery.date = [NSDate date];
+
+  @synchronized(self) {
+    [_slowQueries addObject:slowQuery];
+    while (_slowQueries.count > self.slowQueryLimit) {
+      [_slowQueries removeObjectAtIndex:0];
+    }
+  }
+
+  // Explaining requires a connection, which cannot be used from within the profile hook
+  dispatch_async(_queue, ^{
+
+    slowQuery.queryPlan = [self queryPlanForSQL:sql];
+
+    DDLogWarn(@"Slow query (%.1fms, %llu steps): %@\n%@", duration * 1e3, steps, sql, slowQuery.queryPlan);
+  });
+}
+
+-(NSString *) queryPlanForSQL:(NSString *)sql
+{
+  NSMutableArray *lines = [NSMutableArray new];
+
+  [self.pool inReadableDatabase:^(FMDatabase *db) {
+
+    // Prepared directly; parameters are left unbound, which FMDB would reject
+    NSString *explainSQL = [@(kQueryPlanPrefix) stringByAppendingString:sql];
+
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db.sqliteHandle, explainSQL.UTF8String, -1, &stmt, NULL) != SQLITE_OK) {
+      [lines addObject:[NSString stringWithFormat:@"(unavailable: %@)", db.lastErrorMessage]];
+      sqlite3_finalize(stmt);
+      return;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      const char *detail = (const char *)sqlite3_column_text(stmt, 3);
+      [lines addObject:[NSString stringWithFormat:@"%d|%d|%d|%s",
+                        sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2), detail ?: ""]];
+    }
+
+    sqlite3_finalize(stmt);
+  }];
+
+  return [lines componentsJoinedByString:@"\n"];
+}
+
+-(void) recordAccess:(DBTracerAccess)access requested:(NSTimeInterval)requested acquired:(NSTimeInterval)acquired released:(NSTimeInterval)released
+{
+  @synchronized(self) {
+    [_waitTimings[access] addTiming:acquired - requested];
+    [_holdTimings[access] addTiming:released - acquired];
+  }
+}
+
+-(NSArray<DBStatementStats *> *) statementStats
+{
+  NSMutableArray *statementStats = [NSMutableArray new];
+
+  @synchronized(self) {
+    for (DBStatementStats *stats in _statements.objectEnumerator) {
+      [statementStats addObject:[stats snapshot]];
+    }
+  }
+
+  [statementStats sortUsingComparator:^NSComparisonResult(DBStatementStats *a, DBStatementStats *b) {
+    return [@(b.timings.total) compare:@(a.timings.total)];
+  }];
+
+  return statementStats;
+}
+
+-(NSArray<DBSlowQuery *> *) slowQueries
+{
+  @synchronized(self) {
+    return [_slowQueries copy];
+  }
+}
+
+-(DBTimingHistogram *) waitTimingsForAccess:(DBTracerAccess)access
+{
+  @synchronized(self) {
+    return [_waitTimings[access] copy];
+  }
+}
+
+-(DBTimingHistogram *) holdTimingsForAccess:(DBTracerAccess)access
+{
+  @synchronized(self) {
+    return [_holdTimings[access] copy];
+  }
+}
+
+-(void) reset
+{
+  @synchronized(self) {
+    [_statements removeAllObjects];
+    [_slowQueries removeAllObjects];
+    for (int c = 0; c < 3; ++c) {
+      _waitTimings[c] = [DBTimingHistogram new];
+      _holdTimings[c] = [DBTimingHistogram new];
+    }
+  }
+}
+
+-(NSString *) report
+{
+  NSMutableString *report = [NSMutableString new];
+
+  NSArray *accessNames = @[@"read", @"write", @"transaction"];
+  for (DBTracerAccess access = DBTracerAccessRead; access <= DBTracerAccessTransaction; ++access) {
+    [report appendFormat:@"%@ wait: %@; hold: %@\n",
+     accessNames[access], [self waitTimingsForAccess:access], [self holdTimingsForAccess:access]];
+  }
+
+  NSArray<DBStatementStats *> *statementStats = self.statementStats;
+
+  [report appendFormat:@"\n%lu statements, by total time:\n", (unsigned long)statementStats.count];
+  for (DBStatementStats *stats in [statementStats subarrayWithRange:NSMakeRange(0, MIN(statementStats.count, 20))]) {
+    [report appendFormat:@"%.1fms total, %@, %llu steps (%llu full scan): %@\n",
+     stats.timings.total * 1e3, stats.timings, stats.steps, stats.fullScanSteps, stats.sql];
+  }
+
+  NSArray<DBSlowQuery *> *slowQueries = self.slowQueries;
+
+  [report appendFormat:@"\n%lu slow queries:\n", (unsigned long)slowQueries.count];
+  for (DBSlowQuery *slowQuery in slowQueries) {
+    [report appendFormat:@"%@ %.1fms, %llu steps: %@\n%@\n",
+     slowQuery.date, slowQuery.duration * 1e3, slowQuery.steps, slowQuery.sql, slowQuery.queryPlan ?: @"(plan pending)"];
+  }
+
+  return report;
+}
+
+@end
+
+
+
+@implementation DBTracingPool
+
+-(instancetype) initWithPath:(NSString *)aPath flags:(int)openFlags vfs:(NSString *)vfsName error:(NSError **)error
+{
+  self = [super initWithPath:aPath flags:openFlags vfs:vfsName error:error];
+  if (self) {
+    _tracer = [DBTracer.alloc initWithPool:self];
+  }
+  return self;
+}
+
+-(void) inReadableDatabase:(void (^)(FMDatabase *))block
+{
+  DBTracer *tracer = _tracer;
+  if (!tracer.enabled) {
+    [super inReadableDatabase:block];
+    return;
+  }
+
+  NSTimeInterval requested = Now();
+  __block NSTimeInterval acquired = 0;
+
+  [super inReadableDatabase:^(FMDatabase *db) {
+    acquired = Now();
+    [tracer prepareDatabase:db];
+    block(db);
+  }];
+
+  if (acquired) {
+    [tracer recordAccess:DBTracerAccessRead requested:requested acquired:acquired released:Now()];
+  }
+}
+
+-(void) inWritableDatabase:(void (^)(FMDatabase *))block
+{
+  DBTracer *tracer = _tracer;
+  if (!tracer.enabled) {
+    [super inWritableDatabase:block];
+    return;
+  }
+
+  NSTimeInterval requested = Now();
+  __block NSTimeInterval acquired = 0;
+
+  [super inWritableDatabase:^(FMDatabase *db) {
+    acquired = Now();
+    [tracer prepareDatabase:db];
+    block(db);
+  }];
+
+  if (acquired) {
+    [tracer recordAccess:DBTracerAccessWrite requested:requested acquired:acquired released:Now()];
+  }
+}
+
+-(void) inTransaction:(void (^)(FMDatabase *, BOOL *))block
+{
+  DBTracer *tracer = _tracer;
+  if (!tracer.enabled) {
+    [super inTransaction:block];
+    return;
+  }
+
+  NSTimeInterval requested = Now();
+  __block NSTimeInterval acquired = 0;
+
+  [super inTransaction:^(FMDatabase *db, BOOL *rollback) {
+    acquired = Now();
+    [tracer prepareDatabase:db];
+    block(db, rollback);
+  }];
+
+  // Released after the commit
+  if (acquired) {
+    [tracer recordAccess:DBTracerAccessTransaction requested:requested acquired:acquired released:Now()];
+  }
+}
+
+-(void) inDeferredTransaction:(void (^)(FMDatabase *, BOOL *))block
+{
+  DBTracer *tracer = _tracer;
+  if (!tracer.enabled) {
+    [super inDeferredTransaction:block];
+    return;
+  }
+
+  NSTimeInterval requested = Now();
+  __block NSTimeInterval acquired = 0;
+
+  [super inDeferredTransaction:^(FMDatabase *db, BOOL *rollback) {
+    acquired = Now();
+    [tracer prepareDatabase:db];
+    block(db, rollback);
+  }];
+
+  if (acquired) {
+    [tracer recordAccess:DBTracerAccessTransaction requested:requested acquired:acquired released:Now()];
+  }
+}
+
+@end
@@ -34,6 +34,30 @@ extension DataReference {
     }, withMIMEType: MIMEType)
   }
 
+  public func filteredToURL(URL: NSURL, filteredBy filter: DataReferenceFilter? = nil) throws -> (data: DataReference, length: UInt64, digest: NSData) {
+    
+    var length : UInt64 = 0
+    var digest : NSData?
+    
+    guard let filter = filter else {
+      let data = try DataReferences.__filterReference(self, toURL: URL, usingFilter: nil, length: &length, digest: &digest)
+      return (data, length, digest!)
+    }
+    
+    let data = try DataReferences.__filterReference(self, toURL: URL, usingFilter: { ins, outs, error in
+      do {
+        try filter(ins, outs)
+        return true
+      }
+      catch let caughtError {
+        error.memory = caughtError as NSError
+        return false
+      }
+    }, length: &length, digest: &digest)
+    
+    return (data, length, digest!)
+  }
+
   public func readAllData() throws -> NSData {
     return try DataReferences.readAllDataFromReference(self)
   }
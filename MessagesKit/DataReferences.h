@@ -21,6 +21,21 @@ NS_ASSUME_NONNULL_BEGIN
 +(nullable NSData *) readAllDataFromReference:(nullable id<DataReference>)source error:(NSError **)error;
 +(nullable NSURL *) saveDataReferenceToTemporaryURL:(id<DataReference>)source error:(NSError **)error;
 
+// Streams source through filter into a file at url in a single pass, measuring the
+// length & SHA-256 digest of the written (filtered) data along the way
++(nullable URLDataReference *) filterReference:(id<DataReference>)source
+                                         toURL:(NSURL *)url
+                                   usingFilter:(nullable DataReferenceFilter)filter
+                                        length:(nullable unsigned long long *)length
+                                        digest:(NSData *__nullable *__nullable)digest
+                                         error:(NSError **)error;
+
+// Measures the length & SHA-256 digest of source without writing it anywhere
++(BOOL) digestReference:(id<DataReference>)source
+                 length:(nullable unsigned long long *)length
+                 digest:(NSData *__nullable *__nullable)digest
+                  error:(NSError **)error;
+
 +(BOOL) isDataReference:(id<DataReference>)aref equivalentToDataReference:(id<DataReference>)bref;
 
 @end
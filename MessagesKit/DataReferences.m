@@ -10,6 +10,62 @@
 
 #import "NSURL+Utils.h"
 
+#import <CommonCrypto/CommonDigest.h>
+
+
+@interface DigestingOutputStream : NSObject <DataOutputStream> {
+  CC_SHA256_CTX _ctx;
+}
+
+@property(strong, nonatomic) id<DataOutputStream> outputStream;
+@property(assign, nonatomic) unsigned long long length;
+
+-(instancetype) initWithOutputStream:(id<DataOutputStream>)outputStream;
+
+-(NSData *) digest;
+
+@end
+
+
+@implementation DigestingOutputStream
+
+-(instancetype) initWithOutputStream:(id<DataOutputStream>)outputStream
+{
+  self = [super init];
+  if (self) {
+    _outputStream = outputStream;
+    CC_SHA256_Init(&_ctx);
+  }
+  return self;
+}
+
+-(BOOL) writeBytesFromBuffer:(const UInt8 *)buffer length:(NSUInteger)length error:(NSError **)error
+{
+  // Without an output stream the data is only measured
+  if (_outputStream && ![_outputStream writeBytesFromBuffer:buffer length:length error:error]) {
+    return NO;
+  }
+
+  CC_SHA256_Update(&_ctx, buffer, (CC_LONG)length);
+  _length += length;
+
+  return YES;
+}
+
+-(void) close
+{
+  [_outputStream close];
+}
+
+-(NSData *) digest
+{
+  NSMutableData *digest = [NSMutableData dataWithLength:CC_SHA256_DIGEST_LENGTH];
+  CC_SHA256_Final(digest.mutableBytes, &_ctx);
+  return digest;
+}
+
+@end
+
 
 @implementation DataReferences
 
@@ -91,6 +147,82 @@
   return tempURL;
 }
 
++(URLDataReference *) filterReference:(id<DataReference>)source
+                                toURL:(NSURL *)url
+                          usingFilter:(DataReferenceFilter)filter
+                               length:(unsigned long long *)length
+                               digest:(NSData **)digest
+                                error:(NSError **)error
+{
+  id<DataInputStream> inStream = [source openInputStreamAndReturnError:error];
+  if (!inStream) {
+    return nil;
+  }
+
+  NSOutputStream *outStream = [NSOutputStream outputStreamWithURL:url append:NO];
+  if (!outStream) {
+    [inStream close];
+    return nil;
+  }
+  [outStream open];
+  if (outStream.streamError) {
+    if (error) {
+      *error = outStream.streamError;
+    }
+    [inStream close];
+    return nil;
+  }
+
+  DigestingOutputStream *digestStream = [DigestingOutputStream.alloc initWithOutputStream:outStream];
+
+  BOOL res = [self filterStreamsWithInput:inStream output:digestStream usingFilter:filter error:error];
+  [inStream close];
+  [digestStream close];
+
+  if (!res) {
+    [NSFileManager.defaultManager removeItemAtURL:url error:nil];
+    return nil;
+  }
+
+  if (length) {
+    *length = digestStream.length;
+  }
+  if (digest) {
+    *digest = digestStream.digest;
+  }
+
+  return [URLDataReference.alloc initWithURL:url];
+}
+
++(BOOL) digestReference:(id<DataReference>)source
+                length:(unsigned long long *)length
+                digest:(NSData **)digest
+                 error:(NSError **)error
+{
+  id<DataInputStream> inStream = [source openInputStreamAndReturnError:error];
+  if (!inStream) {
+    return NO;
+  }
+
+  DigestingOutputStream *digestStream = [DigestingOutputStream.alloc initWithOutputStream:nil];
+
+  BOOL res = [self filterStreamsWithInput:inStream output:digestStream usingFilter:nil error:error];
+  [inStream close];
+
+  if (!res) {
+    return NO;
+  }
+
+  if (length) {
+    *length = digestStream.length;
+  }
+  if (digest) {
+    *digest = digestStream.digest;
+  }
+
+  return YES;
+}
+
 +(BOOL) isDataReference:(id<DataReference>)aref equivalentToDataReference:(id<DataReference>)bref
 {
   NSData *aData = [DataReferences readAllDataFromReference:aref error:nil];
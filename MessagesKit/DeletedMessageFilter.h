@@ -0,0 +1,78 @@
+//
+//  DeletedMessageFilter.h
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "DBManager.h"
+#import "Messages.h"
+
+
+NS_ASSUME_NONNULL_BEGIN
+
+
+@interface DeletedMessageFilterMetrics : NSObject <NSCopying>
+
+@property (readonly, nonatomic) NSUInteger lookups;
+@property (readonly, nonatomic) NSUInteger databaseLookups;
+@property (readonly, nonatomic) NSUInteger falsePositives;
+@property (readonly, nonatomic) NSUInteger rebuilds;
+@property (readonly, nonatomic) NSUInteger tombstonesCompacted;
+@property (readonly, nonatomic, nullable) NSDate *lastCompacted;
+
+@end
+
+
+/*
+ * DeletedMessageFilter
+ *
+ * Bloom filter over the ids in the deleted (tombstone) table. An id it
+ * reports absent was never marked deleted; an id it reports present must
+ * be confirmed with the database.
+ *
+ * The filter is saved beside the database along with the last tombstone
+ * row it covers; at load, rows added after the last save are caught up
+ * and a filter that does not match the table is rebuilt.
+ */
+@interface DeletedMessageFilter : NSObject
+
+@property (readonly, nonatomic) DBManager *dbManager;
+
+// Tombstones older than this are removed by compaction; must exceed the server's redelivery window (default 30 days)
+@property (assign, nonatomic) NSTimeInterval retentionInterval;
+// Minimum time between compaction passes started via compactIfNeeded (default 1 day)
+@property (assign, nonatomic) NSTimeInterval compactInterval;
+
+@property (readonly, nonatomic) NSURL *fileURL;
+
+// Number of tombstones in the filter & number it was sized for
+@property (readonly, nonatomic) NSUInteger count;
+@property (readonly, nonatomic) NSUInteger capacity;
+
+// Snapshot of cumulative metrics
+@property (readonly, nonatomic) DeletedMessageFilterMetrics *metrics;
+
+-(instancetype) init NS_UNAVAILABLE;
+-(instancetype) initWithDBManager:(DBManager *)dbManager NS_DESIGNATED_INITIALIZER;
+
+-(BOOL) mightContainId:(Id *)msgId;
+-(void) recordFalsePositive;
+
+// Adds a tombstone inserted by the database; must be called while holding the writer
+-(void) addId:(Id *)msgId rowId:(int64_t)rowId;
+
+// Asynchronously compacts when compactInterval has elapsed since the last pass
+-(void) compactIfNeeded;
+-(BOOL) compactAndReturnError:(NSError **)error;
+
+// Rebuilds from the table then checks every tombstone is reported present
+-(BOOL) rebuildAndVerifyReturningError:(NSError **)error;
+
+-(BOOL) saveAndReturnError:(NSError **)error;
+
+@end
+
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,549 @@
+//
+//  DeletedMessageFilter.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "DeletedMessageFilter.h"
+
+#import "Log.h"
+
+
+MK_DECLARE_LOG_LEVEL()
+
+
+static const uint32_t kFileMagic = 0x4d4b4446; // MKDF
+static const uint32_t kFileVersion = 1;
+
+// 10 bits & 7 probes per tombstone keeps false positives under 1% at capacity
+static const NSUInteger kBitsPerElement = 10;
+static const uint32_t kHashCount = 7;
+
+static const NSUInteger kMinimumCapacity = 8 * 1024;
+
+static const NSTimeInterval kSaveDelay = 2;
+
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t bitCount;
+  uint32_t hashCount;
+  uint32_t reserved;
+  uint64_t count;
+  int64_t lastRowId;
+  NSTimeInterval lastCompacted;
+} FilterFileHeader;
+
+
+static inline uint64_t Mix64(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Two independent hashes of the id; the remaining probes are derived by double hashing
+static void HashIdData(NSData *idData, uint64_t *h1, uint64_t *h2)
+{
+  uint64_t words[2] = {0, 0};
+  memcpy(words, idData.bytes, MIN(idData.length, sizeof(words)));
+
+  *h1 = Mix64(words[0] ^ Mix64(words[1]));
+  *h2 = Mix64(words[1] + 0x9e3779b97f4a7c15ULL) | 1;
+}
+
+static void SetBits(uint8_t *bits, uint64_t bitCount, NSData *idData)
+{
+  uint64_t h1, h2;
+  HashIdData(idData, &h1, &h2);
+
+  for (uint32_t c = 0; c < kHashCount; ++c) {
+    uint64_t bit = (h1 + c * h2) % bitCount;
+    bits[bit >> 3] |= (uint8_t)(1 << (bit & 7));
+  }
+}
+
+static BOOL TestBits(const uint8_t *bits, uint64_t bitCount, NSData *idData)
+{
+  uint64_t h1, h2;
+  HashIdData(idData, &h1, &h2);
+
+  for (uint32_t c = 0; c < kHashCount; ++c) {
+    uint64_t bit = (h1 + c * h2) % bitCount;
+    if ((bits[bit >> 3] & (1 << (bit & 7))) == 0) {
+      return NO;
+    }
+  }
+
+  return YES;
+}
+
+static NSUInteger CapacityForCount(NSUInteger count)
+{
+  // Room to double before resizing, rounded so the bits fill whole words
+  return MAX(kMinimumCapacity, (count * 2 + 63) & ~(NSUInteger)63);
+}
+
+static NSData *BitsFromFileData(NSData *fileData, FilterFileHeader *header)
+{
+  if (fileData.length < sizeof(FilterFileHeader)) {
+    return nil;
+  }
+
+  [fileData getBytes:header length:sizeof(FilterFileHeader)];
+
+  if (header->magic != kFileMagic || header->version != kFileVersion || header->hashCount != kHashCount ||
+      header->bitCount == 0 || header->bitCount % 8 != 0 ||
+      fileData.length != sizeof(FilterFileHeader) + header->bitCount / 8) {
+    return nil;
+  }
+
+  return [fileData subdataWithRange:NSMakeRange(sizeof(FilterFileHeader), fileData.length - sizeof(FilterFileHeader))];
+}
+
+
+@interface DeletedMessageFilterMetrics ()
+
+@property (assign, nonatomic) NSUInteger lookups;
+@property (assign, nonatomic) NSUInteger databaseLookups;
+@property (assign, nonatomic) NSUInteger falsePositives;
+@property (assign, nonatomic) NSUInteger rebuilds;
+@property (assign, nonatomic) NSUInteger tombstonesCompacted;
+@property (strong, nonatomic, nullable) NSDate *lastCompacted;
+
+@end
+
+
+@implementation DeletedMessageFilterMetrics
+
+-(id) copyWithZone:(NSZone *)zone
+{
+  DeletedMessageFilterMetrics *copy = [DeletedMessageFilterMetrics new];
+  copy.lookups = self.lookups;
+  copy.databaseLookups = self.databaseLookups;
+  copy.falsePositives = self.falsePositives;
+  copy.rebuilds = self.rebuilds;
+  copy.tombstonesCompacted = self.tombstonesCompacted;
+  copy.lastCompacted = self.lastCompacted;
+  return copy;
+}
+
+-(NSString *) description
+{
+  return [NSString stringWithFormat:@"<lookups=%lu, databaseLookups=%lu, falsePositives=%lu, rebuilds=%lu, compacted=%lu>",
+          (unsigned long)self.lookups, (unsigned long)self.databaseLookups, (unsigned long)self.falsePositives,
+          (unsigned long)self.rebuilds, (unsigned long)self.tombstonesCompacted];
+}
+
+@end
+
+
+@interface DeletedMessageFilter () {
+  dispatch_queue_t _queue;
+  DeletedMessageFilterMetrics *_metrics;
+  NSMutableData *_bits;
+  uint64_t _bitCount;
+  NSUInteger _count;
+  NSUInteger _capacity;
+  int64_t _lastRowId;
+  BOOL _saveScheduled;
+  BOOL _rebuildScheduled;
+}
+
+@end
+
+
+@implementation DeletedMessageFilter
+
+-(instancetype) initWithDBManager:(DBManager *)dbManager
+{
+  self = [super init];
+  if (self) {
+    _dbManager = dbManager;
+    _queue = dispatch_queue_create("DeletedMessageFilter Queue", DISPATCH_QUEUE_SERIAL);
+    dispatch_set_target_queue(_queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+    _metrics = [DeletedMessageFilterMetrics new];
+    _retentionInterval = 30 * 24 * 60 * 60;
+    _compactInterval = 24 * 60 * 60;
+
+    // Until loaded every lookup falls through to the database
+    NSError *error;
+    if (![self loadAndReturnError:&error]) {
+      DDLogError(@"Error loading deleted message filter: %@", error);
+    }
+  }
+  return self;
+}
+
+-(DeletedMessageFilterMetrics *) metrics
+{
+  @synchronized(_metrics) {
+    return [_metrics copy];
+  }
+}
+
+-(NSURL *) fileURL
+{
+  NSString *fileName = [_dbManager.URL.lastPathComponent.stringByDeletingPathExtension stringByAppendingString:@"-deleted.filter"];
+  return [NSURL URLWithString:fileName relativeToURL:_dbManager.URL];
+}
+
+-(NSUInteger) count
+{
+  @synchronized(self) {
+    return _count;
+  }
+}
+
+-(NSUInteger) capacity
+{
+  @synchronized(self) {
+    return _capacity;
+  }
+}
+
+-(BOOL) mightContainId:(Id *)msgId
+{
+  BOOL contains;
+
+  @synchronized(self) {
+    contains = !_bits || TestBits(_bits.bytes, _bitCount, msgId.data);
+  }
+
+  @synchronized(_metrics) {
+    _metrics.lookups += 1;
+    if (contains) {
+      _metrics.databaseLookups += 1;
+    }
+  }
+
+  return contains;
+}
+
+-(void) recordFalsePositive
+{
+  @synchronized(_metrics) {
+    _metrics.falsePositives += 1;
+  }
+}
+
+-(void) addId:(Id *)msgId rowId:(int64_t)rowId
+{
+  BOOL full;
+
+  @synchronized(self) {
+
+    if (!_bits) {
+      return;
+    }
+
+    SetBits(_bits.mutableBytes, _bitCount, msgId.data);
+    _count += 1;
+    _lastRowId = MAX(_lastRowId, rowId);
+
+    full = _count > _capacity && !_rebuildScheduled;
+    if (full) {
+      _rebuildScheduled = YES;
+    }
+  }
+
+  if (!full) {
+    [self scheduleSave];
+    return;
+  }
+
+  // Lookups stay correct while full, only the false positive rate climbs until resized
+
+  dispatch_async(_queue, ^{
+
+    __block BOOL valid = NO;
+    __block NSError *error;
+
+    [_dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+      valid = [self rebuildInDatabase:db error:&error];
+    }];
+
+    @synchronized(self) {
+      _rebuildScheduled = NO;
+    }
+
+    if (!valid) {
+      DDLogError(@"Error resizing deleted message filter: %@", error);
+    }
+
+  });
+}
+
+-(BOOL) loadAndReturnError:(NSError **)error
+{
+  NSData *fileData = [NSData dataWithContentsOfURL:self.fileURL options:NSDataReadingMappedIfSafe error:nil];
+
+  __block BOOL valid = NO;
+
+  [_dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+
+    FilterFileHeader header;
+    NSData *bits = fileData ? BitsFromFileData(fileData, &header) : nil;
+    if (bits) {
+
+      // Only rows added after the save can be caught up; a table changed any other way
+      // (e.g. compacted without the filter being saved) must be rebuilt
+
+      long covered = [db longForQuery:@"SELECT COUNT(*) FROM deleted WHERE ROWID <= ?", @(header.lastRowId)];
+      if (covered == (long)header.count) {
+
+        @synchronized(self) {
+          _bits = [bits mutableCopy];
+          _bitCount = header.bitCount;
+          _capacity = (NSUInteger)(header.bitCount / kBitsPerElement);
+          _count = (NSUInteger)header.count;
+          _lastRowId = header.lastRowId;
+        }
+
+        @synchronized(_metrics) {
+          _metrics.lastCompacted = header.lastCompacted ? [NSDate dateWithTimeIntervalSinceReferenceDate:header.lastCompacted] : nil;
+        }
+
+        valid = [self enumerateTombstonesInDatabase:db afterRowId:header.lastRowId error:error block:^(int64_t rowId, NSData *idData) {
+          [self addId:[Id idWithData:idData] rowId:rowId];
+        }];
+        return;
+      }
+
+      DDLogInfo(@"Deleted message filter does not match database, rebuilding");
+    }
+
+    valid = [self rebuildInDatabase:db error:error];
+  }];
+
+  return valid;
+}
+
+-(BOOL) enumerateTombstonesInDatabase:(FMDatabase *)db afterRowId:(int64_t)afterRowId error:(NSError **)error block:(void (^)(int64_t rowId, NSData *idData))block
+{
+  FMResultSet *resultSet = [db executeQuery:@"SELECT ROWID, id FROM deleted WHERE ROWID > ? ORDER BY ROWID"
+                                valuesArray:@[@(afterRowId)]
+                                      error:error];
+  if (!resultSet) {
+    return NO;
+  }
+
+  while (YES) {
+
+    BOOL hasResult = NO;
+    if (![resultSet nextReturning:&hasResult error:error]) {
+      [resultSet close];
+      return NO;
+    }
+
+    if (!hasResult) {
+      break;
+    }
+
+    block([resultSet longLongIntForColumnIndex:0], [resultSet dataForColumnIndex:1]);
+  }
+
+  [resultSet close];
+
+  return YES;
+}
+
+// Must be called while holding the writer, so no tombstone is added between the scan & the swap
+-(BOOL) rebuildInDatabase:(FMDatabase *)db error:(NSError **)error
+{
+  NSUInteger capacity = CapacityForCount([db longForQuery:@"SELECT COUNT(*) FROM deleted"]);
+  uint64_t bitCount = (uint64_t)capacity * kBitsPerElement;
+
+  NSMutableData *bits = [NSMutableData dataWithLength:(NSUInteger)(bitCount / 8)];
+  uint8_t *bytes = bits.mutableBytes;
+
+  __block NSUInteger count = 0;
+  __block int64_t lastRowId = 0;
+
+  BOOL valid = [self enumerateTombstonesInDatabase:db afterRowId:0 error:error block:^(int64_t rowId, NSData *idData) {
+    SetBits(bytes, bitCount, idData);
+    count += 1;
+    lastRowId = rowId;
+  }];
+
+  if (!valid) {
+    return NO;
+  }
+
+  @synchronized(self) {
+    _bits = bits;
+    _bitCount = bitCount;
+    _capacity = capacity;
+    _count = count;
+    _lastRowId = lastRowId;
+  }
+
+  @synchronized(_metrics) {
+    _metrics.rebuilds += 1;
+  }
+
+  DDLogInfo(@"Rebuilt deleted message filter with %lu tombstones (capacity %lu)", (unsigned long)count, (unsigned long)capacity);
+
+  [self scheduleSave];
+
+  return YES;
+}
+
+-(void) scheduleSave
+{
+  @synchronized(self) {
+    if (_saveScheduled) {
+      return;
+    }
+    _saveScheduled = YES;
+  }
+
+  dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kSaveDelay * NSEC_PER_SEC)), _queue, ^{
+
+    NSError *error;
+    if (![self saveAndReturnError:&error]) {
+      DDLogError(@"Error saving deleted message filter: %@", error);
+    }
+
+  });
+}
+
+-(BOOL) saveAndReturnError:(NSError **)error
+{
+  FilterFileHeader header = {0};
+  header.magic = kFileMagic;
+  header.version = kFileVersion;
+  header.hashCount = kHashCount;
+
+  @synchronized(_metrics) {
+    header.lastCompacted = _metrics.lastCompacted.timeIntervalSinceReferenceDate;
+  }
+
+  NSMutableData *fileData;
+
+  @synchronized(self) {
+
+    _saveScheduled = NO;
+
+    if (!_bits) {
+      return YES;
+    }
+
+    header.bitCount = _bitCount;
+    header.count = _count;
+    header.lastRowId = _lastRowId;
+
+    fileData = [NSMutableData dataWithCapacity:sizeof(header) + _bits.length];
+    [fileData appendBytes:&header length:sizeof(header)];
+    [fileData appendData:_bits];
+  }
+
+  return [fileData writeToURL:self.fileURL options:NSDataWritingAtomic error:error];
+}
+
+-(void) compactIfNeeded
+{
+  dispatch_async(_queue, ^{
+
+    NSDate *lastCompacted = self.metrics.lastCompacted;
+    if (lastCompacted && -lastCompacted.timeIntervalSinceNow < _compactInterval) {
+      return;
+    }
+
+    NSError *error;
+    if (![self compactAndReturnError:&error]) {
+      DDLogError(@"Error compacting deleted messages: %@", error);
+    }
+
+  });
+}
+
+-(BOOL) compactAndReturnError:(NSError **)error
+{
+  NSDate *start = [NSDate date];
+  NSDate *cutoff = [NSDate dateWithTimeIntervalSinceNow:-_retentionInterval];
+
+  __block NSUInteger removed = 0;
+  __block BOOL valid = NO;
+
+  [_dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+
+    if (![db executeUpdate:@"DELETE FROM deleted WHERE marked < ?" valuesArray:@[cutoff] error:error]) {
+      return;
+    }
+
+    removed = db.changes;
+
+    // A crash before the rebuilt filter is saved is detected at load, the filter never misses a tombstone
+    valid = removed == 0 || [self rebuildInDatabase:db error:error];
+  }];
+
+  if (!valid) {
+    return NO;
+  }
+
+  @synchronized(_metrics) {
+    _metrics.tombstonesCompacted += removed;
+    _metrics.lastCompacted = start;
+  }
+
+  if (removed) {
+    DDLogInfo(@"Compacted %lu deleted message tombstones in %.3fs", (unsigned long)removed, -start.timeIntervalSinceNow);
+  }
+
+  return [self saveAndReturnError:error];
+}
+
+-(BOOL) rebuildAndVerifyReturningError:(NSError **)error
+{
+  __block NSUInteger tombstones = 0;
+  __block NSUInteger missing = 0;
+  __block BOOL valid = NO;
+
+  [_dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+
+    if (![self rebuildInDatabase:db error:error] || ![self saveAndReturnError:error]) {
+      return;
+    }
+
+    // Verify against the saved file, covering both the hashing & the persisted form
+
+    NSData *fileData = [NSData dataWithContentsOfURL:self.fileURL options:0 error:error];
+    if (!fileData) {
+      return;
+    }
+
+    FilterFileHeader header;
+    NSData *bits = BitsFromFileData(fileData, &header);
+    if (!bits) {
+      error && (*error = [NSError errorWithDomain:@"DeletedMessageFilterErrorDomain" code:0 userInfo:@{NSLocalizedDescriptionKey: @"Saved deleted message filter is invalid"}]);
+      return;
+    }
+
+    valid = [self enumerateTombstonesInDatabase:db afterRowId:0 error:error block:^(int64_t rowId, NSData *idData) {
+      tombstones += 1;
+      if (!TestBits(bits.bytes, header.bitCount, idData)) {
+        missing += 1;
+      }
+    }];
+  }];
+
+  if (!valid) {
+    return NO;
+  }
+
+  if (missing) {
+    error && (*error = [NSError errorWithDomain:@"DeletedMessageFilterErrorDomain" code:0 userInfo:@{NSLocalizedDescriptionKey: @"Deleted message filter is missing tombstones",
+                                                                                                        @"missing": @(missing)}]);
+    return NO;
+  }
+
+  DDLogInfo(@"Verified deleted message filter covers all %lu tombstones", (unsigned long)tombstones);
+
+  return YES;
+}
+
+@end
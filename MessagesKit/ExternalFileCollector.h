@@ -0,0 +1,90 @@
+//
+//  ExternalFileCollector.h
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "DBManager.h"
+
+
+NS_ASSUME_NONNULL_BEGIN
+
+
+@protocol ExternalFileOwner <NSObject>
+
+// Names of all external files currently referenced by the owner's rows
+-(nullable NSSet<NSString *> *) referencedExternalFileNamesInDatabase:(FMDatabase *)db error:(NSError **)error;
+
+// Names among `fileNames` that may have been linked again since a scan by the above;
+// reconciliation calls it while holding the writer, so it must be cheap
+-(nullable NSSet<NSString *> *) referencedExternalFileNamesInArray:(NSArray<NSString *> *)fileNames inDatabase:(FMDatabase *)db error:(NSError **)error;
+
+@end
+
+
+@interface ExternalFileCollectorMetrics : NSObject <NSCopying>
+
+@property (readonly, nonatomic) NSUInteger filesReclaimed;
+@property (readonly, nonatomic) NSUInteger orphansReclaimed;
+@property (readonly, nonatomic) unsigned long long bytesReclaimed;
+@property (readonly, nonatomic) NSUInteger failures;
+@property (readonly, nonatomic) NSTimeInterval collectTime;
+@property (readonly, nonatomic) NSTimeInterval reconcileTime;
+@property (readonly, nonatomic, nullable) NSDate *lastReconciled;
+
+@end
+
+
+/*
+ * ExternalFileCollector
+ *
+ * Unlinks journaled external files after the deleting transaction commits,
+ * and removes orphaned files found by reconciling against the database
+ */
+@interface ExternalFileCollector : NSObject
+
+@property (readonly, nonatomic) DBManager *dbManager;
+@property (weak, nonatomic, nullable) id<ExternalFileOwner> owner;
+
+// Number of journaled files unlinked per transaction (default 64)
+@property (assign, nonatomic) NSUInteger batchSize;
+// Unreferenced files younger than this are never treated as orphans (default 1 hour)
+@property (assign, nonatomic) NSTimeInterval orphanGracePeriod;
+// Minimum time between reconciliation passes started via reconcileIfNeeded (default 1 day)
+@property (assign, nonatomic) NSTimeInterval reconcileInterval;
+
+// Directory, relative to the database, holding all newly stored files
+@property (readonly, nonatomic) NSString *directoryName;
+@property (readonly, nonatomic) NSURL *directoryURL;
+
+// Snapshot of cumulative metrics
+@property (readonly, nonatomic) ExternalFileCollectorMetrics *metrics;
+
+// Start of the last completed reconciliation pass, kept in the database across launches
+@property (readonly, nonatomic, nullable) NSDate *lastReconciled;
+
+-(instancetype) init NS_UNAVAILABLE;
+-(instancetype) initWithDBManager:(DBManager *)dbManager NS_DESIGNATED_INITIALIZER;
+
+// Unique file name (relative to the database) for storing a new external file
+-(nullable NSString *) newFileNameWithExtension:(nullable NSString *)extension error:(NSError **)error;
+
+// Joins the current transaction when called from within one
+-(BOOL) journalFileNamed:(NSString *)fileName error:(NSError **)error;
+
+-(NSUInteger) countOfPendingFiles;
+
+// Asynchronously unlinks journaled files; coalesced, and a no-op when nothing was journaled since the last pass
+-(void) collect;
+-(BOOL) collectAndReturnError:(NSError **)error;
+
+// Asynchronously reconciles when reconcileInterval has elapsed since the last pass
+-(void) reconcileIfNeeded;
+-(BOOL) reconcileAndReturnError:(NSError **)error;
+
+@end
+
+
+NS_ASSUME_NONNULL_END
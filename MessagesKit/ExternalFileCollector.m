@@ -0,0 +1,486 @@
+//
+//  ExternalFileCollector.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "ExternalFileCollector.h"
+
+#import "Log.h"
+
+#include <sys/stat.h>
+
+
+MK_DECLARE_LOG_LEVEL()
+
+
+static BOOL IsExternalFileName(NSString *fileName)
+{
+  static NSCharacterSet *nonHexChars;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    nonHexChars = [NSCharacterSet characterSetWithCharactersInString:@"0123456789abcdef"].invertedSet;
+  });
+
+  NSString *baseName = fileName.stringByDeletingPathExtension;
+
+  if (baseName.length == 64 && [baseName rangeOfCharacterFromSet:nonHexChars].location == NSNotFound) {
+    return YES;
+  }
+
+  return [NSUUID.alloc initWithUUIDString:baseName] != nil;
+}
+
+
+@interface ExternalFileCollectorMetrics ()
+
+@property (assign, nonatomic) NSUInteger filesReclaimed;
+@property (assign, nonatomic) NSUInteger orphansReclaimed;
+@property (assign, nonatomic) unsigned long long bytesReclaimed;
+@property (assign, nonatomic) NSUInteger failures;
+@property (assign, nonatomic) NSTimeInterval collectTime;
+@property (assign, nonatomic) NSTimeInterval reconcileTime;
+@property (strong, nonatomic, nullable) NSDate *lastReconciled;
+
+@end
+
+
+@implementation ExternalFileCollectorMetrics
+
+-(id) copyWithZone:(NSZone *)zone
+{
+  ExternalFileCollectorMetrics *copy = [ExternalFileCollectorMetrics new];
+  copy.filesReclaimed = self.filesReclaimed;
+  copy.orphansReclaimed = self.orphansReclaimed;
+  copy.bytesReclaimed = self.bytesReclaimed;
+  copy.failures = self.failures;
+  copy.collectTime = self.collectTime;
+  copy.reconcileTime = self.reconcileTime;
+  copy.lastReconciled = self.lastReconciled;
+  return copy;
+}
+
+-(NSString *) description
+{
+  return [NSString stringWithFormat:@"<files=%lu, orphans=%lu, bytes=%llu, failures=%lu, collectTime=%.3fs, reconcileTime=%.3fs>",
+          (unsigned long)self.filesReclaimed, (unsigned long)self.orphansReclaimed, self.bytesReclaimed,
+          (unsigned long)self.failures, self.collectTime, self.reconcileTime];
+}
+
+@end
+
+
+@interface ExternalFileCollector () {
+  dispatch_queue_t _queue;
+  ExternalFileCollectorMetrics *_metrics;
+  BOOL _collectScheduled;
+  BOOL _journaled;
+}
+
+@end
+
+
+@implementation ExternalFileCollector
+
+-(instancetype) initWithDBManager:(DBManager *)dbManager
+{
+  self = [super init];
+  if (self) {
+    _dbManager = dbManager;
+    _queue = dispatch_queue_create("ExternalFileCollector Queue", DISPATCH_QUEUE_SERIAL);
+    dispatch_set_target_queue(_queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+    _metrics = [ExternalFileCollectorMetrics new];
+    _journaled = YES; // Pick up anything left by a previous run
+    _batchSize = 64;
+    _orphanGracePeriod = 60 * 60;
+    _reconcileInterval = 24 * 60 * 60;
+  }
+  return self;
+}
+
+-(ExternalFileCollectorMetrics *) metrics
+{
+  @synchronized(_metrics) {
+    return [_metrics copy];
+  }
+}
+
+-(BOOL) journalFileNamed:(NSString *)fileName error:(NSError **)error
+{
+  __block BOOL valid = NO;
+
+  [_dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+
+    valid = [db executeUpdate:@"INSERT OR REPLACE INTO pending_file_delete (fileName, queued) VALUES (?, ?)"
+                  valuesArray:@[fileName, [NSDate date]]
+                        error:error];
+
+  }];
+
+  if (valid) {
+    @synchronized(self) {
+      _journaled = YES;
+    }
+  }
+
+  return valid;
+}
+
+-(NSString *) directoryName
+{
+  return [_dbManager.URL.lastPathComponent.stringByDeletingPathExtension stringByAppendingString:@"-files"];
+}
+
+-(NSURL *) directoryURL
+{
+  return [NSURL URLWithString:self.directoryName relativeToURL:_dbManager.URL];
+}
+
+-(NSString *) newFileNameWithExtension:(NSString *)extension error:(NSError **)error
+{
+  if (![NSFileManager.defaultManager createDirectoryAtURL:self.directoryURL withIntermediateDirectories:YES attributes:nil error:error]) {
+    return nil;
+  }
+
+  NSString *fileName = NSUUID.UUID.UUIDString;
+  if (extension.length) {
+    fileName = [fileName stringByAppendingPathExtension:extension];
+  }
+
+  return [self.directoryName stringByAppendingPathComponent:fileName];
+}
+
+-(NSUInteger) countOfPendingFiles
+{
+  __block NSUInteger count = 0;
+
+  [_dbManager.pool inReadableDatabase:^(FMDatabase *db) {
+
+    count = [db intForQuery:@"SELECT COUNT(fileName) FROM pending_file_delete"];
+
+  }];
+
+  return count;
+}
+
+-(void) collect
+{
+  @synchronized(self) {
+    if (_collectScheduled || !_journaled) {
+      return;
+    }
+    _collectScheduled = YES;
+  }
+
+  dispatch_async(_queue, ^{
+
+    @synchronized(self) {
+      _collectScheduled = NO;
+      _journaled = NO;
+    }
+
+    NSError *error;
+    if (![self collectAndReturnError:&error]) {
+      DDLogError(@"Error collecting external files: %@", error);
+    }
+
+  });
+}
+
+-(BOOL) collectAndReturnError:(NSError **)error
+{
+  NSDate *start = [NSDate date];
+  __block NSUInteger files = 0;
+  __block unsigned long long bytes = 0;
+  __block NSUInteger failures = 0;
+
+  while (YES) {
+
+    __block NSUInteger batchCount = 0;
+    __block BOOL valid = NO;
+
+    // Each batch holds the writer, so a journaled file cannot be reused (see ExternalFileStore) while it is unlinked
+
+    [_dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+
+      FMResultSet *resultSet = [db executeQuery:@"SELECT fileName FROM pending_file_delete ORDER BY queued LIMIT ?"
+                                    valuesArray:@[@(_batchSize)]
+                                          error:error];
+      if (!resultSet) {
+        return;
+      }
+
+      NSMutableArray<NSString *> *fileNames = [NSMutableArray array];
+
+      while (YES) {
+
+        BOOL hasResult = NO;
+        if (![resultSet nextReturning:&hasResult error:error]) {
+          [resultSet close];
+          return;
+        }
+
+        if (!hasResult) {
+          break;
+        }
+
+        [fileNames addObject:[resultSet stringForColumnIndex:0]];
+      }
+
+      [resultSet close];
+
+      batchCount = fileNames.count;
+      if (batchCount == 0) {
+        valid = YES;
+        return;
+      }
+
+      for (NSString *fileName in fileNames) {
+
+        unsigned long long size = 0;
+        if ([self removeFileNamed:fileName size:&size]) {
+          files += 1;
+          bytes += size;
+        }
+        else {
+          failures += 1;
+        }
+
+      }
+
+      // Rows are dropped even when unlinking fails; reconciliation will retry orphans
+
+      NSMutableArray *paramSpecs = [NSMutableArray arrayWithCapacity:fileNames.count];
+      for (NSUInteger c = 0; c < fileNames.count; ++c) {
+        [paramSpecs addObject:@"?"];
+      }
+
+      NSString *sql = [NSString stringWithFormat:@"DELETE FROM pending_file_delete WHERE fileName IN (%@)",
+                       [paramSpecs componentsJoinedByString:@","]];
+
+      valid = [db executeUpdate:sql valuesArray:fileNames error:error];
+    }];
+
+    if (!valid) {
+      return NO;
+    }
+
+    if (batchCount < _batchSize) {
+      break;
+    }
+  }
+
+  @synchronized(_metrics) {
+    _metrics.filesReclaimed += files;
+    _metrics.bytesReclaimed += bytes;
+    _metrics.failures += failures;
+    _metrics.collectTime += -start.timeIntervalSinceNow;
+  }
+
+  if (files || failures) {
+    DDLogInfo(@"Collected %lu external files (%llu bytes) with %lu failures in %.3fs",
+              (unsigned long)files, bytes, (unsigned long)failures, -start.timeIntervalSinceNow);
+  }
+
+  return YES;
+}
+
+-(NSDate *) lastReconciled
+{
+  __block NSDate *lastReconciled = nil;
+
+  [_dbManager.pool inReadableDatabase:^(FMDatabase *db) {
+
+    FMResultSet *resultSet = [db executeQuery:@"SELECT MAX(reconciled) FROM file_reconcile" valuesArray:nil error:nil];
+    if ([resultSet next] && ![resultSet columnIndexIsNull:0]) {
+      lastReconciled = [resultSet dateForColumnIndex:0];
+    }
+    [resultSet close];
+
+  }];
+
+  return lastReconciled;
+}
+
+-(void) reconcileIfNeeded
+{
+  dispatch_async(_queue, ^{
+
+    NSDate *lastReconciled = self.lastReconciled;
+    if (lastReconciled && -lastReconciled.timeIntervalSinceNow < _reconcileInterval) {
+      return;
+    }
+
+    NSError *error;
+    if (![self reconcileAndReturnError:&error]) {
+      DDLogError(@"Error reconciling external files: %@", error);
+    }
+
+  });
+}
+
+-(BOOL) reconcileAndReturnError:(NSError **)error
+{
+  NSDate *start = [NSDate date];
+
+  id<ExternalFileOwner> owner = self.owner;
+  if (!owner) {
+    return YES;
+  }
+
+  NSURL *directoryURL = self.directoryURL;
+  NSString *directoryName = self.directoryName;
+
+  NSError *listError;
+  NSArray<NSURL *> *URLs = [NSFileManager.defaultManager contentsOfDirectoryAtURL:directoryURL
+                                                       includingPropertiesForKeys:@[NSURLIsRegularFileKey, NSURLCreationDateKey]
+                                                                          options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                                            error:&listError];
+  if (!URLs) {
+    // Nothing has been stored yet
+    if ([listError.domain isEqualToString:NSCocoaErrorDomain] && listError.code == NSFileReadNoSuchFileError) {
+      URLs = @[];
+    }
+    else {
+      if (error) {
+        *error = listError;
+      }
+      return NO;
+    }
+  }
+
+  __block NSSet *referenced = nil;
+
+  // Scanned from a snapshot, writers are never blocked by it. Files linked after the snapshot
+  // are either younger than the grace period or relinked by the owner, which is re-checked below
+
+  [_dbManager.pool inReadableDatabase:^(FMDatabase *db) {
+
+    if (![db beginDeferredTransaction]) {
+      if (error) {
+        *error = db.lastError;
+      }
+      return;
+    }
+
+    referenced = [owner referencedExternalFileNamesInDatabase:db error:error];
+
+    [db commit];
+  }];
+
+  if (!referenced) {
+    return NO;
+  }
+
+  NSMutableArray<NSString *> *candidates = [NSMutableArray array];
+
+  for (NSURL *URL in URLs) {
+
+    NSString *fileName = [directoryName stringByAppendingPathComponent:URL.lastPathComponent];
+
+    // External files are always named by UUID or content hash; leave anything else alone
+    if (!IsExternalFileName(URL.lastPathComponent) || [referenced containsObject:fileName]) {
+      continue;
+    }
+
+    NSNumber *isRegularFile;
+    NSDate *created;
+    if (![URL getResourceValue:&isRegularFile forKey:NSURLIsRegularFileKey error:nil] || !isRegularFile.boolValue ||
+        ![URL getResourceValue:&created forKey:NSURLCreationDateKey error:nil] || -created.timeIntervalSinceNow < _orphanGracePeriod) {
+      continue;
+    }
+
+    [candidates addObject:fileName];
+  }
+
+  __block unsigned long long bytes = 0;
+  __block NSUInteger files = 0;
+  __block NSUInteger failures = 0;
+
+  for (NSUInteger offset = 0; offset < candidates.count; offset += _batchSize) {
+
+    NSArray<NSString *> *batch = [candidates subarrayWithRange:NSMakeRange(offset, MIN(_batchSize, candidates.count - offset))];
+
+    __block BOOL valid = NO;
+
+    // Orphans are re-checked & unlinked while holding the writer, so none can be relinked in between
+
+    [_dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+
+      NSSet *relinked = [owner referencedExternalFileNamesInArray:batch inDatabase:db error:error];
+      if (!relinked) {
+        return;
+      }
+
+      for (NSString *fileName in batch) {
+
+        if ([relinked containsObject:fileName]) {
+          continue;
+        }
+
+        unsigned long long size = 0;
+        if ([self removeFileNamed:fileName size:&size]) {
+          files += 1;
+          bytes += size;
+        }
+        else {
+          failures += 1;
+        }
+
+      }
+
+      valid = YES;
+    }];
+
+    if (!valid) {
+      return NO;
+    }
+  }
+
+  [_dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+
+    if (![db executeUpdate:@"DELETE FROM file_reconcile" valuesArray:nil error:nil] ||
+        ![db executeUpdate:@"INSERT INTO file_reconcile (reconciled) VALUES (?)" valuesArray:@[start] error:nil]) {
+      DDLogError(@"Unable to save external file reconcile time: %@", db.lastError);
+    }
+
+  }];
+
+  @synchronized(_metrics) {
+    _metrics.orphansReclaimed += files;
+    _metrics.bytesReclaimed += bytes;
+    _metrics.failures += failures;
+    _metrics.reconcileTime += -start.timeIntervalSinceNow;
+    _metrics.lastReconciled = start;
+  }
+
+  DDLogInfo(@"Reconciled external files, removed %lu orphans (%llu bytes) with %lu failures in %.3fs",
+            (unsigned long)files, bytes, (unsigned long)failures, -start.timeIntervalSinceNow);
+
+  return YES;
+}
+
+-(BOOL) removeFileNamed:(NSString *)fileName size:(unsigned long long *)size
+{
+  NSURL *URL = [NSURL URLWithString:fileName relativeToURL:_dbManager.URL];
+
+  struct stat st;
+  if (stat(URL.fileSystemRepresentation, &st) != 0) {
+    // Already gone
+    return errno == ENOENT;
+  }
+
+  if (unlink(URL.fileSystemRepresentation) != 0) {
+    int unlinkErrno = errno;
+    DDLogError(@"Unable to unlink external file %@: %d", fileName, unlinkErrno);
+    return unlinkErrno == ENOENT;
+  }
+
+  *size = st.st_nlink > 1 ? 0 : st.st_size;
+
+  return YES;
+}
+
+@end
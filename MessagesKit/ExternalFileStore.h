@@ -0,0 +1,75 @@
+//
+//  ExternalFileStore.h
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "DataReference.h"
+#import "ExternalFileCollector.h"
+
+
+NS_ASSUME_NONNULL_BEGIN
+
+
+/*
+ * StagedExternalFile
+ *
+ * Data hashed (and written, unless identical data was already stored)
+ * ahead of the transaction storing it
+ */
+@interface StagedExternalFile : NSObject
+
+@property (readonly, nonatomic) id<DataReference> data;
+@property (readonly, nonatomic) NSString *fileName;
+@property (readonly, nonatomic) unsigned long long size;
+// Content written ahead, nil when the file was already stored
+@property (readonly, nonatomic, nullable) NSURL *tempURL;
+
+@end
+
+
+/*
+ * ExternalFileStore
+ *
+ * Content addressed store for external files. Files are named by the
+ * SHA-256 of their contents and reference counted in the `blob` table,
+ * so identical payloads are stored once. Files whose last reference is
+ * released are handed to the collector.
+ */
+@interface ExternalFileStore : NSObject
+
+@property (readonly, nonatomic) DBManager *dbManager;
+@property (readonly, nonatomic) ExternalFileCollector *collector;
+
+-(instancetype) init NS_UNAVAILABLE;
+-(instancetype) initWithDBManager:(DBManager *)dbManager collector:(ExternalFileCollector *)collector NS_DESIGNATED_INITIALIZER;
+
+// Stores (or adds a reference to identical) data returning its file name relative
+// to the database; joins the current transaction when called from within one
+-(nullable NSString *) storeDataReference:(id<DataReference>)data error:(NSError **)error;
+
+// Hashes data, writing it to a temporary file only when no identical file is stored;
+// must be called outside of transactions, so the writer is never held while doing so
+-(nullable StagedExternalFile *) stageDataReference:(id<DataReference>)data error:(NSError **)error;
+
+// Stores staged data like storeDataReference:error:, joining the current transaction
+-(nullable NSString *) storeStagedFile:(StagedExternalFile *)staged error:(NSError **)error;
+
+// Removes anything left by staging, once stored or abandoned
+-(void) discardStagedFile:(StagedExternalFile *)staged;
+
+// Drops a reference returned by storeDataReference:error:, journaling the file
+// for collection when it was the last one
+-(BOOL) releaseFileNamed:(NSString *)fileName error:(NSError **)error;
+
+-(NSUInteger) referenceCountForFileNamed:(NSString *)fileName;
+
+// Bytes that would be used by storing every reference separately, minus bytes used
+-(unsigned long long) bytesSavedByDeduplication;
+
+@end
+
+
+NS_ASSUME_NONNULL_END
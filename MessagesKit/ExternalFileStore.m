@@ -0,0 +1,280 @@
+//
+//  ExternalFileStore.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "ExternalFileStore.h"
+
+#import "ExternalFileDataReference.h"
+#import "DataReferences.h"
+#import "NSData+Encoding.h"
+#import "NSURL+Utils.h"
+#import "Log.h"
+
+
+MK_DECLARE_LOG_LEVEL()
+
+
+@interface StagedExternalFile ()
+
+@property (strong, nonatomic) id<DataReference> data;
+@property (copy, nonatomic) NSString *fileName;
+@property (assign, nonatomic) unsigned long long size;
+@property (strong, nonatomic, nullable) NSURL *tempURL;
+
+@end
+
+
+@implementation StagedExternalFile
+
+@end
+
+
+@implementation ExternalFileStore
+
+-(instancetype) initWithDBManager:(DBManager *)dbManager collector:(ExternalFileCollector *)collector
+{
+  self = [super init];
+  if (self) {
+    _dbManager = dbManager;
+    _collector = collector;
+  }
+  return self;
+}
+
+-(NSString *) storeDataReference:(id<DataReference>)data error:(NSError **)error
+{
+  StagedExternalFile *staged = [self stageDataReference:data error:error];
+  if (!staged) {
+    return nil;
+  }
+
+  NSString *fileName = [self storeStagedFile:staged error:error];
+
+  [self discardStagedFile:staged];
+
+  return fileName;
+}
+
+-(BOOL) isFileNamedStored:(NSString *)fileName
+{
+  __block BOOL stored = NO;
+
+  [_dbManager.pool inReadableDatabase:^(FMDatabase *db) {
+
+    stored = [db intForQuery:@"SELECT COUNT(fileName) FROM blob WHERE fileName = ?", fileName] > 0;
+
+  }];
+
+  return stored;
+}
+
+-(NSString *) fileNameForDigest:(NSData *)digest MIMEType:(NSString *)MIMEType
+{
+  NSString *fileName = digest.hexEncodedString;
+
+  NSString *extension = [NSURL extensionForMimeType:MIMEType];
+  if (extension.length) {
+    fileName = [fileName stringByAppendingPathExtension:extension];
+  }
+
+  return [_collector.directoryName stringByAppendingPathComponent:fileName];
+}
+
+-(StagedExternalFile *) stageDataReference:(id<DataReference>)data error:(NSError **)error
+{
+  StagedExternalFile *staged = [StagedExternalFile new];
+  staged.data = data;
+
+  // Files already in the store only need another reference
+
+  if ([data isKindOfClass:ExternalFileDataReference.class] && [(ExternalFileDataReference *)data dbManager] == _dbManager) {
+
+    NSString *fileName = [(ExternalFileDataReference *)data fileName];
+
+    if ([self isFileNamedStored:fileName]) {
+      staged.fileName = fileName;
+      return staged;
+    }
+
+    // Files stored before the store existed are hashed like any other data
+  }
+
+  // Hashed before writing anything, duplicates cost a single read
+
+  unsigned long long size = 0;
+  NSData *digest = nil;
+  if (![DataReferences digestReference:data length:&size digest:&digest error:error]) {
+    return nil;
+  }
+
+  staged.fileName = [self fileNameForDigest:digest MIMEType:data.MIMEType];
+  staged.size = size;
+
+  if ([self isFileNamedStored:staged.fileName]) {
+    return staged;
+  }
+
+  if (![self writeStagedFile:staged error:error]) {
+    return nil;
+  }
+
+  return staged;
+}
+
+-(BOOL) writeStagedFile:(StagedExternalFile *)staged error:(NSError **)error
+{
+  NSString *tempFileName = [_collector newFileNameWithExtension:nil error:error];
+  if (!tempFileName) {
+    return NO;
+  }
+
+  NSURL *tempURL = [NSURL URLWithString:tempFileName relativeToURL:_dbManager.URL];
+
+  unsigned long long size = 0;
+  NSData *digest = nil;
+  if (![DataReferences filterReference:staged.data toURL:tempURL usingFilter:nil length:&size digest:&digest error:error]) {
+    return NO;
+  }
+
+  // Named by what was written, should the source have changed since hashing
+  staged.fileName = [self fileNameForDigest:digest MIMEType:staged.data.MIMEType];
+  staged.size = size;
+  staged.tempURL = tempURL;
+
+  return YES;
+}
+
+-(NSString *) storeStagedFile:(StagedExternalFile *)staged error:(NSError **)error
+{
+  __block BOOL valid = NO;
+
+  [_dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+
+    if (![db executeUpdate:@"UPDATE blob SET refs = refs + 1 WHERE fileName = ?" valuesArray:@[staged.fileName] error:error]) {
+      *rollback = YES;
+      return;
+    }
+
+    if (db.changes > 0) {
+      DDLogInfo(@"Deduplicated external file %@", staged.fileName);
+      valid = YES;
+      return;
+    }
+
+    // Released since staging (or never stored); only then is anything written while holding the writer
+
+    if (!staged.tempURL && ![self writeStagedFile:staged error:error]) {
+      *rollback = YES;
+      return;
+    }
+
+    // A file released earlier may still be awaiting collection, it is replaced below
+
+    if (![db executeUpdate:@"DELETE FROM pending_file_delete WHERE fileName = ?" valuesArray:@[staged.fileName] error:error]) {
+      *rollback = YES;
+      return;
+    }
+
+    // Always published from the fresh copy, replacing any unreferenced file left on disk;
+    // the collector only unlinks while holding the writer, after checking the blob table
+
+    NSURL *URL = [NSURL URLWithString:staged.fileName relativeToURL:_dbManager.URL];
+
+    if (rename(staged.tempURL.fileSystemRepresentation, URL.fileSystemRepresentation) != 0) {
+      if (error) {
+        *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+      }
+      *rollback = YES;
+      return;
+    }
+
+    staged.tempURL = nil;
+
+    if (![db executeUpdate:@"INSERT INTO blob (fileName, size, refs) VALUES (?, ?, 1)" valuesArray:@[staged.fileName, @(staged.size)] error:error]) {
+      *rollback = YES;
+      return;
+    }
+
+    valid = YES;
+  }];
+
+  return valid ? staged.fileName : nil;
+}
+
+-(void) discardStagedFile:(StagedExternalFile *)staged
+{
+  // Left over when deduplicated, or when storing failed
+  if (staged.tempURL) {
+    [NSFileManager.defaultManager removeItemAtURL:staged.tempURL error:nil];
+    staged.tempURL = nil;
+  }
+}
+
+-(BOOL) releaseFileNamed:(NSString *)fileName error:(NSError **)error
+{
+  __block BOOL valid = NO;
+
+  [_dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+
+    if (![db executeUpdate:@"UPDATE blob SET refs = refs - 1 WHERE fileName = ?" valuesArray:@[fileName] error:error]) {
+      *rollback = YES;
+      return;
+    }
+
+    if (db.changes > 0) {
+
+      if (![db executeUpdate:@"DELETE FROM blob WHERE fileName = ? AND refs <= 0" valuesArray:@[fileName] error:error]) {
+        *rollback = YES;
+        return;
+      }
+
+      if (db.changes == 0) {
+        // Still referenced
+        valid = YES;
+        return;
+      }
+
+    }
+
+    if (![_collector journalFileNamed:fileName error:error]) {
+      *rollback = YES;
+      return;
+    }
+
+    valid = YES;
+  }];
+
+  return valid;
+}
+
+-(NSUInteger) referenceCountForFileNamed:(NSString *)fileName
+{
+  __block NSUInteger refs = 0;
+
+  [_dbManager.pool inReadableDatabase:^(FMDatabase *db) {
+
+    refs = [db intForQuery:@"SELECT refs FROM blob WHERE fileName = ?", fileName];
+
+  }];
+
+  return refs;
+}
+
+-(unsigned long long) bytesSavedByDeduplication
+{
+  __block unsigned long long saved = 0;
+
+  [_dbManager.pool inReadableDatabase:^(FMDatabase *db) {
+
+    saved = (unsigned long long)[db longForQuery:@"SELECT ifnull(SUM((refs - 1) * size), 0) FROM blob WHERE refs > 1"];
+
+  }];
+
+  return saved;
+}
+
+@end
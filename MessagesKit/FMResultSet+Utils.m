@@ -11,7 +11,12 @@
 #import "Messages+Exts.h"
 #import "ExternalFileDataReference.h"
 #import "DataReferences.h"
+#import "Log.h"
 
+#import <sqlite3.h>
+
+
+MK_DECLARE_LOG_LEVEL()
 
 
 @interface DataReferenceInflater : NSObject <NSKeyedUnarchiverDelegate>
@@ -50,14 +55,30 @@
 
 -(Id *) idForColumn:(NSString *)columnName
 {
-  NSData *val = [self dataForColumn:columnName];
-  return val ? [Id idWithData:val] : nil;
+  return [self idForColumnIndex:[self columnIndexForName:columnName]];
 }
 
 -(Id *) idForColumnIndex:(int)columnIdx
 {
-  NSData *val = [self dataForColumnIndex:columnIdx];
-  return val ? [Id idWithData:val] : nil;
+  // Read in place, without an intermediate NSData
+  sqlite3_stmt *stmt = self.statement.statement;
+  if (columnIdx < 0 || sqlite3_column_type(stmt, columnIdx) == SQLITE_NULL) {
+    return nil;
+  }
+
+  const void *bytes = sqlite3_column_blob(stmt, columnIdx);
+  if (!bytes) {
+    return nil;
+  }
+
+  // Corrupt values are reported rather than mistaken for another (e.g. null) id
+  int length = sqlite3_column_bytes(stmt, columnIdx);
+  if (length != 16) {
+    DDLogError(@"Invalid id in column %@: %d bytes", [self columnNameForIndex:columnIdx], length);
+    return nil;
+  }
+
+  return [Id.alloc initWithBytes:bytes];
 }
 
 -(CGSize) sizeForColumn:(NSString *)columnName
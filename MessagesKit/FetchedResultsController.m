@@ -197,6 +197,32 @@ NSComparisonResult sortObjects(NSArray *sortDescriptors, id obj1, id obj2);
   }
 }
 
+-(void) modelObjectsWithDbIds:(NSArray *)dbIds updatedInDAO:(DAO *)dao
+{
+  if (dao != _dao) {
+    return;
+  }
+
+  @synchronized(self) {
+
+    [_changeSet addObject:@[@3, dbIds]];
+
+  }
+}
+
+-(void) modelObjectsWithDbIds:(NSArray *)dbIds deletedInDAO:(DAO *)dao
+{
+  if (dao != _dao) {
+    return;
+  }
+
+  @synchronized(self) {
+
+    [_changeSet addObject:@[@4, dbIds]];
+
+  }
+}
+
 -(void) modelObjectsDidChangeInDAO:(DAO *)dao
 {
   NSArray *changeSet;
@@ -229,6 +255,14 @@ NSComparisonResult sortObjects(NSArray *sortDescriptors, id obj1, id obj2);
           [self processDelete:change[1]];
           break;
 
+        case 3:
+          [self processUpdatesWithDbIds:change[1]];
+          break;
+
+        case 4:
+          [self processDeletesWithDbIds:change[1]];
+          break;
+
         default:
           break;
         }
@@ -330,6 +364,84 @@ NSComparisonResult sortObjects(NSArray *sortDescriptors, id obj1, id obj2);
 
 }
 
+-(NSArray *) _trackedObjectsWithDbIds:(NSArray *)dbIds
+{
+  NSSet *dbIdSet = [NSSet setWithArray:dbIds];
+
+  NSMutableArray *tracked = [NSMutableArray array];
+  for (Model *model in _resultsPending) {
+    if ([dbIdSet containsObject:model.dbId]) {
+      [tracked addObject:model];
+    }
+  }
+
+  return tracked;
+}
+
+-(void) processUpdatesWithDbIds:(NSArray *)dbIds
+{
+  NSArray *tracked = [self _trackedObjectsWithDbIds:dbIds];
+
+  for (Model *model in tracked) {
+
+    Model *current = [_dao refreshObject:model];
+
+    if (current && (!_request.predicate || [_request.predicate evaluateWithObject:current])) {
+      [self processUpdate:current.copy];
+    }
+    else {
+      [self processDelete:model];
+    }
+  }
+
+  // Untracked objects the update moved into the results are loaded & inserted;
+  // the request's predicate is part of the query so non-matching rows never load
+
+  NSSet *trackedDbIds = [NSSet setWithArray:[tracked valueForKey:@"dbId"]];
+
+  NSMutableArray *untrackedDbIds = [NSMutableArray arrayWithCapacity:dbIds.count];
+  for (id dbId in dbIds) {
+    if (![trackedDbIds containsObject:dbId]) {
+      [untrackedDbIds addObject:dbId];
+    }
+  }
+
+  static const NSUInteger maxParameters = 500;
+
+  for (NSUInteger start = 0; start < untrackedDbIds.count; start += maxParameters) {
+
+    NSArray *batch = [untrackedDbIds subarrayWithRange:NSMakeRange(start, MIN(maxParameters, untrackedDbIds.count - start))];
+
+    NSPredicate *predicate = [NSPredicate predicateWithFormat:@"id IN %@", batch];
+    if (_request.predicate) {
+      predicate = [NSCompoundPredicate andPredicateWithSubpredicates:@[_request.predicate, predicate]];
+    }
+
+    NSError *error;
+    NSArray *untracked = [_dao fetchAllObjectsMatching:predicate offset:0 limit:0 sortedBy:nil error:&error];
+    if (!untracked) {
+      NSLog(@"FetchedResultsController: unable to load updated objects: %@", error);
+      return;
+    }
+
+    for (Model *model in untracked) {
+
+      if (!_isMatchingInstance(model, _isMatchingInstanceSEL, _request.resultClass)) {
+        continue;
+      }
+
+      [self processInsert:model.copy];
+    }
+  }
+}
+
+-(void) processDeletesWithDbIds:(NSArray *)dbIds
+{
+  for (Model *model in [self _trackedObjectsWithDbIds:dbIds]) {
+    [self processDelete:model];
+  }
+}
+
 -(NSUInteger) _insertionIndexOfObject:(id)object
 {
   NSRange indexRange = {0, _resultsPending.count};
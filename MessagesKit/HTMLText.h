@@ -10,6 +10,15 @@
 @import UIKit;
 
 
+/*
+ * HTMLTextParser
+ *
+ * Converts HTML message bodies to attributed strings & plain text.
+ *
+ * Results are kept in a shared, cost limited cache keyed by a hash of
+ * the HTML, so redisplaying or re-searching a message does not parse it
+ * again.
+ */
 @interface HTMLTextParser : NSObject
 
 -(instancetype) initWithDefaultFont:(UIFont *)font;
@@ -17,6 +26,11 @@
 -(NSAttributedString *) parseWithData:(NSData *)data;
 -(NSAttributedString *) parseWithString:(NSString *)string;
 
+// Text content of the HTML, extracted from the token stream without building a document
 +(NSString *) extractText:(NSData *)data;
 
+// Limit, in bytes (approximately), of the shared caches (default 4MB each)
++(void) setCacheCostLimit:(NSUInteger)costLimit;
++(void) purgeCache;
+
 @end
@@ -8,6 +8,8 @@
 
 #import "HTMLText.h"
 
+#import "NSData+CommonDigest.h"
+#import "NSData+Encoding.h"
 #import "NSString+Utils.h"
 #import "UIFont+Utils.h"
 
@@ -15,6 +17,12 @@
 @import MobileCoreServices;
 
 
+static const NSUInteger HTMLTextCacheDefaultCostLimit = 4 * 1024 * 1024;
+
+static NSCache *textCache;
+static NSCache *attributedTextCache;
+
+
 @interface HTMLTextParser ()
 
 @property (strong, nonatomic) NSMutableAttributedString *result;
@@ -25,6 +33,33 @@
 
 @implementation HTMLTextParser
 
++(void) initialize
+{
+  if (self != HTMLTextParser.class) {
+    return;
+  }
+
+  textCache = [NSCache new];
+  textCache.name = @"HTMLTextParser.text";
+  textCache.totalCostLimit = HTMLTextCacheDefaultCostLimit;
+
+  attributedTextCache = [NSCache new];
+  attributedTextCache.name = @"HTMLTextParser.attributedText";
+  attributedTextCache.totalCostLimit = HTMLTextCacheDefaultCostLimit;
+}
+
++(void) setCacheCostLimit:(NSUInteger)costLimit
+{
+  textCache.totalCostLimit = costLimit;
+  attributedTextCache.totalCostLimit = costLimit;
+}
+
++(void) purgeCache
+{
+  [textCache removeAllObjects];
+  [attributedTextCache removeAllObjects];
+}
+
 -(instancetype) init
 {
   return [self initWithDefaultFont:[UIFont systemFontOfSize:UIFont.systemFontSize]];
@@ -32,6 +67,7 @@
 
 -(instancetype) initWithDefaultFont:(UIFont *)font
 {
+  self = [super init];
   if (self) {
     self.result = [NSMutableAttributedString new];
     self.defaultFont = font;
@@ -41,22 +77,65 @@
 
 -(NSAttributedString *) parseWithString:(NSString *)string
 {
+  NSString *key = [self cacheKeyWithPrefix:@"s" digest:[string dataUsingEncoding:NSUTF8StringEncoding].sha256];
+
+  NSAttributedString *res = [attributedTextCache objectForKey:key];
+  if (res) {
+    return res;
+  }
+
   HTMLDocument *doc = [HTMLDocument documentWithString:string];
   if (!doc) {
     return [[NSAttributedString alloc] initWithString:@""];
   }
 
-  return [self parse:doc];
+  res = [[self parse:doc] copy];
+
+  [attributedTextCache setObject:res forKey:key cost:[self cacheCostOfAttributedString:res]];
+
+  return res;
 }
 
 -(NSAttributedString *) parseWithData:(NSData *)data
 {
+  NSString *key = [self cacheKeyWithPrefix:@"d" digest:data.sha256];
+
+  NSAttributedString *res = [attributedTextCache objectForKey:key];
+  if (res) {
+    return res;
+  }
+
   HTMLDocument *doc = [HTMLDocument documentWithData:data contentTypeHeader:@"text/html"];
   if (!doc) {
     return [[NSAttributedString alloc] initWithString:@""];
   }
 
-  return [self parse:doc];
+  res = [[self parse:doc] copy];
+
+  [attributedTextCache setObject:res forKey:key cost:[self cacheCostOfAttributedString:res]];
+
+  return res;
+}
+
+-(NSUInteger) cacheCostOfAttributedString:(NSAttributedString *)string
+{
+  __block NSUInteger cost = string.length * sizeof(unichar);
+
+  // Inline images keep their decoded data, which dwarfs the characters
+  [string enumerateAttribute:NSAttachmentAttributeName
+                     inRange:NSMakeRange(0, string.length)
+                     options:0
+                  usingBlock:^(NSTextAttachment *attachment, NSRange range, BOOL *stop) {
+    cost += attachment.contents.length;
+  }];
+
+  return cost;
+}
+
+-(NSString *) cacheKeyWithPrefix:(NSString *)prefix digest:(NSData *)digest
+{
+  // Attributes depend on the default font as well as the content
+  return [NSString stringWithFormat:@"%@:%@:%@:%g", prefix, digest.hexEncodedString, _defaultFont.fontName, _defaultFont.pointSize];
 }
 
 -(NSAttributedString *) parse:(HTMLDocument *)doc
@@ -149,7 +228,155 @@
 
 +(NSString *) extractText:(NSData *)data
 {
-  return [HTMLDocument documentWithData:data contentTypeHeader:@"text/html"].textContent;
+  NSData *digest = data.sha256;
+
+  NSString *text = [textCache objectForKey:digest];
+  if (text) {
+    return text;
+  }
+
+  NSString *html;
+  HTMLStringEncoding encoding = DeterminedStringEncodingForData(data, @"text/html", &html);
+
+  NSStringEncoding declaredEncoding = encoding.encoding;
+  text = [self extractTextFromString:html ?: @"" declaredEncoding:encoding.confidence == Tentative ? &declaredEncoding : NULL];
+
+  // A <meta> charset overrides a guessed encoding; like the document parser, start over with it
+  if (declaredEncoding != encoding.encoding) {
+    NSString *redecoded = [[NSString alloc] initWithData:data encoding:declaredEncoding];
+    if (redecoded) {
+      text = [self extractTextFromString:redecoded declaredEncoding:NULL];
+    }
+  }
+
+  [textCache setObject:text forKey:digest cost:text.length * sizeof(unichar)];
+
+  return text;
+}
+
+/*
+ * Concatenates the character tokens of the HTML, as HTMLDocument's
+ * textContent would, without building the document tree. The tokenizer
+ * state switches & whitespace handling the tree builder applies are
+ * mirrored so the results match for message content.
+ *
+ * When declaredEncoding is provided (holding the guessed encoding), the
+ * first <meta> tag declaring an encoding is checked; extraction stops
+ * there if it declares a different one, returning it in declaredEncoding.
+ */
++(NSString *) extractTextFromString:(NSString *)html declaredEncoding:(NSStringEncoding *)declaredEncoding
+{
+  NSMutableString *text = [NSMutableString new];
+
+  HTMLTokenizer *tokenizer = [[HTMLTokenizer alloc] initWithString:html];
+
+  // Whitespace before the head (or first content) is not part of the document
+  BOOL leading = YES;
+  // A newline directly after <pre>, <listing> or <textarea> is dropped
+  BOOL skipNewline = NO;
+
+  id token;
+  while ((token = tokenizer.nextObject)) {
+
+    BOOL skipNewlineToken = skipNewline;
+    skipNewline = NO;
+
+    if ([token isKindOfClass:HTMLCharacterToken.class]) {
+
+      HTMLCharacterToken *characters = token;
+      NSString *string = characters.string;
+
+      if (leading) {
+        string = characters.afterLeadingWhitespaceToken.string;
+        if (!string) {
+          continue;
+        }
+        leading = NO;
+      }
+
+      if (skipNewlineToken && [string hasPrefix:@"\n"]) {
+        string = [string substringFromIndex:1];
+      }
+
+      [text appendString:string];
+
+    }
+    else if ([token isKindOfClass:HTMLStartTagToken.class]) {
+
+      HTMLStartTagToken *tag = token;
+      NSString *tagName = tag.tagName;
+
+      if (![tagName isEqualToString:@"html"]) {
+        leading = NO;
+      }
+
+      if ([tagName isEqualToString:@"title"] || [tagName isEqualToString:@"textarea"]) {
+        tokenizer.state = HTMLRCDATATokenizerState;
+      }
+      else if ([tagName isEqualToString:@"style"] || [tagName isEqualToString:@"xmp"] || [tagName isEqualToString:@"iframe"] ||
+               [tagName isEqualToString:@"noembed"] || [tagName isEqualToString:@"noframes"]) {
+        tokenizer.state = HTMLRAWTEXTTokenizerState;
+      }
+      else if ([tagName isEqualToString:@"script"]) {
+        tokenizer.state = HTMLScriptDataTokenizerState;
+      }
+      else if ([tagName isEqualToString:@"plaintext"]) {
+        tokenizer.state = HTMLPLAINTEXTTokenizerState;
+      }
+      else if ([tagName isEqualToString:@"meta"] && declaredEncoding) {
+        NSStringEncoding encoding = [self encodingDeclaredByMetaAttributes:tag.attributes];
+        if (encoding != InvalidStringEncoding()) {
+          if (encoding != *declaredEncoding) {
+            *declaredEncoding = encoding;
+            return text;
+          }
+          // Confirmed, later declarations are ignored
+          declaredEncoding = NULL;
+        }
+      }
+
+      skipNewline = [tagName isEqualToString:@"pre"] || [tagName isEqualToString:@"listing"] || [tagName isEqualToString:@"textarea"];
+
+    }
+
+  }
+
+  return text;
+}
+
++(NSStringEncoding) encodingDeclaredByMetaAttributes:(HTMLOrderedDictionary *)attributes
+{
+  NSString *label = attributes[@"charset"];
+
+  if (!label && [attributes[@"http-equiv"] isEqualToStringCI:@"Content-Type"]) {
+
+    NSScanner *scanner = [NSScanner scannerWithString:attributes[@"content"] ?: @""];
+    scanner.caseSensitive = NO;
+
+    [scanner scanUpToString:@"charset=" intoString:nil];
+    if ([scanner scanString:@"charset=" intoString:nil]) {
+      if (![scanner scanString:@"\"" intoString:nil]) {
+        [scanner scanString:@"'" intoString:nil];
+      }
+      [scanner scanUpToCharactersFromSet:[NSCharacterSet characterSetWithCharactersInString:@"\"';"] intoString:&label];
+    }
+
+  }
+
+  if (!label) {
+    return InvalidStringEncoding();
+  }
+
+  NSStringEncoding encoding = StringEncodingForLabel(label);
+  if (IsUTF16Encoding(encoding)) {
+    // Bytes that decoded as ASCII compatible cannot actually be UTF-16
+    return NSUTF8StringEncoding;
+  }
+  if (encoding != InvalidStringEncoding() && !IsASCIICompatibleEncoding(encoding)) {
+    return InvalidStringEncoding();
+  }
+
+  return encoding;
 }
 
 @end
@@ -0,0 +1,38 @@
+//
+//  Id.h
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import <Thrift/TBase.h>
+
+
+/*
+ * Id
+ *
+ * Hand written implementation of the Thrift `Id` struct, which must be
+ * removed from the generated Messages.h/.m after regenerating. The 16
+ * bytes are stored inline, and compared & hashed as two words; `data`
+ * is a view created on first use (e.g. for binding) and kept.
+ *
+ * Only 16 byte values are accepted; a nil `data` remains nil.
+ */
+@interface Id : NSObject <TBase, NSCoding, NSCopying>
+
+@property (strong, nonatomic) NSData *data;
+@property (assign, nonatomic) BOOL dataIsSet;
+-(void) unsetData;
+
+// The inline value; all zeros when `data` is nil or unset
+@property (readonly, nonatomic) const void *bytes NS_RETURNS_INNER_POINTER;
+
+// Returns nil for data of any length but 16
+-(instancetype) initWithData:(NSData *)data;
+-(instancetype) initWithBytes:(const void *)bytes;
+
+@end
+
@@ -0,0 +1,223 @@
+//
+//  Id.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "Id.h"
+
+#import <Thrift/TProtocol.h>
+#import <Thrift/TProtocolError.h>
+#import <Thrift/TProtocolUtil.h>
+
+
+enum { IdLength = 16 };
+
+
+@implementation Id {
+  // Inline value; compared & hashed as two words
+  union {
+    UInt8 bytes[IdLength];
+    UInt64 words[2];
+  } _value;
+  // Set when `data` is non-nil
+  BOOL _hasValue;
+}
+
+@synthesize data = _data;
+
+-(instancetype) initWithData:(NSData *)data
+{
+  if (data && data.length != IdLength) {
+    return nil;
+  }
+
+  self = [super init];
+  if (self) {
+    self.data = data;
+  }
+  return self;
+}
+
+-(instancetype) initWithBytes:(const void *)bytes
+{
+  self = [super init];
+  if (self) {
+    memcpy(_value.bytes, bytes, IdLength);
+    _hasValue = YES;
+    _dataIsSet = YES;
+  }
+  return self;
+}
+
+-(instancetype) initWithCoder:(NSCoder *)decoder
+{
+  self = [super init];
+  if (self) {
+    if ([decoder containsValueForKey:@"data"]) {
+      NSData *data = [decoder decodeObjectForKey:@"data"];
+      if (data && data.length != IdLength) {
+        return nil;
+      }
+      self.data = data;
+    }
+  }
+  return self;
+}
+
+-(void) encodeWithCoder:(NSCoder *)encoder
+{
+  if (_dataIsSet) {
+    [encoder encodeObject:self.data forKey:@"data"];
+  }
+}
+
+-(NSUInteger) hash
+{
+  UInt64 hash = _value.words[0] ^ _value.words[1];
+  return (NSUInteger)(hash ^ (hash >> 32));
+}
+
+-(BOOL) isEqual:(id)anObject
+{
+  if (self == anObject) {
+    return YES;
+  }
+  if (![anObject isKindOfClass:[Id class]]) {
+    return NO;
+  }
+  Id *other = (Id *)anObject;
+  return _dataIsSet == other->_dataIsSet &&
+         _hasValue == other->_hasValue &&
+         _value.words[0] == other->_value.words[0] &&
+         _value.words[1] == other->_value.words[1];
+}
+
+-(instancetype) copyWithZone:(NSZone *)zone
+{
+  Id *val = [Id new];
+  val->_value = _value;
+  val->_hasValue = _hasValue;
+  val->_dataIsSet = _dataIsSet;
+  val->_data = _data;
+  return val;
+}
+
+-(const void *) bytes
+{
+  return _value.bytes;
+}
+
+-(NSData *) data
+{
+  NSData *data = _data;
+  if (!data && _hasValue) {
+    // Created once; Ids are shared between threads
+    @synchronized(self) {
+      if (!_data) {
+        _data = [NSData dataWithBytes:_value.bytes length:IdLength];
+      }
+      data = _data;
+    }
+  }
+  return data;
+}
+
+-(void) setData:(NSData *)data
+{
+  if (data && data.length != IdLength) {
+    [NSException raise:NSInvalidArgumentException format:@"Id data must be %lu bytes, not %lu",
+                                                          (unsigned long)IdLength, (unsigned long)data.length];
+  }
+
+  memset(&_value, 0, sizeof(_value));
+  if (data) {
+    memcpy(_value.bytes, data.bytes, IdLength);
+  }
+  _hasValue = data != nil;
+  _data = [data copy];
+  _dataIsSet = YES;
+}
+
+-(void) unsetData
+{
+  memset(&_value, 0, sizeof(_value));
+  _hasValue = NO;
+  _data = nil;
+  _dataIsSet = NO;
+}
+
+-(BOOL) read:(id <TProtocol>)inProtocol error:(NSError *__autoreleasing *)__thriftError
+{
+  NSString *fieldName;
+  SInt32 fieldType;
+  SInt32 fieldID;
+
+  if (![inProtocol readStructBeginReturningName:NULL error:__thriftError]) return NO;
+  while (true) {
+    if (![inProtocol readFieldBeginReturningName:&fieldName type:&fieldType fieldID:&fieldID error:__thriftError]) return NO;
+    if (fieldType == TTypeSTOP) {
+      break;
+    }
+    switch (fieldID) {
+      case 1:
+        if (fieldType == TTypeSTRING) {
+          NSData *fieldValue;
+          if (![inProtocol readBinary:&fieldValue error:__thriftError]) return NO;
+          if (fieldValue.length != IdLength) {
+            if (__thriftError) {
+              *__thriftError = [NSError errorWithDomain:TProtocolErrorDomain
+                                                   code:TProtocolErrorInvalidData
+                                               userInfo:@{TProtocolErrorFieldNameKey: @"data"}];
+            }
+            return NO;
+          }
+          self.data = fieldValue;
+        }
+        else {
+          NSLog(@"%s: field ID %i has unexpected type %i.  Skipping.", __PRETTY_FUNCTION__, (int)fieldID, (int)fieldType);
+          if (![TProtocolUtil skipType:fieldType onProtocol:inProtocol error:__thriftError]) return NO;
+        }
+        break;
+      default:
+        NSLog(@"%s: unexpected field ID %i with type %i.  Skipping.", __PRETTY_FUNCTION__, (int)fieldID, (int)fieldType);
+        if (![TProtocolUtil skipType:fieldType onProtocol:inProtocol error:__thriftError]) return NO;
+        break;
+    }
+    if (![inProtocol readFieldEnd:__thriftError]) return NO;
+  }
+  if (![inProtocol readStructEnd:__thriftError]) return NO;
+  if (![self validate:__thriftError]) return NO;
+  return YES;
+}
+
+-(BOOL) write:(id <TProtocol>)outProtocol error:(NSError *__autoreleasing *)__thriftError
+{
+  if (![outProtocol writeStructBeginWithName:@"Id" error:__thriftError]) return NO;
+  if (_dataIsSet && _hasValue) {
+    if (![outProtocol writeFieldBeginWithName:@"data" type:TTypeSTRING fieldID:1 error:__thriftError]) return NO;
+    if (![outProtocol writeBinary:self.data error:__thriftError]) return NO;
+    if (![outProtocol writeFieldEnd:__thriftError]) return NO;
+  }
+  if (![outProtocol writeFieldStop:__thriftError]) return NO;
+  if (![outProtocol writeStructEnd:__thriftError]) return NO;
+  return YES;
+}
+
+-(BOOL) validate:(NSError *__autoreleasing *)__thriftError
+{
+  // check for required fields
+  if (!_dataIsSet) {
+    if (__thriftError) {
+      *__thriftError = [NSError errorWithDomain:TProtocolErrorDomain
+                                           code:TProtocolErrorUnknown
+                                       userInfo:@{TProtocolErrorExtendedErrorKey: @(TProtocolExtendedErrorMissingRequiredField),
+                                                  TProtocolErrorFieldNameKey: @"data"}];
+    }
+  }
+  return YES;
+}
+
+@end
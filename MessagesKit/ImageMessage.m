@@ -28,7 +28,10 @@
 const CGFloat MK_THUMBNAIL_MAX_PERCENT = 0.5f;
 
 
-@interface ImageMessage ()
+@interface ImageMessage () {
+  ExternalFileDataReference *_replacedData;
+  StagedExternalFile *_stagedData;
+}
 
 @end
 
@@ -97,8 +100,9 @@ const CGFloat MK_THUMBNAIL_MAX_PERCENT = 0.5f;
 
 -(void) setData:(id<DataReference>)data
 {
-  if ([self.data isKindOfClass:ExternalFileDataReference.class]) {
-    [NSFileManager.defaultManager removeItemAtURL:[(id)self.data URL] error:nil];
+  // Replaced files are released when the new data is saved
+  if (!_replacedData && [_data isKindOfClass:ExternalFileDataReference.class]) {
+    _replacedData = (id)_data;
   }
   _data = data;
 }
@@ -119,32 +123,67 @@ const CGFloat MK_THUMBNAIL_MAX_PERCENT = 0.5f;
   return @"New image";
 }
 
--(BOOL)internalizeDataReferenceWithDAO:(DAO *)dao error:(NSError **)error
+-(BOOL)willSaveInDAO:(MessageDAO *)dao error:(NSError **)error
+{
+  // New data is hashed (& written when not already stored) before the writer is held
+  if (_stagedData) {
+    [dao.externalFileStore discardStagedFile:_stagedData];
+    _stagedData = nil;
+  }
+
+  if (!_data || ([_data isKindOfClass:ExternalFileDataReference.class] && [(ExternalFileDataReference *)_data dbManager] == dao.dbManager)) {
+    return YES;
+  }
+
+  _stagedData = [dao.externalFileStore stageDataReference:_data error:error];
+
+  return _stagedData != nil;
+}
+
+-(BOOL)internalizeDataReferenceWithDAO:(MessageDAO *)dao error:(NSError **)error
 {
-  NSString *fileName = [NSUUID.UUID.UUIDString stringByAppendingPathExtension:[NSURL extensionForMimeType:self.data.MIMEType]];
-  ExternalFileDataReference *externalFileRef = [ExternalFileDataReference.alloc initWithDBManager:dao.dbManager fileName:fileName];
-  if (![self.data writeToURL:externalFileRef.URL error:error]) {
+  StagedExternalFile *staged = _stagedData;
+  _stagedData = nil;
+
+  NSString *fileName;
+  if (staged && staged.data == _data) {
+    fileName = [dao.externalFileStore storeStagedFile:staged error:error];
+  }
+  else {
+    fileName = [dao.externalFileStore storeDataReference:self.data error:error];
+  }
+
+  if (staged) {
+    [dao.externalFileStore discardStagedFile:staged];
+  }
+
+  if (!fileName) {
     return NO;
   }
-  self.data = externalFileRef;
+
+  _data = [ExternalFileDataReference.alloc initWithDBManager:dao.dbManager fileName:fileName];
   return YES;
 }
 
--(BOOL)willInsertIntoDAO:(DAO *)dao error:(NSError **)error
+-(BOOL)willInsertIntoDAO:(MessageDAO *)dao error:(NSError **)error
 {
   return [self internalizeDataReferenceWithDAO:dao error:error];
 }
 
--(BOOL)willUpdateInDAO:(DAO *)dao error:(NSError **)error
+-(BOOL)willUpdateInDAO:(MessageDAO *)dao error:(NSError **)error
 {
+  // Unchanged since stored for this row
+  if (!_replacedData && [_data isKindOfClass:ExternalFileDataReference.class] && [(ExternalFileDataReference *)_data dbManager] == dao.dbManager) {
+    return YES;
+  }
   return [self internalizeDataReferenceWithDAO:dao error:error];
 }
 
--(BOOL)didDeleteFromDAO:(DAO *)dao error:(NSError **)error
+-(BOOL)didDeleteFromDAO:(MessageDAO *)dao error:(NSError **)error
 {
-  if ([self.data isKindOfClass:ExternalFileDataReference.class]) {
-    ExternalFileDataReference *externalFileRef = self.data;
-    return [NSFileManager.defaultManager removeItemAtURL:externalFileRef.URL error:error];
+  if ([_data isKindOfClass:ExternalFileDataReference.class]) {
+    ExternalFileDataReference *externalFileRef = (id)_data;
+    return [dao.externalFileStore releaseFileNamed:externalFileRef.fileName error:error];
   }
   return YES;
 }
@@ -162,11 +201,19 @@ const CGFloat MK_THUMBNAIL_MAX_PERCENT = 0.5f;
   return YES;
 }
 
--(BOOL) save:(NSMutableDictionary *)values dao:(DAO *)dao error:(NSError *__autoreleasing *)error
+-(BOOL) save:(NSMutableDictionary *)values dao:(MessageDAO *)dao error:(NSError *__autoreleasing *)error
 {
   if (![super save:values dao:dao error:error]) {
     return NO;
   }
+
+  // The new data holds its own reference (see internalizeDataReferenceWithDAO:error:)
+  if (_replacedData) {
+    if (![dao.externalFileStore releaseFileNamed:_replacedData.fileName error:error]) {
+      return NO;
+    }
+    _replacedData = nil;
+  }
   
   [values setNillableObject:self.thumbnailData forKey:@"data1"];
   [values setNillableObject:[NSKeyedArchiver archivedDataWithRootObject:self.data] forKey:@"data2"];
@@ -11,6 +11,7 @@
 #import "Chat.h"
 #import "ChatDAO.h"
 #import "MessageDAO.h"
+#import "DAO+Internal.h"
 #import "MemoryDataReference.h"
 #import "URLDataReference.h"
 #import "Messages+Exts.h"
@@ -41,12 +42,12 @@
 
 -(id) dbId
 {
-  return self.id.data;
+  return self.id;
 }
 
 -(void) setDbId:(id)dbId
 {
-  self.id = [Id idWithData:dbId];
+  self.id = dbId;
 }
 
 -(BOOL) load:(FMResultSet *)resultSet dao:(MessageDAO *)dao error:(NSError **)error
@@ -81,7 +82,7 @@
     return NO;
   }
 
-  [values setNillableObject:self.chat.dbId forKey:@"chat"];
+  [values setNillableObject:[dao parameterForDbId:self.chat.dbId] forKey:@"chat"];
   [values setNillableObject:self.sender forKey:@"sender"];
   [values setNillableObject:self.sent forKey:@"sent"];
   [values setNillableObject:self.updated forKey:@"updated"];
@@ -24,6 +24,8 @@ private let UnreadMessageCountKey = "io.retxt.UnreadMessageCount"
 private let ClearDataDebugKey = "io.retxt.debug.ClearData"
 private let RandomUniqueDeviceIdDebugKey = "io.retxt.debug.RandomUniqueDeviceId"
 private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDeviceId"
+private let SQLTracingDebugKey = "io.retxt.debug.SQLTracing"
+private let OperationTracingDebugKey = "io.retxt.debug.OperationTracing"
 
 
 @objc public class MessageAPI : NSObject {
@@ -54,17 +56,36 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
   private var userInfoCache : PersistentCache<String, UserInfo>!
   internal var webSocket : WebSocket!
   
+  // Where reconnects resume receiving
+  internal var receiveWatermark : ReceiveWatermark!
+  
+  // Thrift protocol of the message preamble leading HTTP transfer bodies; servers that
+  // negotiate compact over the WebSocket accept preambles, others require MsgInfoHTTPHeader
+  internal var transferPreambleProtocolName : String? {
+    return webSocket?.protocolName == ThriftCompactProtocolName ? ThriftCompactProtocolName : nil
+  }
+  
   internal var backgroundURLSession : NSURLSession!
   
   private var signedOut = false
   
-  private let queue = OperationQueue()
+  internal let lanes = OperationLanes(name: "MessageAPI Processing")
+  
+  // Stage latencies of message sends & receives (see OperationTracingDebugKey)
+  public let operationTracer = OperationTracer()
+  
+  // Serial queue for URL session & notification callbacks, kept apart from the
+  // lanes so callbacks that complete executing operations are never queued behind them
+  private let eventQueue = NSOperationQueue()
   private var observers : [AnyObject]!
   
   private(set) var networkAvailable = true
   
   internal let certificateTrust : OpenSSLCertificateTrust
   
+  // Launch time by phase; independent phases overlap
+  public let startupTrace : StartupTrace
+  
   
   public class func initialize(target target: ServerTarget) {
     assert(self.target == nil, "MessageAPI target already initialized")
@@ -76,9 +97,15 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
     
     assert(MessageAPI.target != nil, "MessageAPI target not initialized, call MessageAPI.initialize first")
     
-    self.queue.name = "MessageAPI Processing Queue"
+    let startupTrace = StartupTrace(name: "MessageAPI")
+    self.startupTrace = startupTrace
+    
+    self.eventQueue.name = "MessageAPI Event Queue"
+    self.eventQueue.maxConcurrentOperationCount = 1
     
+    startupTrace.beginPhase("api.certificates")
     self.certificateTrust = try MessageAPI.makeCertificateTrust()
+    startupTrace.endPhase("api.certificates")
     
     self.credentials = credentials
     self.accessToken = nil
@@ -90,74 +117,97 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
     let dbName = credentials.userId.UUIDString + ".sqlite"
     let dbURL = docsDirURL.URLByAppendingPathComponent(dbName)
     
+    let watermarkURL = docsDirURL.URLByAppendingPathComponent(credentials.userId.UUIDString + ".watermark")
+    
     let clearData = NSUserDefaults.standardUserDefaults().boolForKey(ClearDataDebugKey)
     
     if clearData {
       let _ = try? NSFileManager.defaultManager().removeItemAtURL(dbURL)
+      let _ = try? NSFileManager.defaultManager().removeItemAtURL(watermarkURL)
     }
     
+    self.receiveWatermark = ReceiveWatermark(fileURL: watermarkURL)
+    
     guard let dbPath = dbURL.filePathURL?.path else {
       throw MessageAPIError.InvalidDocumentDirectoryURL
     }
     
-    self.dbManager = try DBManager(path: dbPath, kind: "Message", daoClasses: [ChatDAO.self, MessageDAO.self, NotificationDAO.self])
+    // The message database & user info cache are independent; open them
+    // concurrently while the network clients are built on this thread
     
-    self.chatDAO = self.dbManager["Chat"] as! ChatDAO
-    self.messageDAO = self.dbManager["Message"] as! MessageDAO
-    self.notificationDAO = self.dbManager["Notification"] as! NotificationDAO
+    let opening = dispatch_group_create()
+    var dbError : ErrorType?
+    var userInfoCacheError : ErrorType?
     
-    self.userInfoCache = try PersistentCache(name: "UserInfo", clear: clearData) { key in
-      
-      let wait = dispatch_semaphore_create(0)
-      var userInfo : UserInfo?
-      var error : NSError?
-
-      self.publicAPI.findUserWithAlias(key,
-                                       response: { userInfo = $0; dispatch_semaphore_signal(wait) },
-                                       failure: { error = $0; dispatch_semaphore_signal(wait) })
-      
-      if dispatch_semaphore_wait(wait, dispatch_time(DISPATCH_TIME_NOW, Int64(NSEC_PER_SEC) * 3)) != 0 {
-        error = NSError(code: MessageAPIError.UnknownError, userInfo: nil)
+    dispatch_group_async(opening, GCD.userInitiatedQueue) {
+      do {
+        self.dbManager = try DBManager(path: dbPath, kind: "Message", daoClasses: [ChatDAO.self, MessageDAO.self, NotificationDAO.self], trace: self.startupTrace)
       }
-      
-      if let error = error {
-        throw error
+      catch let error {
+        dbError = error
       }
-      
-      if let userInfo = userInfo {
-        return (userInfo, NSDate(timeIntervalSinceNow: kUserCacheTTL))
+    }
+    
+    dispatch_group_async(opening, GCD.userInitiatedQueue) {
+      self.startupTrace.beginPhase("api.userInfoCache")
+      do {
+        self.userInfoCache = try self.makeUserInfoCache(clear: clearData)
       }
-      
-      return nil
+      catch let error {
+        userInfoCacheError = error
+      }
+      self.startupTrace.endPhase("api.userInfoCache")
     }
     
-    self.userAPI = makeUserAPI()
-    self.webSocket = makeWebSocket()
+    startupTrace.tracePhase("api.clients") {
+      self.webSocket = self.makeWebSocket()
+      self.userAPI = self.makeUserAPI()
+    }
+    
+    dispatch_group_wait(opening, DISPATCH_TIME_FOREVER)
+    
+    if let error = dbError ?? userInfoCacheError {
+      throw error
+    }
+    
+    self.dbManager.tracer.enabled = NSUserDefaults.standardUserDefaults().boolForKey(SQLTracingDebugKey)
+    self.operationTracer.enabled = NSUserDefaults.standardUserDefaults().boolForKey(OperationTracingDebugKey)
+    
+    self.chatDAO = self.dbManager["Chat"] as! ChatDAO
+    self.messageDAO = self.dbManager["Message"] as! MessageDAO
+    self.notificationDAO = self.dbManager["Notification"] as! NotificationDAO
     
     // Initialize background URLSession
     //
     
+    startupTrace.beginPhase("api.backgroundSession")
+    
     // Build session as required
     let backgroundURLSessionConfig = NSURLSessionConfiguration.backgroundSessionConfigurationWithUserId(credentials.userId)
     let backgroundSessionOperations = BackgroundSessionOperations(trustedCertificates: ServerAPI.pinnedCerts(),
                                                                   api: self,
                                                                   dao: messageDAO,
-                                                                  queue: queue)
+                                                                  queue: lanes[.Interactive])
     
     self.backgroundURLSession = NSURLSession(configuration: backgroundURLSessionConfig,
                                              delegate: backgroundSessionOperations,
-                                             delegateQueue: queue)
+                                             delegateQueue: eventQueue)
+    
+    startupTrace.endPhase("api.backgroundSession")
+    startupTrace.beginPhase("api.resurrectTransfers")
     
     // Ensure transfers currently in progress are linked and handled correctly...
     backgroundSessionOperations.resurrectOperationsForSession(backgroundURLSession) { transferringMessageIds in
       
+      self.startupTrace.endPhase("api.resurrectTransfers")
+      
       if !transferringMessageIds.isEmpty {
         
         // Kill any that are failing, and are not in the background,
         self.messageDAO.failAllSendingMessagesExcluding(transferringMessageIds)
         
         // Restart any transfers that were just killed
-        self.queue.addOperation(ResendUnsentMessagesOperation(api: self))
+        self.lanes.addOperation(ResendUnsentMessagesOperation(api: self), lane: .Maintenance)
       }
       
     }
@@ -169,25 +219,25 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
     self.observers = [
       
       // Network - Available
-      nc.addObserverForName(NetworkConnectivityAvailableNotification, object: nil, queue: queue) { not in
+      nc.addObserverForName(NetworkConnectivityAvailableNotification, object: nil, queue: eventQueue) { not in
         if !self.networkAvailable {
-          self.queue.addOperation(ResendUnsentMessagesOperation(api: self))
+          self.lanes.addOperation(ResendUnsentMessagesOperation(api: self), lane: .Maintenance)
         }
         self.networkAvailable = true
       },
       
       // Network - Unavailable
-      nc.addObserverForName(NetworkConnectivityUnavailableNotification, object: nil, queue: queue) { not in
+      nc.addObserverForName(NetworkConnectivityUnavailableNotification, object: nil, queue: eventQueue) { not in
         self.networkAvailable = false
       },
       
       // Application - Did Become Active
-      nc.addObserverForName(UIApplicationDidBecomeActiveNotification, object: nil, queue: queue) { not in
+      nc.addObserverForName(UIApplicationDidBecomeActiveNotification, object: nil, queue: eventQueue) { not in
         self.activate()
       },
 
       // Application - Will Resign Active
-      nc.addObserverForName(UIApplicationDidBecomeActiveNotification, object: nil, queue: queue) { not in
+      nc.addObserverForName(UIApplicationDidBecomeActiveNotification, object: nil, queue: eventQueue) { not in
         self.deactivate()
       }
     ]
@@ -196,12 +246,18 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
       self.activate()
     }
     
+    startupTrace.log()
   }
   
   deinit {
     self.observers.forEach(NSNotificationCenter.defaultCenter().removeObserver)
   }
   
+  // Statement timings, pool waits & slow queries of the message database (see SQLTracingDebugKey)
+  public var sqlTracer : DBTracer {
+    return dbManager.tracer
+  }
+  
   public func isChatActive(chat: Chat) -> Bool {
     return activeChatId == chat.id
   }
@@ -211,8 +267,11 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
   }
     
   func didBecomeAuthorized() {
-    queue.addOperation(FetchWaitingOperation(api: self))
-    queue.addOperation(ResendUnsentMessagesOperation(api: self))
+    // With a saved watermark the WebSocket resumes after it, fetching only if the server declines
+    if receiveWatermark.value == 0 {
+      lanes.addOperation(FetchWaitingOperation(api: self), lane: .Receive)
+    }
+    lanes.addOperation(ResendUnsentMessagesOperation(api: self), lane: .Maintenance)
   }
   
   public func activate() {
@@ -221,12 +280,19 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
     
     active = true
     
-    queue.addOperation(ConnectWebSocketOperation(api: self))
+    lanes.addOperation(ConnectWebSocketOperation(api: self), lane: .Receive)
 
     if credentials.authorized {
       didBecomeAuthorized()
     }
     
+    // Finish reclaiming files deleted by earlier runs & periodically remove orphans
+    messageDAO.externalFileCollector.collect()
+    messageDAO.externalFileCollector.reconcileIfNeeded()
+    
+    // Drop tombstones older than the server will redeliver
+    messageDAO.deletedMessageFilter.compactIfNeeded()
+    
     if let suspendedChatId = suspendedChatId {
 
       if let chat = try! chatDAO.fetchChatWithId(suspendedChatId) {
@@ -246,18 +312,18 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
     
     activate()
 
-    queue.addOperationWithBlock {
+    lanes.addOperationWithBlock(lane: .Interactive) {
       
       self.chatDAO.resetUnreadCountsForChat(chat)
 
-      let unreadCount = Int(try! self.messageDAO.readAllMessagesForChat(chat))
-      self.adjustUnreadMessageCountWithDelta(-unreadCount)
+      try! self.messageDAO.readAllMessagesForChat(chat)
+      self.updateUnreadMessageCount()
       
       if let error = try? self.hideNotificationsForChat(chat) {
         DDLogError("Error hiding notifications for chat: \(chat.alias): \(error)")
       }
       
-      self.queue.addOperation(SendChatReceiptOperation(chat: chat, api: self))
+      self.lanes.addOperation(SendChatReceiptOperation(chat: chat, api: self), lane: .Status)
     }
     
   }
@@ -286,19 +352,9 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
       .postNotificationName(MessageAPIAccessTokenRefreshed, object: self)
   }
   
-  internal func adjustUnreadMessageCountWithDelta(delta: Int) {
-    
-    let defs = NSUserDefaults.standardUserDefaults()
-    
-    let unread = max(defs.integerForKey(UnreadMessageCountKey) + delta, 0)
-    defs.setInteger(unread, forKey: UnreadMessageCountKey)
-    
-    UIApplication.sharedApplication().applicationIconBadgeNumber = unread
-  }
-  
   public func updateUnreadMessageCount() -> UInt {
     
-    let count = Int(messageDAO.countOfUnreadMessages())
+    let count = Int(chatDAO.countOfUnreadMessages())
     
     NSUserDefaults.standardUserDefaults().setInteger(count, forKey: UnreadMessageCountKey)
     
@@ -307,6 +363,14 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
     return UInt(count)
   }
   
+  public var externalFileMetrics : ExternalFileCollectorMetrics {
+    return messageDAO.externalFileCollector.metrics
+  }
+  
+  public var externalFileBytesSavedByDeduplication : UInt64 {
+    return messageDAO.externalFileStore.bytesSavedByDeduplication()
+  }
+  
   private func clearUnreadMessageCount() {
     
     NSUserDefaults.standardUserDefaults().setInteger(0, forKey: UnreadMessageCountKey)
@@ -377,7 +441,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
       }
 
       let send = MessageSendOperation(message: message, api: self)
-      self.queue.addOperation(send)
+      self.lanes.addOperation(send, lane: .Interactive)
       
       return send.promise().asVoid()
     }
@@ -418,7 +482,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
       
       // Send the update!
       let update = MessageSendOperation(message: message, api: self)
-      queue.addOperation(update)
+      lanes.addOperation(update, lane: .Interactive)
       
       return update.promise().asVoid()
     }
@@ -440,7 +504,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
                                                metaData: [MetaDataKey_TargetMessageId: message.id.UUIDString],
                                                target: .Standard,
                                                api: self)
-      self.queue.addOperation(clarify)
+      self.lanes.addOperation(clarify, lane: .Interactive)
     
       return clarify.promise().asVoid()
     }
@@ -463,6 +527,8 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
     }
     
     try hideNotificationForMessage(message)
+    
+    updateUnreadMessageCount()
   }
 
   @nonobjc public func deleteMessage(message: Message) -> Promise<Void> {
@@ -477,7 +543,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
                                                          "type": "message"],
                                               target: .Standard,
                                               api: self)
-      queue.addOperation(delete)
+      lanes.addOperation(delete, lane: .Interactive)
     
       return delete.promise().asVoid()
     }
@@ -495,7 +561,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
       let data = try NSJSONSerialization.dataWithJSONObject(dataObject, options: [])
      
       let send = MessageSendDirectOperation(sender: senderAlias, recipientDevices: recipientDevices, msgId: msgId, msgType: type, msgData: data, api: self)
-      self.queue.addOperation(send)
+      self.lanes.addOperation(send, lane: .Interactive)
       
       return send.promise().asVoid()
     }
@@ -555,7 +621,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
                                            metaData: ["member": chat.localAlias],
                                            target: .Everybody,
                                            api: self)
-    queue.addOperation(enter)
+    lanes.addOperation(enter, lane: .Interactive)
   }
   
   @objc public func exitChat(chat: GroupChat) throws {
@@ -571,7 +637,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
                                            metaData: ["member": chat.localAlias],
                                            target: .Everybody,
                                            api: self)
-    queue.addOperation(enter)
+    lanes.addOperation(enter, lane: .Interactive)
   }
   
   @nonobjc public func findChatsMatchingPredicate(predicate: NSPredicate, offset: UInt, limit: UInt, sortedBy sorts: [NSSortDescriptor]) -> Promise<[Chat]> {
@@ -614,7 +680,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
                                             metaData: ["type": "chat"],
                                             target: .CC,
                                             api: self)
-    queue.addOperation(delete)
+    lanes.addOperation(delete, lane: .Interactive)
   }
   
   @objc public func deleteChatLocally(chat: Chat) throws {
@@ -622,6 +688,8 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
     try chatDAO.deleteChat(chat)
     
     try hideNotificationsForChat(chat)
+    
+    updateUnreadMessageCount()
   }
   
   @objc public func sendUserStatus(status: UserStatus, withSender sender: String, toRecipient recipient: String) {
@@ -704,7 +772,11 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
     var notification = try notificationDAO.fetchNotificationWithId(message.id)
     
     if let notification = notification {
-      try deleteAndCancelNotification(notification, ifOnOrBefore: NSDate())
+      // Cancel the notification being replaced, unless it has yet to fire
+      if (notification.fireDate ?? NSDate.distantPast()).compare(NSDate()) != .OrderedDescending,
+        let previous = unarchiveLocalNotification(notification.data) {
+        UIApplication.sharedApplication().cancelLocalNotification(previous)
+      }
     }
     else {
       notification = SavedNotification()
@@ -712,6 +784,8 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
       notification!.chatId = message.chat.id
     }
     
+    // Notifications without a fire date are delivered immediately & never hidden
+    notification!.fireDate = localNotification.fireDate ?? NSDate.distantFuture()
     notification!.data = NSKeyedArchiver.archivedDataWithRootObject(localNotification)
     
     try notificationDAO.upsertNotification(notification!)
@@ -721,36 +795,58 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
     
     DDLogDebug("HIDING NOTIFICATIONS FOR CHAT: \(chat.id)")
 
-    for notification in try notificationDAO.fetchAllNotificationsForChat(chat) {
-      try deleteAndCancelNotification(notification, ifOnOrBefore:NSDate())
-    }
-    
+    try cancelNotificationsForChat(chat, firingOnOrBefore: NSDate())
   }
   
   internal func hideNotificationForMessage(message: Message) throws {
     
     DDLogDebug("HIDING NOTIFICATION FOR MESSAGE: \(message.id)")
     
-    for notification in try notificationDAO.fetchAllNotificationsMatching("chatId = ?", parameters: [message.chat.id]) {
-      try deleteAndCancelNotification(notification, ifOnOrBefore:message.statusTimestamp ?? NSDate())
-    }
-    
+    try cancelNotificationsForChat(message.chat, firingOnOrBefore: message.statusTimestamp ?? NSDate())
   }
   
-  internal func deleteAndCancelNotification(notification: SavedNotification, ifOnOrBefore sent: NSDate) throws {
+  /*
+    Selects the notifications to cancel by their indexed fire date & deletes them
+    together; only those being cancelled have their archived payload decoded
+  */
+  internal func cancelNotificationsForChat(chat: Chat, firingOnOrBefore date: NSDate) throws {
     
-    if let localNotification = NSKeyedUnarchiver.unarchiveObjectWithData(notification.data) as? UILocalNotification {
+    var cancelledIds = [Id]()
+    
+    for notification in try notificationDAO.fetchAllNotificationsForChat(chat, firingOnOrBefore: date) {
+      
+      let localNotification = unarchiveLocalNotification(notification.data)
       
-      if let fireDate = localNotification.fireDate
-        where fireDate.compare(sent).rawValue <= NSComparisonResult.OrderedSame.rawValue {
+      if notification.fireDate == nil {
         
+        // Saved before fire dates were recorded, index it from the payload
+        let fireDate = localNotification?.fireDate ?? NSDate.distantFuture()
+        if fireDate.compare(date) == .OrderedDescending {
+          notification.fireDate = fireDate
+          try notificationDAO.updateNotification(notification)
+          continue
+        }
+      }
+      
+      if let localNotification = localNotification {
         UIApplication.sharedApplication().cancelLocalNotification(localNotification)
-
-        try notificationDAO.deleteNotification(notification)
       }
       
+      cancelledIds.append(notification.msgId)
     }
     
+    if !cancelledIds.isEmpty {
+      try notificationDAO.deleteAllNotificationsWithIds(cancelledIds)
+    }
+  }
+  
+  private func unarchiveLocalNotification(data: NSData?) -> UILocalNotification? {
+    
+    guard let data = data else {
+      return nil
+    }
+    
+    return NSKeyedUnarchiver.unarchiveObjectWithData(data) as? UILocalNotification
   }
   
   @objc public func signOut() {
@@ -766,8 +862,8 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
     webSocket.disconnect()
     webSocket = nil
 
-    queue.suspended = true
-    queue.cancelAllOperations()
+    lanes.suspended = true
+    lanes.cancelAllOperations()
 
     GCD.mainQueue.async {
       NSNotificationCenter.defaultCenter().postNotificationName(MessageAPISignedOutNotification, object: self)
@@ -877,7 +973,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
                                                     deviceId: credentials.deviceId,
                                                     deviceName: UIDevice.currentDevice().name,
                                                     api: self)
-    queue.addOperation(requestAuth)
+    lanes.addOperation(requestAuth, lane: .Interactive)
     
     return requestAuth.promise().asVoid()
   }
@@ -890,7 +986,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
   @nonobjc public func resetKeys() -> Promise<Credentials> {
     
     let resetKeys = ResetKeysOperation(api: self)
-    queue.addOperation(resetKeys)
+    lanes.addOperation(resetKeys, lane: .Interactive)
     
     return resetKeys.promise().asVoid().then { Void -> Credentials in
       self.didBecomeAuthorized()
@@ -954,7 +1050,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
       if newValue != _informationNotificationToken {
         _informationNotificationToken = newValue
         if let newValue = newValue {
-          queue.addOperation(RegisterNotificationTokenOperation(token: newValue, type: .Information, api:self))
+          lanes.addOperation(RegisterNotificationTokenOperation(token: newValue, type: .Information, api:self), lane: .Maintenance)
         }
       }
     }
@@ -971,7 +1067,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
       if newValue != _messageNotificationToken {
         _messageNotificationToken = newValue
         if let newValue = newValue {
-          queue.addOperation(RegisterNotificationTokenOperation(token: newValue, type: .Message, api:self))
+          lanes.addOperation(RegisterNotificationTokenOperation(token: newValue, type: .Message, api:self), lane: .Maintenance)
         }
       }
     }
@@ -992,7 +1088,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
         }
       }
       
-      queue.addOperation(op)
+      lanes.addOperation(op, lane: .Receive)
     }
   }
   
@@ -1021,7 +1117,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
         }
       }
       
-      queue.addOperation(op)
+      lanes.addOperation(op, lane: .Receive)
     }
   }
   
@@ -1034,7 +1130,7 @@ private let InjectedUniqueDeviceIdDebugKey = "io.retxt.debug.InjectedUniqueDevic
   @nonobjc public func pollForMessages() -> Promise<Int> {
     
     let fetch = FetchWaitingOperation(api: self)
-    queue.addOperation(fetch)
+    lanes.addOperation(fetch, lane: .Receive)
     
     return fetch.promise().to()
   }
@@ -1468,7 +1564,7 @@ extension MessageAPI {
 extension MessageAPI : WebSocketDelegate {
   
   //
-  // Adds build # and Bearer token to websocket connection requests
+  // Adds build # and Bearer token to websocket connection requests & sets where they resume
   //
   public func webSocket(webSocket: WebSocket, willConnect request: NSMutableURLRequest) {
     
@@ -1478,23 +1574,44 @@ extension MessageAPI : WebSocketDelegate {
       request.addHTTPBearerAuthorizationWithToken(accessToken)
     }
     
+    webSocket.resumeTimestamp = receiveWatermark.value
   }
   
-  public func webSocket(webSocket: WebSocket, didReceiveUserStatus sender: String, recipient: String, status: UserStatus) {
-
-    DDLogDebug("USER STATUS: \(sender), \(recipient), \(status)")
+  public func webSocket(webSocket: WebSocket, didReceiveUserStatuses userStatuses: [WebSocketUserStatus]) {
     
-    guard let chat = try? chatDAO.fetchChatForAlias(sender, localAlias: recipient) else {
-      return
+    // Only the latest status of each user/recipient pair in a batch matters
+    
+    var seenPairs = Set<String>()
+    var latestUserStatuses = [WebSocketUserStatus]()
+    
+    for userStatus in userStatuses.reverse() {
+      let pair = "\(userStatus.sender):\(userStatus.recipient)"
+      if !seenPairs.contains(pair) {
+        seenPairs.insert(pair)
+        latestUserStatuses.insert(userStatus, atIndex: 0)
+      }
     }
     
-    let info = UserStatusInfo(status: status, forUser: sender, inChat: chat)
+    var infos = [UserStatusInfo]()
+    
+    for userStatus in latestUserStatuses {
+      
+      DDLogDebug("USER STATUS: \(userStatus.sender), \(userStatus.recipient), \(userStatus.status)")
+      
+      guard let chat = try? chatDAO.fetchChatForAlias(userStatus.sender, localAlias: userStatus.recipient) else {
+        continue
+      }
+      
+      infos.append(UserStatusInfo(status: userStatus.status, forUser: userStatus.sender, inChat: chat))
+    }
     
     GCD.mainQueue.async {
-      NSNotificationCenter.defaultCenter()
-        .postNotificationName(MessageAPIUserStatusDidChangeNotification,
-          object: self,
-          userInfo: [MessageAPIUserStatusDidChangeNotification_InfoKey:info])
+      for info in infos {
+        NSNotificationCenter.defaultCenter()
+          .postNotificationName(MessageAPIUserStatusDidChangeNotification,
+            object: self,
+            userInfo: [MessageAPIUserStatusDidChangeNotification_InfoKey:info])
+      }
     }
   }
   
@@ -1520,14 +1637,14 @@ extension MessageAPI : WebSocketDelegate {
     
     DDLogDebug("MESSAGE READY: \(msgHdr)")
     
-    queue.addOperation(MessageRecvOperation(msgHdr: msgHdr, api: self))
+    lanes.addOperation(MessageRecvOperation(msgHdr: msgHdr, api: self), lane: .Receive)
   }
   
   public func webSocket(webSocket: WebSocket, didReceiveMsgDelivery msg: Msg) {
 
     DDLogDebug("MESSAGE DELIVERY: \(msg.id) \(msg.type) \(msg.sent)")
     
-    queue.addOperation(MessageRecvOperation(msg: msg, api: self))
+    lanes.addOperation(MessageRecvOperation(msg: msg, api: self), lane: .Receive)
   }
   
   public func webSocket(webSocket: WebSocket, didReceiveMsgDirect msg: DirectMsg) {
@@ -1537,9 +1654,28 @@ extension MessageAPI : WebSocketDelegate {
     reportDirectMessage(msg)
   }
   
-  public func webSocket(webSocket: WebSocket, didReceiveMsgDelivered msgId: Id, recipient: String) {
+  public func webSocket(webSocket: WebSocket, didReceiveMsgsDelivered msgsDelivered: [WebSocketMsgDelivered]) {
+    
+    lanes.addOperation(MessageDeliveredOperation(msgIds: msgsDelivered.map { $0.msgId }, api: self), lane: .Status)
+  }
+  
+  public func webSocket(webSocket: WebSocket, didReconnectResumed resumed: Bool) {
+    
+    DDLogDebug("RECONNECTED: resumed=\(resumed)")
+    
+    // Server is replaying messages sent after the watermark when resumed, otherwise fetch them
+    if !resumed {
+      lanes.addOperation(FetchWaitingOperation(api: self), lane: .Receive)
+    }
+  }
+  
+  //
+  // Requests multiplexed over the websocket never see the HTTP response
+  // headers, the server sends refreshed tokens over the socket instead
+  //
+  public func webSocket(webSocket: WebSocket, didReceiveBearerRefresh accessToken: String) {
     
-    queue.addOperation(MessageDeliveredOperation(msgId: msgId, api: self))
+    updateAccessToken(accessToken)
   }
   
 }
@@ -1610,8 +1746,43 @@ extension MessageAPI {
       return nil
     }
     
+    // Multiplex requests over the WebSocket while it's open, using HTTP otherwise;
+    // the socket is authorized when it connects & delivers its own bearer refreshes
+    
+    let webSocketTransportFactory = WebSocketTransportFactory(webSocket: webSocket,
+                                                              protocolName: ThriftCompactProtocolName,
+                                                              fallbackTransportFactory: transportFactory)
+    
     return UserAPIClientAsync(protocolFactory: protocolFactory,
-                                transportFactory:transportFactory)
+                                transportFactory:webSocketTransportFactory)
+  }
+  
+  private func makeUserInfoCache(clear clear: Bool) throws -> PersistentCache<String, UserInfo> {
+    
+    return try PersistentCache(name: "UserInfo", clear: clear) { key in
+      
+      let wait = dispatch_semaphore_create(0)
+      var userInfo : UserInfo?
+      var error : NSError?
+
+      self.publicAPI.findUserWithAlias(key,
+                                       response: { userInfo = $0; dispatch_semaphore_signal(wait) },
+                                       failure: { error = $0; dispatch_semaphore_signal(wait) })
+      
+      if dispatch_semaphore_wait(wait, dispatch_time(DISPATCH_TIME_NOW, Int64(NSEC_PER_SEC) * 3)) != 0 {
+        error = NSError(code: MessageAPIError.UnknownError, userInfo: nil)
+      }
+      
+      if let error = error {
+        throw error
+      }
+      
+      if let userInfo = userInfo {
+        return (userInfo, NSDate(timeIntervalSinceNow: kUserCacheTTL))
+      }
+      
+      return nil
+    }
   }
   
   private func makeWebSocket() -> WebSocket {
@@ -1630,6 +1801,10 @@ extension MessageAPI {
   
   private class func makeCertificateTrust() throws -> OpenSSLCertificateTrust {
     
+    if let certificateTrust = target.certificateTrust {
+      return certificateTrust
+    }
+    
     let bundle = NSBundle(forClass: self)
     let rootsURL = bundle.URLForResource("roots", withExtension:"pem", subdirectory:"Certificates")!
     let intermediatesURL = bundle.URLForResource("inters", withExtension:"pem", subdirectory:"Certificates")!
@@ -20,6 +20,7 @@ import Thrift
   case AuthenticationError            = 1006
   case DeviceNotReady                 = 1007
   case NetworkError                   = 2001
+  case ServiceUnavailable             = 2002
 }
 
 public let MessageAPIErrorDomain = (MessageAPIError.UnknownError as NSError).domain
@@ -95,6 +95,8 @@ class MessageBuildOperation: Operation {
           data: nil)
       
       transmitContext.encryptedData = buildContext.encryptedData
+      transmitContext.encryptedDataLength = buildContext.encryptedDataLength
+      transmitContext.encryptedDataDigest = buildContext.encryptedDataDigest
       
       finish()
       
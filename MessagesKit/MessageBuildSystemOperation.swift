@@ -115,6 +115,8 @@ class MessageBuildSystemOperation: Operation {
 
       transmitContext.msgPack = msgPack
       transmitContext.encryptedData = nil
+      transmitContext.encryptedDataLength = nil
+      transmitContext.encryptedDataDigest = nil
       
       finish()
       
@@ -35,6 +35,10 @@ protocol MessageBuildContext : MessageContext {
   
   var encryptedData : DataReference? { get set }
   
+  var encryptedDataLength : UInt64? { get set }
+  
+  var encryptedDataDigest : NSData? { get set }
+  
 }
 
 
@@ -44,6 +48,10 @@ protocol MessageTransmitContext {
   
   var encryptedData : DataReference? { get set }
   
+  var encryptedDataLength : UInt64? { get set }
+  
+  var encryptedDataDigest : NSData? { get set }
+  
   var sentAt : TimeStamp? { get set }
   
 }
@@ -8,6 +8,9 @@
 
 #import "DAO.h"
 #import "Message.h"
+#import "ExternalFileCollector.h"
+#import "ExternalFileStore.h"
+#import "DeletedMessageFilter.h"
 
 
 NS_ASSUME_NONNULL_BEGIN
@@ -25,7 +28,7 @@ typedef NS_ENUM (int32_t, MessageType) {
   MessageTypeConference
 };
 
-@interface MessageDAO : DAO
+@interface MessageDAO : DAO <ExternalFileOwner>
 
 @property (nonatomic, assign) int chatFieldIdx;
 @property (nonatomic, assign) int senderFieldIdx;
@@ -39,10 +42,17 @@ typedef NS_ENUM (int32_t, MessageType) {
 @property (nonatomic, assign) int data3FieldIdx;
 @property (nonatomic, assign) int data4FieldIdx;
 
+@property (nonatomic, readonly) ExternalFileCollector *externalFileCollector;
+@property (nonatomic, readonly) ExternalFileStore *externalFileStore;
+@property (nonatomic, readonly) DeletedMessageFilter *deletedMessageFilter;
+
 
 -(void) failAllSendingMessagesExcluding:(NSArray<Id *> *)excludedMessageIds;
 -(nullable NSArray<__kindof Message *> *) fetchUnsentMessagesAndReturnError:(NSError **)error;
 
+// Page of unsent messages in sent order, starting after the given message
+-(nullable NSArray<__kindof Message *> *) fetchUnsentMessagesAfter:(nullable Message *)message limit:(NSUInteger)limit error:(NSError **)error;
+
 -(BOOL) fetchLastMessage:(Message *__nullable *__nonnull)returnedMessage forChat:(Chat *)chat error:(NSError **)error NS_REFINED_FOR_SWIFT;
 -(BOOL) fetchLatestUnviewedMessage:(Message *__nullable *__nonnull)returnedMessage forChat:(Chat *)chat error:(NSError **)error NS_REFINED_FOR_SWIFT;
 
@@ -10,8 +10,11 @@
 
 #import "DAO+Internal.h"
 #import "NSObject+Utils.h"
+#import "FMResultSet+Utils.h"
+#import "ExternalFileDataReference.h"
 
 #import "Chat.h"
+#import "ChatDAO.h"
 #import "TextMessage.h"
 #import "ImageMessage.h"
 #import "AudioMessage.h"
@@ -48,10 +51,7 @@
 
 -(instancetype) initWithDBManager:(DBManager *)dbManager
 {
-  __block DBTableInfo *tableInfo;
-  [dbManager.pool inReadableDatabase:^(FMDatabase *db) {
-    tableInfo = [DBTableInfo loadTableInfo:db tableName:@"message"];
-  }];
+  DBTableInfo *tableInfo = [dbManager tableInfoForTableName:@"message" readOnlyFieldNames:nil];
   
   self = [super initWithDBManager:dbManager
                         tableInfo:tableInfo
@@ -73,6 +73,12 @@
     _data3FieldIdx = [tableInfo findField:@"data3"];
     _data4FieldIdx = [tableInfo findField:@"data4"];
 
+    _externalFileCollector = [ExternalFileCollector.alloc initWithDBManager:dbManager];
+    _externalFileCollector.owner = self;
+    _externalFileStore = [ExternalFileStore.alloc initWithDBManager:dbManager collector:_externalFileCollector];
+
+    _deletedMessageFilter = [DeletedMessageFilter.alloc initWithDBManager:dbManager];
+
   }
 
   return self;
@@ -83,9 +89,141 @@
   return @"Message";
 }
 
--(id) dbIdForId:(id)id
+-(id) dbIdForColumnIndex:(int)columnIndex inResultSet:(FMResultSet *)resultSet
+{
+  return [resultSet idForColumnIndex:columnIndex];
+}
+
+-(void) updated:(Model *)model
+{
+  [super updated:model];
+
+  [_externalFileCollector collect];
+}
+
+-(void) deleted:(Model *)model
+{
+  [super deleted:model];
+
+  [_externalFileCollector collect];
+}
+
+-(void) deletedAll:(NSArray *)models
 {
-  return [id data];
+  [super deletedAll:models];
+
+  [_externalFileCollector collect];
+}
+
+-(void) deletedAllWithDbIds:(NSArray *)dbIds
+{
+  [super deletedAllWithDbIds:dbIds];
+
+  [_externalFileCollector collect];
+}
+
+-(NSSet<NSString *> *) referencedExternalFileNamesInDatabase:(FMDatabase *)db error:(NSError **)error
+{
+  int audioTypeIdx = (int)[self typeIndexOfClass:AudioMessage.class];
+
+  FMResultSet *resultSet = [db executeQuery:@"SELECT _type, data1, data2 FROM message WHERE _type IN (?, ?, ?)"
+                                valuesArray:@[@([self typeIndexOfClass:ImageMessage.class]),
+                                              @(audioTypeIdx),
+                                              @([self typeIndexOfClass:VideoMessage.class])]
+                                      error:error];
+  if (!resultSet) {
+    return nil;
+  }
+
+  NSMutableSet *fileNames = [NSMutableSet set];
+
+  while (YES) {
+
+    BOOL hasResult = NO;
+    if (![resultSet nextReturning:&hasResult error:error]) {
+      [resultSet close];
+      return nil;
+    }
+
+    if (!hasResult) {
+      break;
+    }
+
+    // Audio data lives in data1, image & video data in data2
+    int dataColumnIdx = [resultSet intForColumnIndex:0] == audioTypeIdx ? 1 : 2;
+
+    id data = [resultSet dataReferenceForColumnIndex:dataColumnIdx usingDBManager:self.dbManager];
+    if ([data isKindOfClass:ExternalFileDataReference.class]) {
+      [fileNames addObject:[data fileName]];
+    }
+  }
+
+  [resultSet close];
+
+  // Stored files are owned by the store until their last reference is released
+
+  resultSet = [db executeQuery:@"SELECT fileName FROM blob" valuesArray:nil error:error];
+  if (!resultSet) {
+    return nil;
+  }
+
+  while (YES) {
+
+    BOOL hasResult = NO;
+    if (![resultSet nextReturning:&hasResult error:error]) {
+      [resultSet close];
+      return nil;
+    }
+
+    if (!hasResult) {
+      break;
+    }
+
+    [fileNames addObject:[resultSet stringForColumnIndex:0]];
+  }
+
+  [resultSet close];
+
+  return fileNames;
+}
+
+-(NSSet<NSString *> *) referencedExternalFileNamesInArray:(NSArray<NSString *> *)fileNames inDatabase:(FMDatabase *)db error:(NSError **)error
+{
+  // Messages only link existing files through the store; anything else they reference is newly created
+
+  NSMutableArray *paramSpecs = [NSMutableArray arrayWithCapacity:fileNames.count];
+  for (NSUInteger c = 0; c < fileNames.count; ++c) {
+    [paramSpecs addObject:@"?"];
+  }
+
+  NSString *sql = [NSString stringWithFormat:@"SELECT fileName FROM blob WHERE fileName IN (%@)",
+                   [paramSpecs componentsJoinedByString:@","]];
+
+  FMResultSet *resultSet = [db executeQuery:sql valuesArray:fileNames error:error];
+  if (!resultSet) {
+    return nil;
+  }
+
+  NSMutableSet *referenced = [NSMutableSet set];
+
+  while (YES) {
+
+    BOOL hasResult = NO;
+    if (![resultSet nextReturning:&hasResult error:error]) {
+      [resultSet close];
+      return nil;
+    }
+
+    if (!hasResult) {
+      break;
+    }
+
+    [referenced addObject:[resultSet stringForColumnIndex:0]];
+  }
+
+  [resultSet close];
+
+  return referenced;
 }
 
 -(void) failAllSendingMessagesExcluding:(NSArray *)excludedMessageIds
@@ -124,6 +262,39 @@
   return res;
 }
 
+-(NSArray *) fetchUnsentMessagesAfter:(Message *)message limit:(NSUInteger)limit error:(NSError **)error
+{
+  __block NSArray *res;
+
+  [self.dbManager.pool inReadableDatabase:^(FMDatabase *db) {
+
+    // Status is inlined to match the partial message_unsent_idx index; paging
+    // is keyed on (sent, id) so messages updated mid-resend are not revisited
+    NSString *sql;
+    NSArray *params;
+
+    if (message) {
+      sql = [NSString stringWithFormat:@"SELECT * FROM message WHERE status < %d AND (sent > ? OR (sent = ? AND id > ?)) ORDER BY sent, id LIMIT ?", MessageStatusSending];
+      params = @[message.sent, message.sent, message.id.data, @(limit)];
+    }
+    else {
+      sql = [NSString stringWithFormat:@"SELECT * FROM message WHERE status < %d ORDER BY sent, id LIMIT ?", MessageStatusSending];
+      params = @[@(limit)];
+    }
+
+    FMResultSet *resultSet = [db executeQuery:sql valuesArray:params error:error];
+    if (!resultSet) {
+      return;
+    }
+
+    res = [self loadAll:resultSet error:error];
+
+    [resultSet close];
+  }];
+
+  return res;
+}
+
 -(BOOL) fetchLatestUnviewedMessage:(Message **)returnedMessage forChat:(Chat *)chat error:(NSError **)error
 {
   __block BOOL valid = NO;
@@ -131,7 +302,7 @@
   [self.dbManager.pool inReadableDatabase:^(FMDatabase *db) {
 
     FMResultSet *resultSet = [db executeQuery:@"SELECT * FROM message WHERE chat = ? AND sender <> ? AND status < ? ORDER BY sent DESC LIMIT 1",
-                              chat.dbId, chat.localAlias, @(MessageStatusViewed)];
+                              chat.id.data, chat.localAlias, @(MessageStatusViewed)];
 
     BOOL hasResult = NO;
     if (![resultSet nextReturning:&hasResult error:error]) {
@@ -162,7 +333,7 @@
   [self.dbManager.pool inReadableDatabase:^(FMDatabase *db) {
 
     FMResultSet *resultSet = [db executeQuery:@"SELECT * FROM message WHERE chat = ? ORDER BY sent DESC LIMIT 1",
-                              chat.dbId];
+                              chat.id.data];
 
     BOOL hasResult = NO;
     if (![resultSet nextReturning:&hasResult error:error]) {
@@ -189,99 +360,32 @@
 
 -(BOOL) viewAllMessagesForChat:(Chat *)chat before:(NSDate *)sent error:(NSError **)error
 {
-  __block BOOL valid = NO;
-  __block NSArray *updated;
-  __block int count =0;
-
-  [self.dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+  NSDate *now = [NSDate date];
 
-    FMResultSet *resultSet = [db executeQuery:@"SELECT * FROM message WHERE chat = ? AND sender <> ? AND status < ? AND sent <= ?"
-                                  valuesArray:@[chat.dbId, chat.localAlias, @(MessageStatusViewed), sent]
-                                        error:error];
-    if (!resultSet) {
-      *rollback = YES;
-      return;
-    }
-
-    updated = [self loadAll:resultSet error:error];
-    [resultSet close];
-    
-    if (!updated) {
-      *rollback = YES;
-      return;
-    }
-
-    NSDate *now = [NSDate date];
-
-    valid = [db executeUpdate:@"UPDATE message SET status = ?, statusTimestamp = ? WHERE chat = ? AND sender <> ? AND status < ? AND sent <= ?"
-                  valuesArray:@[@(MessageStatusViewed), now, chat.dbId, chat.localAlias, @(MessageStatusViewed), sent]
-                        error:error];
-    if (!valid) {
-      *rollback = YES;
-      return;
-    }
-    
-    count = db.changes;
-
-    for (Message *up in updated) {
-      up.status = MessageStatusViewed;
-      up.statusTimestamp = now;
-    }
-    
-  }];
-  
-  if (count && updated) {
-    [self updatedAll:updated];
-  }
-
-  return valid;
+  return [self updateAllObjectsMatching:@"chat = ? AND sender <> ? AND status < ? AND sent <= ?"
+                             parameters:@[chat.id.data, chat.localAlias, @(MessageStatusViewed), sent]
+                               settings:@"status = ?, statusTimestamp = ?"
+                      settingParameters:@[@(MessageStatusViewed), now]
+                                  patch:^(Message *message) {
+                                    message.status = MessageStatusViewed;
+                                    message.statusTimestamp = now;
+                                  }
+                                  error:error];
 }
 
 -(BOOL) readAllMessagesForChat:(Chat *)chat error:(NSError **)error
 {
-  __block BOOL valid = NO;
-  __block NSArray *updated;
-  __block int count =0;
-
-  [self.dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
-
-    FMResultSet *resultSet = [db executeQuery:@"SELECT * FROM message WHERE chat = ? AND flags & ?"
-                                  valuesArray:@[chat.dbId, @(MessageFlagUnread)]
-                                        error:error];
-    if (!resultSet) {
-      *rollback = YES;
-      return;
-    }
-    
-    updated = [self loadAll:resultSet error:error];
-    [resultSet close];
-    
-    if (!updated) {
-      *rollback = YES;
-      return;
-    }
-
-    valid = [db executeUpdate:@"UPDATE message SET flags = flags & ? WHERE chat = ? AND flags & ?"
-                  valuesArray:@[@(~MessageFlagUnread), chat.dbId, @(MessageFlagUnread)]
-                        error:error];
-    if (!valid) {
-      *rollback = YES;
-      return;
-    }
-    
-    count = db.changes;
-    
-    for (Message *msg in updated) {
-      msg.unreadFlag = NO;
-    }
-    
-  }];
+  // Unread flag is a literal so the partial unread index can be used
+  NSString *where = [NSString stringWithFormat:@"chat = ? AND flags & %d", (int)MessageFlagUnread];
 
-  if (count && updated) {
-    [self updatedAll:updated];
-  }
-
-  return valid;
+  return [self updateAllObjectsMatching:where
+                             parameters:@[chat.id.data]
+                               settings:@"flags = flags & ?"
+                      settingParameters:@[@(~MessageFlagUnread)]
+                                  patch:^(Message *message) {
+                                    message.unreadFlag = NO;
+                                  }
+                                  error:error];
 }
 
 -(BOOL) updateMessage:(Message *)message withStatus:(MessageStatus)status error:(NSError **)error
@@ -296,15 +400,11 @@
 
   [self.dbManager.pool inWritableDatabase:^(FMDatabase *db) {
 
-    if (![message willUpdateInDAO:self error:error]) {
-      return;
-    }
-    
     message.status = status;
     message.statusTimestamp = timestamp;
 
     valid = [db executeUpdate:@"UPDATE message SET status = ?, statusTimestamp = ? WHERE id = ?"
-                  valuesArray:@[@(status), timestamp, message.dbId]
+                  valuesArray:@[@(status), timestamp, message.id.data]
                         error:error];
     if (!valid) {
       return;
@@ -330,14 +430,10 @@
 
   [self.dbManager.pool inWritableDatabase:^(FMDatabase *db) {
 
-    if (![message willUpdateInDAO:self error:error]) {
-      return;
-    }
-    
     message.sent = sent;
 
     valid = [db executeUpdate:@"UPDATE message SET sent = ? WHERE id = ?"
-                  valuesArray:@[sent, message.dbId]
+                  valuesArray:@[sent, message.id.data]
                         error:error];
     if(!valid) {
       return;
@@ -362,15 +458,11 @@
   __block BOOL updated = NO;
 
   [self.dbManager.pool inWritableDatabase:^(FMDatabase *db) {
-    
-    if (![message willUpdateInDAO:self error:error]) {
-      return;
-    }
 
     message.flags = flags;
 
     valid = [db executeUpdate:@"UPDATE message SET flags = ? WHERE id = ?"
-                  valuesArray:@[@(flags), message.dbId]
+                  valuesArray:@[@(flags), message.id.data]
                         error:error];
     if (!valid) {
       return;
@@ -392,42 +484,65 @@
 -(BOOL) deleteAllMessagesForChat:(Chat *)chat error:(NSError **)error
 {
   __block BOOL valid = NO;
-  __block NSArray *deleted;
-  __block int count = 0;
+  __block NSArray *deletedIds;
+  __block NSArray *externalDataOwners;
 
   [self.dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
 
-    FMResultSet *resultSet = [db executeQuery:@"SELECT * FROM message WHERE chat = ?",
-                              chat.dbId];
+    // Only messages owning external data need loading, so they can clean up after themselves
+
+    NSString *ownersSQL = [self.tableInfo.fetchAllSQL stringByAppendingString:@" WHERE chat = ? AND _type IN (?, ?, ?)"];
 
-    deleted = [self loadAll:resultSet error:error];
-    if (!deleted) {
+    FMResultSet *resultSet = [db executeQuery:ownersSQL
+                                  valuesArray:@[chat.id.data,
+                                                @([self typeIndexOfClass:ImageMessage.class]),
+                                                @([self typeIndexOfClass:AudioMessage.class]),
+                                                @([self typeIndexOfClass:VideoMessage.class])]
+                                        error:error];
+    if (!resultSet) {
+      *rollback = YES;
       return;
     }
 
+    externalDataOwners = [self loadAll:resultSet error:error];
+
     [resultSet close];
 
-    if (![db executeUpdate:@"DELETE FROM message WHERE chat = ?" valuesArray:@[chat.dbId] error:error]) {
+    if (!externalDataOwners) {
+      *rollback = YES;
       return;
     }
-    
-    valid = YES;
-    count = db.changes;
 
-    for (Model *model in deleted) {
-      [model didDeleteFromDAO:self error:nil];
+    resultSet = [db executeQuery:@"SELECT id FROM message WHERE chat = ?" valuesArray:@[chat.id.data] error:error];
+    if (!resultSet) {
+      *rollback = YES;
+      return;
     }
-    
-  }];
 
-  if (count && deleted) {
+    deletedIds = [self loadAllDbIds:resultSet error:error];
 
-    for (Model *del in deleted) {
+    [resultSet close];
 
-      [self.objectCache removeObjectForKey:[del dbId]];
+    if (!deletedIds) {
+      *rollback = YES;
+      return;
+    }
+
+    if (![db executeUpdate:@"DELETE FROM message WHERE chat = ?" valuesArray:@[chat.id.data] error:error]) {
+      *rollback = YES;
+      return;
+    }
+
+    valid = YES;
+
+    for (Model *model in externalDataOwners) {
+      [model didDeleteFromDAO:self error:nil];
     }
 
-    [self deletedAll:deleted];
+  }];
+
+  if (valid && deletedIds.count) {
+    [self deletedAllWithDbIds:deletedIds];
   }
 
   return valid;
@@ -435,19 +550,17 @@
 
 -(int) countOfUnreadMessages
 {
-  __block int unread;
-
-  [self.dbManager.pool inReadableDatabase:^(FMDatabase *db) {
-
-    unread = [db intForQuery:@"SELECT COUNT(id) FROM message WHERE flags & ?", @(MessageFlagUnread)];
-
-  }];
+  ChatDAO *dao = self.dbManager[@"Chat"];
 
-  return unread;
+  return [dao countOfUnreadMessages];
 }
 
 -(BOOL) isMessageDeletedWithId:(Id *)msgId
 {
+  if (![_deletedMessageFilter mightContainId:msgId]) {
+    return NO;
+  }
+
   __block BOOL deleted;
 
   [self.dbManager.pool inReadableDatabase:^(FMDatabase *db) {
@@ -456,6 +569,10 @@
 
   }];
 
+  if (!deleted) {
+    [_deletedMessageFilter recordFalsePositive];
+  }
+
   return deleted;
 }
 
@@ -463,7 +580,9 @@
 {
   [self.dbManager.pool inWritableDatabase:^(FMDatabase *db) {
 
-    [db executeUpdate:@"INSERT INTO deleted (id) VALUES (?)", msgId.data];
+    if ([db executeUpdate:@"INSERT OR IGNORE INTO deleted (id, marked) VALUES (?, ?)", msgId.data, [NSDate date]] && db.changes > 0) {
+      [_deletedMessageFilter addId:msgId rowId:db.lastInsertRowId];
+    }
 
   }];
 }
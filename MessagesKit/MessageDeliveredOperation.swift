@@ -13,34 +13,43 @@ import CocoaLumberjack
 class MessageDeliveredOperation: MessageAPIOperation {
   
   
-  let msgId : Id
+  let msgIds : [Id]
   
   
-  init(msgId: Id, api: MessageAPI) {
+  init(msgIds: [Id], api: MessageAPI) {
     
-    self.msgId = msgId
+    self.msgIds = msgIds
   
     super.init(api: api)
   }
   
+  convenience init(msgId: Id, api: MessageAPI) {
+    self.init(msgIds: [msgId], api: api)
+  }
+  
   override func execute() {
     
-    do {
-      
-      if let deliveredMessage = try api.messageDAO.fetchMessageWithId(msgId) {
+    for msgId in msgIds {
       
-        if deliveredMessage.status.rawValue > MessageStatus.Delivered.rawValue {
-          return;
+      do {
+        
+        if let deliveredMessage = try api.messageDAO.fetchMessageWithId(msgId) {
+        
+          if deliveredMessage.status.rawValue > MessageStatus.Delivered.rawValue {
+            continue
+          }
+        
+          try api.messageDAO.updateMessage(deliveredMessage, withStatus: .Delivered)
         }
-      
-        try api.messageDAO.updateMessage(deliveredMessage, withStatus: .Delivered)
+        
+      }
+      catch _ {
+        DDLogError("Error marking message delivered: \(msgId)")
       }
       
     }
-    catch _ {
-      DDLogError("Error marking message delivered: \(msgId)")
-    }
     
+    finish()
   }
   
 }
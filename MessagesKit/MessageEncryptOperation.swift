@@ -42,10 +42,49 @@ class MessageEncryptOperation: Operation {
       
       if let data = data {
         
-        context.key = try cipher.randomKey()
+        let key = try cipher.randomKey()
         
-        context.encryptedData = try data.temporaryDuplicate { ins, outs in
-          try self.cipher.encryptFromStream(ins, toStream: outs, withKey: self.context.key!)
+        context.key = key
+        
+        let encrypt : DataReferenceFilter = { ins, outs in
+          try self.cipher.encryptFromStream(ins, toStream: outs, withKey: key)
+        }
+        
+        switch context.message.payloadType {
+          
+        case .Image, .Audio, .Video:
+          
+          // Media is uploaded from a file, encrypt straight into it
+          
+          let uploadURL = MessageTransmitHTTPOperation.uploadFileURLForMessageId(context.message.id)
+          let _ = try? NSFileManager.defaultManager().removeItemAtURL(uploadURL)
+          
+          let encrypted = try data.filteredToURL(uploadURL, filteredBy: encrypt)
+          
+          context.encryptedData = encrypted.data
+          context.encryptedDataLength = encrypted.length
+          context.encryptedDataDigest = encrypted.digest
+          
+        default:
+          
+          var filter = encrypt
+          
+          // Ciphertext is incompressible, so compress compressible
+          // payloads on their way into the cipher
+          
+          if MsgCompression.shouldCompressPayloadOfType(context.message.payloadType, size: try data.dataSize().unsignedLongLongValue) {
+            
+            filter = { ins, outs in
+              try encrypt(MsgDeflatingInputStream(inputStream: ins), outs)
+            }
+            
+            let metaData = NSMutableDictionary(dictionary: context.metaData ?? [:])
+            metaData[MetaDataKey_Compression] = CompressionType_Deflate
+            context.metaData = metaData
+          }
+          
+          context.encryptedData = try data.temporaryDuplicate(filteredBy: filter)
+          
         }
         
       }
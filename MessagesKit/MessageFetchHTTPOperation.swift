@@ -67,7 +67,13 @@ class MessageFetchHTTPOperation: Operation {
   }
   
   override func cancel() {
+    
+    // No attempt follows a cancelled fetch, drop any partial download
+    
     task?.cancel()
+    
+    MessageFetchHTTPOperation.cleanupResumeDataForMessageId(context.msgHdr!.id)
+    
     super.cancel()
   }
   
@@ -84,13 +90,42 @@ class MessageFetchHTTPOperation: Operation {
     request.addHTTPBearerAuthorizationWithToken(api.accessToken)
     request.setValue(OctetStreamContentType, forHTTPHeaderField: AcceptHTTPHeader)
     
-    task = api.backgroundURLSession.downloadTaskWithRequest(request)
+    // Offer to receive the message in a body preamble (see MessageTransmitHTTPOperation)
+    
+    if let protocolName = api.transferPreambleProtocolName {
+      request.setValue(protocolName, forHTTPHeaderField: MsgPreambleProtocolHTTPHeader)
+    }
+    
+    // Continue a previously interrupted download with a byte-range request
+    
+    let resumeDataURL = MessageFetchHTTPOperation.resumeDataURLForMessageId(context.msgHdr!.id)
+    
+    if let resumeData = NSData(contentsOfURL: resumeDataURL) {
+      
+      let _ = try? NSFileManager.defaultManager().removeItemAtURL(resumeDataURL)
+      
+      task = api.backgroundURLSession.downloadTaskWithResumeData(resumeData)
+    }
+    else {
+      
+      task = api.backgroundURLSession.downloadTaskWithRequest(request)
+    }
     
     task!.resume()
     
     return true
   }
   
+  class func resumeDataURLForMessageId(id: Id) -> NSURL {
+    return NSURL(fileURLWithPath: NSTemporaryDirectory())
+      .URLByAppendingPathComponent(id.UUIDString)
+      .URLByAppendingPathExtension("fetch-resume")
+  }
+  
+  class func cleanupResumeDataForMessageId(id: Id) {
+    let _ = try? NSFileManager.defaultManager().removeItemAtURL(resumeDataURLForMessageId(id))
+  }
+  
 }
 
 
@@ -102,28 +137,56 @@ extension MessageFetchHTTPOperation: BackgroundSessionDownloadOperation {
   
   func taskCompletedWithURL(downloadURL: NSURL) {
     
-    guard let response = task?.response as? NSHTTPURLResponse where response.statusCode == 200 else {
+    // Resumed downloads finish with a partial content response
+    
+    guard let response = task?.response as? NSHTTPURLResponse where response.statusCode == 200 || response.statusCode == 206 else {
       finishWithError(Error.InvalidResponse as NSError)
       return
     }
     
+    MessageFetchHTTPOperation.cleanupResumeDataForMessageId(context.msgHdr!.id)
+    
     do {
 
-      // Deserialize the Msg-Info header
-      
-      if let msgInfoHeader = response.allHeaderFields[MsgInfoHTTPHeader] as? String,
-        let msg = try TBaseUtils.deserialize(Msg(), fromBase64String:msgInfoHeader) as? Msg
-      {
-        context.msg = msg
+      if let protocolName = response.allHeaderFields[MsgPreambleProtocolHTTPHeader] as? String {
+        
+        guard let protocolFactory = TBaseUtils.protocolFactoryNamed(protocolName) else {
+          throw Error.InvalidMessageHeader
+        }
+        
+        // Deserialize the preamble & copy the remaining data to a safe location
+        
+        var msg : Msg?
+        
+        context.encryptedData = try URLDataReference(URL: downloadURL).temporaryDuplicate { inStream, outStream in
+          msg = try TBaseUtils.deserialize(Msg(), fromPreambleOfStream: inStream, usingProtocolFactory: protocolFactory) as? Msg
+          try DataReferences.filterStreamsWithInput(inStream, output: outStream, usingFilter: nil)
+        }
+        
+        guard let preambleMsg = msg else {
+          throw Error.InvalidMessageHeader
+        }
+        
+        context.msg = preambleMsg
       }
       else {
-        throw Error.InvalidMessageHeader
+        
+        // Deserialize the Msg-Info header
+        
+        if let msgInfoHeader = response.allHeaderFields[MsgInfoHTTPHeader] as? String,
+          let msg = try TBaseUtils.deserialize(Msg(), fromBase64String:msgInfoHeader) as? Msg
+        {
+          context.msg = msg
+        }
+        else {
+          throw Error.InvalidMessageHeader
+        }
+        
+        // Copy data to safe location & store it
+        
+        context.encryptedData = try URLDataReference(URL: downloadURL).temporaryDuplicate()
       }
       
-      // Copy data to safe location & store it
-      
-      context.encryptedData = try URLDataReference(URL: downloadURL).temporaryDuplicate()
-      
       finish()
       
     }
@@ -135,6 +198,12 @@ extension MessageFetchHTTPOperation: BackgroundSessionDownloadOperation {
   }
   
   func taskCompletedWithError(error: NSError) {
+    
+    // Save the partial download so a retry resumes where this one stopped
+    
+    if let resumeData = error.userInfo[NSURLSessionDownloadTaskResumeData] as? NSData {
+      resumeData.writeToURL(MessageFetchHTTPOperation.resumeDataURLForMessageId(context.msgHdr!.id), atomically: true)
+    }
    
     finishWithError(error)
     
@@ -98,6 +98,9 @@ class MessageAPIGroupOperation: GroupOperation {
     return nil
   }
   
+  // Stage timings, nil unless the api's operation tracer is enabled
+  internal private(set) var trace : OperationTrace?
+  
   init(api: MessageAPI) {
     self.api = api
     
@@ -132,6 +135,31 @@ class MessageAPIGroupOperation: GroupOperation {
     
   }
   
+  /*
+    Traces this operation, and the stages subsequently added
+    with `addOperation(_:stage:)`, under `id`
+  */
+  func beginTrace(id: Id, stage: String) {
+    
+    trace = api.operationTracer.beginTrace(id.UUIDString)
+    trace?.addStage(self, named: stage)
+  }
+  
+  func addOperation(operation: Operation, stage: String) {
+    
+    if let trace = trace {
+      
+      trace.addStage(operation, named: stage)
+      
+      if let retry = operation as? RetryOperation {
+        retry.traceAttempts(trace, stage: stage)
+      }
+      
+    }
+    
+    addOperation(operation)
+  }
+  
   func promise() -> Promise<Any?> {
     
     if let resolverPromise = resolverPromise {
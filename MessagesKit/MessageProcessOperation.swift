@@ -36,7 +36,17 @@ class MessageProcessOperation: Operation {
       
       try processMsg()
       
-      api.userAPI.ack(context.msg!.id, sent: context.msg!.sent)
+      let msg = context.msg!
+      let receiveWatermark = api.receiveWatermark
+      
+      // Unacknowledged messages stay pending, holding the watermark below them
+      api.userAPI.ack(msg.id, sent: msg.sent).toPromise(Void)
+        .then {
+          receiveWatermark.complete(msg.id, sent: msg.sent)
+        }
+        .error { error in
+          DDLogError("Error acknowledging message: \(error)")
+        }
       
       finish()
     }
@@ -385,8 +395,32 @@ class MessageProcessOperation: Operation {
         
         let cipher = MsgCipher(forKey: key!)
         
-        data = try encryptedData.temporaryDuplicate { inStream, outStream in
-          try cipher.decryptFromStream(inStream, toStream: outStream, withKey: key!)
+        // Undo any compression applied before encryption
+        
+        switch msg.metaData[MetaDataKey_Compression] as? String {
+          
+        case .None:
+          
+          data = try encryptedData.temporaryDuplicate { inStream, outStream in
+            try cipher.decryptFromStream(inStream, toStream: outStream, withKey: key!)
+          }
+          
+        case .Some(CompressionType_Deflate):
+          
+          // Bounds what a hostile sender can make us write
+          let maximumLength = MsgCompression.maximumInflatedSizeForCompressedSize(try encryptedData.dataSize().unsignedLongLongValue)
+          
+          data = try encryptedData.temporaryDuplicate { inStream, outStream in
+            let inflateStream = MsgInflatingOutputStream(outputStream: outStream, maximumLength: maximumLength)
+            try cipher.decryptFromStream(inStream, toStream: inflateStream, withKey: key!)
+            try inflateStream.finish()
+          }
+          
+        case .Some(let compression):
+          
+          DDLogError("MessageProcessOperation: Unsupported compression \(compression)")
+          throw NSError(domain: MsgCompressionErrorDomain, code: Int(MsgCompressionError.UnsupportedType.rawValue), userInfo: nil)
+          
         }
         
       }
@@ -503,10 +537,10 @@ class MessageProcessOperation: Operation {
     
     if message.unreadFlag {
       
-      // We only adjust the unread count if the message was already unread
+      // Counts are maintained by the database, only refresh when it changed
       if !previouslyUnread {
         
-        api.adjustUnreadMessageCountWithDelta(1)
+        api.updateUnreadMessageCount()
         
       }
       
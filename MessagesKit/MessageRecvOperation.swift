@@ -30,6 +30,10 @@ class MessageRecvOperation: MessageAPIGroupOperation, MessageFetchContext {
     
     super.init(api: api)
     
+    beginTrace(msgHdr.id, stage: "recv")
+    
+    api.receiveWatermark.begin(msgHdr.id, sent: nil)
+    
     addCondition(RequireAuthorization(api: api))
     
     let fetch : Operation
@@ -38,7 +42,11 @@ class MessageRecvOperation: MessageAPIGroupOperation, MessageFetchContext {
 
     case .Image, .Audio, .Video:
       
-      fetch = MessageFetchHTTPOperation(context: self, api: api)
+      // Retries resume the interrupted download
+      
+      fetch = RetryOperation(maxAttempts: 3, endpoint: MessageAPI.target.userFetchURL, generator: {
+        return MessageFetchHTTPOperation(context: self, api: api)
+      })
       
     default:
       
@@ -50,7 +58,8 @@ class MessageRecvOperation: MessageAPIGroupOperation, MessageFetchContext {
     save.addDependency(fetch)
     
     
-    [fetch, save].forEach { addOperation($0) }
+    addOperation(fetch, stage: "fetch")
+    addOperation(save, stage: "process")
   }
   
   init(msg: Msg, api: MessageAPI) {
@@ -61,9 +70,13 @@ class MessageRecvOperation: MessageAPIGroupOperation, MessageFetchContext {
     
     super.init(api: api)
     
+    beginTrace(msg.id, stage: "recv")
+    
+    api.receiveWatermark.begin(msg.id, sent: msg.sent)
+    
     let save = MessageProcessOperation(context: self, api: api)
     
-    addOperation(save)
+    addOperation(save, stage: "process")
   }
   
 }
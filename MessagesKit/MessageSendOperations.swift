@@ -21,6 +21,8 @@ class MessageSendBaseOperation: MessageAPIGroupOperation, MessageContext, Messag
   let message : Message
   var recipientInformation : [String: UserInfo]?
   var encryptedData : DataReference?
+  var encryptedDataLength : UInt64?
+  var encryptedDataDigest : NSData?
   var msgPack : MsgPack?
   var sentAt : TimeStamp?
   
@@ -33,6 +35,8 @@ class MessageSendBaseOperation: MessageAPIGroupOperation, MessageContext, Messag
     self.message = message
     
     super.init(api: api)
+    
+    beginTrace(message.id, stage: "send")
 
     addObserver(
       BlockObserver(
@@ -48,6 +52,9 @@ class MessageSendBaseOperation: MessageAPIGroupOperation, MessageContext, Messag
           
           if !errors.isEmpty {
             
+            // Any partial upload is useless once the message is re-encrypted
+            MessageTransmitHTTPOperation.cleanupUploadForMessageId(message.id)
+            
             try! api.messageDAO.updateMessage(message, withStatus: api.networkAvailable ? .Failed : .Unsent)
             
           }
@@ -96,7 +103,7 @@ class MessageSendOperation: MessageSendBaseOperation, MessageBuildContext {
     
     // Resolve operation
     
-    let resolve = RetryOperation(maxAttempts: 3, failureErrors: failures, generator:{
+    let resolve = RetryOperation(maxAttempts: 3, failureErrors: failures, endpoint: MessageAPI.target.publicURL, generator:{
       return MessageRecipientResolveOperation(context: self, api: api)
     })
     
@@ -117,15 +124,17 @@ class MessageSendOperation: MessageSendBaseOperation, MessageBuildContext {
       
     case .Image, .Audio, .Video:
       
-      // Transmit via HTTP upload
+      // Transmit via HTTP upload (retries resume from the last confirmed offset)
       
-      transmit = MessageTransmitHTTPOperation(context: self, api: api)
+      transmit = RetryOperation(maxAttempts: 3, failureErrors: failures, endpoint: MessageAPI.target.userSendURL, generator: {
+        return MessageTransmitHTTPOperation(context: self, api: api)
+      })
       
     default:
       
       // Transmit via API send
       
-      transmit = RetryOperation(maxAttempts: 3, failureErrors:failures, generator: {
+      transmit = RetryOperation(maxAttempts: 3, failureErrors:failures, endpoint: MessageAPI.target.userURL, generator: {
         return MessageTransmitAPIOperation(context: self, userAPI: api.userAPI)
       })
       
@@ -138,7 +147,11 @@ class MessageSendOperation: MessageSendBaseOperation, MessageBuildContext {
     let finish = MessageFinishOperation(messageContext: self, transmitContext: self, dao: api.messageDAO)
     finish.addDependency(transmit)
     
-    [resolve, encrypt, build, transmit, finish].forEach { addOperation($0) }
+    addOperation(resolve, stage: "resolve")
+    addOperation(encrypt, stage: "encrypt")
+    addOperation(build, stage: "build")
+    addOperation(transmit, stage: "transmit")
+    addOperation(finish, stage: "finish")
   }
   
 }
@@ -162,7 +175,8 @@ class MessageSendResurrectedOperation: MessageSendBaseOperation {
     let finish = MessageFinishOperation(messageContext: self, transmitContext: self, dao: api.messageDAO)
     finish.addDependency(transmit)
     
-    [transmit, finish].forEach { addOperation($0) }
+    addOperation(transmit, stage: "transmit")
+    addOperation(finish, stage: "finish")
     
   }
   
@@ -25,6 +25,10 @@ class MessageSendSystemOperation: MessageAPIGroupOperation, MessageResolveContex
   
   var encryptedData : DataReference?
   
+  var encryptedDataLength : UInt64?
+  
+  var encryptedDataDigest : NSData?
+  
   var sentAt : TimeStamp?
   
   
@@ -57,7 +61,7 @@ class MessageSendSystemOperation: MessageAPIGroupOperation, MessageResolveContex
     
     // Resolve operation
     
-    let resolve = RetryOperation(maxAttempts: 3, failureErrors:failures, generator:{
+    let resolve = RetryOperation(maxAttempts: 3, failureErrors:failures, endpoint: MessageAPI.target.publicURL, generator:{
       return MessageRecipientResolveOperation(context: self, api: api)
     })
     
@@ -69,7 +73,7 @@ class MessageSendSystemOperation: MessageAPIGroupOperation, MessageResolveContex
     
     // Transmit operation
     
-    let transmit = RetryOperation(maxAttempts: 3, failureErrors:failures, generator: {
+    let transmit = RetryOperation(maxAttempts: 3, failureErrors:failures, endpoint: MessageAPI.target.userURL, generator: {
       return MessageTransmitAPIOperation(context: self, userAPI: api.userAPI)
     })
     
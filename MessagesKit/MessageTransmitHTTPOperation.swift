@@ -9,18 +9,31 @@
 import Foundation
 import PSOperations
 import Thrift
+import CocoaLumberjack
 
 
 /*
   Transmits the message via the HTTP upload API
+
+  Uploads are resumable (see ChunkedUpload) so interrupted,
+  retried & resurrected transmits continue from the last offset
+  the server confirmed.
 */
 class MessageTransmitHTTPOperation: Operation {
   
+  enum Error: ErrorType {
+    case InvalidRequest
+  }
+  
   
   var context : MessageTransmitContext
   
   var task : NSURLSessionUploadTask?
   
+  var upload : ChunkedUpload?
+  
+  var baseRequest : NSURLRequest?
+  
   let api : MessageAPI
   
   
@@ -51,14 +64,16 @@ class MessageTransmitHTTPOperation: Operation {
       // Resurrected transmit operations will already
       // have a task reference
       
-      if task == nil {
+      if let task = task {
+        try resumeUpload(task)
+      }
+      else {
         try initiateUpload()
       }
       
       // Wait for task notification from background transfer service
       
-      let backgroundOperations = api.backgroundURLSession.delegate as! BackgroundSessionOperations
-      backgroundOperations.addOperation(self)
+      waitForTask()
       
     }
     catch let error as NSError {
@@ -69,6 +84,7 @@ class MessageTransmitHTTPOperation: Operation {
   
   override func cancel() {
     task?.cancel()
+    upload?.removeChunk()
     super.cancel()
   }
   
@@ -76,46 +92,155 @@ class MessageTransmitHTTPOperation: Operation {
     return "Send: Transmit (HTTP)"
   }
   
+  private func waitForTask() {
+    
+    let backgroundOperations = api.backgroundURLSession.delegate as! BackgroundSessionOperations
+    backgroundOperations.addOperation(self)
+    
+  }
+  
   private func initiateUpload() throws {
     
     // Build request
     //
-    let msgInfo = try TBaseUtils.serializeToBase64String(context.msgPack!)
-    
     let request = NSMutableURLRequest(URL: MessageAPI.target.userSendURL)
     request.HTTPMethod = "POST";
     request.addHTTPBearerAuthorizationWithToken(api.accessToken)
     request.setValue(OctetStreamContentType, forHTTPHeaderField: ContentTypeHTTPHeader)
     request.setValue(ThriftContentType, forHTTPHeaderField: AcceptHTTPHeader)
-    request.setValue("\(try context.encryptedData!.dataSize())", forHTTPHeaderField: ContentLengthHTTPHeader)
-    request.setValue(msgInfo, forHTTPHeaderField: MsgInfoHTTPHeader)
+    request.setValue(context.msgPack!.id.UUIDString, forHTTPHeaderField: MsgIdHTTPHeader)
     
-    // Generate file for uploading
+    // Send the message pack in a body preamble when supported; a header holding
+    // every recipient's envelope grows too large for proxies with big groups
     //
+    var preamble : NSData?
     
+    if let protocolName = api.transferPreambleProtocolName, let protocolFactory = TBaseUtils.protocolFactoryNamed(protocolName) {
+      preamble = try TBaseUtils.serializeToPreamble(context.msgPack!, usingProtocolFactory: protocolFactory)
+      request.setValue(protocolName, forHTTPHeaderField: MsgPreambleProtocolHTTPHeader)
+    }
+    else {
+      request.setValue(try TBaseUtils.serializeToBase64String(context.msgPack!), forHTTPHeaderField: MsgInfoHTTPHeader)
+    }
     
-    let sendTempURL = NSURL(fileURLWithPath: NSTemporaryDirectory())
-      .URLByAppendingPathComponent(context.msgPack!.id.UUIDString)
-      .URLByAppendingPathExtension("send")
-    let _ = try? NSFileManager.defaultManager().removeItemAtURL(sendTempURL)
+    // Generate file for uploading (unless encrypted directly into it)
+    //
     
-    try context.encryptedData?.writeToURL(sendTempURL)
+    let sendTempURL = MessageTransmitHTTPOperation.uploadFileURLForMessageId(context.msgPack!.id)
     
-    // Initiate upload task
+    if (context.encryptedData as? URLDataReference)?.URL != sendTempURL {
+      
+      let _ = try? NSFileManager.defaultManager().removeItemAtURL(sendTempURL)
+      
+      try context.encryptedData?.writeToURL(sendTempURL)
+      
+      context.encryptedDataLength = nil
+    }
+    
+    let contentLength = try context.encryptedDataLength ?? context.encryptedData!.dataSize().unsignedLongLongValue
+    
+    // Picks up progress confirmed by a previous attempt of this same payload
     //
-    task = api.backgroundURLSession.uploadTaskWithRequest(request, fromFile: sendTempURL)
+    upload = ChunkedUpload(fileURL: sendTempURL, length: UInt64(preamble?.length ?? 0) + contentLength, digest: context.encryptedDataDigest, preamble: preamble)
     
-    task!.resume()
+    baseRequest = request
+    
+    try uploadNextChunk()
   }
   
-  func cleanup() {
+  private func resumeUpload(task: NSURLSessionUploadTask) throws {
+    
+    let request = task.originalRequest!
+    
+    upload = try MessageTransmitHTTPOperation.restoreUploadForRequest(request).upload
     
-    // Remove temporary file
-    let sendTempURL = NSURL(fileURLWithPath: NSTemporaryDirectory())
-      .URLByAppendingPathComponent(context.msgPack!.id.UUIDString)
+    let baseRequest = request.mutableCopy() as! NSMutableURLRequest
+    baseRequest.setValue(nil, forHTTPHeaderField: ContentRangeHTTPHeader)
+    baseRequest.setValue(nil, forHTTPHeaderField: ContentLengthHTTPHeader)
+    self.baseRequest = baseRequest
+  }
+  
+  /*
+    Restores the upload & message pack of an in-flight upload request; everything
+    needed is carried by its headers & the persisted upload progress
+  */
+  class func restoreUploadForRequest(request: NSURLRequest) throws -> (upload: ChunkedUpload, msgPack: MsgPack) {
+    
+    guard
+      let msgIdHeader = request.valueForHTTPHeaderField(MsgIdHTTPHeader),
+      let msgId = Id(string: msgIdHeader),
+      let contentRange = request.valueForHTTPHeaderField(ContentRangeHTTPHeader),
+      let lengthString = contentRange.componentsSeparatedByString("/").last,
+      let length = UInt64(lengthString)
+    else {
+      throw Error.InvalidRequest
+    }
+    
+    var digest : NSData?
+    if let digestHeader = request.valueForHTTPHeaderField(DigestHTTPHeader) where digestHeader.hasPrefix("SHA-256=") {
+      digest = NSData(base64EncodedString: digestHeader.substringFromIndex(digestHeader.startIndex.advancedBy(8)), options: [])
+    }
+    
+    let upload = ChunkedUpload(fileURL: uploadFileURLForMessageId(msgId), length: length, digest: digest)
+    
+    let msgPack : MsgPack?
+    
+    if let protocolName = request.valueForHTTPHeaderField(MsgPreambleProtocolHTTPHeader) {
+      
+      guard let protocolFactory = TBaseUtils.protocolFactoryNamed(protocolName) else {
+        throw Error.InvalidRequest
+      }
+      
+      let preambleStream = NSInputStream(data: upload.preamble)
+      preambleStream.open()
+      defer { preambleStream.close() }
+      
+      msgPack = try TBaseUtils.deserialize(MsgPack(), fromPreambleOfStream: preambleStream, usingProtocolFactory: protocolFactory) as? MsgPack
+    }
+    else if let msgInfoHeader = request.valueForHTTPHeaderField(MsgInfoHTTPHeader) {
+      
+      msgPack = try TBaseUtils.deserialize(MsgPack(), fromBase64String: msgInfoHeader) as? MsgPack
+    }
+    else {
+      
+      msgPack = nil
+    }
+    
+    guard let foundMsgPack = msgPack else {
+      throw Error.InvalidRequest
+    }
+    
+    return (upload, foundMsgPack)
+  }
+  
+  private func uploadNextChunk() throws {
+    
+    let (request, bodyURL) = try upload!.nextRequest(baseRequest!)
+    
+    task = api.backgroundURLSession.uploadTaskWithRequest(request, fromFile: bodyURL)
+    
+    task!.resume()
+  }
+  
+  class func uploadFileURLForMessageId(id: Id) -> NSURL {
+    return NSURL(fileURLWithPath: NSTemporaryDirectory())
+      .URLByAppendingPathComponent(id.UUIDString)
       .URLByAppendingPathExtension("send")
+  }
+  
+  class func cleanupUploadForMessageId(id: Id) {
+    
+    // Remove temporary file, request body & upload progress
+    let sendTempURL = uploadFileURLForMessageId(id)
     let _ = try? NSFileManager.defaultManager().removeItemAtURL(sendTempURL)
     
+    ChunkedUpload(fileURL: sendTempURL, length: 0, digest: nil).cleanup()
+  }
+  
+  func cleanup() {
+    
+    MessageTransmitHTTPOperation.cleanupUploadForMessageId(context.msgPack!.id)
+    
   }
   
 }
@@ -126,12 +251,28 @@ extension MessageTransmitHTTPOperation: BackgroundSessionUploadOperation {
     return task!.taskIdentifier
   }
   
-  func taskCompletedWithData(data: NSData) {
-    
-    cleanup()
+  func taskCompletedWithResponse(response: NSHTTPURLResponse, data: NSData) {
     
     do {
       
+      switch try upload!.processResponse(response, data: data) {
+        
+      case .Incomplete(let offset):
+        
+        DDLogDebug("MessageTransmitHTTPOperation: Confirmed \(offset)/\(upload!.length)")
+        
+        try uploadNextChunk()
+        
+        waitForTask()
+        
+        return
+        
+      case .Complete:
+        
+        cleanup()
+        
+      }
+      
       let resultClass = NSClassFromString("UserAPI_send_result") as! NSObject.Type
 
       if let result = try TBaseUtils.deserialize(resultClass.init() as! TBase, fromData: data) as? NSObject {
@@ -178,7 +319,10 @@ extension MessageTransmitHTTPOperation: BackgroundSessionUploadOperation {
   
   func taskCompletedWithError(error: NSError) {
     
-    cleanup()
+    // Keep the upload file & progress so a retry resumes
+    // from the last confirmed offset
+    
+    upload?.interrupted()
     
     finishWithError(error)
   }
@@ -18,9 +18,9 @@ static Id *null;
 
 +(void) initialize
 {
-  NSMutableData *data = [NSMutableData dataWithLength:16];
-  uuid_clear([data mutableBytes]);
-  null = [Id idWithData:data];
+  uuid_t bytes;
+  uuid_clear(bytes);
+  null = [Id.alloc initWithBytes:bytes];
 }
 
 -(id) initWithString:(NSString *)str
@@ -28,19 +28,19 @@ static Id *null;
   if (!str.length) {
     return null;
   }
-  NSMutableData *data = [NSMutableData dataWithLength:16];
-  int res = uuid_parse([str UTF8String], [data mutableBytes]);
+  uuid_t bytes;
+  int res = uuid_parse([str UTF8String], bytes);
   if (res) {
     return null;
   }
-  return [self initWithData:data];
+  return [self initWithBytes:bytes];
 }
 
 -(id) initWithUUID:(NSUUID *)uuid
 {
-  NSMutableData *data = [NSMutableData dataWithLength:16];
-  [uuid getUUIDBytes:[data mutableBytes]];
-  return [self initWithData:data];
+  uuid_t bytes;
+  [uuid getUUIDBytes:bytes];
+  return [self initWithBytes:bytes];
 }
 
 +(Id *) idWithString:(NSString *)value
@@ -68,15 +68,15 @@ static Id *null;
 
 +(Id *) generate
 {
-  NSMutableData *data = [NSMutableData dataWithLength:16];
-  uuid_generate_time([data mutableBytes]);
-  return [Id idWithData:data];
+  uuid_t bytes;
+  uuid_generate_time(bytes);
+  return [Id.alloc initWithBytes:bytes];
 }
 
 -(NSString *) UUIDString
 {
   uuid_string_t str;
-  uuid_unparse([self.data bytes], str);
+  uuid_unparse(self.bytes, str);
   return [NSString stringWithUTF8String:str];
 }
 
@@ -87,13 +87,19 @@ static Id *null;
 
 -(BOOL) isNull
 {
-  return uuid_is_null([self.data bytes]);
+  return uuid_is_null(self.bytes);
 }
 
 -(NSComparisonResult) compare:(Id *)other
 {
-  int res = uuid_compare([self.data bytes], [other.data bytes]);
-  return res < 0 ? (NSOrderedAscending) : (res > 0 ? NSOrderedDescending : NSOrderedSame);
+  // Big endian words order as the bytes (and SQLite's blobs) do
+  const UInt64 *words = self.bytes, *otherWords = other.bytes;
+  UInt64 value = CFSwapInt64BigToHost(words[0]), otherValue = CFSwapInt64BigToHost(otherWords[0]);
+  if (value == otherValue) {
+    value = CFSwapInt64BigToHost(words[1]);
+    otherValue = CFSwapInt64BigToHost(otherWords[1]);
+  }
+  return value < otherValue ? (NSOrderedAscending) : (value > otherValue ? NSOrderedDescending : NSOrderedSame);
 }
 
 @end
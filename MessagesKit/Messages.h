@@ -19,6 +19,8 @@
 
 #import <PromiseKit/PromiseKit.h>
 
+#import "Id.h"
+
 typedef NS_ENUM(SInt32, AliasType) {
   AliasTypeEMailAddress = 0,
   AliasTypePhoneNumber = 1
@@ -111,17 +113,6 @@ typedef NSArray<DirectEnvelope *> * DirectEnvelopeList;
 
 typedef NSMutableArray<DirectEnvelope *> * MutableDirectEnvelopeList;
 
-@interface Id : NSObject <TBase, NSCoding, NSCopying> 
-
-@property (strong, nonatomic) NSData * data;
-@property (assign, nonatomic) BOOL dataIsSet;
-- (void) unsetData;
-
-
-- (instancetype) initWithData: (NSData *) data;
-
-@end
-
 @interface Group : NSObject <TBase, NSCoding, NSCopying> 
 
 @property (strong, nonatomic) Id * chat;
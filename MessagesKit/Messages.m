@@ -21,157 +21,6 @@
 
 #import "Messages.h"
 
-@implementation Id
-
-- (instancetype) init
-{
-  self = [super init];
-  if (self)  {
-  }
-  return self;
-}
-
-- (instancetype) initWithData: (NSData *) data
-{
-  self = [super init];
-  if (self)  {
-    _data = data;
-    _dataIsSet = YES;
-  }
-  return self;
-}
-
-- (instancetype) initWithCoder: (NSCoder *) decoder
-{
-  self = [super init];
-  if (self)   {
-    if ([decoder containsValueForKey: @"data"])
-    {
-      _data = [decoder decodeObjectForKey: @"data"];
-      _dataIsSet = YES;
-    }
-  }
-  return self;
-}
-
-- (void) encodeWithCoder: (NSCoder *) encoder
-{
-  if (_dataIsSet)
-  {
-    [encoder encodeObject: _data forKey: @"data"];
-  }
-}
-
-- (NSUInteger) hash
-{
-  NSUInteger hash = 17;
-  hash = (hash * 31) ^ _dataIsSet ? 2654435761 : 0;
-  if (_dataIsSet)
-  {
-    hash = (hash * 31) ^ [_data hash];
-  }
-  return hash;
-}
-
-- (BOOL) isEqual: (id) anObject
-{
-  if (self == anObject) {
-    return YES;
-  }
-  if (![anObject isKindOfClass:[Id class]]) {
-    return NO;
-  }
-  Id *other = (Id *)anObject;
-  if ((_dataIsSet != other->_dataIsSet) ||
-      (_dataIsSet && ((_data || other->_data) && ![_data isEqual:other->_data]))) {
-    return NO;
-  }
-  return YES;
-}
-
-- (instancetype) copyWithZone:(NSZone *)zone
-{
-  Id * val = [Id new];
-  val.data = [self.data copy];
-  return val;
-}
-
-- (void) setData: (NSData *) data {
-  _data = data;
-  _dataIsSet = YES;
-}
-
-- (void) unsetData {
-  _data = nil;
-  _dataIsSet = NO;
-}
-
-- (BOOL) read: (id <TProtocol>) inProtocol error: (NSError *__autoreleasing *)__thriftError
-{
-  NSString * fieldName;
-  SInt32 fieldType;
-  SInt32 fieldID;
-
-  if (![inProtocol readStructBeginReturningName: NULL error: __thriftError]) return NO;
-  while (true)
-  {
-    if (![inProtocol readFieldBeginReturningName: &fieldName type: &fieldType fieldID: &fieldID error: __thriftError]) return NO;
-    if (fieldType == TTypeSTOP) { 
-      break;
-    }
-    switch (fieldID)
-    {
-      case 1:
-        if (fieldType == TTypeSTRING) {
-          NSData * fieldValue;
-          if (![inProtocol readBinary:&fieldValue error: __thriftError]) return NO;
-          self.data = fieldValue;
-        } else { 
-          NSLog(@"%s: field ID %i has unexpected type %i.  Skipping.", __PRETTY_FUNCTION__, (int)fieldID, (int)fieldType);
-          if (![TProtocolUtil skipType: fieldType onProtocol: inProtocol error: __thriftError]) return NO;
-        }
-        break;
-      default:
-        NSLog(@"%s: unexpected field ID %i with type %i.  Skipping.", __PRETTY_FUNCTION__, (int)fieldID, (int)fieldType);
-        if (![TProtocolUtil skipType: fieldType onProtocol: inProtocol error: __thriftError]) return NO;
-        break;
-    }
-    if (![inProtocol readFieldEnd: __thriftError]) return NO;
-  }
-  if (![inProtocol readStructEnd: __thriftError]) return NO;
-  if (![self validate: __thriftError]) return NO;
-  return YES;
-}
-
-- (BOOL) write: (id <TProtocol>) outProtocol error: (NSError *__autoreleasing *)__thriftError {
-  if (![outProtocol writeStructBeginWithName: @"Id" error: __thriftError]) return NO;
-  if (_dataIsSet) {
-    if (_data != nil) {
-      if (![outProtocol writeFieldBeginWithName: @"data" type: TTypeSTRING fieldID: 1 error: __thriftError]) return NO;
-      if (![outProtocol writeBinary: _data error: __thriftError]) return NO;
-      if (![outProtocol writeFieldEnd: __thriftError]) return NO;
-    }
-  }
-  if (![outProtocol writeFieldStop: __thriftError]) return NO;
-  if (![outProtocol writeStructEnd: __thriftError]) return NO;
-  return YES;
-}
-
-- (BOOL) validate: (NSError *__autoreleasing *)__thriftError {
-  // check for required fields
-  if (!_dataIsSet)   {
-    if (__thriftError)     {
-      *__thriftError = [NSError errorWithDomain: TProtocolErrorDomain
-                                           code: TProtocolErrorUnknown
-                                       userInfo: @{TProtocolErrorExtendedErrorKey: @(TProtocolExtendedErrorMissingRequiredField),
-                                                   TProtocolErrorFieldNameKey: @"data"}];
-    }
-  }
-  return YES;
-}
-
-@end
-
 @implementation Group
 
 - (instancetype) init
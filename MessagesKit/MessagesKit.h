@@ -15,10 +15,13 @@ FOUNDATION_EXPORT double MessagesKitVersionNumber;
 FOUNDATION_EXPORT const unsigned char MessagesKitVersionString[];
 
 
+#import "Id.h"
 #import "Messages.h"
 #import "Messages+Exts.h"
 
 #import "DBManager.h"
+#import "DBTracer.h"
+#import "StartupTrace.h"
 
 #import "DBCodeMigrations.h"
 #import "SQLBuilder.h"
@@ -34,6 +37,9 @@ FOUNDATION_EXPORT const unsigned char MessagesKitVersionString[];
 #import "URLDataReference.h"
 #import "MemoryDataReference.h"
 #import "ExternalFileDataReference.h"
+#import "ExternalFileCollector.h"
+#import "ExternalFileStore.h"
+#import "DeletedMessageFilter.h"
 
 #import "Model.h"
 #import "Message.h"
@@ -67,6 +73,7 @@ FOUNDATION_EXPORT const unsigned char MessagesKitVersionString[];
 
 #import "MsgSigner.h"
 #import "MsgCipher.h"
+#import "MsgCompression.h"
 
 #import "URLSessionSSLValidator.h"
 #import "NSURLSessionConfiguration+MessageAPI.h"
@@ -78,6 +85,7 @@ FOUNDATION_EXPORT const unsigned char MessagesKitVersionString[];
 
 #import "NetworkConnectivity.h"
 #import "HTTPSessionTransportFactory.h"
+#import "WebSocketTransportFactory.h"
 
 #import "Settings.h"
 
@@ -24,6 +24,8 @@ NS_ASSUME_NONNULL_BEGIN
 -(BOOL) load:(FMResultSet *)resultSet dao:(DAO *)dao error:(NSError **)error;
 -(BOOL) save:(NSMutableDictionary *)values dao:(DAO *)dao error:(NSError **)error;
 
+// Called before the saving transaction begins, for work that must not hold the writer
+-(BOOL) willSaveInDAO:(DAO *)dao error:(NSError **)error;
 -(BOOL) willInsertIntoDAO:(DAO *)dao error:(NSError **)error;
 -(BOOL) willUpdateInDAO:(DAO *)dao error:(NSError **)error;
 -(BOOL) didDeleteFromDAO:(DAO *)dao error:(NSError **)error;
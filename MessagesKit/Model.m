@@ -8,7 +8,7 @@
 
 #import "Model.h"
 
-#import "DAO.h"
+#import "DAO+Internal.h"
 #import "Messages+Exts.h"
 #import "NSObject+Utils.h"
 #import "NSMutableDictionary+Utils.h"
@@ -27,7 +27,7 @@
 {
   if ([object isKindOfClass:[Model class]]) {
     Model *other = object;
-    return isEqual(self.dbId, other.dbId);
+    return isEqual(self.id, other.id);
   }
   return NO;
 }
@@ -53,13 +53,18 @@
 
 -(BOOL)load:(FMResultSet *)resultSet dao:(DAO *)dao error:(NSError *__autoreleasing *)error
 {
-  self.dbId = [resultSet objectForColumnIndex:dao.tableInfo.idFieldIndex.intValue];
+  // dbId is assigned by the DAO, which already read it to probe its caches
   return YES;
 }
 
 -(BOOL)save:(NSMutableDictionary *)values dao:(DAO *)dao error:(NSError *__autoreleasing *)error
 {
-  [values setNillableObject:self.dbId forKey:@"id"];
+  [values setNillableObject:[dao parameterForDbId:self.dbId] forKey:@"id"];
+  return YES;
+}
+
+-(BOOL) willSaveInDAO:(DAO *)dao error:(NSError **)error
+{
   return YES;
 }
 
@@ -0,0 +1,89 @@
+//
+//  MsgCompression.h
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+@import Foundation;
+
+#import "Messages.h"
+#import "DataReference.h"
+
+
+NS_ASSUME_NONNULL_BEGIN
+
+
+extern NSString *const MsgCompressionErrorDomain;
+
+typedef NS_ENUM(int, MsgCompressionError) {
+  MsgCompressionErrorInitFailed         = 0,
+  MsgCompressionErrorCompressFailed     = 1,
+  MsgCompressionErrorDecompressFailed   = 2,
+  MsgCompressionErrorTruncated          = 3,
+  MsgCompressionErrorUnsupportedType    = 4,
+  MsgCompressionErrorSizeLimit          = 5,
+};
+
+
+// Meta data key naming the compression applied to a payload before it was encrypted
+extern NSString *const MetaDataKey_Compression;
+
+extern NSString *const CompressionType_Deflate;
+
+
+@interface MsgCompression : NSObject
+
+// Payloads smaller than this gain less than a cipher block or two from compression
++(unsigned long long) minimumCompressibleSize;
+
+// Whether payloads of the type & size are compressed before encryption
++(BOOL) shouldCompressPayloadOfType:(MsgType)type size:(unsigned long long)size;
+
+// Largest payload (of any compressible type) inflating will produce
++(unsigned long long) maximumInflatedSize;
+
+// Most a valid stream of compressed bytes can inflate to, capped at the maximum inflated size
++(unsigned long long) maximumInflatedSizeForCompressedSize:(unsigned long long)size;
+
++(nullable NSData *) deflateData:(NSData *)data error:(NSError **)error;
++(nullable NSData *) inflateData:(NSData *)data error:(NSError **)error;
+
+@end
+
+
+/*
+ * MsgDeflatingInputStream
+ *
+ * Reads zlib compressed bytes of another input stream, allowing
+ * compression to be chained in front of a stream filter (e.g. MsgCipher)
+ */
+@interface MsgDeflatingInputStream : NSObject <DataInputStream>
+
+-(instancetype) init NS_UNAVAILABLE;
+-(instancetype) initWithInputStream:(id<DataInputStream>)inputStream NS_DESIGNATED_INITIALIZER;
+
+@end
+
+
+/*
+ * MsgInflatingOutputStream
+ *
+ * Decompresses zlib compressed bytes written to it into another output
+ * stream. Call finishAndReturnError: after the last write to detect
+ * truncated input. Writes fail with MsgCompressionErrorSizeLimit once
+ * more than the maximum length would be produced.
+ */
+@interface MsgInflatingOutputStream : NSObject <DataOutputStream>
+
+-(instancetype) init NS_UNAVAILABLE;
+-(instancetype) initWithOutputStream:(id<DataOutputStream>)outputStream;
+-(instancetype) initWithOutputStream:(id<DataOutputStream>)outputStream maximumLength:(unsigned long long)maximumLength NS_DESIGNATED_INITIALIZER;
+
+-(BOOL) finishAndReturnError:(NSError **)error;
+
+@end
+
+
+NS_ASSUME_NONNULL_END
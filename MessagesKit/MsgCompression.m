@@ -0,0 +1,324 @@
+//
+//  MsgCompression.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "MsgCompression.h"
+
+#import <zlib.h>
+
+
+#define BUFFER_SIZE (16 * 1024)
+
+// Deflate cannot encode more than 258 bytes in fewer than 2 bits, so no
+// valid stream inflates to more than ~1032 times its size
+#define MAX_DEFLATE_RATIO 1032
+
+
+NSString *const MsgCompressionErrorDomain = @"MsgCompressionErrorDomain";
+
+NSString *const MetaDataKey_Compression = @"compression";
+
+NSString *const CompressionType_Deflate = @"deflate";
+
+
+static NSError *MakeError(MsgCompressionError code, z_stream *stream)
+{
+  NSString *description = stream->msg ? @(stream->msg) : @"Unknown zlib error";
+  return [NSError errorWithDomain:MsgCompressionErrorDomain code:code userInfo:@{NSLocalizedDescriptionKey: description}];
+}
+
+
+@implementation MsgCompression
+
++(unsigned long long) minimumCompressibleSize
+{
+  return 512;
+}
+
++(BOOL) shouldCompressPayloadOfType:(MsgType)type size:(unsigned long long)size
+{
+  switch (type) {
+  case MsgTypeText:
+  case MsgTypeContact:
+    return size >= self.minimumCompressibleSize;
+
+  default:
+    // Media formats are already compressed
+    return NO;
+  }
+}
+
++(unsigned long long) maximumInflatedSize
+{
+  return 16 * 1024 * 1024;
+}
+
++(unsigned long long) maximumInflatedSizeForCompressedSize:(unsigned long long)size
+{
+  if (size > self.maximumInflatedSize / MAX_DEFLATE_RATIO) {
+    return self.maximumInflatedSize;
+  }
+  return size * MAX_DEFLATE_RATIO;
+}
+
++(NSData *) deflateData:(NSData *)data error:(NSError **)error
+{
+  NSInputStream *inStream = [NSInputStream inputStreamWithData:data];
+  [inStream open];
+
+  MsgDeflatingInputStream *deflateStream = [MsgDeflatingInputStream.alloc initWithInputStream:inStream];
+
+  NSMutableData *deflated = [NSMutableData data];
+
+  UInt8 buffer[BUFFER_SIZE];
+
+  for (;;) {
+
+    NSUInteger bytesRead = 0;
+    if (![deflateStream readBytesOfMaxLength:sizeof(buffer) intoBuffer:buffer bytesRead:&bytesRead error:error]) {
+      [deflateStream close];
+      return nil;
+    }
+
+    if (!bytesRead) {
+      break;
+    }
+
+    [deflated appendBytes:buffer length:bytesRead];
+  }
+
+  [deflateStream close];
+
+  return deflated;
+}
+
++(NSData *) inflateData:(NSData *)data error:(NSError **)error
+{
+  NSOutputStream *outStream = [NSOutputStream outputStreamToMemory];
+  [outStream open];
+
+  MsgInflatingOutputStream *inflateStream = [MsgInflatingOutputStream.alloc initWithOutputStream:outStream
+                                                                                maximumLength:[self maximumInflatedSizeForCompressedSize:data.length]];
+
+  BOOL result = [inflateStream writeBytesFromBuffer:data.bytes length:data.length error:error] &&
+                [inflateStream finishAndReturnError:error];
+
+  [inflateStream close];
+
+  if (!result) {
+    return nil;
+  }
+
+  return [outStream propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+}
+
+@end
+
+
+@interface MsgDeflatingInputStream () {
+  id<DataInputStream> _inputStream;
+  z_stream _stream;
+  BOOL _initialized;
+  BOOL _inputEnded;
+  BOOL _finished;
+  UInt8 _buffer[BUFFER_SIZE];
+}
+
+@end
+
+
+@implementation MsgDeflatingInputStream
+
+-(instancetype) initWithInputStream:(id<DataInputStream>)inputStream
+{
+  self = [super init];
+  if (self) {
+    _inputStream = inputStream;
+  }
+  return self;
+}
+
+-(void) dealloc
+{
+  if (_initialized) {
+    deflateEnd(&_stream);
+  }
+}
+
+-(NSUInteger) availableBytes
+{
+  return _finished ? 0 : 1;
+}
+
+-(BOOL) readBytesOfMaxLength:(NSUInteger)maxLength intoBuffer:(UInt8 *)buffer bytesRead:(NSUInteger *)bytesRead error:(NSError **)error
+{
+  if (!_initialized) {
+    if (deflateInit(&_stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+      if (error) {
+        *error = MakeError(MsgCompressionErrorInitFailed, &_stream);
+      }
+      return NO;
+    }
+    _initialized = YES;
+  }
+
+  _stream.next_out = buffer;
+  _stream.avail_out = (uInt)MIN(maxLength, UINT_MAX);
+
+  while (_stream.avail_out && !_finished) {
+
+    if (!_stream.avail_in && !_inputEnded) {
+
+      NSUInteger sourceRead = 0;
+      if (![_inputStream readBytesOfMaxLength:sizeof(_buffer) intoBuffer:_buffer bytesRead:&sourceRead error:error]) {
+        return NO;
+      }
+
+      _inputEnded = sourceRead == 0;
+
+      _stream.next_in = _buffer;
+      _stream.avail_in = (uInt)sourceRead;
+    }
+
+    int res = deflate(&_stream, _inputEnded ? Z_FINISH : Z_NO_FLUSH);
+    if (res == Z_STREAM_END) {
+      _finished = YES;
+    }
+    else if (res != Z_OK && res != Z_BUF_ERROR) {
+      if (error) {
+        *error = MakeError(MsgCompressionErrorCompressFailed, &_stream);
+      }
+      return NO;
+    }
+
+  }
+
+  *bytesRead = (UInt8 *)_stream.next_out - buffer;
+
+  return YES;
+}
+
+-(void) close
+{
+  [_inputStream close];
+}
+
+@end
+
+
+@interface MsgInflatingOutputStream () {
+  id<DataOutputStream> _outputStream;
+  unsigned long long _maximumLength;
+  unsigned long long _totalProduced;
+  z_stream _stream;
+  BOOL _initialized;
+  BOOL _finished;
+  UInt8 _buffer[BUFFER_SIZE];
+}
+
+@end
+
+
+@implementation MsgInflatingOutputStream
+
+-(instancetype) initWithOutputStream:(id<DataOutputStream>)outputStream
+{
+  return [self initWithOutputStream:outputStream maximumLength:MsgCompression.maximumInflatedSize];
+}
+
+-(instancetype) initWithOutputStream:(id<DataOutputStream>)outputStream maximumLength:(unsigned long long)maximumLength
+{
+  self = [super init];
+  if (self) {
+    _outputStream = outputStream;
+    _maximumLength = maximumLength;
+  }
+  return self;
+}
+
+-(void) dealloc
+{
+  if (_initialized) {
+    inflateEnd(&_stream);
+  }
+}
+
+-(BOOL) writeBytesFromBuffer:(const UInt8 *)buffer length:(NSUInteger)length error:(NSError **)error
+{
+  if (!_initialized) {
+    if (inflateInit(&_stream) != Z_OK) {
+      if (error) {
+        *error = MakeError(MsgCompressionErrorInitFailed, &_stream);
+      }
+      return NO;
+    }
+    _initialized = YES;
+  }
+
+  _stream.next_in = (Bytef *)buffer;
+  _stream.avail_in = (uInt)length;
+
+  // Continue while input remains or a full buffer suggests more output is pending
+  do {
+
+    _stream.next_out = _buffer;
+    _stream.avail_out = sizeof(_buffer);
+
+    int res = inflate(&_stream, Z_NO_FLUSH);
+    if (res == Z_STREAM_END) {
+      _finished = YES;
+    }
+    else if (res != Z_OK && res != Z_BUF_ERROR) {
+      if (error) {
+        *error = MakeError(MsgCompressionErrorDecompressFailed, &_stream);
+      }
+      return NO;
+    }
+
+    NSUInteger produced = sizeof(_buffer) - _stream.avail_out;
+    if (!produced && res == Z_BUF_ERROR) {
+      break;
+    }
+
+    _totalProduced += produced;
+    if (_totalProduced > _maximumLength) {
+      if (error) {
+        *error = [NSError errorWithDomain:MsgCompressionErrorDomain
+                                     code:MsgCompressionErrorSizeLimit
+                                 userInfo:@{NSLocalizedDescriptionKey: @"Inflated data exceeds size limit"}];
+      }
+      return NO;
+    }
+
+    if (produced && ![_outputStream writeBytesFromBuffer:_buffer length:produced error:error]) {
+      return NO;
+    }
+
+  } while (!_finished && (_stream.avail_in || !_stream.avail_out));
+
+  return YES;
+}
+
+-(BOOL) finishAndReturnError:(NSError **)error
+{
+  if (!_finished) {
+    if (error) {
+      *error = [NSError errorWithDomain:MsgCompressionErrorDomain
+                                   code:MsgCompressionErrorTruncated
+                               userInfo:@{NSLocalizedDescriptionKey: @"Compressed data truncated"}];
+    }
+    return NO;
+  }
+  return YES;
+}
+
+-(void) close
+{
+  [_outputStream close];
+}
+
+@end
@@ -13,6 +13,8 @@
 
 @property (nonatomic, retain) Id *msgId;
 @property (nonatomic, retain) Id *chatId;
+// Nil for notifications saved before fire dates were recorded
+@property (nonatomic, retain) NSDate *fireDate;
 @property (nonatomic, retain) NSData *data;
 
 -(BOOL) isEquivalent:(SavedNotification *)notification;
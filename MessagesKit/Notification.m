@@ -24,12 +24,12 @@
 
 -(id) dbId
 {
-  return self.msgId.data;
+  return self.msgId;
 }
 
 -(void) setDbId:(id)dbId
 {
-  self.msgId = [Id idWithData:dbId];
+  self.msgId = dbId;
 }
 
 -(BOOL) load:(FMResultSet *)resultSet dao:(NotificationDAO *)dao error:(NSError *__autoreleasing *)error
@@ -39,6 +39,7 @@
   }
 
   self.chatId = [resultSet idForColumnIndex:dao.chatIdFieldIdx];
+  self.fireDate = [resultSet dateForColumnIndex:dao.fireDateFieldIdx];
   self.data = [resultSet dataForColumnIndex:dao.dataFieldIdx];
   
   return YES;
@@ -51,6 +52,7 @@
   }
   
   [values setNillableObject:self.chatId forKey:@"chatId"];
+  [values setNillableObject:self.fireDate forKey:@"fireDate"];
   [values setNillableObject:self.data forKey:@"data"];
   
   return YES;
@@ -60,6 +62,7 @@
 {
   return isEqual(self.msgId, notification.msgId) &&
          isEqual(self.chatId, notification.chatId) &&
+         isEqual(self.fireDate, notification.fireDate) &&
          isEqual(self.data, notification.data);
 }
 
@@ -18,9 +18,15 @@ NS_ASSUME_NONNULL_BEGIN
 
 @property (nonatomic, assign) int chatIdFieldIdx;
 @property (nonatomic, assign) int dataFieldIdx;
+@property (nonatomic, assign) int fireDateFieldIdx;
 
 -(nullable NSArray<__kindof SavedNotification *> *) fetchAllNotificationsForChat:(Chat *)chat error:(NSError **)error;
 
+// Notifications of the chat firing on or before the date, plus any saved without a fire date
+-(nullable NSArray<__kindof SavedNotification *> *) fetchAllNotificationsForChat:(Chat *)chat firingOnOrBefore:(NSDate *)date error:(NSError **)error;
+
+-(BOOL) deleteAllNotificationsWithIds:(NSArray<Id *> *)ids error:(NSError **)error;
+
 @end
 
 
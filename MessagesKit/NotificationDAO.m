@@ -10,6 +10,7 @@
 
 #import "DAO+Internal.h"
 #import "NSObject+Utils.h"
+#import "FMResultSet+Utils.h"
 
 @import ObjectiveC;
 
@@ -37,10 +38,7 @@
 
 -(instancetype) initWithDBManager:(DBManager *)dbManager
 {
-  __block DBTableInfo *tableInfo;
-  [dbManager.pool inReadableDatabase:^(FMDatabase *db) {
-    tableInfo = [DBTableInfo loadTableInfo:db tableName:@"notification"];
-  }];
+  DBTableInfo *tableInfo = [dbManager tableInfoForTableName:@"notification" readOnlyFieldNames:nil];
   
   self = [super initWithDBManager:dbManager
                         tableInfo:tableInfo
@@ -50,6 +48,7 @@
 
     _chatIdFieldIdx = [tableInfo findField:@"chatId"];
     _dataFieldIdx = [tableInfo findField:@"data"];
+    _fireDateFieldIdx = [tableInfo findField:@"fireDate"];
 
   }
 
@@ -61,9 +60,9 @@
   return @"Notification";
 }
 
--(id) dbIdForId:(id)id
+-(id) dbIdForColumnIndex:(int)columnIndex inResultSet:(FMResultSet *)resultSet
 {
-  return [id data];
+  return [resultSet idForColumnIndex:columnIndex];
 }
 
 -(NSArray *) fetchAllNotificationsForChat:(Chat *)chat error:(NSError **)error
@@ -73,7 +72,7 @@
   [self.dbManager.pool inReadableDatabase:^(FMDatabase *db) {
 
     FMResultSet *resultSet = [db executeQuery:@"SELECT * FROM notification WHERE chatId = ?",
-                              chat.dbId];
+                              chat.id.data];
 
     res = [self loadAll:resultSet error:error];
 
@@ -83,4 +82,67 @@
   return res;
 }
 
+-(NSArray *) fetchAllNotificationsForChat:(Chat *)chat firingOnOrBefore:(NSDate *)date error:(NSError **)error
+{
+  __block NSArray *res;
+
+  [self.dbManager.pool inReadableDatabase:^(FMDatabase *db) {
+
+    NSString *sql = [self.tableInfo.fetchAllSQL stringByAppendingString:@" WHERE chatId = ? AND (fireDate <= ? OR fireDate IS NULL)"];
+
+    FMResultSet *resultSet = [db executeQuery:sql valuesArray:@[chat.id.data, date] error:error];
+    if (!resultSet) {
+      return;
+    }
+
+    res = [self loadAll:resultSet error:error];
+
+    [resultSet close];
+  }];
+
+  return res;
+}
+
+-(BOOL) deleteAllNotificationsWithIds:(NSArray<Id *> *)ids error:(NSError **)error
+{
+  // Stays well under SQLite's limit on bound parameters
+  static const NSUInteger batchSize = 256;
+
+  __block BOOL valid = YES;
+
+  NSMutableArray *parameters = [NSMutableArray arrayWithCapacity:ids.count];
+  for (Id *msgId in ids) {
+    [parameters addObject:msgId.data];
+  }
+
+  [self.dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+
+    for (NSUInteger start = 0; start < parameters.count; start += batchSize) {
+
+      NSArray *batch = [parameters subarrayWithRange:NSMakeRange(start, MIN(batchSize, parameters.count - start))];
+
+      NSMutableArray *paramSpecs = [NSMutableArray arrayWithCapacity:batch.count];
+      for (NSUInteger c = 0; c < batch.count; ++c) {
+        [paramSpecs addObject:@"?"];
+      }
+
+      NSString *sql = [NSString stringWithFormat:@"DELETE FROM notification WHERE id IN (%@)",
+                       [paramSpecs componentsJoinedByString:@","]];
+
+      if (![db executeUpdate:sql valuesArray:batch error:error]) {
+        *rollback = YES;
+        valid = NO;
+        return;
+      }
+    }
+
+  }];
+
+  if (valid && ids.count) {
+    [self deletedAllWithDbIds:ids];
+  }
+
+  return valid;
+}
+
 @end
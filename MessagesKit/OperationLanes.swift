@@ -0,0 +1,270 @@
+//
+//  OperationLanes.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import Foundation
+import PSOperations
+import CocoaLumberjack
+
+
+/*
+  Scheduling lanes, highest priority first
+*/
+enum OperationLane : Int {
+
+  // Sends & edits the user is waiting on
+  case Interactive
+
+  // Fetching & processing incoming messages
+  case Receive
+
+  // Receipts & delivery status
+  case Status
+
+  // Resends, notification tokens & other upkeep
+  case Maintenance
+
+  static let all : [OperationLane] = [.Interactive, .Receive, .Status, .Maintenance]
+
+  var name : String {
+    switch self {
+    case .Interactive: return "Interactive"
+    case .Receive: return "Receive"
+    case .Status: return "Status"
+    case .Maintenance: return "Maintenance"
+    }
+  }
+
+  var maxConcurrentOperationCount : Int {
+    switch self {
+    case .Interactive: return 4
+    case .Receive: return 3
+    case .Status: return 2
+    // Resends hold a slot while their sends run, leave room for other upkeep
+    case .Maintenance: return 2
+    }
+  }
+
+  var qualityOfService : NSQualityOfService {
+    switch self {
+    case .Interactive: return .UserInitiated
+    case .Receive, .Status: return .Utility
+    case .Maintenance: return .Background
+    }
+  }
+
+}
+
+
+/*
+  Time operations of a lane spent queued before starting
+*/
+struct OperationLaneStatistics {
+
+  var started = 0
+  var totalWait : NSTimeInterval = 0
+  var maxWait : NSTimeInterval = 0
+
+  var averageWait : NSTimeInterval {
+    return started > 0 ? totalWait / Double(started) : 0
+  }
+
+}
+
+
+/*
+  OperationLanes
+
+  Runs each lane on its own queue, with its own concurrency limit &
+  quality of service, so a backlog in one lane cannot hold up another.
+  Operations queued longer than the aging interval are raised a step
+  of priority & quality of service per interval waited, keeping low
+  lanes from starving when the device is busy.
+
+  Operations produced by, or required as dependencies of, an operation
+  run in its lane. Wait times are tracked for PSOperations operations.
+*/
+class OperationLanes {
+
+  let agingInterval : NSTimeInterval
+
+  private var queues = [OperationLane: LaneOperationQueue]()
+
+  private let syncQueue = dispatch_queue_create("OperationLanes Sync Queue", DISPATCH_QUEUE_SERIAL)
+  private var enqueueTimes = [ObjectIdentifier: CFAbsoluteTime]()
+  private var statistics = [OperationLane: OperationLaneStatistics]()
+
+  private let agingTimer : dispatch_source_t
+
+  init(name: String, agingInterval: NSTimeInterval = 10) {
+
+    self.agingInterval = agingInterval
+
+    self.agingTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, GCD.utilityQueue)
+
+    for lane in OperationLane.all {
+
+      let queue = LaneOperationQueue(lane: lane)
+      queue.name = "\(name) Queue (\(lane.name))"
+      queue.maxConcurrentOperationCount = lane.maxConcurrentOperationCount
+      queue.qualityOfService = lane.qualityOfService
+      queue.lanes = self
+
+      queues[lane] = queue
+      statistics[lane] = OperationLaneStatistics()
+    }
+
+    let interval = UInt64(agingInterval / 2 * Double(NSEC_PER_SEC))
+    dispatch_source_set_timer(agingTimer, dispatch_time(DISPATCH_TIME_NOW, Int64(interval)), interval, interval / 10)
+    dispatch_source_set_event_handler(agingTimer) { [weak self] in
+      self?.ageWaitingOperations()
+    }
+    dispatch_resume(agingTimer)
+  }
+
+  deinit {
+    dispatch_source_cancel(agingTimer)
+  }
+
+  subscript(lane: OperationLane) -> OperationQueue {
+    return queues[lane]!
+  }
+
+  var suspended : Bool {
+    get {
+      return queues.values.contains { $0.suspended }
+    }
+    set {
+      queues.values.forEach { $0.suspended = newValue }
+    }
+  }
+
+  func addOperation(operation: NSOperation, lane: OperationLane) {
+    queues[lane]!.addOperation(operation)
+  }
+
+  func addOperationWithBlock(lane lane: OperationLane, block: () -> Void) {
+    addOperation(BlockOperation { continuation in block(); continuation() }, lane: lane)
+  }
+
+  func cancelAllOperations() {
+    queues.values.forEach { $0.cancelAllOperations() }
+  }
+
+  func statisticsForLane(lane: OperationLane) -> OperationLaneStatistics {
+    return syncQueue.sync { self.statistics[lane]! }
+  }
+
+  private func willEnqueueOperation(operation: Operation, lane: OperationLane) {
+
+    let id = ObjectIdentifier(operation)
+
+    syncQueue.sync {
+      self.enqueueTimes[id] = CFAbsoluteTimeGetCurrent()
+    }
+
+    operation.addObserver(
+      BlockObserver(
+        startHandler: { [weak self] op in
+          self?.didStartOperation(op, lane: lane)
+        },
+        finishHandler: { [weak self] op, errors in
+          // Cancelled operations finish without starting
+          self?.syncQueue.async {
+            self?.enqueueTimes[id] = nil
+          }
+        }
+      )
+    )
+  }
+
+  private func didStartOperation(operation: Operation, lane: OperationLane) {
+
+    let id = ObjectIdentifier(operation)
+
+    let wait : NSTimeInterval? = syncQueue.sync {
+
+      guard let enqueueTime = self.enqueueTimes.removeValueForKey(id) else {
+        return nil
+      }
+
+      let wait = CFAbsoluteTimeGetCurrent() - enqueueTime
+
+      var laneStatistics = self.statistics[lane]!
+      laneStatistics.started += 1
+      laneStatistics.totalWait += wait
+      laneStatistics.maxWait = max(laneStatistics.maxWait, wait)
+      self.statistics[lane] = laneStatistics
+
+      return wait
+    }
+
+    if let wait = wait where wait >= agingInterval {
+      DDLogInfo("\(lane.name) lane: \(operation.dynamicType) started after waiting \(String(format: "%.1f", wait))s")
+    }
+  }
+
+  private func ageWaitingOperations() {
+
+    let now = CFAbsoluteTimeGetCurrent()
+
+    for lane in OperationLane.all where lane != .Interactive {
+
+      for operation in queues[lane]!.operations where !operation.executing && !operation.finished {
+
+        guard let enqueueTime = syncQueue.sync({ self.enqueueTimes[ObjectIdentifier(operation)] }) else {
+          continue
+        }
+
+        let steps = Int((now - enqueueTime) / agingInterval)
+        if steps == 0 {
+          continue
+        }
+
+        operation.queuePriority = OperationLanes.priorityRaised(.Normal, steps: steps)
+        operation.qualityOfService = OperationLanes.qualityOfServiceRaised(lane.qualityOfService, steps: steps)
+      }
+    }
+  }
+
+  class func priorityRaised(priority: NSOperationQueuePriority, steps: Int) -> NSOperationQueuePriority {
+    let ladder : [NSOperationQueuePriority] = [.VeryLow, .Low, .Normal, .High, .VeryHigh]
+    let index = ladder.indexOf(priority) ?? 2
+    return ladder[min(index + steps, ladder.count - 1)]
+  }
+
+  // Aging stops short of user-interactive, which is reserved for the UI
+  class func qualityOfServiceRaised(qualityOfService: NSQualityOfService, steps: Int) -> NSQualityOfService {
+    let ladder : [NSQualityOfService] = [.Background, .Utility, .UserInitiated]
+    let index = ladder.indexOf(qualityOfService) ?? 1
+    return ladder[min(index + steps, ladder.count - 1)]
+  }
+
+
+  private class LaneOperationQueue : OperationQueue {
+
+    let lane : OperationLane
+
+    weak var lanes : OperationLanes?
+
+    init(lane: OperationLane) {
+      self.lane = lane
+      super.init()
+    }
+
+    override func addOperation(operation: NSOperation) {
+
+      if let operation = operation as? Operation {
+        lanes?.willEnqueueOperation(operation, lane: lane)
+      }
+
+      super.addOperation(operation)
+    }
+
+  }
+
+}
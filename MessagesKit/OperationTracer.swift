@@ -0,0 +1,371 @@
+//
+//  OperationTracer.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import Foundation
+import PSOperations
+
+
+/*
+  Timings of one stage (or retry attempt) of a traced operation
+
+  Times are seconds of system uptime. Wait is spent on the stage's
+  dependencies (for retry attempts, in backoff), queue between becoming
+  runnable & executing (condition evaluation and queue scheduling) and
+  execution while running.
+*/
+public struct OperationStageSpan {
+
+  public let traceId : String
+  public let stage : String
+  // Retry attempt starting at 1, 0 for the stage as a whole
+  public let attempt : UInt
+  public let enqueued : NSTimeInterval
+  public let runnable : NSTimeInterval
+  public let started : NSTimeInterval
+  public let finished : NSTimeInterval
+  public let failed : Bool
+
+  public var waitTime : NSTimeInterval {
+    return runnable - enqueued
+  }
+
+  public var queueTime : NSTimeInterval {
+    return started - runnable
+  }
+
+  public var executionTime : NSTimeInterval {
+    return finished - started
+  }
+
+  // Histogram key, attempts are kept apart from their stage
+  var key : String {
+    return attempt == 0 ? stage : stage + ".attempt"
+  }
+
+}
+
+
+/*
+  Wait, queue & execution histograms of a stage
+*/
+public struct OperationStageTimings {
+
+  public let wait : DBTimingHistogram
+  public let queue : DBTimingHistogram
+  public let execution : DBTimingHistogram
+  public let failures : Int
+
+}
+
+
+private class OperationStageHistograms {
+
+  let wait = DBTimingHistogram()
+  let queue = DBTimingHistogram()
+  let execution = DBTimingHistogram()
+  var failures = 0
+
+  func addSpan(span: OperationStageSpan) {
+    wait.addTiming(span.waitTime)
+    queue.addTiming(span.queueTime)
+    execution.addTiming(span.executionTime)
+    failures += span.failed ? 1 : 0
+  }
+
+  var timings : OperationStageTimings {
+    return OperationStageTimings(wait: wait.copy() as! DBTimingHistogram,
+                                 queue: queue.copy() as! DBTimingHistogram,
+                                 execution: execution.copy() as! DBTimingHistogram,
+                                 failures: failures)
+  }
+
+}
+
+
+/*
+  Opt-in latency tracing of operation graphs
+
+  Collects the spans of each trace's stages into per stage histograms and
+  keeps the most recent spans for export in Chrome's trace event format
+  (load in chrome://tracing). Disabled (the default), no traces are begun
+  and traced operations carry no observers.
+*/
+public class OperationTracer {
+
+  private let syncQueue = dispatch_queue_create("OperationTracer Sync Queue", DISPATCH_QUEUE_SERIAL)
+
+  private var _enabled = false
+  private var _spanLimit = 10_000
+  private var histograms = [String: OperationStageHistograms]()
+  private var spans = [OperationStageSpan]()
+
+  public init() {
+  }
+
+  public var enabled : Bool {
+    get { return syncQueue.sync { self._enabled } }
+    set { syncQueue.sync { self._enabled = newValue } }
+  }
+
+  // Number of recent spans kept for export, oldest are dropped first
+  public var spanLimit : Int {
+    get { return syncQueue.sync { self._spanLimit } }
+    set { syncQueue.sync { self._spanLimit = newValue } }
+  }
+
+  // Begins a trace correlated by `id` (e.g. a message id), nil when disabled
+  public func beginTrace(id: String) -> OperationTrace? {
+    return enabled ? OperationTrace(id: id, tracer: self) : nil
+  }
+
+  func record(span: OperationStageSpan) {
+    syncQueue.async {
+
+      var stageHistograms : OperationStageHistograms! = self.histograms[span.key]
+      if stageHistograms == nil {
+        stageHistograms = OperationStageHistograms()
+        self.histograms[span.key] = stageHistograms
+      }
+      stageHistograms.addSpan(span)
+
+      self.spans.append(span)
+
+      // Trim in batches to keep appends cheap
+      if self.spans.count > self._spanLimit + self._spanLimit / 4 {
+        self.spans.removeFirst(self.spans.count - self._spanLimit)
+      }
+    }
+  }
+
+  // Snapshot, by stage ("transmit", "transmit.attempt", ...)
+  public var stageTimings : [String: OperationStageTimings] {
+    return syncQueue.sync {
+      var timings = [String: OperationStageTimings]()
+      for (key, stageHistograms) in self.histograms {
+        timings[key] = stageHistograms.timings
+      }
+      return timings
+    }
+  }
+
+  public var recentSpans : [OperationStageSpan] {
+    return syncQueue.sync {
+      return self.spans.count > self._spanLimit ? Array(self.spans.suffix(self._spanLimit)) : self.spans
+    }
+  }
+
+  public func spansForTraceId(id: String) -> [OperationStageSpan] {
+    return recentSpans.filter { $0.traceId == id }
+  }
+
+  public func reset() {
+    syncQueue.sync {
+      self.histograms.removeAll()
+      self.spans.removeAll()
+    }
+  }
+
+  // Multi-line summary of each stage's timings
+  public func report() -> String {
+
+    var report = ""
+
+    for (key, timings) in stageTimings.sort({ $0.0 < $1.0 }) {
+      report += "\(key): wait \(timings.wait); queue \(timings.queue); execution \(timings.execution); \(timings.failures) failed\n"
+    }
+
+    return report
+  }
+
+  /*
+    Recent spans in Chrome's trace event format
+
+    Each trace is a process & each of its stages a thread; a stage's
+    wait, queue & execution are consecutive events with its retry
+    attempts nested inside the execution.
+  */
+  public func chromeTrace() throws -> NSData {
+
+    var events = [[String: AnyObject]]()
+    var pids = [String: Int]()
+    var tids = [String: Int]()
+
+    for span in recentSpans {
+
+      if pids[span.traceId] == nil {
+        pids[span.traceId] = pids.count + 1
+        events.append(["name": "process_name", "ph": "M", "pid": pids.count, "tid": 0, "args": ["name": span.traceId]])
+      }
+      let pid = pids[span.traceId]!
+
+      let stageKey = span.traceId + "/" + span.stage
+      if tids[stageKey] == nil {
+        tids[stageKey] = tids.count + 1
+        events.append(["name": "thread_name", "ph": "M", "pid": pid, "tid": tids.count, "args": ["name": span.stage]])
+      }
+      let tid = tids[stageKey]!
+
+      let name = span.attempt == 0 ? span.stage : "\(span.stage) #\(span.attempt)"
+      let args : [String: AnyObject] = ["id": span.traceId, "attempt": span.attempt, "failed": span.failed]
+
+      let phases = [
+        ("wait", span.enqueued, span.runnable),
+        ("queue", span.runnable, span.started),
+        ("execute", span.started, span.finished),
+      ]
+
+      for (category, start, end) in phases where end > start {
+        events.append([
+          "name": category == "execute" ? name : name + " (\(category))",
+          "cat": category,
+          "ph": "X",
+          "pid": pid,
+          "tid": tid,
+          "ts": start * 1e6,
+          "dur": (end - start) * 1e6,
+          "args": args,
+        ])
+      }
+    }
+
+    return try NSJSONSerialization.dataWithJSONObject(["traceEvents": events, "displayTimeUnit": "ms"], options: [])
+  }
+
+  public func writeChromeTraceToURL(url: NSURL) throws {
+    try chromeTrace().writeToURL(url, options: [.DataWritingAtomic])
+  }
+
+}
+
+
+/*
+  Trace of one operation graph
+
+  The first operation added is the root (e.g. the group operation
+  composing the stages); other stages are considered enqueued no
+  earlier than the root started and runnable once their traced
+  dependencies have finished.
+*/
+public class OperationTrace {
+
+  public let id : String
+
+  private let tracer : OperationTracer
+  private let created = NSProcessInfo.processInfo().systemUptime
+  private let syncQueue = dispatch_queue_create("OperationTrace Sync Queue", DISPATCH_QUEUE_SERIAL)
+  private var root : ObjectIdentifier?
+  private var rootStarted : NSTimeInterval?
+  private var finishTimes = [ObjectIdentifier: NSTimeInterval]()
+
+  private init(id: String, tracer: OperationTracer) {
+    self.id = id
+    self.tracer = tracer
+  }
+
+  /*
+    Traces `operation` as `stage`; enqueued & runnable times are
+    derived from the root and dependencies unless given.
+  */
+  public func addStage(operation: Operation, named stage: String, attempt: UInt = 0,
+                       enqueued: NSTimeInterval? = nil, runnable: NSTimeInterval? = nil) {
+
+    let added = syncQueue.sync { Void -> NSTimeInterval in
+      if self.root == nil {
+        self.root = ObjectIdentifier(operation)
+        return self.created
+      }
+      return NSProcessInfo.processInfo().systemUptime
+    }
+
+    operation.addObserver(OperationTraceObserver(trace: self, stage: stage, attempt: attempt,
+                                                 added: enqueued ?? added, runnable: runnable))
+  }
+
+  private func operationStarted(operation: Operation, added: NSTimeInterval, runnable: NSTimeInterval?) -> (enqueued: NSTimeInterval, runnable: NSTimeInterval) {
+
+    let now = NSProcessInfo.processInfo().systemUptime
+
+    return syncQueue.sync { Void -> (enqueued: NSTimeInterval, runnable: NSTimeInterval) in
+
+      if ObjectIdentifier(operation) == self.root {
+        self.rootStarted = now
+        return (added, runnable ?? added)
+      }
+
+      let enqueued = max(added, self.rootStarted ?? added)
+
+      if let runnable = runnable {
+        return (enqueued, runnable)
+      }
+
+      let dependenciesFinished = operation.dependencies.flatMap { self.finishTimes[ObjectIdentifier($0)] }
+
+      return (enqueued, min(now, dependenciesFinished.reduce(enqueued, combine: max)))
+    }
+  }
+
+  private func operationFinished(operation: Operation) -> NSTimeInterval {
+
+    let now = NSProcessInfo.processInfo().systemUptime
+
+    syncQueue.sync {
+      self.finishTimes[ObjectIdentifier(operation)] = now
+    }
+
+    return now
+  }
+
+  private func record(span: OperationStageSpan) {
+    tracer.record(span)
+  }
+
+}
+
+
+private class OperationTraceObserver: OperationObserver {
+
+  let trace : OperationTrace
+  let stage : String
+  let attempt : UInt
+  let added : NSTimeInterval
+  let runnable : NSTimeInterval?
+
+  var started : (enqueued: NSTimeInterval, runnable: NSTimeInterval, at: NSTimeInterval)?
+
+  init(trace: OperationTrace, stage: String, attempt: UInt, added: NSTimeInterval, runnable: NSTimeInterval?) {
+    self.trace = trace
+    self.stage = stage
+    self.attempt = attempt
+    self.added = added
+    self.runnable = runnable
+  }
+
+  func operationDidStart(operation: Operation) {
+    let (enqueued, runnable) = trace.operationStarted(operation, added: added, runnable: self.runnable)
+    started = (enqueued, runnable, max(runnable, NSProcessInfo.processInfo().systemUptime))
+  }
+
+  func operationDidCancel(operation: Operation) {
+  }
+
+  func operation(operation: Operation, didProduceOperation newOperation: NSOperation) {
+  }
+
+  func operationDidFinish(operation: Operation, errors: [NSError]) {
+
+    let finished = trace.operationFinished(operation)
+
+    // Cancelled before starting, nothing executed
+    let (enqueued, runnable, startedAt) = started ?? (added, added, finished)
+
+    trace.record(OperationStageSpan(traceId: trace.id, stage: stage, attempt: attempt,
+                                    enqueued: enqueued, runnable: runnable, started: startedAt,
+                                    finished: finished, failed: !errors.isEmpty))
+  }
+
+}
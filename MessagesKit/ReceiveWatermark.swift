@@ -0,0 +1,111 @@
+//
+//  ReceiveWatermark.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import Foundation
+import CocoaLumberjack
+
+
+/*
+  Sent time up to which every received message has been processed
+  & acknowledged; reconnects resume after it.
+
+  Receives complete out of order, so the latest processed message
+  says nothing about older ones still being fetched or processed.
+  Each receive is pending from the moment it is announced until it
+  is acknowledged, and the watermark stays below the oldest pending
+  one. Headers announce messages without their sent time; until it
+  is known they hold the watermark where it was when announced.
+
+  Failed receives stay pending, the server keeps un-acknowledged
+  messages & a later receive of the same message releases them.
+
+  The watermark is saved whenever it changes, so a cold start can
+  resume as well.
+*/
+class ReceiveWatermark {
+
+  let fileURL : NSURL
+
+  private let syncQueue = dispatch_queue_create("ReceiveWatermark Sync Queue", DISPATCH_QUEUE_SERIAL)
+
+  // Latest sent time processed
+  private var processed : TimeStamp = 0
+
+  // Highest timestamp each pending message allows the watermark
+  private var pending = [Id: TimeStamp]()
+
+  private var saved : TimeStamp = 0
+
+  init(fileURL: NSURL) {
+
+    self.fileURL = fileURL
+
+    if let state = NSDictionary(contentsOfURL: fileURL), let processed = state["processed"] as? NSNumber {
+      self.processed = processed.longLongValue
+      self.saved = self.processed
+    }
+  }
+
+  // Zero when nothing has been processed
+  var value : TimeStamp {
+    return syncQueue.sync { self.currentValue }
+  }
+
+  private var currentValue : TimeStamp {
+    return pending.values.reduce(processed) { min($0, $1) }
+  }
+
+  /*
+    Marks a received message pending; `sent` is nil when
+    only its header has been received
+  */
+  func begin(id: Id, sent: TimeStamp?) {
+
+    syncQueue.sync {
+
+      let limit = sent.map { $0 - 1 } ?? self.currentValue
+
+      self.pending[id] = min(self.pending[id] ?? limit, limit)
+    }
+  }
+
+  /*
+    Marks a received message processed & acknowledged
+  */
+  func complete(id: Id, sent: TimeStamp) {
+
+    syncQueue.sync {
+
+      self.pending.removeValueForKey(id)
+
+      self.processed = max(self.processed, sent)
+
+      self.save()
+    }
+  }
+
+  private func save() {
+
+    let value = currentValue
+    if value == saved {
+      return
+    }
+
+    // Only what is safe to resume after on a cold start is saved,
+    // pending messages are lost with the process
+    let state : NSDictionary = ["processed": NSNumber(longLong: value)]
+
+    if state.writeToURL(fileURL, atomically: true) {
+      saved = value
+    }
+    else {
+      DDLogError("ReceiveWatermark: Unable to save to \(fileURL)")
+    }
+  }
+
+}
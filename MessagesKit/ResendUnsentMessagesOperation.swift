@@ -11,36 +11,91 @@ import PSOperations
 import CocoaLumberjack
 
 
-class ResendUnsentMessagesOperation: Operation {
+/*
+  Resends unsent messages, oldest first, keeping at most
+  `maxSendsInFlight` sends running and loading messages a page at
+  a time as earlier sends finish
+*/
+class ResendUnsentMessagesOperation: GroupOperation {
+  
+  static let defaultMaxSendsInFlight = 4
+  static let defaultPageSize = 32
   
   let api : MessageAPI
+  let maxSendsInFlight : Int
+  let pageSize : Int
+  
+  private var page = [Message]()
+  private var lastFetched : Message?
+  private var exhausted = false
+  private let syncQueue = dispatch_queue_create("ResendUnsentMessagesOperation Sync Queue", DISPATCH_QUEUE_SERIAL)
   
-  init(api: MessageAPI) {
+  init(api: MessageAPI, maxSendsInFlight: Int = ResendUnsentMessagesOperation.defaultMaxSendsInFlight, pageSize: Int = ResendUnsentMessagesOperation.defaultPageSize) {
     
     self.api = api
+    self.maxSendsInFlight = maxSendsInFlight
+    self.pageSize = pageSize
     
-    super.init()
+    super.init(operations: [])
     
     addCondition(RequireAccessToken(api: api))
     addCondition(ReachabilityCondition(host: MessageAPI.target.publicURL))
   }
   
   override func execute() {
-
+    
+    for _ in 0..<maxSendsInFlight {
+      if !sendNextMessage() {
+        break
+      }
+    }
+    
+    super.execute()
+  }
+  
+  override func operationDidFinish(operation: NSOperation, withErrors errors: [NSError]) {
+    
+    // Called before the send is marked finished, so the group cannot complete in between
+    if operation is MessageSendOperation {
+      sendNextMessage()
+    }
+  }
+  
+  private func sendNextMessage() -> Bool {
+    
+    if cancelled {
+      return false
+    }
+    
     do {
       
-      for message in try api.messageDAO.fetchUnsentMessages() {
-      
-        produceOperation(MessageSendOperation(message: message, api: api))
-      
+      guard let message = try syncQueue.sync({ try self.nextMessage() }) else {
+        return false
       }
       
-      finish()
+      addOperation(MessageSendOperation(message: message, api: api))
+      
+      return true
     }
     catch let error {
-      finishWithError(error as NSError)
+      
+      aggregateError(error as NSError)
+      
+      return false
+    }
+  }
+  
+  private func nextMessage() throws -> Message? {
+    
+    if page.isEmpty && !exhausted {
+      
+      page = try api.messageDAO.fetchUnsentMessagesAfter(lastFetched, limit: UInt(pageSize))
+      
+      lastFetched = page.last ?? lastFetched
+      exhausted = page.count < pageSize
     }
     
+    return page.isEmpty ? nil : page.removeFirst()
   }
   
 }
@@ -12,6 +12,11 @@ import PSOperations
 
 /**
   Retries an operation
+
+  Retries are delayed with jittered exponential backoff, drawn from
+  the shared retry budget and, when an endpoint is given, pass through
+  its circuit breaker; while the breaker is open attempts fail
+  immediately with `ServiceUnavailable`.
 */
 class RetryOperation: Operation {
   
@@ -28,20 +33,40 @@ class RetryOperation: Operation {
   
   private var currentOperation : Operation?
   
+  var backoff = RetryBackoff.standard
+  
+  var budget = RetryBudget.shared
+  
+  var breaker : CircuitBreaker?
+  
+  // Attempts are traced under the retried stage, with backoff as their wait time
+  private var trace : (trace: OperationTrace, stage: String)?
+  
+  private var attemptScheduled = NSTimeInterval(0)
+  
   
-  required init(maxAttempts: UInt, failureErrors: [String: Int?], generator: () -> Operation) {
+  required init(maxAttempts: UInt, failureErrors: [String: Int?], endpoint: NSURL?, generator: () -> Operation) {
     
     self.maxAttempts = maxAttempts
     self.failureErrors = failureErrors
     self.generator = generator
+    self.breaker = endpoint.map { CircuitBreaker.breakerForEndpoint($0) }
     
     super.init()
     
     internalQueue.delegate = self
   }
   
+  convenience init(maxAttempts: UInt, failureErrors: [String: Int?], generator: () -> Operation) {
+    self.init(maxAttempts: maxAttempts, failureErrors: failureErrors, endpoint: nil, generator: generator)
+  }
+  
+  convenience init(maxAttempts: UInt, endpoint: NSURL?, generator: () -> Operation) {
+    self.init(maxAttempts: maxAttempts, failureErrors: [String: Int?](), endpoint: endpoint, generator: generator)
+  }
+  
   convenience init(maxAttempts: UInt, generator: () -> Operation) {
-    self.init(maxAttempts: maxAttempts, failureErrors: [String: Int?](), generator: generator)
+    self.init(maxAttempts: maxAttempts, failureErrors: [String: Int?](), endpoint: nil, generator: generator)
   }
   
   convenience init(maxAttempts: UInt, retryBlock block: (Void -> Void) -> Void) {
@@ -57,11 +82,59 @@ class RetryOperation: Operation {
     super.cancel()
   }
   
+  func traceAttempts(trace: OperationTrace, stage: String) {
+    self.trace = (trace, stage)
+  }
+  
   override func execute() {
+    attemptScheduled = NSProcessInfo.processInfo().systemUptime
+    startAttempt()
+  }
+  
+  private func startAttempt() {
+    
+    if let breaker = breaker where !breaker.allowRequest() {
+      
+      RetryStatistics.update { $0.breakerRejections += 1 }
+      
+      finishWithError(NSError(code: .ServiceUnavailable, userInfo: [
+        NSLocalizedDescriptionKey: "Service temporarily unavailable"]))
+      return
+    }
+    
     currentOperation = generator()
+    
+    if let trace = trace {
+      trace.trace.addStage(currentOperation!, named: trace.stage, attempt: attempt,
+                           enqueued: attemptScheduled, runnable: NSProcessInfo.processInfo().systemUptime)
+    }
+    
     internalQueue.addOperation(currentOperation!)
   }
   
+  private func scheduleRetry() {
+    
+    let delay = backoff.delayForRetry(attempt - 1)
+    
+    attempt += 1
+    attemptScheduled = NSProcessInfo.processInfo().systemUptime
+    
+    RetryStatistics.update {
+      $0.retries += 1
+      $0.waitTime += delay
+    }
+    
+    GCD.utilityQueue.after(Float(delay)) { [weak self] in
+      
+      // Cancelling finishes the operation
+      guard let strongSelf = self where !strongSelf.cancelled else {
+        return
+      }
+      
+      strongSelf.startAttempt()
+    }
+  }
+  
   private func shouldRetry(error: NSError) -> Bool {
     
     for (domain, code) in failureErrors {
@@ -92,24 +165,44 @@ extension RetryOperation: OperationQueueDelegate {
   
   final func operationQueue(operationQueue: OperationQueue, operationDidFinish operation: NSOperation, withErrors errors: [NSError]) {
 
-    if errors.isEmpty {
+    // Cancelled attempts finish without errors, but prove nothing about the endpoint
+
+    if operation.cancelled {
+
+      breaker?.releaseProbe()
+
+      finish(errors)
+
+    }
+    else if errors.isEmpty {
+      
+      breaker?.recordSuccess()
+      budget.recordSuccess()
       
       finish()
       
     }
     else {
 
-      if !operation.cancelled && shouldRetry(errors) {
+      if errors.contains({ CircuitBreaker.isEndpointFailure($0) }) {
+        breaker?.recordFailure()
+      }
+      else {
+        breaker?.releaseProbe()
+      }
+
+      if shouldRetry(errors) {
         
-        if attempt < maxAttempts {
-          
-          attempt += 1
-          
-          currentOperation = generator()
-          internalQueue.addOperation(currentOperation!)
+        if attempt < maxAttempts && !cancelled {
           
-          return;
+          if budget.withdraw() {
+            
+            scheduleRetry()
+            
+            return;
+          }
           
+          RetryStatistics.update { $0.budgetExhausted += 1 }
         }
         
       }
@@ -0,0 +1,276 @@
+//
+//  RetryPolicy.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import Foundation
+import CocoaLumberjack
+import Thrift
+
+
+/*
+  Counters shared by all retrying operations
+*/
+public struct RetryStatistics {
+
+  public var retries = 0
+  public var budgetExhausted = 0
+  public var breakerTrips = 0
+  public var breakerRejections = 0
+  public var waitTime : NSTimeInterval = 0
+
+  private static let syncQueue = dispatch_queue_create("RetryStatistics Sync Queue", DISPATCH_QUEUE_SERIAL)
+  private static var shared = RetryStatistics()
+
+  public static var current : RetryStatistics {
+    return syncQueue.sync { shared }
+  }
+
+  static func update(block: (inout RetryStatistics) -> Void) {
+    syncQueue.sync { block(&shared) }
+  }
+
+  static func reset() {
+    syncQueue.sync { shared = RetryStatistics() }
+  }
+
+}
+
+
+/*
+  Jittered exponential backoff; delays are drawn from the upper
+  half of the exponential ceiling so clients failing together
+  spread their retries out
+*/
+struct RetryBackoff {
+
+  let baseDelay : NSTimeInterval
+  let maxDelay : NSTimeInterval
+
+  static let standard = RetryBackoff(baseDelay: 1, maxDelay: 30)
+
+  func delayForRetry(retry: UInt) -> NSTimeInterval {
+    let ceiling = min(maxDelay, baseDelay * pow(2, Double(min(retry, 16))))
+    return ceiling / 2 + (ceiling / 2) * (Double(arc4random()) / Double(UInt32.max))
+  }
+
+}
+
+
+/*
+  RetryBudget
+
+  Token bucket limiting retries to a fraction of successful
+  requests. Each retry withdraws a token, each success deposits a
+  fraction of one; when the server is failing everything the bucket
+  drains and requests fail on their first error instead of
+  multiplying the load.
+*/
+class RetryBudget {
+
+  static let shared = RetryBudget(capacity: 20, successDeposit: 0.2)
+
+  let capacity : Double
+  let successDeposit : Double
+
+  private var tokens : Double
+  private let syncQueue = dispatch_queue_create("RetryBudget Sync Queue", DISPATCH_QUEUE_SERIAL)
+
+  init(capacity: Double, successDeposit: Double) {
+    self.capacity = capacity
+    self.successDeposit = successDeposit
+    self.tokens = capacity
+  }
+
+  var available : Double {
+    return syncQueue.sync { self.tokens }
+  }
+
+  func withdraw() -> Bool {
+    return syncQueue.sync {
+      if self.tokens < 1 {
+        return false
+      }
+      self.tokens -= 1
+      return true
+    }
+  }
+
+  func recordSuccess() {
+    syncQueue.sync {
+      self.tokens = min(self.capacity, self.tokens + self.successDeposit)
+    }
+  }
+
+}
+
+
+/*
+  CircuitBreaker
+
+  Tracks consecutive failures of an endpoint; after the threshold is
+  reached it opens, rejecting requests until a cooldown passes. A
+  single probe is then allowed through, closing the breaker on success
+  or reopening it with a doubled cooldown on failure. Only transport
+  failures & 5xx responses (see `isEndpointFailure`) count; probes
+  that are cancelled or rejected by the application are released.
+*/
+class CircuitBreaker {
+
+  enum State {
+    case Closed
+    case Open(until: CFAbsoluteTime)
+    case HalfOpen
+  }
+
+  let name : String
+  let failureThreshold : Int
+  let cooldown : RetryBackoff
+
+  private(set) var state = State.Closed
+  private var consecutiveFailures = 0
+  private var consecutiveTrips = UInt(0)
+  private var probing = false
+  private let syncQueue = dispatch_queue_create("CircuitBreaker Sync Queue", DISPATCH_QUEUE_SERIAL)
+
+  init(name: String, failureThreshold: Int = 5, cooldown: RetryBackoff = RetryBackoff(baseDelay: 15, maxDelay: 300)) {
+    self.name = name
+    self.failureThreshold = failureThreshold
+    self.cooldown = cooldown
+  }
+
+  var isOpen : Bool {
+    return syncQueue.sync {
+      if case .Open(let until) = self.state {
+        return CFAbsoluteTimeGetCurrent() < until
+      }
+      return false
+    }
+  }
+
+  func allowRequest() -> Bool {
+    return syncQueue.sync {
+
+      switch self.state {
+      case .Closed:
+        return true
+
+      case .Open(let until):
+        if CFAbsoluteTimeGetCurrent() < until {
+          return false
+        }
+        self.state = .HalfOpen
+        self.probing = true
+        return true
+
+      case .HalfOpen:
+        if self.probing {
+          return false
+        }
+        self.probing = true
+        return true
+      }
+    }
+  }
+
+  func recordSuccess() {
+    syncQueue.sync {
+      self.state = .Closed
+      self.consecutiveFailures = 0
+      self.consecutiveTrips = 0
+      self.probing = false
+    }
+  }
+
+  func recordFailure() {
+    syncQueue.sync {
+
+      switch self.state {
+      case .HalfOpen:
+        self.trip()
+
+      case .Closed:
+        self.consecutiveFailures += 1
+        if self.consecutiveFailures >= self.failureThreshold {
+          self.trip()
+        }
+
+      case .Open:
+        break
+      }
+    }
+  }
+
+  // Ends an attempt that says nothing about the endpoint's health, letting another probe through
+  func releaseProbe() {
+    syncQueue.sync {
+      self.probing = false
+    }
+  }
+
+  // Transport failures & 5xx responses; cancellations & application errors (e.g. authentication) are not the endpoint's fault
+  static func isEndpointFailure(error: NSError) -> Bool {
+
+    switch (error.domain, error.code) {
+    case (NSURLErrorDomain, NSURLErrorCancelled),
+         (NSURLErrorDomain, NSURLErrorUserCancelledAuthentication),
+         (NSURLErrorDomain, NSURLErrorUserAuthenticationRequired):
+      return false
+
+    case (NSURLErrorDomain, _):
+      return true
+
+    case (TTransportErrorDomain, _):
+      if let statusCode = error.userInfo["statusCode"] as? Int {
+        return statusCode >= 500
+      }
+      return error.userInfo[TTransportErrorHttpErrorKey] as? Int != THttpTransportError.Authentication.rawValue
+
+    case (MessageAPIErrorDomain, MessageAPIError.NetworkError.rawValue):
+      if let underlying = error.userInfo[NSUnderlyingErrorKey] as? NSError {
+        return isEndpointFailure(underlying)
+      }
+      return true
+
+    case (MessageAPIErrorDomain, MessageAPIError.ServiceUnavailable.rawValue):
+      return true
+
+    default:
+      return false
+    }
+  }
+
+  private func trip() {
+
+    let delay = cooldown.delayForRetry(consecutiveTrips)
+
+    state = .Open(until: CFAbsoluteTimeGetCurrent() + delay)
+    consecutiveFailures = 0
+    consecutiveTrips += 1
+    probing = false
+
+    RetryStatistics.update { $0.breakerTrips += 1 }
+
+    DDLogWarn("Circuit breaker for \(name) opened for \(String(format: "%.1f", delay))s")
+  }
+
+  private static let registrySyncQueue = dispatch_queue_create("CircuitBreaker Registry Sync Queue", DISPATCH_QUEUE_SERIAL)
+  private static var registry = [String: CircuitBreaker]()
+
+  // Shared breaker for an endpoint (e.g. one of the ServerTarget URLs)
+  static func breakerForEndpoint(endpoint: NSURL) -> CircuitBreaker {
+    let key = endpoint.absoluteString
+    return registrySyncQueue.sync {
+      if let breaker = registry[key] {
+        return breaker
+      }
+      let breaker = CircuitBreaker(name: key)
+      registry[key] = breaker
+      return breaker
+    }
+  }
+
+}
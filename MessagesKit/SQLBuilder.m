@@ -346,7 +346,7 @@ NSDictionary *nullaryFunctions;
 -(id) convertValue:(id)val
 {
   if ([val isKindOfClass:[Model class]]) {
-    return [val dbId];
+    return [self convertValue:[val dbId]];
   }
 
   if ([val isKindOfClass:[Id class]]) {
@@ -366,6 +366,17 @@ NSDictionary *nullaryFunctions;
 
 -(NSString *) constantForValue:(id)val
 {
+  // Collections (e.g. the right side of IN) bind each element
+  if ([val isKindOfClass:[NSArray class]] || [val isKindOfClass:[NSSet class]]) {
+
+    NSMutableArray *constants = [NSMutableArray array];
+    for (id element in val) {
+      [constants addObject:[self constantForValue:element]];
+    }
+
+    return [NSString stringWithFormat:@"(%@)", [constants componentsJoinedByString:@","]];
+  }
+
   NSString *key = @(_parameters.count).stringValue;
   val = [self convertValue:val];
 
@@ -20,6 +20,9 @@ MESSAGES_KIT_INTERNAL extern int ServerTimeout;
 // Common HTTP header names & values
 MESSAGES_KIT_INTERNAL extern NSString *ContentTypeHTTPHeader;
 MESSAGES_KIT_INTERNAL extern NSString *ContentLengthHTTPHeader;
+MESSAGES_KIT_INTERNAL extern NSString *DigestHTTPHeader;
+MESSAGES_KIT_INTERNAL extern NSString *ContentRangeHTTPHeader;
+MESSAGES_KIT_INTERNAL extern NSString *RangeHTTPHeader;
 MESSAGES_KIT_INTERNAL extern NSString *AcceptHTTPHeader;
 MESSAGES_KIT_INTERNAL extern NSString *AuthorizationHTTPHeader;
 MESSAGES_KIT_INTERNAL extern NSString *BearerAuthorizationHTTPHeaderValue;
@@ -37,6 +40,13 @@ MESSAGES_KIT_INTERNAL extern NSString *OctetStreamContentType;
 MESSAGES_KIT_INTERNAL extern NSString *UserAPIFetchMsgIdParam;
 
 MESSAGES_KIT_INTERNAL extern NSString *MsgInfoHTTPHeader;
+MESSAGES_KIT_INTERNAL extern NSString *MsgIdHTTPHeader;
+// Names the Thrift protocol of a length-prefixed preamble leading the body (replaces MsgInfoHTTPHeader)
+MESSAGES_KIT_INTERNAL extern NSString *MsgPreambleProtocolHTTPHeader;
+
+// Sent when connecting the WebSocket with the sent time every earlier message has been processed by;
+// servers echo it when they will replay the messages sent since then
+MESSAGES_KIT_INTERNAL extern NSString *ResumeAfterHTTPHeader;
 
 
 
@@ -26,11 +26,17 @@ NSString *UserAgent = @"reTXT (iOS)";
 NSString *UserAPIFetchMsgIdParam = @"msgId";
 
 NSString *MsgInfoHTTPHeader = @"X-Msg-Info";
+NSString *MsgIdHTTPHeader = @"X-Msg-Id";
+NSString *MsgPreambleProtocolHTTPHeader = @"X-Msg-Preamble-Protocol";
+NSString *ResumeAfterHTTPHeader = @"X-Resume-After";
 NSString *BearerRefreshHTTPHeader = @"X-Bearer-Refresh";
 
 // Common HTTP header names & values
 NSString *ContentTypeHTTPHeader = @"Content-Type";
 NSString *ContentLengthHTTPHeader = @"Content-Length";
+NSString *DigestHTTPHeader = @"Digest";
+NSString *ContentRangeHTTPHeader = @"Content-Range";
+NSString *RangeHTTPHeader = @"Range";
 NSString *AcceptHTTPHeader = @"Accept";
 NSString *AuthorizationHTTPHeader = @"Authorization";
 NSString *BearerAuthorizationHTTPHeaderValue = @"Bearer";
@@ -27,6 +27,10 @@ import Foundation
   let hostName : String
   let port : Int?
   
+  // Validates user certificates issued by the target (e.g. a stand-in
+  // server's own CA), the bundled roots are used when nil
+  public var certificateTrust : OpenSSLCertificateTrust?
+  
   public init(scheme: ServerTargetScheme, hostName: String, port: Int) {
     self.scheme = scheme
     self.hostName = hostName
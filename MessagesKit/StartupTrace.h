@@ -0,0 +1,49 @@
+//
+//  StartupTrace.h
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+@import Foundation;
+
+
+NS_ASSUME_NONNULL_BEGIN
+
+
+/*
+ * StartupTrace
+ *
+ * Records the start & end of named launch phases relative to the
+ * creation of the trace. Phases may overlap when independent steps run
+ * concurrently; the summary lists each with its offset so the critical
+ * path can be read off directly.
+ *
+ * Thread safe.
+ */
+@interface StartupTrace : NSObject
+
+@property (readonly, nonatomic) NSString *name;
+
+// Time since the trace was created
+@property (readonly, nonatomic) NSTimeInterval elapsed;
+
+// Durations of the completed phases, by name
+@property (readonly, nonatomic) NSDictionary<NSString *, NSNumber *> *phaseDurations;
+
+-(instancetype) init NS_UNAVAILABLE;
+-(instancetype) initWithName:(NSString *)name NS_DESIGNATED_INITIALIZER;
+
+-(void) beginPhase:(NSString *)phase;
+-(void) endPhase:(NSString *)phase;
+-(void) tracePhase:(NSString *)phase block:(void (^)(void))block;
+
+// One line breakdown, e.g. "Message startup 182.4ms: open 3.1ms @0.0ms, ..."
+-(NSString *) summary;
+-(void) log;
+
+@end
+
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,130 @@
+//
+//  StartupTrace.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "StartupTrace.h"
+
+#import "Log.h"
+
+
+MK_DECLARE_LOG_LEVEL()
+
+
+@interface StartupTracePhase : NSObject
+
+@property (copy, nonatomic) NSString *name;
+@property (assign, nonatomic) NSTimeInterval start;
+@property (assign, nonatomic) NSTimeInterval end;
+
+@end
+
+
+@implementation StartupTracePhase
+
+@end
+
+
+@interface StartupTrace () {
+  NSTimeInterval _start;
+  NSMutableArray<StartupTracePhase *> *_phases;
+}
+
+@end
+
+
+@implementation StartupTrace
+
+-(instancetype) initWithName:(NSString *)name
+{
+  self = [super init];
+  if (self) {
+    _name = [name copy];
+    _start = NSProcessInfo.processInfo.systemUptime;
+    _phases = [NSMutableArray new];
+  }
+  return self;
+}
+
+-(NSTimeInterval) elapsed
+{
+  return NSProcessInfo.processInfo.systemUptime - _start;
+}
+
+-(void) beginPhase:(NSString *)phase
+{
+  StartupTracePhase *entry = [StartupTracePhase new];
+  entry.name = phase;
+  entry.start = self.elapsed;
+  entry.end = -1;
+
+  @synchronized(self) {
+    [_phases addObject:entry];
+  }
+}
+
+-(void) endPhase:(NSString *)phase
+{
+  NSTimeInterval end = self.elapsed;
+
+  @synchronized(self) {
+    for (StartupTracePhase *entry in _phases.reverseObjectEnumerator) {
+      if (entry.end < 0 && [entry.name isEqualToString:phase]) {
+        entry.end = end;
+        return;
+      }
+    }
+  }
+
+  DDLogWarn(@"%@ startup trace: phase %@ ended without beginning", _name, phase);
+}
+
+-(void) tracePhase:(NSString *)phase block:(void (^)(void))block
+{
+  [self beginPhase:phase];
+  block();
+  [self endPhase:phase];
+}
+
+-(NSDictionary<NSString *, NSNumber *> *) phaseDurations
+{
+  NSMutableDictionary *durations = [NSMutableDictionary new];
+
+  @synchronized(self) {
+    for (StartupTracePhase *entry in _phases) {
+      if (entry.end >= 0) {
+        durations[entry.name] = @([durations[entry.name] doubleValue] + entry.end - entry.start);
+      }
+    }
+  }
+
+  return durations;
+}
+
+-(NSString *) summary
+{
+  NSMutableArray *parts = [NSMutableArray new];
+
+  @synchronized(self) {
+    for (StartupTracePhase *entry in _phases) {
+      if (entry.end >= 0) {
+        [parts addObject:[NSString stringWithFormat:@"%@ %.1fms @%.1fms", entry.name, (entry.end - entry.start) * 1e3, entry.start * 1e3]];
+      }
+      else {
+        [parts addObject:[NSString stringWithFormat:@"%@ (running) @%.1fms", entry.name, entry.start * 1e3]];
+      }
+    }
+  }
+
+  return [NSString stringWithFormat:@"%@ startup %.1fms: %@", _name, self.elapsed * 1e3, [parts componentsJoinedByString:@", "]];
+}
+
+-(void) log
+{
+  DDLogInfo(@"%@", self.summary);
+}
+
+@end
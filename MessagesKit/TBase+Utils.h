@@ -8,18 +8,37 @@
 
 @import Thrift;
 
+#import "DataReference.h"
+
 
 NS_ASSUME_NONNULL_BEGIN
 
 
+// Protocol names used during negotiation (e.g. WebSocket sub-protocols)
+extern NSString *const ThriftCompactProtocolName;
+extern NSString *const ThriftBinaryProtocolName;
+
+
 @interface TBaseUtils : NSObject
 
+// Supported protocol names, most preferred first
++(NSArray<NSString *> *) protocolNames;
++(nullable id<TProtocolFactory>) protocolFactoryNamed:(NSString *)name;
+
 +(nullable NSData *) serializeToData:(id<TBase>)obj error:(NSError **)error;
 +(nullable id) deserialize:(id<TBase>)obj fromData:(NSData *)data error:(NSError **)error;
 
++(nullable NSData *) serializeToData:(id<TBase>)obj usingProtocolFactory:(id<TProtocolFactory>)protocolFactory error:(NSError **)error;
++(nullable id) deserialize:(id<TBase>)obj fromData:(NSData *)data usingProtocolFactory:(id<TProtocolFactory>)protocolFactory error:(NSError **)error;
+
 +(nullable NSString *) serializeToBase64String:(id<TBase>)obj error:(NSError **)error;
 +(nullable id) deserialize:(id<TBase>)obj fromBase64String:(NSString *)data error:(NSError **)error;
 
+// Preambles are serialized objects prefixed with their length (32 bit, big endian),
+// allowing them to lead other data in a body
++(nullable NSData *) serializeToPreamble:(id<TBase>)obj usingProtocolFactory:(id<TProtocolFactory>)protocolFactory error:(NSError **)error;
++(nullable id) deserialize:(id<TBase>)obj fromPreambleOfStream:(id<DataInputStream>)stream usingProtocolFactory:(id<TProtocolFactory>)protocolFactory error:(NSError **)error;
+
 @end
 
 
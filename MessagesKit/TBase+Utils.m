@@ -10,10 +10,35 @@
 
 #import <Thrift/TMemoryBuffer.h>
 #import <Thrift/TBinaryProtocol.h>
+#import <Thrift/TCompactProtocol.h>
+
+
+NSString *const ThriftCompactProtocolName = @"compact";
+NSString *const ThriftBinaryProtocolName = @"binary";
+
+
+// Sanity limit for preamble lengths read from untrusted input
+static const UInt32 kMaxPreambleLength = 16 * 1024 * 1024;
 
 
 @implementation TBaseUtils
 
++(NSArray<NSString *> *) protocolNames
+{
+  return @[ThriftCompactProtocolName, ThriftBinaryProtocolName];
+}
+
++(id<TProtocolFactory>) protocolFactoryNamed:(NSString *)name
+{
+  if ([name isEqualToString:ThriftCompactProtocolName]) {
+    return TCompactProtocolFactory.sharedFactory;
+  }
+  if ([name isEqualToString:ThriftBinaryProtocolName]) {
+    return TBinaryProtocolFactory.sharedFactory;
+  }
+  return nil;
+}
+
 +(NSData *) serializeToData:(id<TBase>)obj error:(NSError *__autoreleasing *)error
 {
   TMemoryBuffer *buffer = [TMemoryBuffer new];
@@ -31,6 +56,26 @@
   return obj;
 }
 
++(NSData *) serializeToData:(id<TBase>)obj usingProtocolFactory:(id<TProtocolFactory>)protocolFactory error:(NSError *__autoreleasing *)error
+{
+  TMemoryBuffer *buffer = [TMemoryBuffer new];
+  id<TProtocol> protocol = [protocolFactory newProtocolOnTransport:buffer];
+  if (![obj write:protocol error:error]) {
+    return nil;
+  }
+  return buffer.buffer;
+}
+
++(id) deserialize:(id<TBase>)obj fromData:(NSData *)data usingProtocolFactory:(id<TProtocolFactory>)protocolFactory error:(NSError *__autoreleasing *)error
+{
+  TMemoryBuffer *buffer = [[TMemoryBuffer alloc] initWithData:data];
+  id<TProtocol> protocol = [protocolFactory newProtocolOnTransport:buffer];
+  if (![obj read:protocol error:error]) {
+    return nil;
+  }
+  return obj;
+}
+
 +(NSString *) serializeToBase64String:(id<TBase>)obj error:(NSError *__autoreleasing *)error
 {
   return [[self serializeToData:obj error:error] base64EncodedStringWithOptions:0];
@@ -41,4 +86,71 @@
   return [self deserialize:obj fromData:[[NSData alloc] initWithBase64EncodedString:data options:0] error:error];
 }
 
++(NSData *) serializeToPreamble:(id<TBase>)obj usingProtocolFactory:(id<TProtocolFactory>)protocolFactory error:(NSError *__autoreleasing *)error
+{
+  NSData *data = [self serializeToData:obj usingProtocolFactory:protocolFactory error:error];
+  if (!data) {
+    return nil;
+  }
+
+  UInt32 length = CFSwapInt32HostToBig((UInt32)data.length);
+
+  NSMutableData *preamble = [NSMutableData dataWithCapacity:sizeof(length) + data.length];
+  [preamble appendBytes:&length length:sizeof(length)];
+  [preamble appendData:data];
+
+  return preamble;
+}
+
++(BOOL) readBytesOfLength:(NSUInteger)length intoBuffer:(UInt8 *)buffer fromStream:(id<DataInputStream>)stream error:(NSError *__autoreleasing *)error
+{
+  NSUInteger total = 0;
+
+  while (total < length) {
+
+    NSUInteger bytesRead = 0;
+    if (![stream readBytesOfMaxLength:length - total intoBuffer:buffer + total bytesRead:&bytesRead error:error]) {
+      return NO;
+    }
+
+    if (!bytesRead) {
+      if (error) {
+        *error = [NSError errorWithDomain:TTransportErrorDomain
+                                     code:TTransportErrorEndOfFile
+                                 userInfo:@{NSLocalizedDescriptionKey: @"Preamble truncated"}];
+      }
+      return NO;
+    }
+
+    total += bytesRead;
+  }
+
+  return YES;
+}
+
++(id) deserialize:(id<TBase>)obj fromPreambleOfStream:(id<DataInputStream>)stream usingProtocolFactory:(id<TProtocolFactory>)protocolFactory error:(NSError *__autoreleasing *)error
+{
+  UInt32 length = 0;
+  if (![self readBytesOfLength:sizeof(length) intoBuffer:(UInt8 *)&length fromStream:stream error:error]) {
+    return nil;
+  }
+
+  length = CFSwapInt32BigToHost(length);
+  if (length > kMaxPreambleLength) {
+    if (error) {
+      *error = [NSError errorWithDomain:TProtocolErrorDomain
+                                   code:TProtocolErrorSizeLimit
+                               userInfo:@{NSLocalizedDescriptionKey: @"Preamble too large"}];
+    }
+    return nil;
+  }
+
+  NSMutableData *data = [NSMutableData dataWithLength:length];
+  if (![self readBytesOfLength:length intoBuffer:data.mutableBytes fromStream:stream error:error]) {
+    return nil;
+  }
+
+  return [self deserialize:obj fromData:data usingProtocolFactory:protocolFactory error:error];
+}
+
 @end
@@ -17,28 +17,83 @@ NS_ASSUME_NONNULL_BEGIN
 @class WebSocket;
 
 
+@interface WebSocketUserStatus : NSObject
+
+@property (readonly, nonatomic) NSString *sender;
+@property (readonly, nonatomic) NSString *recipient;
+@property (readonly, nonatomic) enum UserStatus status;
+
+-(instancetype) initWithSender:(NSString *)sender recipient:(NSString *)recipient status:(enum UserStatus)status;
+
+@end
+
+
+@interface WebSocketMsgDelivered : NSObject
+
+@property (readonly, nonatomic) Id *msgId;
+@property (readonly, nonatomic) NSString *recipient;
+
+-(instancetype) initWithMsgId:(Id *)msgId recipient:(NSString *)recipient;
+
+@end
+
+
+/*
+ * WebSocketDelegate
+ *
+ * Called on the socket's serial processing queue, in the order frames
+ * were received. User status & delivered notifications arrive in storms,
+ * those from frames received together are delivered as a single batch.
+ */
 @protocol WebSocketDelegate <NSObject>
 
 -(void) webSocket:(WebSocket *)webSocket willConnect:(NSMutableURLRequest *)request;
 
--(void) webSocket:(WebSocket *)webSocket didReceiveUserStatus:(NSString *)sender recipient:(NSString *)recipient status:(enum UserStatus)status;
+-(void) webSocket:(WebSocket *)webSocket didReceiveUserStatuses:(NSArray<WebSocketUserStatus *> *)userStatuses;
 -(void) webSocket:(WebSocket *)webSocket didReceiveGroupStatus:(NSString *)sender chatId:(Id *)chatId status:(enum UserStatus)status;
 -(void) webSocket:(WebSocket *)webSocket didReceiveMsgReady:(MsgHdr *)msgHdr;
 -(void) webSocket:(WebSocket *)webSocket didReceiveMsgDelivery:(Msg *)msg;
--(void) webSocket:(WebSocket *)webSocket didReceiveMsgDelivered:(Id *)msgId recipient:(NSString *)recipient;
+-(void) webSocket:(WebSocket *)webSocket didReceiveMsgsDelivered:(NSArray<WebSocketMsgDelivered *> *)msgsDelivered;
 -(void) webSocket:(WebSocket *)webSocket didReceiveMsgDirect:(DirectMsg *)msg;
 
+// Called after an automatic reconnect, or connecting with a resume timestamp;
+// when not resumed, messages sent while disconnected must be fetched
+-(void) webSocket:(WebSocket *)webSocket didReconnectResumed:(BOOL)resumed;
+
+@optional
+
+// Called when the server refreshes the connection's bearer token; the token
+// arrives as an "X-Bearer-Refresh: <token>" text message ahead of the reply
+// to the request that triggered it, standing in for the HTTP response header
+-(void) webSocket:(WebSocket *)webSocket didReceiveBearerRefresh:(NSString *)accessToken;
+
 @end
 
 
+typedef void (^WebSocketRequestCompletion)(NSData *_Nullable replyFrame, NSError *_Nullable error);
+
+
 @interface WebSocket : NSObject
 
 @property (strong, nonatomic) NSURLRequest *URLRequest;
 @property (weak, nonatomic) id<WebSocketDelegate> delegate;
 
+// Thrift protocol negotiated by the most recent connection
+@property (readonly, nonatomic, nullable) NSString *protocolName;
+
+// Pings are sent when nothing has been received for the heartbeat interval; the
+// connection is considered dead when nothing (not even a pong) arrives within
+// the dead peer timeout
+@property (assign, nonatomic) NSTimeInterval heartbeatInterval;
+@property (assign, nonatomic) NSTimeInterval deadPeerTimeout;
+
+// Sent time after which connections ask the server to replay messages, when non-zero
+@property (assign, atomic) TimeStamp resumeTimestamp;
+
 -(instancetype) initWithURL:(NSURL *)URL;
 -(instancetype) initWithURLRequest:(NSURLRequest *)URLRequest;
 
+// Asynchronous; disconnecting also cancels any pending automatic reconnect
 -(void) connect;
 -(void) disconnect;
 -(void) reconnect;
@@ -47,6 +102,13 @@ NS_ASSUME_NONNULL_BEGIN
 -(BOOL) isConnecting;
 -(BOOL) isClosed;
 
+// Sends a Thrift request (serialized in the negotiated protocol) over the socket,
+// completing with the reply frame carrying the same sequence id. The request's
+// sequence id is replaced with one unique to the connection.
+//
+// Returns NO, without calling completion, when the socket is not open.
+-(BOOL) sendRequest:(NSData *)request timeout:(NSTimeInterval)timeout completion:(WebSocketRequestCompletion)completion;
+
 @end
 
 
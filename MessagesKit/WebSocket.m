@@ -10,7 +10,9 @@
 
 #import "SRWebSocket.h"
 #import "ServerAPI.h"
+#import "TBase+Utils.h"
 #import "NSError+Utils.h"
+#import "NetworkConnectivity.h"
 #import "Log.h"
 
 @import Thrift;
@@ -19,23 +21,85 @@
 MK_DECLARE_LOG_LEVEL()
 
 
-static const double kReconnectInterval = 1.0;
-static const double kReconnectIntervalMultiplier = 1.0;
-static const double kReconnectIntervalMax = 10.0;
-static const int kReconnectAttemptsMax = 50;
+static const double kReconnectIntervalMin = 0.5;
+static const double kReconnectIntervalMax = 60.0;
+
+static const double kHeartbeatInterval = 30.0;
+static const double kDeadPeerTimeout = 75.0;
+
+// Pending batches are delivered early once they reach this size
+static const NSUInteger kBatchSizeMax = 256;
+
+
+@interface FrameTransport : NSObject <TTransport>
+
+@property (readonly, nonatomic) UInt32 offset;
+
+-(void) resetWithFrame:(nullable NSData *)frame;
+
+@end
+
+
+@interface NullTransport : NSObject <TTransport>
+
+@end
 
 
 @interface WebSocket () <SRWebSocketDelegate, DeviceService> {
   SRWebSocket *_internalWebSocket;
-  uint _reconnectCount;
+  uint _reconnectAttempt;
+  NSUInteger _reconnectGeneration;
+  BOOL _autoReconnect;
+  BOOL _hasOpened;
+  BOOL _resumeRequested;
+  dispatch_source_t _heartbeatTimer;
+  CFAbsoluteTime _lastReceivedTime;
   DeviceServiceProcessor *_processor;
   id<TProtocolFactory> _protocolFactory;
+  FrameTransport *_frameTransport;
+  NullTransport *_nullTransport;
+  id<TProtocol> _inProtocol;
+  id<TProtocol> _outProtocol;
+  NSMutableArray<WebSocketUserStatus *> *_pendingUserStatuses;
+  NSMutableArray<WebSocketMsgDelivered *> *_pendingMsgsDelivered;
+  BOOL _batchFlushScheduled;
+  NSMutableDictionary<NSNumber *, WebSocketRequestCompletion> *_pendingRequests;
+  SInt32 _lastSequenceID;
 }
 
+// Serial queue all frames are processed (and delegate methods called) on
+@property (readonly, nonatomic) dispatch_queue_t processingQueue;
+
 @end
 
 
-@interface NullTransport : NSObject <TTransport>
+@implementation WebSocketUserStatus
+
+-(instancetype) initWithSender:(NSString *)sender recipient:(NSString *)recipient status:(enum UserStatus)status
+{
+  self = [super init];
+  if (self) {
+    _sender = sender;
+    _recipient = recipient;
+    _status = status;
+  }
+  return self;
+}
+
+@end
+
+
+@implementation WebSocketMsgDelivered
+
+-(instancetype) initWithMsgId:(Id *)msgId recipient:(NSString *)recipient
+{
+  self = [super init];
+  if (self) {
+    _msgId = msgId;
+    _recipient = recipient;
+  }
+  return self;
+}
 
 @end
 
@@ -55,10 +119,32 @@ static const int kReconnectAttemptsMax = 50;
     
     _URLRequest = URLRequest;
     
+    _processingQueue = dispatch_queue_create("WebSocket Processing Queue", DISPATCH_QUEUE_SERIAL);
+    _frameTransport = [FrameTransport new];
+    _nullTransport = [NullTransport new];
+    _pendingUserStatuses = [NSMutableArray array];
+    _pendingMsgsDelivered = [NSMutableArray array];
+    _pendingRequests = [NSMutableDictionary dictionary];
+    
+    _heartbeatInterval = kHeartbeatInterval;
+    _deadPeerTimeout = kDeadPeerTimeout;
+    
+    [NSNotificationCenter.defaultCenter addObserver:self
+                                           selector:@selector(networkAvailable:)
+                                               name:NetworkConnectivityAvailableNotification
+                                             object:nil];
+    
   }
   return self;
 }
 
+-(void) dealloc
+{
+  [NSNotificationCenter.defaultCenter removeObserver:self];
+  
+  [self _stopHeartbeat];
+}
+
 -(void) setURLRequest:(NSURLRequest *)URLRequest
 {
   NSMutableURLRequest *reqs = [URLRequest mutableCopy];
@@ -66,7 +152,17 @@ static const int kReconnectAttemptsMax = 50;
   _URLRequest = reqs;
 }
 
+// Connection state is only changed on the processing queue, where the
+// socket's delegate callbacks, heartbeats & reconnects also run
+
 -(void) reconnect
+{
+  dispatch_async(_processingQueue, ^{
+    [self _reconnect];
+  });
+}
+
+-(void) _reconnect
 {
   [self _invalidate];
   [self _connect];
@@ -74,20 +170,25 @@ static const int kReconnectAttemptsMax = 50;
 
 -(void) connect
 {
-  _reconnectCount = 0;
+  dispatch_async(_processingQueue, ^{
 
-  switch (_internalWebSocket.readyState) {
-  case SR_OPEN:
-    return;
+    self->_reconnectAttempt = 0;
+    self->_autoReconnect = YES;
 
-  case SR_CLOSED:
-  case SR_CLOSING:
-    [self reconnect];
-    return;
+    switch (self->_internalWebSocket.readyState) {
+    case SR_OPEN:
+      return;
 
-  default:
-    [self _connect];
-  }
+    case SR_CLOSED:
+    case SR_CLOSING:
+      [self _reconnect];
+      return;
+
+    default:
+      [self _connect];
+    }
+
+  });
 }
 
 -(void) _connect
@@ -102,8 +203,15 @@ static const int kReconnectAttemptsMax = 50;
       [_delegate webSocket:self willConnect:request];
     }
     
-    _internalWebSocket = [[SRWebSocket alloc] initWithURLRequest:request protocols:@[@"compact", @"binary"] allowsUntrustedSSLCertificates:NO];
-    [_internalWebSocket setDelegateDispatchQueue:dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0)];
+    // Ask for only the messages missed while disconnected
+    TimeStamp resumeTimestamp = self.resumeTimestamp;
+    _resumeRequested = resumeTimestamp > 0;
+    if (_resumeRequested) {
+      [request setValue:@(resumeTimestamp).stringValue forHTTPHeaderField:ResumeAfterHTTPHeader];
+    }
+    
+    _internalWebSocket = [[SRWebSocket alloc] initWithURLRequest:request protocols:TBaseUtils.protocolNames allowsUntrustedSSLCertificates:NO];
+    [_internalWebSocket setDelegateDispatchQueue:_processingQueue];
     _internalWebSocket.delegate = self;
   }
 
@@ -112,21 +220,34 @@ static const int kReconnectAttemptsMax = 50;
 
 -(void) disconnect
 {
-  if (!_internalWebSocket) {
-    return;
-  }
+  dispatch_async(_processingQueue, ^{
 
-  NSLog(@"WebSocket: disconnecting");
+    // Cancels any pending reconnect as well
+    self->_autoReconnect = NO;
+    self->_reconnectGeneration++;
+    self->_hasOpened = NO;
 
-  [_internalWebSocket closeWithCode:SRStatusCodeNormal reason:@"requested"];
+    if (!self->_internalWebSocket) {
+      return;
+    }
 
-  [self _invalidate];
+    NSLog(@"WebSocket: disconnecting");
+
+    [self->_internalWebSocket closeWithCode:SRStatusCodeNormal reason:@"requested"];
+
+    [self _invalidate];
+
+  });
 }
 
 -(void) _invalidate
 {
+  [self _stopHeartbeat];
+
   _internalWebSocket.delegate = nil;
   _internalWebSocket = nil;
+
+  [self _failPendingRequests];
 }
 
 -(BOOL) isOpen
@@ -148,27 +269,50 @@ static const int kReconnectAttemptsMax = 50;
 {
   NSLog(@"WebSocket: connected");
 
-  _reconnectCount = 0;
+  BOOL reconnected = _hasOpened;
+  NSString *resumeAfter = CFBridgingRelease(CFHTTPMessageCopyHeaderFieldValue(webSocket.receivedHTTPHeaders, (__bridge CFStringRef)ResumeAfterHTTPHeader));
 
+  _reconnectAttempt = 0;
+  _hasOpened = YES;
+
+  [self _startProcessingWithProtocolNamed:webSocket.protocol];
+  [self _startHeartbeat];
+
+  if (reconnected || _resumeRequested) {
+    [_delegate webSocket:self didReconnectResumed:resumeAfter != nil];
+  }
+}
+
+-(void) _startProcessingWithProtocolNamed:(NSString *)protocolName
+{
   _processor = [[DeviceServiceProcessor alloc] initWithDeviceService:self];
   
-  if ([webSocket.protocol isEqualToString:@"compact"]) {
-    _protocolFactory = TCompactProtocolFactory.sharedFactory;
-  }
-  else if ([webSocket.protocol isEqualToString:@"binary"]) {
-    _protocolFactory = TBinaryProtocolFactory.sharedFactory;
-  }
-  else {
-    DDLogWarn(@"Unknown websocket protocol %@, using default (binary)", webSocket.protocol);
+  _protocolFactory = [TBaseUtils protocolFactoryNamed:protocolName ?: @""];
+  _protocolName = protocolName;
+  
+  if (!_protocolFactory) {
+    DDLogWarn(@"Unknown websocket protocol %@, using default (binary)", protocolName);
     _protocolFactory = TBinaryProtocolFactory.sharedFactory;
+    _protocolName = ThriftBinaryProtocolName;
   }
   
+  [self _resetProtocols];
+}
+
+-(void) _resetProtocols
+{
+  // Protocols are reused for every frame of a connection
+  _inProtocol = [_protocolFactory newProtocolOnTransport:_frameTransport];
+  _outProtocol = [_protocolFactory newProtocolOnTransport:_nullTransport];
 }
 
 -(void) webSocket:(SRWebSocket *)webSocket didCloseWithCode:(NSInteger)code reason:(NSString *)reason wasClean:(BOOL)wasClean
 {
   NSLog(@"WebSocket: closed");
 
+  [self _stopHeartbeat];
+  [self _failPendingRequests];
+
   if (code != SRStatusCodeNormal) {
     [self tryToReconnect];
   }
@@ -178,6 +322,9 @@ static const int kReconnectAttemptsMax = 50;
 {
   NSLog(@"WebSocket: failed");
 
+  [self _stopHeartbeat];
+  [self _failPendingRequests];
+
   if (![error checkDomain:NSURLErrorDomain code:NSURLErrorUserAuthenticationRequired]) {
     [self tryToReconnect];
   }
@@ -185,56 +332,346 @@ static const int kReconnectAttemptsMax = 50;
 
 -(void) tryToReconnect
 {
-  if (_reconnectCount > kReconnectAttemptsMax) {
-    NSLog(@"WebSocket: Max reconnect attempts reached, failed to reconnect");
+  if (!_autoReconnect) {
     return;
   }
 
-  NSTimeInterval reconnectTime = MIN(kReconnectIntervalMax, kReconnectInterval * _reconnectCount * kReconnectIntervalMultiplier);
+  NSTimeInterval reconnectTime = [WebSocket reconnectIntervalForAttempt:_reconnectAttempt];
+
+  _reconnectAttempt++;
 
-  _reconnectCount++;
+  NSUInteger generation = _reconnectGeneration;
+
+  NSLog(@"WebSocket: reconnecting in %.1fs", reconnectTime);
+
+  dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(reconnectTime * NSEC_PER_SEC)), _processingQueue, ^{
+
+    // Superseded by a network change, or disconnected
+    if (generation != self->_reconnectGeneration || !self->_autoReconnect) {
+      return;
+    }
 
-  dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(reconnectTime * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
     [self checkAndReconnect];
   });
 
 }
 
++(NSTimeInterval) reconnectIntervalForAttempt:(uint)attempt
+{
+  // Exponential with "equal jitter", spreading out clients reconnecting after an outage
+  NSTimeInterval ceiling = MIN(kReconnectIntervalMax, kReconnectIntervalMin * pow(2, MIN(attempt, 16)));
+
+  return ceiling / 2.0 + (ceiling / 2.0) * ((double)arc4random() / UINT32_MAX);
+}
+
+-(void) networkAvailable:(NSNotification *)notification
+{
+  dispatch_async(_processingQueue, ^{
+
+    if (!self->_autoReconnect) {
+      return;
+    }
+
+    // Start over, networks that just came up are worth trying immediately
+    self->_reconnectAttempt = 0;
+    self->_reconnectGeneration++;
+
+    if (self.isOpen) {
+      // The connection may not have survived the change
+      [self _sendHeartbeat];
+    }
+    else {
+      [self checkAndReconnect];
+    }
+
+  });
+}
+
+-(void) _startHeartbeat
+{
+  [self _stopHeartbeat];
+
+  _lastReceivedTime = CFAbsoluteTimeGetCurrent();
+
+  dispatch_source_t heartbeatTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _processingQueue);
+
+  uint64_t interval = (uint64_t)(_heartbeatInterval * NSEC_PER_SEC);
+  dispatch_source_set_timer(heartbeatTimer, dispatch_time(DISPATCH_TIME_NOW, interval), interval, interval / 10);
+
+  __weak WebSocket *weakSelf = self;
+  dispatch_source_set_event_handler(heartbeatTimer, ^{
+    [weakSelf _checkHeartbeat];
+  });
+
+  dispatch_resume(heartbeatTimer);
+
+  _heartbeatTimer = heartbeatTimer;
+}
+
+-(void) _stopHeartbeat
+{
+  if (_heartbeatTimer) {
+    dispatch_source_cancel(_heartbeatTimer);
+    _heartbeatTimer = nil;
+  }
+}
+
+-(void) _checkHeartbeat
+{
+  CFAbsoluteTime silence = CFAbsoluteTimeGetCurrent() - _lastReceivedTime;
+
+  if (silence >= _deadPeerTimeout) {
+
+    // Half-open connections never report an error, replace it
+    NSLog(@"WebSocket: no response for %.1fs, reconnecting", silence);
+
+    SRWebSocket *deadWebSocket = _internalWebSocket;
+
+    [self _invalidate];
+
+    [deadWebSocket closeWithCode:SRStatusCodeGoingAway reason:@"heartbeat timeout"];
+
+    [self tryToReconnect];
+  }
+  else if (silence >= _heartbeatInterval) {
+
+    [self _sendHeartbeat];
+  }
+}
+
+-(void) _sendHeartbeat
+{
+  if (_internalWebSocket.readyState == SR_OPEN) {
+    [_internalWebSocket sendPing:[NSData data]];
+  }
+}
+
+-(void) webSocket:(SRWebSocket *)webSocket didReceivePong:(NSData *)pongPayload
+{
+  _lastReceivedTime = CFAbsoluteTimeGetCurrent();
+}
+
 -(void) checkAndReconnect
 {
   if (![self isConnecting] && ![self isOpen]) {
-    [self reconnect];
+    [self _reconnect];
   }
 }
 
 -(void) webSocket:(SRWebSocket *)webSocket didReceiveMessage:(id)message
 {
-  // Only process binary messages
+  _lastReceivedTime = CFAbsoluteTimeGetCurrent();
+
+  // Text messages carry headers, binary messages Thrift frames
+  if ([message isKindOfClass:[NSString class]]) {
+    [self _processHeader:message];
+    return;
+  }
+
   if (![message isKindOfClass:[NSData class]]) {
     return;
   }
 
-  TMemoryBuffer *messageBuffer = [[TMemoryBuffer alloc] initWithDataNoCopy:message];
-  id<TProtocol> inMessageProtocol = [_protocolFactory newProtocolOnTransport:messageBuffer];
-  id<TProtocol> outMessageProtocol = [_protocolFactory newProtocolOnTransport:[NullTransport new]];
+  [self _processFrame:message];
+}
+
+-(void) _processHeader:(NSString *)header
+{
+  NSRange separator = [header rangeOfString:@":"];
+  if (separator.location == NSNotFound) {
+    DDLogWarn(@"Ignoring malformed websocket header");
+    return;
+  }
+
+  NSString *name = [header substringToIndex:separator.location];
+  NSString *value = [[header substringFromIndex:NSMaxRange(separator)] stringByTrimmingCharactersInSet:NSCharacterSet.whitespaceAndNewlineCharacterSet];
+
+  if ([name caseInsensitiveCompare:BearerRefreshHTTPHeader] == NSOrderedSame && value.length) {
+    if ([_delegate respondsToSelector:@selector(webSocket:didReceiveBearerRefresh:)]) {
+      [_delegate webSocket:self didReceiveBearerRefresh:value];
+    }
+  }
+}
+
+-(void) _processFrame:(NSData *)frame
+{
+  [_frameTransport resetWithFrame:frame];
+
+  // Replies complete requests, anything else is a DeviceService push
 
   NSError *error;
-  if (![_processor processOnInputProtocol:inMessageProtocol outputProtocol:outMessageProtocol error:&error]) {
+  SInt32 type, sequenceID;
+  if (![_inProtocol readMessageBeginReturningName:NULL type:&type sequenceID:&sequenceID error:&error]) {
+    DDLogError(@"Error reading websocket frame: %@", error);
+    [self _resetProtocols];
+    [_frameTransport resetWithFrame:nil];
+    return;
+  }
+
+  if (type == TMessageTypeREPLY || type == TMessageTypeEXCEPTION) {
+    [_frameTransport resetWithFrame:nil];
+    [self _completeRequestWithSequenceID:sequenceID replyFrame:frame error:nil];
+    return;
+  }
+
+  [_frameTransport resetWithFrame:frame];
+
+  if (![_processor processOnInputProtocol:_inProtocol outputProtocol:_outProtocol error:&error]) {
     DDLogError(@"Error processing device service: %@", error);
+    
+    // Partially read frames leave state behind in the protocols
+    [self _resetProtocols];
+  }
+
+  [_frameTransport resetWithFrame:nil];
+}
+
+-(BOOL) sendRequest:(NSData *)request timeout:(NSTimeInterval)timeout completion:(WebSocketRequestCompletion)completion
+{
+  SRWebSocket *internalWebSocket = _internalWebSocket;
+  id<TProtocolFactory> protocolFactory = _protocolFactory;
+
+  if (internalWebSocket.readyState != SR_OPEN || !protocolFactory) {
+    return NO;
+  }
+
+  SInt32 sequenceID;
+  @synchronized(_pendingRequests) {
+    sequenceID = ++_lastSequenceID;
+    _pendingRequests[@(sequenceID)] = completion;
+  }
+
+  NSError *error;
+  NSData *frame = [self _frameForRequest:request withSequenceID:sequenceID protocolFactory:protocolFactory error:&error];
+  if (!frame) {
+    @synchronized(_pendingRequests) {
+      [_pendingRequests removeObjectForKey:@(sequenceID)];
+    }
+    DDLogError(@"Error preparing websocket request: %@", error);
+    return NO;
+  }
+
+  dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeout * NSEC_PER_SEC)), _processingQueue, ^{
+    NSError *timeoutError = [NSError errorWithDomain:TTransportErrorDomain
+                                                code:TTransportErrorTimedOut
+                                            userInfo:@{NSLocalizedDescriptionKey: @"WebSocket request timed out"}];
+    [self _completeRequestWithSequenceID:sequenceID replyFrame:nil error:timeoutError];
+  });
+
+  [internalWebSocket send:frame];
+
+  return YES;
+}
+
+-(NSData *) _frameForRequest:(NSData *)request withSequenceID:(SInt32)sequenceID protocolFactory:(id<TProtocolFactory>)protocolFactory error:(NSError **)error
+{
+  // Rewrite the message header with the new sequence id, the rest is copied as is
+
+  FrameTransport *requestTransport = [FrameTransport new];
+  [requestTransport resetWithFrame:request];
+
+  NSString *name;
+  SInt32 type;
+  if (![[protocolFactory newProtocolOnTransport:requestTransport] readMessageBeginReturningName:&name type:&type sequenceID:NULL error:error]) {
+    return nil;
+  }
+
+  TMemoryBuffer *headerBuffer = [TMemoryBuffer new];
+  if (![[protocolFactory newProtocolOnTransport:headerBuffer] writeMessageBeginWithName:name type:type sequenceID:sequenceID error:error]) {
+    return nil;
+  }
+
+  NSMutableData *frame = [headerBuffer.buffer mutableCopy];
+  [frame appendBytes:(const UInt8 *)request.bytes + requestTransport.offset length:request.length - requestTransport.offset];
+
+  return frame;
+}
+
+-(void) _completeRequestWithSequenceID:(SInt32)sequenceID replyFrame:(NSData *)replyFrame error:(NSError *)error
+{
+  WebSocketRequestCompletion completion;
+  @synchronized(_pendingRequests) {
+    completion = _pendingRequests[@(sequenceID)];
+    [_pendingRequests removeObjectForKey:@(sequenceID)];
+  }
+
+  // Late replies (after timing out) are dropped
+  if (completion) {
+    completion(replyFrame, error);
+  }
+}
+
+-(void) _failPendingRequests
+{
+  NSDictionary<NSNumber *, WebSocketRequestCompletion> *pendingRequests;
+  @synchronized(_pendingRequests) {
+    pendingRequests = [_pendingRequests copy];
+    [_pendingRequests removeAllObjects];
+  }
+
+  if (!pendingRequests.count) {
+    return;
+  }
+
+  NSError *error = [NSError errorWithDomain:TTransportErrorDomain
+                                       code:TTransportErrorNotOpen
+                                   userInfo:@{NSLocalizedDescriptionKey: @"WebSocket closed before reply"}];
+
+  dispatch_async(_processingQueue, ^{
+    for (WebSocketRequestCompletion completion in pendingRequests.allValues) {
+      completion(nil, error);
+    }
+  });
+}
+
+-(void) _scheduleBatchFlush
+{
+  if (_pendingUserStatuses.count + _pendingMsgsDelivered.count >= kBatchSizeMax) {
+    [self _flushBatches];
+    return;
+  }
+
+  if (_batchFlushScheduled) {
     return;
   }
 
+  _batchFlushScheduled = YES;
+
+  // Runs after frames already queued for processing, coalescing a burst into one batch
+  dispatch_async(_processingQueue, ^{
+    self->_batchFlushScheduled = NO;
+    [self _flushBatches];
+  });
+}
+
+-(void) _flushBatches
+{
+  if (_pendingUserStatuses.count) {
+    NSArray *userStatuses = _pendingUserStatuses;
+    _pendingUserStatuses = [NSMutableArray array];
+    [_delegate webSocket:self didReceiveUserStatuses:userStatuses];
+  }
+
+  if (_pendingMsgsDelivered.count) {
+    NSArray *msgsDelivered = _pendingMsgsDelivered;
+    _pendingMsgsDelivered = [NSMutableArray array];
+    [_delegate webSocket:self didReceiveMsgsDelivered:msgsDelivered];
+  }
 }
 
 -(BOOL) userStatus:(Alias)sender recipient:(Alias)recipient status:(UserStatus)status error:(NSError *__autoreleasing *)__thriftError
 {
-  [_delegate webSocket:self didReceiveUserStatus:sender recipient:recipient status:status];
+  [_pendingUserStatuses addObject:[WebSocketUserStatus.alloc initWithSender:sender recipient:recipient status:status]];
+  [self _scheduleBatchFlush];
 
   return YES;
 }
 
 -(BOOL) groupStatus:(Alias)sender chatId:(Id *)chatId status:(UserStatus)status error:(NSError *__autoreleasing *)__thriftError
 {
+  // Keep ordering with batched notifications received earlier
+  [self _flushBatches];
+
   [_delegate webSocket:self didReceiveGroupStatus:sender chatId:chatId status:status];
 
   return YES;
@@ -242,6 +679,8 @@ static const int kReconnectAttemptsMax = 50;
 
 -(BOOL) msgReady:(MsgHdr *)msgHdr error:(NSError *__autoreleasing *)__thriftError
 {
+  [self _flushBatches];
+
   [_delegate webSocket:self didReceiveMsgReady:msgHdr];
 
   return YES;
@@ -249,6 +688,8 @@ static const int kReconnectAttemptsMax = 50;
 
 -(BOOL) msgDelivery:(Msg *)msg error:(NSError *__autoreleasing *)__thriftError
 {
+  [self _flushBatches];
+
   [_delegate webSocket:self didReceiveMsgDelivery:msg];
 
   return YES;
@@ -256,6 +697,8 @@ static const int kReconnectAttemptsMax = 50;
 
 -(BOOL) msgDirect:(DirectMsg *)msg error:(NSError *__autoreleasing *)__thriftError
 {
+  [self _flushBatches];
+
   [_delegate webSocket:self didReceiveMsgDirect:msg];
 
   return YES;
@@ -263,8 +706,65 @@ static const int kReconnectAttemptsMax = 50;
 
 -(BOOL) msgDelivered:(Id *)msgId recipient:(Alias)recipient error:(NSError *__autoreleasing *)__thriftError
 {
-  [_delegate webSocket:self didReceiveMsgDelivered:msgId recipient:recipient];
+  [_pendingMsgsDelivered addObject:[WebSocketMsgDelivered.alloc initWithMsgId:msgId recipient:recipient]];
+  [self _scheduleBatchFlush];
+
+  return YES;
+}
+
+@end
+
+
+
+@implementation FrameTransport {
+  NSData *_frame; // Retains _bytes
+  const UInt8 *_bytes;
+  UInt32 _length;
+  UInt32 _offset;
+}
+
+-(void) resetWithFrame:(NSData *)frame
+{
+  _frame = frame;
+  _bytes = frame.bytes;
+  _length = (UInt32)frame.length;
+  _offset = 0;
+}
+
+-(BOOL) readAll:(UInt8 *)buf offset:(UInt32)offset length:(UInt32)length error:(NSError *__autoreleasing *)error
+{
+  if (length > _length - _offset) {
+    if (error) {
+      *error = [NSError errorWithDomain:TTransportErrorDomain
+                                   code:TTransportErrorEndOfFile
+                               userInfo:nil];
+    }
+    return NO;
+  }
+
+  memcpy(buf + offset, _bytes + _offset, length);
+  _offset += length;
+
+  return YES;
+}
+
+-(BOOL) readAvail:(UInt8 *)buf offset:(UInt32)offset length:(UInt32 *)length error:(NSError *__autoreleasing *)error
+{
+  *length = MIN(*length, _length - _offset);
+
+  memcpy(buf + offset, _bytes + _offset, *length);
+  _offset += *length;
+
+  return YES;
+}
+
+-(BOOL) write:(const UInt8 *)data offset:(UInt32)offset length:(UInt32)length error:(NSError *__autoreleasing *)error
+{
+  return YES;
+}
 
+-(BOOL) flush:(NSError *__autoreleasing *)error
+{
   return YES;
 }
 
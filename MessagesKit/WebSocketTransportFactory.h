@@ -0,0 +1,43 @@
+//
+//  WebSocketTransportFactory.h
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import <Thrift/TAsyncTransport.h>
+
+#import "WebSocket.h"
+
+
+NS_ASSUME_NONNULL_BEGIN
+
+
+/*
+ * WebSocketTransportFactory
+ *
+ * Creates transports that multiplex requests over the already open
+ * WebSocket, avoiding the setup cost of an HTTP request per call.
+ * Requests are sent through the fallback factory's transports when
+ * the socket is down, negotiated a different protocol, or the request
+ * is too large to hold up other frames.
+ */
+@interface WebSocketTransportFactory : NSObject <TAsyncTransportFactory>
+
+@property (readonly, nonatomic) WebSocket *webSocket;
+@property (readonly, nonatomic) NSString *protocolName;
+@property (readonly, nonatomic) id<TAsyncTransportFactory> fallbackTransportFactory;
+
+@property (assign, nonatomic) NSUInteger maxRequestSize;
+@property (assign, nonatomic) NSTimeInterval requestTimeout;
+
+-(instancetype) init NS_UNAVAILABLE;
+-(instancetype) initWithWebSocket:(WebSocket *)webSocket
+                     protocolName:(NSString *)protocolName
+         fallbackTransportFactory:(id<TAsyncTransportFactory>)fallbackTransportFactory NS_DESIGNATED_INITIALIZER;
+
+@end
+
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,191 @@
+//
+//  WebSocketTransportFactory.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "WebSocketTransportFactory.h"
+
+@import Thrift;
+
+
+@interface WebSocketTransport : NSObject <TAsyncTransport>
+
+-(instancetype) initWithFactory:(WebSocketTransportFactory *)factory;
+
+@end
+
+
+@implementation WebSocketTransportFactory
+
+-(instancetype) initWithWebSocket:(WebSocket *)webSocket
+                     protocolName:(NSString *)protocolName
+         fallbackTransportFactory:(id<TAsyncTransportFactory>)fallbackTransportFactory
+{
+  self = [super init];
+  if (self) {
+    _webSocket = webSocket;
+    _protocolName = protocolName;
+    _fallbackTransportFactory = fallbackTransportFactory;
+    _maxRequestSize = 64 * 1024;
+    _requestTimeout = 30.0;
+  }
+  return self;
+}
+
+-(id<TAsyncTransport>) newTransport
+{
+  return [WebSocketTransport.alloc initWithFactory:self];
+}
+
+@end
+
+
+
+@interface WebSocketTransport () {
+  WebSocketTransportFactory *_factory;
+  NSMutableData *_requestData;
+  NSData *_responseData;
+  NSUInteger _responseDataOffset;
+  id<TAsyncTransport> _fallbackTransport;
+}
+
+@end
+
+
+@implementation WebSocketTransport
+
+-(instancetype) initWithFactory:(WebSocketTransportFactory *)factory
+{
+  self = [super init];
+  if (self) {
+    _factory = factory;
+  }
+  return self;
+}
+
+-(BOOL) readAll:(UInt8 *)buf offset:(UInt32)offset length:(UInt32)length error:(NSError *__autoreleasing *)error
+{
+  if (_fallbackTransport) {
+    return [_fallbackTransport readAll:buf offset:offset length:length error:error];
+  }
+
+  if (length > _responseData.length - _responseDataOffset) {
+    if (error) {
+      *error = [NSError errorWithDomain:TTransportErrorDomain
+                                   code:TTransportErrorEndOfFile
+                               userInfo:nil];
+    }
+    return NO;
+  }
+
+  [_responseData getBytes:buf + offset range:NSMakeRange(_responseDataOffset, length)];
+  _responseDataOffset += length;
+
+  return YES;
+}
+
+-(BOOL) readAvail:(UInt8 *)buf offset:(UInt32)offset length:(UInt32 *)length error:(NSError *__autoreleasing *)error
+{
+  if (_fallbackTransport) {
+    return [_fallbackTransport readAvail:buf offset:offset length:length error:error];
+  }
+
+  *length = (UInt32)MIN(*length, _responseData.length - _responseDataOffset);
+
+  [_responseData getBytes:buf + offset range:NSMakeRange(_responseDataOffset, *length)];
+  _responseDataOffset += *length;
+
+  return YES;
+}
+
+-(BOOL) write:(const UInt8 *)data offset:(UInt32)offset length:(UInt32)length error:(NSError *__autoreleasing *)error
+{
+  if (!_requestData) {
+    _requestData = [NSMutableData dataWithCapacity:256];
+  }
+
+  [_requestData appendBytes:data + offset length:length];
+
+  return YES;
+}
+
+-(void) flushWithCompletion:(TAsyncCompletionBlock)completed failure:(TAsyncFailureBlock)failure
+{
+  NSData *request = _requestData ?: [NSData data];
+
+  _requestData = nil;
+  _responseData = nil;
+  _responseDataOffset = 0;
+  _fallbackTransport = nil;
+
+  WebSocket *webSocket = _factory.webSocket;
+
+  // Frames must be in the protocol the socket negotiated
+
+  if (request.length <= _factory.maxRequestSize &&
+      [webSocket.protocolName isEqualToString:_factory.protocolName])
+  {
+    BOOL sent = [webSocket sendRequest:request timeout:_factory.requestTimeout completion:^(NSData *replyFrame, NSError *error) {
+
+      if (error) {
+        failure(error);
+        return;
+      }
+
+      self->_responseData = replyFrame;
+
+      completed();
+    }];
+
+    if (sent) {
+      return;
+    }
+  }
+
+  _fallbackTransport = [_factory.fallbackTransportFactory newTransport];
+
+  NSError *error;
+  if (![_fallbackTransport write:request.bytes offset:0 length:(UInt32)request.length error:&error]) {
+    failure(error);
+    return;
+  }
+
+  [_fallbackTransport flushWithCompletion:completed failure:failure];
+}
+
+-(BOOL) flush:(NSError *__autoreleasing *)error
+{
+  dispatch_semaphore_t completed = dispatch_semaphore_create(0);
+
+  __block BOOL result;
+  __block NSError *internalError;
+
+  [self flushWithCompletion:^{
+
+    result = YES;
+
+    dispatch_semaphore_signal(completed);
+
+  } failure:^(NSError *error) {
+
+    internalError = error;
+
+    result = NO;
+
+    dispatch_semaphore_signal(completed);
+
+  }];
+
+  dispatch_semaphore_wait(completed, DISPATCH_TIME_FOREVER);
+
+  if (error) {
+    *error = internalError;
+  }
+
+  return result;
+}
+
+@end
@@ -0,0 +1,352 @@
+//
+//  BenchmarkCorpus.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import Foundation
+import PopulateKit
+@testable import MessagesKit
+
+
+/*
+  Size & shape of a generated corpus
+
+  Defaults can be overridden from the environment (e.g. in the scheme's
+  test action) with MK_BENCH_CHATS, MK_BENCH_MESSAGES, MK_BENCH_MEDIA_RATIO,
+  MK_BENCH_GROUP_RATIO, MK_BENCH_GROUP_SIZE, MK_BENCH_CONTACTS & MK_BENCH_SEED.
+*/
+struct BenchmarkCorpusConfiguration {
+
+  var chats = 40
+  var messagesPerChat = 500
+  // Fraction of messages that are images
+  var mediaRatio = 0.1
+  // Fraction of chats that are groups
+  var groupRatio = 0.25
+  var groupSize = 8
+  var contacts = 2000
+  var seed : UInt32 = 42
+
+  static func fromEnvironment() -> BenchmarkCorpusConfiguration {
+
+    let environment = NSProcessInfo.processInfo().environment
+
+    var configuration = BenchmarkCorpusConfiguration()
+
+    if let value = environment["MK_BENCH_CHATS"].flatMap({ Int($0) }) {
+      configuration.chats = value
+    }
+    if let value = environment["MK_BENCH_MESSAGES"].flatMap({ Int($0) }) {
+      configuration.messagesPerChat = value
+    }
+    if let value = environment["MK_BENCH_MEDIA_RATIO"].flatMap({ Double($0) }) {
+      configuration.mediaRatio = value
+    }
+    if let value = environment["MK_BENCH_GROUP_RATIO"].flatMap({ Double($0) }) {
+      configuration.groupRatio = value
+    }
+    if let value = environment["MK_BENCH_GROUP_SIZE"].flatMap({ Int($0) }) {
+      configuration.groupSize = value
+    }
+    if let value = environment["MK_BENCH_CONTACTS"].flatMap({ Int($0) }) {
+      configuration.contacts = value
+    }
+    if let value = environment["MK_BENCH_SEED"].flatMap({ UInt32($0) }) {
+      configuration.seed = value
+    }
+
+    return configuration
+  }
+
+  // Identifies the generated corpus, equal configurations generate identical corpora
+  var name : String {
+    return "corpus-\(chats)x\(messagesPerChat)-m\(Int(mediaRatio * 100))-g\(Int(groupRatio * 100))x\(groupSize)-s\(seed)"
+  }
+
+  var propertyList : [String: AnyObject] {
+    return [
+      "chats": chats,
+      "messagesPerChat": messagesPerChat,
+      "mediaRatio": mediaRatio,
+      "groupRatio": groupRatio,
+      "groupSize": groupSize,
+      "contacts": contacts,
+      "seed": Int(seed),
+    ]
+  }
+
+}
+
+
+/*
+  Deterministic pseudo random numbers (LCG), so corpora are
+  reproducible across runs & devices
+*/
+struct BenchmarkRandom {
+
+  private var state : UInt32
+
+  init(seed: UInt32) {
+    state = seed
+  }
+
+  mutating func next(bound: Int) -> Int {
+    state = state &* 1664525 &+ 1013904223
+    return Int((state >> 8) % UInt32(bound))
+  }
+
+  mutating func chance(probability: Double) -> Bool {
+    return Double(next(1_000_000)) < probability * 1_000_000
+  }
+
+  mutating func element<T>(array: [T]) -> T {
+    return array[next(array.count)]
+  }
+
+  mutating func data(length: Int) -> NSData {
+    let data = NSMutableData(length: length)!
+    let bytes = UnsafeMutablePointer<UInt8>(data.mutableBytes)
+    for c in 0..<length {
+      bytes[c] = UInt8(truncatingBitPattern: next(256))
+    }
+    return data
+  }
+
+  mutating func id() -> Id {
+    return Id(data: data(16))
+  }
+
+}
+
+
+/*
+  PopulateKit's name & face data sets, read directly from its bundle
+  (the sets themselves only hand out arc4random picks)
+*/
+struct BenchmarkDataSets {
+
+  let firstNames : [String]
+  let lastNames : [String]
+  let faceImageURLs : [NSURL]
+
+  static let shared = BenchmarkDataSets()
+
+  private init() {
+
+    let bundleURL = NSBundle(forClass: ACPersonSet.self).URLForResource("PopulateKit", withExtension: "bundle")!
+
+    func names(resource: String) -> [String] {
+      let URL = bundleURL.URLByAppendingPathComponent(resource + ".csv")
+      let contents = (try? String(contentsOfURL: URL, encoding: NSUTF8StringEncoding)) ?? ""
+      return contents.componentsSeparatedByCharactersInSet(NSCharacterSet.newlineCharacterSet()).filter { !$0.isEmpty }
+    }
+
+    func images(directory: String) -> [NSURL] {
+      let URL = bundleURL.URLByAppendingPathComponent(directory)
+      let files = (try? NSFileManager.defaultManager().contentsOfDirectoryAtURL(URL, includingPropertiesForKeys: nil, options: [])) ?? []
+      return files.sort { $0.lastPathComponent! < $1.lastPathComponent! }
+    }
+
+    firstNames = names("common_male_names") + names("common_female_names")
+    lastNames = names("common_surnames")
+    faceImageURLs = images("male") + images("female")
+  }
+
+  static let words = ["hey", "are", "you", "coming", "tonight", "running", "late", "see", "you", "soon", "thanks",
+                      "dinner", "at", "eight", "call", "me", "when", "you", "land", "did", "you", "get", "the",
+                      "photos", "meeting", "moved", "to", "tomorrow", "sounds", "good", "on", "my", "way", "lol"]
+
+  func text(inout random: BenchmarkRandom) -> String {
+    return (0..<(2 + random.next(14))).map { _ in random.element(BenchmarkDataSets.words) }.joinWithSeparator(" ")
+  }
+
+  func fullName(inout random: BenchmarkRandom) -> (first: String, last: String) {
+    return (random.element(firstNames), random.element(lastNames))
+  }
+
+}
+
+
+/*
+  Generated message database
+
+  The database is generated once per configuration into the caches
+  directory; benchmarks work on disposable copies of it.
+*/
+class BenchmarkCorpus {
+
+  static let localAlias = "+15550000000"
+
+  static let daoClasses : [AnyClass] = [ChatDAO.self, MessageDAO.self, NotificationDAO.self]
+
+  let configuration : BenchmarkCorpusConfiguration
+
+  let directoryURL : NSURL
+
+  init(configuration: BenchmarkCorpusConfiguration) throws {
+
+    self.configuration = configuration
+
+    let cachesURL = try NSFileManager.defaultManager().URLForDirectory(.CachesDirectory, inDomain: .UserDomainMask, appropriateForURL: nil, create: true)
+    self.directoryURL = cachesURL.URLByAppendingPathComponent("MessagesKitBenchmarks").URLByAppendingPathComponent(configuration.name)
+
+    let completeURL = directoryURL.URLByAppendingPathComponent("complete")
+
+    if !NSFileManager.defaultManager().fileExistsAtPath(completeURL.path!) {
+
+      let _ = try? NSFileManager.defaultManager().removeItemAtURL(directoryURL)
+      try NSFileManager.defaultManager().createDirectoryAtURL(directoryURL, withIntermediateDirectoryAttributes: true, attributes: nil)
+
+      let start = NSProcessInfo.processInfo().systemUptime
+
+      try generateIntoDirectoryAtURL(directoryURL)
+
+      NSData().writeToURL(completeURL, atomically: true)
+
+      NSLog("Generated benchmark corpus %@ in %.1fs", configuration.name, NSProcessInfo.processInfo().systemUptime - start)
+    }
+  }
+
+  // Copies the corpus into a fresh directory, returns the database path of the copy
+  func makeWorkingCopy() throws -> String {
+
+    let workingURL = NSURL(fileURLWithPath: NSTemporaryDirectory()).URLByAppendingPathComponent("MessagesKitBenchmarks-working")
+
+    let _ = try? NSFileManager.defaultManager().removeItemAtURL(workingURL)
+    try NSFileManager.defaultManager().copyItemAtURL(directoryURL, toURL: workingURL)
+
+    return workingURL.URLByAppendingPathComponent("corpus.sqlite").path!
+  }
+
+  func openWorkingCopy() throws -> DBManager {
+    return try DBManager(path: try makeWorkingCopy(), kind: "Message", daoClasses: BenchmarkCorpus.daoClasses)
+  }
+
+  // Contact names & aliases (the first are the corpus' chat partners)
+  func contacts() -> [(first: String, last: String, alias: String)] {
+
+    var random = BenchmarkRandom(seed: configuration.seed)
+
+    return (0..<max(configuration.contacts, configuration.chats * configuration.groupSize)).map { c in
+      let name = BenchmarkDataSets.shared.fullName(&random)
+      return (name.first, name.last, String(format: "+1555%07d", c + 1))
+    }
+  }
+
+  private func generateIntoDirectoryAtURL(URL: NSURL) throws {
+
+    let dataSets = BenchmarkDataSets.shared
+
+    let dbManager = try DBManager(path: URL.URLByAppendingPathComponent("corpus.sqlite").path!, kind: "Message", daoClasses: BenchmarkCorpus.daoClasses)
+    defer { dbManager.shutdown() }
+
+    let chatDAO = dbManager["Chat"] as! ChatDAO
+    let messageDAO = dbManager["Message"] as! MessageDAO
+
+    var random = BenchmarkRandom(seed: configuration.seed)
+
+    let aliases = contacts().map { $0.alias }
+
+    // Images & thumbnails are decoded once per face, then shared
+
+    var images = [(data: DataReference, thumbnail: NSData?, size: CGSize)]()
+    for imageURL in dataSets.faceImageURLs.prefix(16) {
+      let data = MemoryDataReference(data: NSData(contentsOfURL: imageURL)!, ofMIMEType: "image/jpeg")
+      var size = CGSize.zero
+      let thumbnail = try? ImageMessage.generateThumbnailWithImageData(data, size: &size)
+      images.append((data, thumbnail, size))
+    }
+
+    let start = NSDate(timeIntervalSinceReferenceDate: 473385600) // 2016-01-01
+
+    for chatIdx in 0..<configuration.chats {
+
+      let chat : Chat
+
+      if random.chance(configuration.groupRatio) {
+        let members = Set((0..<configuration.groupSize).map { _ in random.element(aliases) })
+        let groupChat = GroupChat()
+        groupChat.id = random.id()
+        groupChat.alias = groupChat.id.UUIDString
+        groupChat.members = members.union([BenchmarkCorpus.localAlias])
+        groupChat.activeMembers = groupChat.members
+        chat = groupChat
+      }
+      else {
+        chat = UserChat()
+        chat.id = random.id()
+        chat.alias = aliases[chatIdx % aliases.count]
+      }
+
+      chat.localAlias = BenchmarkCorpus.localAlias
+      chat.startedDate = start
+
+      try chatDAO.insertChat(chat)
+
+      let others = Array(chat.allRecipients)
+
+      var insertError : ErrorType?
+
+      // Each chat's messages are inserted in one transaction
+      dbManager.pool.inTransaction { db, rollback in
+
+        do {
+
+          var lastMessage : Message?
+
+          for msgIdx in 0..<self.configuration.messagesPerChat {
+
+            let message : Message
+
+            if !images.isEmpty && random.chance(self.configuration.mediaRatio) {
+              let image = random.element(images)
+              let imageMessage = ImageMessage(id: random.id(), chat: chat, data: image.data, thumbnailData: image.thumbnail)
+              imageMessage.thumbnailSize = image.size
+              message = imageMessage
+            }
+            else {
+              message = TextMessage(id: random.id(), chat: chat, text: dataSets.text(&random))
+            }
+
+            let sentByMe = others.isEmpty || random.chance(0.5)
+
+            message.sender = sentByMe ? BenchmarkCorpus.localAlias : random.element(others)
+            message.sent = start.dateByAddingTimeInterval(Double(msgIdx) * 600 + Double(random.next(600)))
+            message.statusTimestamp = message.sent
+
+            // The most recent incoming messages are unread
+            if !sentByMe && msgIdx >= self.configuration.messagesPerChat * 9 / 10 {
+              message.status = .Delivered
+              message.unreadFlag = true
+            }
+            else {
+              message.status = sentByMe ? .Delivered : .Viewed
+            }
+
+            try messageDAO.insertMessage(message)
+
+            lastMessage = message
+          }
+
+          if let lastMessage = lastMessage {
+            try chatDAO.updateChat(chat, withLastMessage: lastMessage)
+          }
+        }
+        catch {
+          insertError = error
+          rollback.memory = true
+        }
+      }
+
+      if let error = insertError {
+        throw error
+      }
+    }
+
+    try chatDAO.rebuildMessageCountsReturningCorrected(nil)
+  }
+
+}
@@ -0,0 +1,150 @@
+//
+//  BenchmarkResults.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import Foundation
+import UIKit
+
+
+/*
+  Timings of one benchmark scenario
+
+  `work` counts the units processed per iteration (messages, bytes,
+  ...), throughput is reported per second of the median iteration.
+*/
+struct BenchmarkResult {
+
+  let name : String
+  let samples : [NSTimeInterval]
+  let work : Double
+  let workUnit : String
+
+  // Measurements other than timings (e.g. allocations per unit of work)
+  var metrics = [String: Double]()
+
+  init(name: String, samples: [NSTimeInterval], work: Double, workUnit: String) {
+    self.name = name
+    self.samples = samples
+    self.work = work
+    self.workUnit = workUnit
+  }
+
+  private var sorted : [NSTimeInterval] {
+    return samples.sort()
+  }
+
+  var median : NSTimeInterval {
+    return percentile(0.5)
+  }
+
+  func percentile(percentile: Double) -> NSTimeInterval {
+    let sorted = self.sorted
+    if sorted.isEmpty {
+      return 0
+    }
+    return sorted[min(sorted.count - 1, Int(ceil(percentile * Double(sorted.count))) - 1)]
+  }
+
+  var propertyList : [String: AnyObject] {
+    let sorted = self.sorted
+    var propertyList : [String: AnyObject] = [
+      "name": name,
+      "iterations": samples.count,
+      "samples": samples,
+      "min": sorted.first ?? 0,
+      "median": median,
+      "p90": percentile(0.9),
+      "p99": percentile(0.99),
+      "max": sorted.last ?? 0,
+      "mean": samples.isEmpty ? 0 : samples.reduce(0, combine: +) / Double(samples.count),
+    ]
+    if work > 0 && median > 0 {
+      propertyList["work"] = work
+      propertyList["workUnit"] = workUnit
+      propertyList["throughput"] = work / median
+    }
+    for (name, value) in metrics {
+      propertyList[name] = value
+    }
+    return propertyList
+  }
+
+}
+
+
+/*
+  Collects the results of a benchmark run & writes them as JSON
+
+  Written to $MK_BENCH_OUTPUT (default MessagesKitBenchmarks.json in the
+  temporary directory); $MK_BENCH_COMMIT is recorded to identify the
+  build being measured when comparing runs.
+*/
+class BenchmarkResults {
+
+  static let shared = BenchmarkResults()
+
+  private var results = [BenchmarkResult]()
+
+  var corpus = [String: AnyObject]()
+
+  func addResult(result: BenchmarkResult) {
+    results.append(result)
+    NSLog("Benchmark %@: median %.2fms, p90 %.2fms, p99 %.2fms", result.name, result.median * 1e3, result.percentile(0.9) * 1e3, result.percentile(0.99) * 1e3)
+  }
+
+  func addMetric(name: String, value: Double, toResultNamed resultName: String) {
+    guard let idx = results.indexOf({ $0.name == resultName }) else {
+      return
+    }
+    results[idx].metrics[name] = value
+    NSLog("Benchmark %@: %@ %.2f", resultName, name, value)
+  }
+
+  var outputURL : NSURL {
+    if let path = NSProcessInfo.processInfo().environment["MK_BENCH_OUTPUT"] {
+      return NSURL(fileURLWithPath: path)
+    }
+    return NSURL(fileURLWithPath: NSTemporaryDirectory()).URLByAppendingPathComponent("MessagesKitBenchmarks.json")
+  }
+
+  func JSONData() throws -> NSData {
+
+    let environment = NSProcessInfo.processInfo().environment
+    let device = UIDevice.currentDevice()
+
+    let report : [String: AnyObject] = [
+      "version": 1,
+      "date": NSDate().timeIntervalSince1970,
+      "commit": environment["MK_BENCH_COMMIT"] ?? "",
+      "device": [
+        "model": device.model,
+        "system": device.systemName + " " + device.systemVersion,
+        "processors": NSProcessInfo.processInfo().activeProcessorCount,
+      ],
+      "corpus": corpus,
+      "results": results.sort { $0.name < $1.name }.map { $0.propertyList },
+    ]
+
+    return try NSJSONSerialization.dataWithJSONObject(report, options: [.PrettyPrinted])
+  }
+
+  func write() {
+
+    guard !results.isEmpty else {
+      return
+    }
+
+    do {
+      try JSONData().writeToURL(outputURL, options: [.DataWritingAtomic])
+      NSLog("Benchmark results written to %@", outputURL.path!)
+    }
+    catch {
+      NSLog("Unable to write benchmark results: %@", "\(error)")
+    }
+  }
+
+}
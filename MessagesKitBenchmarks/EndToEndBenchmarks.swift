@@ -0,0 +1,233 @@
+//
+//  EndToEndBenchmarks.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import XCTest
+@testable import MessagesKit
+
+
+/*
+  Scenarios driving one MessageAPI against a StandInServer on the
+  loopback interface, through the real HTTP & WebSocket transports.
+
+  Sized from the environment with MK_BENCH_PEERS (simulated peers),
+  MK_BENCH_E2E_MESSAGES (messages per scenario) & MK_BENCH_LATENCY
+  (server latency in milliseconds). MessageAPI's target is fixed once
+  initialized, so these need a test run of their own.
+*/
+class EndToEndBenchmarks: XCTestCase {
+
+  static var server : StandInServer!
+  static var api : MessageAPI!
+
+  static let password = "benchmark"
+
+  var server : StandInServer {
+    return EndToEndBenchmarks.server
+  }
+
+  var api : MessageAPI {
+    return EndToEndBenchmarks.api
+  }
+
+  var messageCount : Int {
+    return NSProcessInfo.processInfo().environment["MK_BENCH_E2E_MESSAGES"].flatMap { Int($0) } ?? 500
+  }
+
+  private var chats = [String: Chat]()
+
+  override class func setUp() {
+    super.setUp()
+
+    let environment = NSProcessInfo.processInfo().environment
+
+    let latency = environment["MK_BENCH_LATENCY"].flatMap { Double($0) } ?? 20
+
+    server = StandInServer(peerCount: environment["MK_BENCH_PEERS"].flatMap { Int($0) } ?? 5000)
+    server.latency = latency / 1e3
+    server.latencyJitter = latency / 2e3
+
+    try! server.start()
+
+    let target = ServerTarget(scheme: .HTTP, hostName: "127.0.0.1", port: Int(server.port))
+    target.certificateTrust = server.certificateTrust
+
+    MessageAPI.initialize(target: target)
+  }
+
+  override class func tearDown() {
+
+    api?.deactivate()
+    server.stop()
+
+    BenchmarkResults.shared.write()
+
+    super.tearDown()
+  }
+
+  override func setUp() {
+    super.setUp()
+
+    guard EndToEndBenchmarks.api == nil else {
+      return
+    }
+
+    let documentDirectoryURL = NSURL(fileURLWithPath: NSTemporaryDirectory()).URLByAppendingPathComponent("MessagesKitBenchmarks-e2e")
+    let _ = try? NSFileManager.defaultManager().removeItemAtURL(documentDirectoryURL)
+    try! NSFileManager.defaultManager().createDirectoryAtURL(documentDirectoryURL, withIntermediateDirectories: true, attributes: nil)
+
+    let x = expectationWithDescription("Register")
+
+    MessageAPI.registerUserWithAliases([BenchmarkCorpus.localAlias: "0000"], password: EndToEndBenchmarks.password)
+      .then { credentials -> Void in
+        EndToEndBenchmarks.api = try MessageAPI(credentials: credentials, documentDirectoryURL: documentDirectoryURL)
+        EndToEndBenchmarks.api.activate()
+      }
+      .always {
+        x.fulfill()
+      }
+      .error { error in
+        fatalError("Unable to register: \(error)")
+      }
+
+    waitForExpectationsWithTimeout(60, handler: nil)
+
+    // One round trip, so the WebSocket is connected before measuring
+    try! server.deliverMessages(1, toAlias: BenchmarkCorpus.localAlias)
+    XCTAssertTrue(waitUntil(30) { self.server.ackCount > 0 }, "Warm up message not received")
+  }
+
+  override func tearDown() {
+
+    server.failureRate = 0
+    server.failureMethods = nil
+    server.fetchRatio = 0
+
+    super.tearDown()
+  }
+
+  // Runs the main run loop (where MessageAPI resolves its promises) until `condition` holds
+  func waitUntil(timeout: NSTimeInterval, @noescape condition: () -> Bool) -> Bool {
+
+    let deadline = NSDate(timeIntervalSinceNow: timeout)
+
+    while !condition() {
+      if deadline.timeIntervalSinceNow < 0 {
+        return false
+      }
+      NSRunLoop.currentRunLoop().runUntilDate(NSDate(timeIntervalSinceNow: 0.005))
+    }
+
+    return true
+  }
+
+  func chatWithPeer(alias: String) throws -> Chat {
+
+    if let chat = chats[alias] {
+      return chat
+    }
+
+    let chat = try api.loadUserChatForAlias(alias, localAlias: BenchmarkCorpus.localAlias)
+    chats[alias] = chat
+
+    return chat
+  }
+
+  /*
+    Sends `count` text messages to random peers at once; each sample
+    is one message's time from save to the server accepting it.
+  */
+  func measureSend(name: String, count: Int) throws {
+
+    var random = BenchmarkRandom(seed: 42)
+
+    let messages = try (0..<count).map { _ -> TextMessage in
+      let message = TextMessage(chat: try self.chatWithPeer(random.element(self.server.peerAliases)))
+      message.text = BenchmarkDataSets.shared.text(&random)
+      return message
+    }
+
+    server.resetStatistics()
+
+    var samples = [NSTimeInterval]()
+    var completed = 0
+
+    let start = NSProcessInfo.processInfo().systemUptime
+
+    for message in messages {
+
+      let saved = NSProcessInfo.processInfo().systemUptime
+
+      api.saveMessage(message)
+        .then {
+          samples.append(NSProcessInfo.processInfo().systemUptime - saved)
+        }
+        .always {
+          completed += 1
+        }
+        .error { _ in
+          // Failed sends are reported by count
+        }
+    }
+
+    XCTAssertTrue(waitUntil(600) { completed == count }, "\(name) timed out")
+
+    let elapsed = NSProcessInfo.processInfo().systemUptime - start
+
+    NSLog("Benchmark %@: %d of %d sent, %d requests failed", name, samples.count, count, server.failureCount)
+
+    BenchmarkResults.shared.addResult(BenchmarkResult(name: name, samples: samples, work: 0, workUnit: ""))
+    BenchmarkResults.shared.addResult(BenchmarkResult(name: name + ".burst", samples: [elapsed], work: Double(samples.count), workUnit: "messages"))
+  }
+
+  /*
+    Has peers send `count` messages at once; each sample is one
+    message's time from generation to its acknowledgement, after it
+    was verified, decrypted & saved.
+  */
+  func measureReceive(name: String, count: Int) throws {
+
+    server.resetStatistics()
+
+    let start = NSProcessInfo.processInfo().systemUptime
+
+    try server.deliverMessages(count, toAlias: BenchmarkCorpus.localAlias)
+
+    XCTAssertTrue(waitUntil(600) { self.server.ackCount >= count }, "\(name) timed out")
+
+    let elapsed = NSProcessInfo.processInfo().systemUptime - start
+
+    BenchmarkResults.shared.addResult(BenchmarkResult(name: name, samples: server.takeAckLatencies().map { $0.doubleValue }, work: 0, workUnit: ""))
+    BenchmarkResults.shared.addResult(BenchmarkResult(name: name + ".burst", samples: [elapsed], work: Double(server.ackCount), workUnit: "messages"))
+  }
+
+  func testSend() throws {
+    try measureSend("e2e.send", count: messageCount)
+  }
+
+  // Retried sends lengthen the tail
+  func testSendWithFailures() throws {
+
+    server.failureRate = 0.05
+    server.failureMethods = ["send"]
+
+    try measureSend("e2e.send.failures", count: messageCount)
+  }
+
+  func testReceive() throws {
+    try measureReceive("e2e.receive", count: messageCount)
+  }
+
+  // Announced messages are fetched by the receiver, a round trip each
+  func testReceiveFetched() throws {
+
+    server.fetchRatio = 1
+
+    try measureReceive("e2e.receive.fetch", count: messageCount)
+  }
+
+}
@@ -0,0 +1,321 @@
+//
+//  MessagesKitBenchmarks.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import XCTest
+import AddressBook
+@testable import MessagesKit
+
+
+/*
+  Standard scenarios run against a generated corpus (see
+  BenchmarkCorpusConfiguration for sizing). Results are collected into
+  a JSON report (see BenchmarkResults) for comparing runs between
+  commits; the tests only fail when a scenario errors.
+*/
+class MessagesKitBenchmarks: XCTestCase {
+
+  static var corpus : BenchmarkCorpus!
+
+  static var iterations : Int {
+    return NSProcessInfo.processInfo().environment["MK_BENCH_ITERATIONS"].flatMap { Int($0) } ?? 5
+  }
+
+  var corpus : BenchmarkCorpus {
+    return MessagesKitBenchmarks.corpus
+  }
+
+  override class func setUp() {
+    super.setUp()
+
+    let configuration = BenchmarkCorpusConfiguration.fromEnvironment()
+
+    corpus = try! BenchmarkCorpus(configuration: configuration)
+
+    BenchmarkResults.shared.corpus = configuration.propertyList
+  }
+
+  override class func tearDown() {
+
+    BenchmarkResults.shared.write()
+
+    super.tearDown()
+  }
+
+  /*
+    Times `block` over a number of iterations; `setUp` & `tearDown` run
+    around each iteration, untimed.
+  */
+  func measureScenario(name: String, work: Double = 0, workUnit: String = "",
+                       setUp: () throws -> Void = {}, tearDown: () throws -> Void = {},
+                       block: () throws -> Void) {
+
+    var samples = [NSTimeInterval]()
+
+    do {
+
+      for _ in 0..<MessagesKitBenchmarks.iterations {
+
+        try setUp()
+
+        let start = NSProcessInfo.processInfo().systemUptime
+        try block()
+        samples.append(NSProcessInfo.processInfo().systemUptime - start)
+
+        try tearDown()
+      }
+
+    }
+    catch {
+      XCTFail("Scenario \(name) failed: \(error)")
+      return
+    }
+
+    BenchmarkResults.shared.addResult(BenchmarkResult(name: name, samples: samples, work: work, workUnit: workUnit))
+  }
+
+  func mallocBlocksInUse() -> Int {
+    var statistics = malloc_statistics_t()
+    malloc_zone_statistics(nil, &statistics)
+    return Int(statistics.blocks_in_use)
+  }
+
+  func testColdOpen() {
+
+    var path : String!
+    var dbManager : DBManager?
+
+    func open() throws {
+      dbManager = try DBManager(path: path, kind: "Message", daoClasses: BenchmarkCorpus.daoClasses)
+
+      let chatDAO = dbManager!["Chat"] as! ChatDAO
+      let messageDAO = dbManager!["Message"] as! MessageDAO
+
+      try chatDAO.fetchAllChatsMatching(nil)
+      messageDAO.countOfUnreadMessages()
+    }
+
+    func close() {
+      dbManager?.shutdown()
+      dbManager = nil
+    }
+
+    measureScenario("coldOpen", setUp: {
+      path = try self.corpus.makeWorkingCopy()
+    }, tearDown: close, block: open)
+
+    // As after an install or upgrade
+    measureScenario("coldOpen.noSchemaCache", setUp: {
+      path = try self.corpus.makeWorkingCopy()
+      let _ = try? NSFileManager.defaultManager().removeItemAtPath((path as NSString).stringByDeletingPathExtension + "-schema.plist")
+    }, tearDown: close, block: open)
+  }
+
+  func testScrollChat() throws {
+
+    let dbManager = try corpus.openWorkingCopy()
+    defer { dbManager.shutdown() }
+
+    let chat = try (dbManager["Chat"] as! ChatDAO).fetchAllChatsMatching(nil).first!
+
+    let request = FetchRequest()
+    request.resultClass = Message.self
+    request.includeSubentities = true
+    request.predicate = NSPredicate(format: "chat = %@", chat)
+    request.sortDescriptors = [NSSortDescriptor(key: "sent", ascending: false)]
+    request.fetchBatchSize = 50
+
+    var count = 0
+
+    // Pages through the whole chat, newest first, as the chat view does
+    measureScenario("scrollChat", work: Double(corpus.configuration.messagesPerChat), workUnit: "messages") {
+
+      let controller = FetchedResultsController(DBManager: dbManager, request: request)
+      try controller.execute()
+
+      count = controller.numberOfObjects()
+
+      for idx in 0..<count {
+        let message = controller.objectAtIndex(idx) as! Message
+        message.summaryText()
+      }
+    }
+
+    XCTAssertEqual(count, corpus.configuration.messagesPerChat)
+  }
+
+  func testLoadAll() throws {
+
+    var dbManager : DBManager!
+
+    let messageCount = corpus.configuration.chats * corpus.configuration.messagesPerChat
+
+    // Every message (and its chat) from cold caches, as a search or export does
+    measureScenario("loadAll", work: Double(messageCount), workUnit: "messages", setUp: {
+      dbManager = try self.corpus.openWorkingCopy()
+    }, tearDown: {
+      dbManager.shutdown()
+    }) {
+      try (dbManager["Message"] as! MessageDAO).fetchAllMessagesMatching(nil)
+    }
+
+    // Blocks still allocated while the results are held; transient
+    // allocations need Instruments
+    dbManager = try corpus.openWorkingCopy()
+    defer { dbManager.shutdown() }
+
+    let before = mallocBlocksInUse()
+    let messages = try (dbManager["Message"] as! MessageDAO).fetchAllMessagesMatching(nil)
+    let after = mallocBlocksInUse()
+
+    XCTAssertEqual(messages.count, messageCount)
+
+    BenchmarkResults.shared.addMetric("blocksPerMessage", value: Double(after - before) / Double(messages.count), toResultNamed: "loadAll")
+  }
+
+  func testReceiveBurst() throws {
+
+    let burstSize = 500
+
+    var dbManager : DBManager!
+    var chats = [Chat]()
+    var random = BenchmarkRandom(seed: corpus.configuration.seed)
+
+    // Inserts & updates each message's chat as MessageProcessOperation does
+    measureScenario("receiveBurst", work: Double(burstSize), workUnit: "messages", setUp: {
+      dbManager = try self.corpus.openWorkingCopy()
+      chats = Array(try (dbManager["Chat"] as! ChatDAO).fetchAllChatsMatching(nil).prefix(10))
+    }, tearDown: {
+      dbManager.shutdown()
+    }) {
+
+      let chatDAO = dbManager["Chat"] as! ChatDAO
+      let messageDAO = dbManager["Message"] as! MessageDAO
+
+      for _ in 0..<burstSize {
+
+        let chat = random.element(chats)
+
+        let message = TextMessage(id: random.id(), chat: chat, text: BenchmarkDataSets.shared.text(&random))
+        message.sender = random.element(Array(chat.activeRecipients))
+        message.sent = NSDate()
+        message.status = .Delivered
+        message.statusTimestamp = NSDate()
+        message.unreadFlag = true
+
+        try messageDAO.upsertMessage(message)
+        try chatDAO.updateChat(chat, withLastReceivedMessage: message)
+      }
+    }
+  }
+
+  func testBulkMarkAsRead() throws {
+
+    var dbManager : DBManager!
+    var chats = [Chat]()
+
+    // Mirrors MessageAPI's per chat read, followed by the badge count update
+    measureScenario("bulkMarkAsRead", work: Double(corpus.configuration.chats), workUnit: "chats", setUp: {
+      dbManager = try self.corpus.openWorkingCopy()
+      chats = try (dbManager["Chat"] as! ChatDAO).fetchAllChatsMatching(nil)
+    }, tearDown: {
+      XCTAssertEqual((dbManager["Message"] as! MessageDAO).countOfUnreadMessages(), 0)
+      dbManager.shutdown()
+    }) {
+
+      let chatDAO = dbManager["Chat"] as! ChatDAO
+      let messageDAO = dbManager["Message"] as! MessageDAO
+
+      for chat in chats {
+        chatDAO.resetUnreadCountsForChat(chat)
+        try messageDAO.readAllMessagesForChat(chat)
+        messageDAO.countOfUnreadMessages()
+      }
+    }
+  }
+
+  func testSearch() {
+
+    let contacts = corpus.contacts()
+
+    var index = AddressBookSearchIndex()
+
+    measureScenario("search.index", work: Double(contacts.count), workUnit: "contacts") {
+      index = AddressBookSearchIndex()
+      for (idx, contact) in contacts.enumerate() {
+        index.addRecord(ABRecordID(idx), names: [contact.first, contact.last], aliases: [contact.alias])
+      }
+    }
+
+    // Name prefixes, full names & partial phone numbers, as typed
+    var random = BenchmarkRandom(seed: corpus.configuration.seed)
+    let queries : [String] = (0..<300).map { idx in
+      let contact = random.element(contacts)
+      switch idx % 3 {
+      case 0: return String(contact.first.characters.prefix(3))
+      case 1: return contact.first + " " + contact.last
+      default: return String(contact.alias.characters.suffix(4))
+      }
+    }
+
+    measureScenario("search.query", work: Double(queries.count), workUnit: "queries") {
+      for query in queries {
+        index.recordsMatchingQuery(query)
+      }
+    }
+  }
+
+  func testLargeGroupSend() throws {
+
+    let groupSize = NSProcessInfo.processInfo().environment["MK_BENCH_LARGE_GROUP"].flatMap { Int($0) } ?? 100
+
+    // Key generation is slow; RSA costs are the same for any key of a size
+    let keyPairs = try (0..<4).map { _ in try OpenSSLKeyPair.generateKeyPairWithKeySize(2048) }
+
+    let signer = MsgSigner.defaultSignerWithKeyPair(keyPairs[0])
+    let cipher = MsgCipher.defaultCipher()
+
+    let chatId = Id.generate()
+    let recipients = corpus.contacts().prefix(groupSize).map { $0.alias }
+    var random = BenchmarkRandom(seed: corpus.configuration.seed)
+    let payload = BenchmarkDataSets.shared.text(&random).dataUsingEncoding(NSUTF8StringEncoding)!
+
+    // Local work of MessageEncryptOperation & MessageBuildOperation for one send
+    measureScenario("largeGroupSend", work: Double(groupSize), workUnit: "recipients") {
+
+      let msgId = Id.generate()
+
+      let key = try cipher.randomKey()
+      try cipher.encryptData(payload, withKey: key)
+
+      for (idx, recipient) in recipients.enumerate() {
+        let encryptedKey = try keyPairs[idx % keyPairs.count].publicKey.encryptData(key)
+        try signer.signWithId(msgId, type: .Text, sender: BenchmarkCorpus.localAlias, recipient: recipient, chatId: chatId, msgKey: encryptedKey)
+      }
+    }
+  }
+
+  func testCryptoThroughput() throws {
+
+    let cipher = MsgCipher.defaultCipher()
+    let key = try cipher.randomKey()
+
+    var random = BenchmarkRandom(seed: corpus.configuration.seed)
+    let data = random.data(8 * 1024 * 1024)
+
+    var encrypted = NSData()
+
+    measureScenario("crypto.encrypt", work: Double(data.length), workUnit: "bytes") {
+      encrypted = try cipher.encryptData(data, withKey: key)
+    }
+
+    measureScenario("crypto.decrypt", work: Double(data.length), workUnit: "bytes") {
+      try cipher.decryptData(encrypted, withKey: key)
+    }
+  }
+
+}
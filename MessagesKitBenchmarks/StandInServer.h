@@ -0,0 +1,81 @@
+//
+//  StandInServer.h
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+@import Foundation;
+
+#import "OpenSSLCertificateValidator.h"
+
+
+NS_ASSUME_NONNULL_BEGIN
+
+
+/*
+ * StandInServer
+ *
+ * Loopback server standing in for the reTXT service when load testing.
+ * Implements PublicAPI (HTTP), UserAPI (HTTP & multiplexed over the
+ * WebSocket) and DeviceService pushes over the user connect WebSocket,
+ * using the same protocols & transports as the real service.
+ *
+ * Registered users are issued certificates from the server's own CA
+ * (see certificateTrust). Thousands of simulated peers, sharing a small
+ * pool of identities, accept messages sent to them (acknowledging
+ * delivery) and can generate encrypted & signed messages to a user.
+ *
+ * Requests & pushes are delayed by a configurable latency and calls can
+ * be failed at random to exercise retries.
+ */
+@interface StandInServer : NSObject
+
+@property (readonly, nonatomic) UInt16 port;
+
+// Validates the certificates issued to users & peers
+@property (readonly, nonatomic) OpenSSLCertificateTrust *certificateTrust;
+
+@property (readonly, nonatomic) NSArray<NSString *> *peerAliases;
+
+// Added to every request & push, plus up to `latencyJitter` at random
+@property (assign, nonatomic) NSTimeInterval latency;
+@property (assign, nonatomic) NSTimeInterval latencyJitter;
+
+// Fraction of calls failed with an internal error; only calls of
+// `failureMethods` (e.g. "send", "fetch") when set
+@property (assign, nonatomic) double failureRate;
+@property (copy, nonatomic, nullable) NSSet<NSString *> *failureMethods;
+
+// Fraction of generated messages announced with msgReady (and fetched
+// by the receiver) rather than pushed with msgDelivery
+@property (assign, nonatomic) double fetchRatio;
+
+@property (readonly, nonatomic) NSUInteger requestCount;
+@property (readonly, nonatomic) NSUInteger failureCount;
+@property (readonly, nonatomic) NSUInteger sentCount;
+@property (readonly, nonatomic) NSUInteger ackCount;
+
+-(instancetype) initWithPeerCount:(NSUInteger)peerCount NS_DESIGNATED_INITIALIZER;
+-(instancetype) init NS_UNAVAILABLE;
+
+-(BOOL) startAndReturnError:(NSError **)error;
+-(void) stop;
+
+// Generates text messages from random peers to a registered user's alias
+-(BOOL) deliverMessages:(NSUInteger)count toAlias:(NSString *)alias error:(NSError **)error;
+
+// Seconds between generating each message & its receiver acknowledging it;
+// returns the latencies recorded since the last call
+-(NSArray<NSNumber *> *) takeAckLatencies;
+
+// Closes all WebSocket connections abruptly, as a network change would
+-(void) dropWebSocketConnections;
+
+-(void) resetStatistics;
+
+@end
+
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,1601 @@
+//
+//  StandInServer.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "StandInServer.h"
+
+#import "Messages.h"
+#import "Messages+Exts.h"
+#import "TBase+Utils.h"
+#import "OpenSSL.h"
+#import "OpenSSLKeyPair.h"
+#import "OpenSSLCertificate.h"
+#import "X509Utils.h"
+#import "MsgCipher.h"
+#import "MsgSigner.h"
+#import "NSData+Random.h"
+#import "NSData+CommonDigest.h"
+
+@import Thrift;
+
+#import <openssl/pem.h>
+#import <openssl/x509v3.h>
+#import <openssl/err.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+
+static NSString *const WebSocketGUID = @"258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static NSString *const PublicPath = @"/api/public";
+static NSString *const UserPath = @"/api/user";
+static NSString *const UserConnectPath = @"/api/user/connect";
+
+// RSA key generation is slow; peers share this many identities
+static const NSUInteger PeerIdentityCount = 4;
+
+typedef NS_ENUM(UInt8, Opcode) {
+  OpcodeContinuation  = 0x0,
+  OpcodeBinary        = 0x2,
+  OpcodeClose         = 0x8,
+  OpcodePing          = 0x9,
+  OpcodePong          = 0xA,
+};
+
+
+static TimeStamp StandInNow()
+{
+  return (TimeStamp)(NSDate.date.timeIntervalSince1970 * 1000.0);
+}
+
+static BOOL StandInChance(double probability)
+{
+  return probability > 0 && arc4random_uniform(1000000) < probability * 1000000;
+}
+
+// Frame of a DeviceService push; replies are never read, an empty input fails them immediately
+static NSData *DeviceServiceFrame(id<TProtocolFactory> protocolFactory, void (^build)(DeviceServiceClient *client))
+{
+  TMemoryBuffer *frame = [TMemoryBuffer new];
+
+  DeviceServiceClient *client = [DeviceServiceClient.alloc initWithInProtocol:[protocolFactory newProtocolOnTransport:[TMemoryBuffer new]]
+                                                                  outProtocol:[protocolFactory newProtocolOnTransport:frame]];
+  build(client);
+
+  return frame.buffer;
+}
+
+
+@class StandInUserService;
+
+
+@interface StandInIdentity : NSObject
+
+@property (strong, nonatomic) OpenSSLKeyPair *keyPair;
+@property (strong, nonatomic) NSData *certificate;
+@property (strong, nonatomic) MsgSigner *signer;
+
+@end
+
+
+@interface StandInAccount : NSObject
+
+@property (strong, nonatomic) Id *userId;
+@property (copy, nonatomic) NSString *password;
+@property (strong, nonatomic) NSMutableSet<NSString *> *aliases;
+@property (strong, nonatomic) NSData *encryptionCert;
+@property (strong, nonatomic) NSData *signingCert;
+@property (strong, nonatomic) NSMutableArray<DeviceInfo *> *devices;
+// By device id
+@property (strong, nonatomic) NSMutableDictionary<NSString *, NSData *> *refreshTokens;
+// Delivered but not yet acknowledged, by message id
+@property (strong, nonatomic) NSMutableDictionary<NSString *, Msg *> *waitingMsgs;
+
+-(UserInfo *) userInfo;
+-(UserProfile *) userProfile;
+
+-(nullable DeviceInfo *) deviceWithId:(Id *)deviceId;
+
+@end
+
+
+@interface StandInConnection : NSObject
+
+@property (strong, nonatomic) id<TProtocolFactory> protocolFactory;
+@property (strong, nonatomic) StandInUserService *service;
+
+-(instancetype) initWithSocket:(int)socket;
+
+-(nullable NSString *) readHead;
+-(nullable NSData *) readLength:(NSUInteger)length;
+
+-(BOOL) sendData:(NSData *)data;
+-(BOOL) sendStatus:(int)status headers:(NSDictionary<NSString *, NSString *> *)headers body:(NSData *)body;
+-(BOOL) sendFrame:(NSData *)payload opcode:(Opcode)opcode;
+
+-(void) close;
+
+@end
+
+
+@interface StandInServer () <PublicAPI> {
+  int _listenSocket;
+  dispatch_queue_t _acceptQueue;
+  dispatch_queue_t _workQueue;
+  long _serial;
+  OpenSSLKeyPair *_authorityKeyPair;
+  NSArray<StandInIdentity *> *_identities;
+  NSArray<Id *> *_peerIds;
+  NSDictionary<NSString *, NSNumber *> *_peerIndexesByAlias;
+  NSDictionary<NSString *, NSNumber *> *_peerIndexesById;
+  NSMutableDictionary<NSString *, StandInAccount *> *_accountsById;
+  NSMutableDictionary<NSString *, StandInAccount *> *_accountsByAlias;
+  NSMutableDictionary<NSString *, StandInUserService *> *_servicesByToken;
+  NSMutableArray<StandInConnection *> *_connections;
+  NSMutableDictionary<NSString *, NSNumber *> *_generatedTimes;
+  NSMutableArray<NSNumber *> *_ackLatencies;
+}
+
+-(nullable StandInAccount *) accountWithAlias:(NSString *)alias;
+-(BOOL) isPeerAlias:(NSString *)alias;
+-(void) registerAlias:(NSString *)alias forAccount:(nullable StandInAccount *)account;
+
+-(nullable NSData *) issueCertificateForRequest:(NSData *)requestData error:(NSError **)error;
+
+-(void) deliverMsg:(Msg *)msg toAccount:(StandInAccount *)account viaFetch:(BOOL)viaFetch;
+-(void) pushToAccount:(StandInAccount *)account excludingDevice:(nullable Id *)deviceId build:(void (^)(DeviceServiceClient *client))build;
+
+-(void) recordSend;
+-(void) recordAckOfMsgId:(Id *)msgId;
+
+@end
+
+
+/*
+ * UserAPI of one signed in device (one per access token)
+ */
+@interface StandInUserService : NSObject <UserAPI>
+
+@property (weak, nonatomic) StandInServer *server;
+@property (strong, nonatomic) StandInAccount *account;
+@property (strong, nonatomic) Id *deviceId;
+
+@end
+
+
+
+@implementation StandInServer
+
+-(instancetype) initWithPeerCount:(NSUInteger)peerCount
+{
+  self = [super init];
+  if (self) {
+
+    _listenSocket = -1;
+    _acceptQueue = dispatch_queue_create("StandInServer Accept Queue", DISPATCH_QUEUE_SERIAL);
+    _workQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+
+    _accountsById = [NSMutableDictionary dictionary];
+    _accountsByAlias = [NSMutableDictionary dictionary];
+    _servicesByToken = [NSMutableDictionary dictionary];
+    _connections = [NSMutableArray array];
+    _generatedTimes = [NSMutableDictionary dictionary];
+    _ackLatencies = [NSMutableArray array];
+
+    NSMutableArray<NSString *> *peerAliases = [NSMutableArray arrayWithCapacity:peerCount];
+    NSMutableArray<Id *> *peerIds = [NSMutableArray arrayWithCapacity:peerCount];
+    NSMutableDictionary<NSString *, NSNumber *> *peerIndexesByAlias = [NSMutableDictionary dictionaryWithCapacity:peerCount];
+    NSMutableDictionary<NSString *, NSNumber *> *peerIndexesById = [NSMutableDictionary dictionaryWithCapacity:peerCount];
+
+    for (NSUInteger idx = 0; idx < peerCount; ++idx) {
+      NSString *alias = [NSString stringWithFormat:@"+1666%07lu", (unsigned long)idx + 1];
+      Id *peerId = [Id generate];
+      [peerAliases addObject:alias];
+      [peerIds addObject:peerId];
+      peerIndexesByAlias[alias] = @(idx);
+      peerIndexesById[peerId.UUIDString] = @(idx);
+    }
+
+    _peerAliases = peerAliases;
+    _peerIds = peerIds;
+    _peerIndexesByAlias = peerIndexesByAlias;
+    _peerIndexesById = peerIndexesById;
+  }
+  return self;
+}
+
+-(void) dealloc
+{
+  [self stop];
+}
+
+-(BOOL) startAndReturnError:(NSError **)error
+{
+  if (!_certificateTrust && ![self generateIdentitiesReturningError:error]) {
+    return NO;
+  }
+
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock < 0) {
+    error && (*error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]);
+    return NO;
+  }
+
+  int on = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  struct sockaddr_in addr = {0};
+  addr.sin_len = sizeof(addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+
+  socklen_t addrLen = sizeof(addr);
+
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(sock, 64) != 0 ||
+      getsockname(sock, (struct sockaddr *)&addr, &addrLen) != 0)
+  {
+    error && (*error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]);
+    close(sock);
+    return NO;
+  }
+
+  _listenSocket = sock;
+  _port = ntohs(addr.sin_port);
+
+  dispatch_async(_acceptQueue, ^{
+
+    while (YES) {
+
+      int conn = accept(sock, NULL, NULL);
+      if (conn < 0) {
+        break;
+      }
+
+      int noSigPipe = 1;
+      setsockopt(conn, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+
+      int noDelay = 1;
+      setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+      // Connections block reading, each is handled on its own thread
+      dispatch_async(self->_workQueue, ^{
+        [self handleConnection:[StandInConnection.alloc initWithSocket:conn]];
+      });
+    }
+
+  });
+
+  return YES;
+}
+
+-(void) stop
+{
+  if (_listenSocket >= 0) {
+    shutdown(_listenSocket, SHUT_RDWR);
+    close(_listenSocket);
+    _listenSocket = -1;
+  }
+
+  [self dropWebSocketConnections];
+}
+
+-(void) dropWebSocketConnections
+{
+  NSArray<StandInConnection *> *connections;
+  @synchronized(self) {
+    connections = [_connections copy];
+  }
+
+  for (StandInConnection *connection in connections) {
+    [connection close];
+  }
+}
+
+#pragma mark - Statistics
+
+-(void) recordRequestFailed:(BOOL)failed
+{
+  @synchronized(self) {
+    _requestCount += 1;
+    _failureCount += failed ? 1 : 0;
+  }
+}
+
+-(void) recordSend
+{
+  @synchronized(self) {
+    _sentCount += 1;
+  }
+}
+
+-(void) recordAckOfMsgId:(Id *)msgId
+{
+  NSTimeInterval now = NSProcessInfo.processInfo.systemUptime;
+
+  @synchronized(self) {
+
+    _ackCount += 1;
+
+    NSNumber *generated = _generatedTimes[msgId.UUIDString];
+    if (generated) {
+      [_generatedTimes removeObjectForKey:msgId.UUIDString];
+      [_ackLatencies addObject:@(now - generated.doubleValue)];
+    }
+  }
+}
+
+-(NSArray<NSNumber *> *) takeAckLatencies
+{
+  @synchronized(self) {
+    NSArray<NSNumber *> *latencies = [_ackLatencies copy];
+    [_ackLatencies removeAllObjects];
+    return latencies;
+  }
+}
+
+-(void) resetStatistics
+{
+  @synchronized(self) {
+    _requestCount = 0;
+    _failureCount = 0;
+    _sentCount = 0;
+    _ackCount = 0;
+    [_generatedTimes removeAllObjects];
+    [_ackLatencies removeAllObjects];
+  }
+}
+
+-(NSTimeInterval) nextDelay
+{
+  return _latency + _latencyJitter * ((double)arc4random() / UINT32_MAX);
+}
+
+#pragma mark - Certificates
+
+-(BOOL) generateIdentitiesReturningError:(NSError **)error
+{
+  _authorityKeyPair = [OpenSSLKeyPair generateKeyPairWithKeySize:2048 error:error];
+  if (!_authorityKeyPair) {
+    return NO;
+  }
+
+  // Issued certificates always name "reTXT" as their issuer (see X509Utils)
+  X509_NAME *authorityName = [X509Utils nameWithDictionary:@{@"CN": @"reTXT"}];
+  OpenSSLCertificate *authorityCert = [self issueCertificateNamed:authorityName
+                                                        publicKey:_authorityKeyPair.publicKey.pointer
+                                                       extensions:NULL
+                                                        authority:YES
+                                                            error:error];
+  X509_NAME_free(authorityName);
+
+  if (!authorityCert) {
+    return NO;
+  }
+
+  BIO *bio = BIO_new(BIO_s_mem());
+  PEM_write_bio_X509(bio, authorityCert.pointer);
+  char *pemBytes;
+  long pemLength = BIO_get_mem_data(bio, &pemBytes);
+  NSData *pem = [NSData dataWithBytes:pemBytes length:pemLength];
+  BIO_free(bio);
+
+  _certificateTrust = [OpenSSLCertificateTrust.alloc initWithPEMEncodedRoots:pem intermediates:pem error:error];
+  if (!_certificateTrust) {
+    return NO;
+  }
+
+  NSMutableArray<StandInIdentity *> *identities = [NSMutableArray array];
+
+  for (NSUInteger idx = 0; idx < PeerIdentityCount; ++idx) {
+
+    StandInIdentity *identity = [StandInIdentity new];
+
+    identity.keyPair = [OpenSSLKeyPair generateKeyPairWithKeySize:2048 error:error];
+    if (!identity.keyPair) {
+      return NO;
+    }
+
+    // One certificate serves for both encryption & signing
+    X509_NAME *name = [X509Utils nameWithDictionary:@{@"CN": [NSString stringWithFormat:@"Stand-In Peer %lu", (unsigned long)idx]}];
+    OpenSSLCertificate *cert = [self issueCertificateNamed:name
+                                                 publicKey:identity.keyPair.publicKey.pointer
+                                                extensions:NULL
+                                                 authority:NO
+                                                     error:error];
+    X509_NAME_free(name);
+
+    if (!cert) {
+      return NO;
+    }
+
+    identity.certificate = cert.encoded;
+    identity.signer = [MsgSigner defaultSignerWithKeyPair:identity.keyPair];
+
+    [identities addObject:identity];
+  }
+
+  _identities = identities;
+
+  return YES;
+}
+
+-(nullable OpenSSLCertificate *) issueCertificateNamed:(X509_NAME *)subject
+                                             publicKey:(EVP_PKEY *)publicKey
+                                            extensions:(nullable STACK_OF(X509_EXTENSION) *)extensions
+                                             authority:(BOOL)authority
+                                                 error:(NSError **)error
+{
+  X509 *cert = X509_new();
+  if (!cert) {
+    MK_RETURN_OPENSSL_ERROR(CertBuildFailed, nil);
+  }
+
+  long serial;
+  @synchronized(self) {
+    serial = ++_serial;
+  }
+
+  X509_NAME *issuer = [X509Utils nameWithDictionary:@{@"CN": @"reTXT"}];
+
+  BOOL built =
+    X509_set_version(cert, 2) &&
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), serial) &&
+    X509_gmtime_adj(X509_get_notBefore(cert), -24 * 60 * 60) &&
+    X509_gmtime_adj(X509_get_notAfter(cert), 10 * 365 * 24 * 60 * 60L) &&
+    X509_set_issuer_name(cert, issuer) &&
+    X509_set_subject_name(cert, subject) &&
+    X509_set_pubkey(cert, publicKey);
+
+  X509_NAME_free(issuer);
+
+  // Requested extensions (e.g. key usage) are granted as is
+  for (int idx = 0; built && idx < sk_X509_EXTENSION_num(extensions); ++idx) {
+    built = X509_add_ext(cert, sk_X509_EXTENSION_value(extensions, idx), -1);
+  }
+
+  if (built && authority) {
+    built =
+      [X509Utils addExtenstionNamed:SN_basic_constraints withValue:@"critical,CA:TRUE" toCertificate:cert] &&
+      [X509Utils addExtenstionNamed:SN_key_usage withValue:@"critical,keyCertSign,cRLSign" toCertificate:cert];
+  }
+
+  if (!built || X509_sign(cert, _authorityKeyPair.privateKey.pointer, EVP_sha256()) <= 0) {
+    X509_free(cert);
+    MK_RETURN_OPENSSL_ERROR(CertBuildFailed, nil);
+  }
+
+  OpenSSLCertificate *certificate = [OpenSSLCertificate.alloc initWithCertPointer:cert];
+
+  X509_free(cert);
+
+  return certificate;
+}
+
+-(nullable NSData *) issueCertificateForRequest:(NSData *)requestData error:(NSError **)error
+{
+  const unsigned char *requestBytes = requestData.bytes;
+  X509_REQ *request = d2i_X509_REQ(NULL, &requestBytes, requestData.length);
+  if (!request) {
+    MK_RETURN_OPENSSL_ERROR(CertificateInvalid, nil);
+  }
+
+  EVP_PKEY *publicKey = X509_REQ_get_pubkey(request);
+  if (!publicKey) {
+    X509_REQ_free(request);
+    MK_RETURN_OPENSSL_ERROR(PublicKeyInvalid, nil);
+  }
+
+  STACK_OF(X509_EXTENSION) *extensions = X509_REQ_get_extensions(request);
+
+  OpenSSLCertificate *cert = [self issueCertificateNamed:X509_REQ_get_subject_name(request)
+                                               publicKey:publicKey
+                                              extensions:extensions
+                                               authority:NO
+                                                   error:error];
+
+  sk_X509_EXTENSION_pop_free(extensions, X509_EXTENSION_free);
+  EVP_PKEY_free(publicKey);
+  X509_REQ_free(request);
+
+  return cert.encoded;
+}
+
+#pragma mark - Connections
+
+-(void) handleConnection:(StandInConnection *)connection
+{
+  // Persistent; requests are read until the client closes
+
+  while (YES) {
+
+    NSString *head = [connection readHead];
+    if (!head) {
+      break;
+    }
+
+    NSArray<NSString *> *lines = [head componentsSeparatedByString:@"\r\n"];
+    NSArray<NSString *> *requestLine = [lines.firstObject componentsSeparatedByString:@" "];
+    if (requestLine.count < 2) {
+      break;
+    }
+
+    NSString *method = requestLine[0];
+    NSString *path = [requestLine[1] componentsSeparatedByString:@"?"].firstObject;
+
+    NSMutableDictionary<NSString *, NSString *> *headers = [NSMutableDictionary dictionary];
+    for (NSString *line in [lines subarrayWithRange:NSMakeRange(1, lines.count - 1)]) {
+      NSRange colon = [line rangeOfString:@":"];
+      if (colon.location != NSNotFound) {
+        NSString *name = [line substringToIndex:colon.location].lowercaseString;
+        NSString *value = [[line substringFromIndex:colon.location + 1] stringByTrimmingCharactersInSet:NSCharacterSet.whitespaceCharacterSet];
+        headers[name] = value;
+      }
+    }
+
+    if ([headers[@"upgrade"] caseInsensitiveCompare:@"websocket"] == NSOrderedSame) {
+      if ([path isEqualToString:UserConnectPath]) {
+        [self handleWebSocketWithHeaders:headers connection:connection];
+      }
+      else {
+        [connection sendStatus:404 headers:@{} body:[NSData data]];
+      }
+      break;
+    }
+
+    NSData *body = [connection readLength:(NSUInteger)[headers[@"content-length"] longLongValue]];
+    if (!body) {
+      break;
+    }
+
+    NSTimeInterval delay = [self nextDelay];
+    if (delay > 0) {
+      [NSThread sleepForTimeInterval:delay];
+    }
+
+    if (![self handleRequestWithMethod:method path:path headers:headers body:body connection:connection]) {
+      break;
+    }
+  }
+
+  [connection close];
+}
+
+-(BOOL) handleRequestWithMethod:(NSString *)method path:(NSString *)path headers:(NSDictionary<NSString *, NSString *> *)headers
+                           body:(NSData *)body connection:(StandInConnection *)connection
+{
+  if (![method isEqualToString:@"POST"]) {
+    return [connection sendStatus:405 headers:@{} body:[NSData data]];
+  }
+
+  // Thrift content types name their protocol (e.g. "application/x-thrift; p=compact")
+  NSString *contentType = headers[@"content-type"] ?: @"application/x-thrift";
+  NSString *protocolName = ThriftBinaryProtocolName;
+  NSRange protocolParam = [contentType rangeOfString:@"p="];
+  if (protocolParam.location != NSNotFound) {
+    protocolName = [contentType substringFromIndex:NSMaxRange(protocolParam)];
+  }
+
+  id<TProtocolFactory> protocolFactory = [TBaseUtils protocolFactoryNamed:protocolName];
+  if (!protocolFactory) {
+    return [connection sendStatus:415 headers:@{} body:[NSData data]];
+  }
+
+  NSData *reply;
+
+  if ([path isEqualToString:PublicPath]) {
+
+    reply = [self processRequest:body
+                         service:@"PublicAPI"
+                       processor:[PublicAPIProcessor.alloc initWithPublicAPI:self]
+                 protocolFactory:protocolFactory];
+  }
+  else if ([path isEqualToString:UserPath]) {
+
+    StandInUserService *service = [self serviceForAuthorization:headers[@"authorization"]];
+    if (!service) {
+      return [connection sendStatus:401 headers:@{} body:[NSData data]];
+    }
+
+    reply = [self processRequest:body
+                         service:@"UserAPI"
+                       processor:[UserAPIProcessor.alloc initWithUserAPI:service]
+                 protocolFactory:protocolFactory];
+  }
+  else {
+
+    return [connection sendStatus:404 headers:@{} body:[NSData data]];
+  }
+
+  if (!reply) {
+    return [connection sendStatus:400 headers:@{} body:[NSData data]];
+  }
+
+  return [connection sendStatus:200 headers:@{@"Content-Type": contentType} body:reply];
+}
+
+-(nullable StandInUserService *) serviceForAuthorization:(nullable NSString *)authorization
+{
+  if (![authorization hasPrefix:@"Bearer "]) {
+    return nil;
+  }
+
+  NSString *token = [authorization substringFromIndex:7];
+
+  @synchronized(self) {
+    return _servicesByToken[token];
+  }
+}
+
+-(void) handleWebSocketWithHeaders:(NSDictionary<NSString *, NSString *> *)headers connection:(StandInConnection *)connection
+{
+  StandInUserService *service = [self serviceForAuthorization:headers[@"authorization"]];
+  if (!service) {
+    [connection sendStatus:401 headers:@{} body:[NSData data]];
+    return;
+  }
+
+  // First offered protocol the server speaks; without one clients assume binary
+  NSString *protocolName;
+  for (NSString *offered in [headers[@"sec-websocket-protocol"] componentsSeparatedByString:@","]) {
+    NSString *name = [offered stringByTrimmingCharactersInSet:NSCharacterSet.whitespaceCharacterSet];
+    if ([TBaseUtils protocolFactoryNamed:name]) {
+      protocolName = name;
+      break;
+    }
+  }
+
+  NSData *acceptDigest = [[headers[@"sec-websocket-key"] stringByAppendingString:WebSocketGUID] dataUsingEncoding:NSASCIIStringEncoding].sha1;
+
+  NSString *protocolHeader = protocolName ? [NSString stringWithFormat:@"Sec-WebSocket-Protocol: %@\r\n", protocolName] : @"";
+
+  NSString *response = [NSString stringWithFormat:@"HTTP/1.1 101 Switching Protocols\r\n"
+                                                   "Upgrade: websocket\r\n"
+                                                   "Connection: Upgrade\r\n"
+                                                   "Sec-WebSocket-Accept: %@\r\n%@\r\n",
+                        [acceptDigest base64EncodedStringWithOptions:0], protocolHeader];
+
+  if (![connection sendData:[response dataUsingEncoding:NSASCIIStringEncoding]]) {
+    return;
+  }
+
+  connection.protocolFactory = [TBaseUtils protocolFactoryNamed:protocolName ?: ThriftBinaryProtocolName];
+  connection.service = service;
+
+  @synchronized(self) {
+    [_connections addObject:connection];
+  }
+
+  [self readFramesFromConnection:connection];
+
+  @synchronized(self) {
+    [_connections removeObject:connection];
+  }
+}
+
+-(void) readFramesFromConnection:(StandInConnection *)connection
+{
+  // Clients always mask, servers never do
+
+  while (YES) {
+
+    NSData *header = [connection readLength:2];
+    if (!header) {
+      return;
+    }
+
+    const UInt8 *headerBytes = header.bytes;
+
+    Opcode opcode = headerBytes[0] & 0x0F;
+    UInt64 length = headerBytes[1] & 0x7F;
+
+    if (length == 126 || length == 127) {
+      NSData *ext = [connection readLength:length == 126 ? 2 : 8];
+      if (!ext) {
+        return;
+      }
+      const UInt8 *extBytes = ext.bytes;
+      length = 0;
+      for (NSUInteger c = 0; c < ext.length; ++c) {
+        length = (length << 8) | extBytes[c];
+      }
+    }
+
+    NSData *mask = [connection readLength:4];
+    NSMutableData *payload = [[connection readLength:(NSUInteger)length] mutableCopy];
+    if (!mask || !payload) {
+      return;
+    }
+
+    const UInt8 *maskBytes = mask.bytes;
+    UInt8 *payloadBytes = payload.mutableBytes;
+    for (NSUInteger c = 0; c < payload.length; ++c) {
+      payloadBytes[c] ^= maskBytes[c % 4];
+    }
+
+    switch (opcode) {
+    case OpcodeBinary:
+
+      // Requests are processed concurrently, replies carry their sequence id
+      dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)([self nextDelay] * NSEC_PER_SEC)), _workQueue, ^{
+
+        NSData *reply = [self processRequest:payload
+                                     service:@"UserAPI"
+                                   processor:[UserAPIProcessor.alloc initWithUserAPI:connection.service]
+                             protocolFactory:connection.protocolFactory];
+        if (reply.length) {
+          [connection sendFrame:reply opcode:OpcodeBinary];
+        }
+      });
+      break;
+
+    case OpcodePing:
+      [connection sendFrame:payload opcode:OpcodePong];
+      break;
+
+    case OpcodeClose:
+      [connection sendFrame:payload opcode:OpcodeClose];
+      return;
+
+    default:
+      break;
+    }
+  }
+}
+
+#pragma mark - Processing
+
+/*
+ * Processes a Thrift request returning the reply (empty for one way calls);
+ * injected failures & errors returned by the service are mapped onto the
+ * method's declared exceptions or an application exception, as a Thrift
+ * server would.
+ */
+-(nullable NSData *) processRequest:(NSData *)request service:(NSString *)service processor:(id<TProcessor>)processor protocolFactory:(id<TProtocolFactory>)protocolFactory
+{
+  NSString *name;
+  SInt32 type, sequenceID;
+
+  id<TProtocol> peekProtocol = [protocolFactory newProtocolOnTransport:[TMemoryBuffer.alloc initWithData:request]];
+  if (![peekProtocol readMessageBeginReturningName:&name type:&type sequenceID:&sequenceID error:NULL]) {
+    return nil;
+  }
+
+  TMemoryBuffer *reply = [TMemoryBuffer new];
+
+  NSError *error;
+
+  BOOL fail = StandInChance(_failureRate) && (!_failureMethods || [_failureMethods containsObject:name]);
+  if (fail) {
+    error = [NSError errorWithType:TApplicationErrorInternalError reason:@"Injected failure"];
+  }
+  else {
+    id<TProtocol> inProtocol = [protocolFactory newProtocolOnTransport:[TMemoryBuffer.alloc initWithData:request]];
+    if ([processor processOnInputProtocol:inProtocol outputProtocol:[protocolFactory newProtocolOnTransport:reply] error:&error]) {
+      [self recordRequestFailed:NO];
+      return reply.buffer;
+    }
+  }
+
+  [self recordRequestFailed:YES];
+
+  if (type == TMessageTypeONEWAY) {
+    return [NSData data];
+  }
+
+  reply = [TMemoryBuffer new];
+  id<TProtocol> outProtocol = [protocolFactory newProtocolOnTransport:reply];
+
+  // Declared exceptions & missing (nil) results are replies
+
+  id<TBase> result = [self resultOfService:service method:name withError:error];
+  if (result) {
+    [outProtocol writeMessageBeginWithName:name type:TMessageTypeREPLY sequenceID:sequenceID error:NULL];
+    [result write:outProtocol error:NULL];
+  }
+  else {
+    NSError *exception = [error.domain isEqualToString:TApplicationErrorDomain] ? error :
+      [NSError errorWithType:TApplicationErrorInternalError reason:error.localizedDescription ?: @"Unknown error"];
+    [outProtocol writeMessageBeginWithName:name type:TMessageTypeEXCEPTION sequenceID:sequenceID error:NULL];
+    [exception write:outProtocol error:NULL];
+  }
+
+  [outProtocol writeMessageEnd:NULL];
+
+  return reply.buffer;
+}
+
+-(nullable id<TBase>) resultOfService:(NSString *)service method:(NSString *)method withError:(nullable NSError *)error
+{
+  Class resultClass = NSClassFromString([NSString stringWithFormat:@"%@_%@_result", service, method]);
+  if (!resultClass) {
+    return nil;
+  }
+
+  id result = [resultClass new];
+
+  if (!error) {
+    return result;
+  }
+
+  if (![error conformsToProtocol:@protocol(TBase)]) {
+    return nil;
+  }
+
+  // Exception fields are named after their type (e.g. InvalidRecipient -> invalidRecipient)
+  NSString *typeName = NSStringFromClass(error.class);
+  if (![result respondsToSelector:NSSelectorFromString([NSString stringWithFormat:@"set%@:", typeName])]) {
+    return nil;
+  }
+
+  NSString *key = [[typeName substringToIndex:1].lowercaseString stringByAppendingString:[typeName substringFromIndex:1]];
+  [result setValue:error forKey:key];
+
+  return result;
+}
+
+#pragma mark - Delivery
+
+-(nullable StandInAccount *) accountWithAlias:(NSString *)alias
+{
+  @synchronized(self) {
+    return _accountsByAlias[alias];
+  }
+}
+
+-(BOOL) isPeerAlias:(NSString *)alias
+{
+  return _peerIndexesByAlias[alias] != nil;
+}
+
+-(void) registerAlias:(NSString *)alias forAccount:(StandInAccount *)account
+{
+  @synchronized(self) {
+    _accountsByAlias[alias] = account;
+  }
+}
+
+-(void) deliverMsg:(Msg *)msg toAccount:(StandInAccount *)account viaFetch:(BOOL)viaFetch
+{
+  // Held until acknowledged; devices not connected fetch them when they are
+
+  @synchronized(self) {
+    account.waitingMsgs[msg.id.UUIDString] = msg;
+  }
+
+  if (viaFetch) {
+
+    MsgHdr *msgHdr = [MsgHdr.alloc initWithId:msg.id type:msg.type dataLength:(SInt32)msg.data.length];
+
+    [self pushToAccount:account excludingDevice:nil build:^(DeviceServiceClient *client) {
+      [client msgReady:msgHdr error:NULL];
+    }];
+  }
+  else {
+
+    [self pushToAccount:account excludingDevice:nil build:^(DeviceServiceClient *client) {
+      [client msgDelivery:msg error:NULL];
+    }];
+  }
+}
+
+-(void) pushToAccount:(StandInAccount *)account excludingDevice:(nullable Id *)deviceId build:(void (^)(DeviceServiceClient *client))build
+{
+  NSMutableArray<StandInConnection *> *connections = [NSMutableArray array];
+
+  @synchronized(self) {
+    for (StandInConnection *connection in _connections) {
+      if (connection.service.account == account && ![connection.service.deviceId isEqual:deviceId]) {
+        [connections addObject:connection];
+      }
+    }
+  }
+
+  if (!connections.count) {
+    return;
+  }
+
+  dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)([self nextDelay] * NSEC_PER_SEC)), _workQueue, ^{
+    for (StandInConnection *connection in connections) {
+      [connection sendFrame:DeviceServiceFrame(connection.protocolFactory, build) opcode:OpcodeBinary];
+    }
+  });
+}
+
+-(BOOL) deliverMessages:(NSUInteger)count toAlias:(NSString *)alias error:(NSError **)error
+{
+  StandInAccount *account = [self accountWithAlias:alias];
+  if (!account) {
+    error && (*error = [InvalidRecipient.alloc initWithOffender:alias]);
+    return NO;
+  }
+
+  OpenSSLCertificate *recipientCert = [OpenSSLCertificate.alloc initWithDEREncodedData:account.encryptionCert error:error];
+  if (!recipientCert) {
+    return NO;
+  }
+
+  MsgCipher *cipher = [MsgCipher defaultCipher];
+
+  for (NSUInteger c = 0; c < count; ++c) {
+
+    NSUInteger peerIdx = arc4random_uniform((UInt32)_peerAliases.count);
+    NSString *sender = _peerAliases[peerIdx];
+    StandInIdentity *identity = _identities[peerIdx % _identities.count];
+
+    Id *msgId = [Id generate];
+
+    NSString *text = [NSString stringWithFormat:@"Message %lu from %@", (unsigned long)c, sender];
+
+    NSData *key = [cipher randomKeyWithError:error];
+    if (!key) {
+      return NO;
+    }
+
+    NSData *data = [cipher encryptData:[text dataUsingEncoding:NSUTF8StringEncoding] withKey:key error:error];
+    if (!data) {
+      return NO;
+    }
+
+    NSData *encryptedKey = [recipientCert.publicKey encryptData:key error:error];
+    if (!encryptedKey) {
+      return NO;
+    }
+
+    NSData *signature = [identity.signer signWithId:msgId type:MsgTypeText sender:sender recipient:alias chatId:nil msgKey:encryptedKey error:error];
+    if (!signature) {
+      return NO;
+    }
+
+    Msg *msg = [Msg.alloc initWithId:msgId
+                                type:MsgTypeText
+                              sender:sender
+                           recipient:alias
+                               group:nil
+                                 key:encryptedKey
+                           signature:signature
+                                data:data
+                            metaData:@{@"type": @"text/plain"}
+                                sent:StandInNow()
+                               flags:0];
+
+    @synchronized(self) {
+      _generatedTimes[msgId.UUIDString] = @(NSProcessInfo.processInfo.systemUptime);
+    }
+
+    [self deliverMsg:msg toAccount:account viaFetch:StandInChance(_fetchRatio)];
+  }
+
+  return YES;
+}
+
+#pragma mark - PublicAPI
+
+-(nullable StandInAccount *) accountWithId:(Id *)userId
+{
+  @synchronized(self) {
+    return _accountsById[userId.UUIDString];
+  }
+}
+
+-(UserInfo *) peerInfoAtIndex:(NSUInteger)idx
+{
+  NSData *certificate = _identities[idx % _identities.count].certificate;
+
+  return [UserInfo.alloc initWithId:_peerIds[idx]
+                            aliases:[NSSet setWithObject:_peerAliases[idx]]
+                     encryptionCert:certificate
+                        signingCert:certificate
+                             avatar:nil];
+}
+
+-(UserInfo *) findUserWithAlias:(Alias)name error:(NSError *__autoreleasing *)__thriftError
+{
+  NSNumber *peerIdx = _peerIndexesByAlias[name];
+  if (peerIdx) {
+    return [self peerInfoAtIndex:peerIdx.unsignedIntegerValue];
+  }
+
+  @synchronized(self) {
+    return [self accountWithAlias:name].userInfo;
+  }
+}
+
+-(UserInfo *) findUserWithId:(Id *)userId error:(NSError *__autoreleasing *)__thriftError
+{
+  NSNumber *peerIdx = _peerIndexesById[userId.UUIDString];
+  if (peerIdx) {
+    return [self peerInfoAtIndex:peerIdx.unsignedIntegerValue];
+  }
+
+  @synchronized(self) {
+    return [self accountWithId:userId].userInfo;
+  }
+}
+
+-(BOOL) requestAliasAuthentication:(Alias)name error:(NSError *__autoreleasing *)__thriftError
+{
+  return YES;
+}
+
+-(NSNumber *) checkAliasAuthentication:(Alias)name pin:(NSString *)pin error:(NSError *__autoreleasing *)__thriftError
+{
+  return @YES;
+}
+
+-(UserProfile *) findProfileWithId:(Id *)userId password:(NSString *)password error:(NSError *__autoreleasing *)__thriftError
+{
+  @synchronized(self) {
+    StandInAccount *account = [self accountWithId:userId];
+    return [account.password isEqualToString:password] ? account.userProfile : nil;
+  }
+}
+
+-(UserProfile *) findProfileWithAlias:(NSString *)userAlias password:(NSString *)password error:(NSError *__autoreleasing *)__thriftError
+{
+  @synchronized(self) {
+    StandInAccount *account = [self accountWithAlias:userAlias];
+    return [account.password isEqualToString:password] ? account.userProfile : nil;
+  }
+}
+
+-(UserProfile *) registerUser:(NSString *)password encryptionCSR:(NSData *)encryptionCSR signingCSR:(NSData *)signingCSR
+         authenticatedAliases:(NSArray<AuthenticatedAlias *> *)authenticatedAliases deviceInfo:(DeviceInfo *)deviceInfo
+                        error:(NSError *__autoreleasing *)__thriftError
+{
+  StandInAccount *account = [StandInAccount new];
+  account.userId = [Id generate];
+  account.password = password;
+  account.aliases = [NSMutableSet setWithArray:[authenticatedAliases valueForKey:@"name"]];
+  account.devices = [NSMutableArray arrayWithObject:deviceInfo];
+  account.refreshTokens = [NSMutableDictionary dictionary];
+  account.waitingMsgs = [NSMutableDictionary dictionary];
+
+  account.encryptionCert = [self issueCertificateForRequest:encryptionCSR error:__thriftError];
+  account.signingCert = [self issueCertificateForRequest:signingCSR error:__thriftError];
+  if (!account.encryptionCert || !account.signingCert) {
+    return nil;
+  }
+
+  @synchronized(self) {
+
+    for (NSString *alias in account.aliases) {
+      if (_accountsByAlias[alias] || [self isPeerAlias:alias]) {
+        __thriftError && (*__thriftError = [AliasInUse.alloc initWithProblemAlias:alias]);
+        return nil;
+      }
+    }
+
+    _accountsById[account.userId.UUIDString] = account;
+    for (NSString *alias in account.aliases) {
+      _accountsByAlias[alias] = account;
+    }
+
+    return account.userProfile;
+  }
+}
+
+-(NSData *) signIn:(Id *)userId password:(NSString *)password deviceId:(Id *)deviceId error:(NSError *__autoreleasing *)__thriftError
+{
+  @synchronized(self) {
+
+    StandInAccount *account = [self accountWithId:userId];
+    if (![account.password isEqualToString:password]) {
+      __thriftError && (*__thriftError = [SignInDisallowed.alloc initWithMessage:@"Invalid user or password"]);
+      return nil;
+    }
+
+    if (![account deviceWithId:deviceId]) {
+      __thriftError && (*__thriftError = [InvalidDevice new]);
+      return nil;
+    }
+
+    NSData *refreshToken = [NSData dataWithRandomBytesOfLength:32];
+    account.refreshTokens[deviceId.UUIDString] = refreshToken;
+
+    return refreshToken;
+  }
+}
+
+-(NSString *) generateAccessToken:(Id *)userId deviceId:(Id *)deviceId refreshToken:(NSData *)refreshToken error:(NSError *__autoreleasing *)__thriftError
+{
+  @synchronized(self) {
+
+    StandInAccount *account = [self accountWithId:userId];
+    if (!account) {
+      __thriftError && (*__thriftError = [InvalidUser new]);
+      return nil;
+    }
+
+    if (![account.refreshTokens[deviceId.UUIDString] isEqualToData:refreshToken]) {
+      __thriftError && (*__thriftError = [InvalidDevice new]);
+      return nil;
+    }
+
+    StandInUserService *service = [StandInUserService new];
+    service.server = self;
+    service.account = account;
+    service.deviceId = deviceId;
+
+    NSString *accessToken = NSUUID.UUID.UUIDString;
+    _servicesByToken[accessToken] = service;
+
+    return accessToken;
+  }
+}
+
+-(BOOL) registerDevice:(Id *)userId password:(NSString *)password deviceInfo:(DeviceInfo *)deviceInfo error:(NSError *__autoreleasing *)__thriftError
+{
+  @synchronized(self) {
+    [[self accountWithId:userId].devices addObject:deviceInfo];
+    return YES;
+  }
+}
+
+-(BOOL) replaceRegisteredDevice:(Id *)userId password:(NSString *)password deviceInfo:(DeviceInfo *)deviceInfo currentDeviceId:(Id *)currentDeviceId
+                          error:(NSError *__autoreleasing *)__thriftError
+{
+  @synchronized(self) {
+    StandInAccount *account = [self accountWithId:userId];
+    [account.devices removeObject:[account deviceWithId:currentDeviceId] ?: deviceInfo];
+    [account.devices addObject:deviceInfo];
+    return YES;
+  }
+}
+
+-(BOOL) unregisterDevice:(Id *)userId password:(NSString *)password deviceId:(Id *)deviceId error:(NSError *__autoreleasing *)__thriftError
+{
+  @synchronized(self) {
+    StandInAccount *account = [self accountWithId:userId];
+    DeviceInfo *device = [account deviceWithId:deviceId];
+    if (device) {
+      [account.devices removeObject:device];
+    }
+    return YES;
+  }
+}
+
+-(NSNumber *) changePassword:(Id *)userId oldPassword:(NSString *)oldPassword newPassword:(NSString *)newPassword error:(NSError *__autoreleasing *)__thriftError
+{
+  @synchronized(self) {
+    StandInAccount *account = [self accountWithId:userId];
+    if (![account.password isEqualToString:oldPassword]) {
+      return @NO;
+    }
+    account.password = newPassword;
+    return @YES;
+  }
+}
+
+-(Id *) requestTemporaryPassword:(Alias)name error:(NSError *__autoreleasing *)__thriftError
+{
+  return [self accountWithAlias:name].userId;
+}
+
+-(NSNumber *) checkTemporaryPassword:(Id *)userId tempPassword:(NSString *)tempPassword error:(NSError *__autoreleasing *)__thriftError
+{
+  return @YES;
+}
+
+-(NSNumber *) resetPassword:(Id *)userId tempPassword:(NSString *)tempPassword password:(NSString *)password error:(NSError *__autoreleasing *)__thriftError
+{
+  @synchronized(self) {
+    [self accountWithId:userId].password = password;
+    return @YES;
+  }
+}
+
+@end
+
+
+
+@implementation StandInUserService
+
+-(BOOL) registerNotifications:(NotificationType)type platform:(NSString *)platform token:(NSData *)token error:(NSError *__autoreleasing *)__thriftError
+{
+  return YES;
+}
+
+-(CertificateSet *) updateCertificates:(NSData *)encryptionCSR signingCSR:(NSData *)signingCSR error:(NSError *__autoreleasing *)__thriftError
+{
+  StandInServer *server = _server;
+
+  NSData *encryptionCert = [server issueCertificateForRequest:encryptionCSR error:__thriftError];
+  NSData *signingCert = [server issueCertificateForRequest:signingCSR error:__thriftError];
+  if (!encryptionCert || !signingCert) {
+    return nil;
+  }
+
+  @synchronized(server) {
+    _account.encryptionCert = encryptionCert;
+    _account.signingCert = signingCert;
+  }
+
+  return [CertificateSet.alloc initWithEncryptionCert:encryptionCert signingCert:signingCert];
+}
+
+-(BOOL) updateAvatar:(Image *)avatar error:(NSError *__autoreleasing *)__thriftError
+{
+  return YES;
+}
+
+-(AliasSet) listAliases:(NSError *__autoreleasing *)__thriftError
+{
+  @synchronized(_server) {
+    return [_account.aliases copy];
+  }
+}
+
+-(BOOL) registerAlias:(AuthenticatedAlias *)authenticatedAlias error:(NSError *__autoreleasing *)__thriftError
+{
+  StandInServer *server = _server;
+
+  @synchronized(server) {
+
+    StandInAccount *owner = [server accountWithAlias:authenticatedAlias.name];
+    if ((owner && owner != _account) || [server isPeerAlias:authenticatedAlias.name]) {
+      __thriftError && (*__thriftError = [AliasInUse.alloc initWithProblemAlias:authenticatedAlias.name]);
+      return NO;
+    }
+
+    [_account.aliases addObject:authenticatedAlias.name];
+    [server registerAlias:authenticatedAlias.name forAccount:_account];
+
+    return YES;
+  }
+}
+
+-(BOOL) unregisterAlias:(Alias)name error:(NSError *__autoreleasing *)__thriftError
+{
+  StandInServer *server = _server;
+
+  @synchronized(server) {
+
+    if ([_account.aliases containsObject:name]) {
+      [_account.aliases removeObject:name];
+      [server registerAlias:name forAccount:nil];
+    }
+
+    return YES;
+  }
+}
+
+-(NSArray<DeviceInfo *> *) listDevices:(NSError *__autoreleasing *)__thriftError
+{
+  @synchronized(_server) {
+    return [_account.devices copy];
+  }
+}
+
+-(BOOL) updateDeviceActiveAliases:(Id *)deviceId activeAliases:(AliasSet)activeAliases error:(NSError *__autoreleasing *)__thriftError
+{
+  @synchronized(_server) {
+    [_account deviceWithId:deviceId].activeAliases = [activeAliases mutableCopy];
+    return YES;
+  }
+}
+
+-(NSArray<MsgHdr *> *) fetchWaiting:(NSError *__autoreleasing *)__thriftError
+{
+  NSMutableArray<MsgHdr *> *msgHdrs = [NSMutableArray array];
+
+  @synchronized(_server) {
+    for (Msg *msg in _account.waitingMsgs.allValues) {
+      [msgHdrs addObject:[MsgHdr.alloc initWithId:msg.id type:msg.type dataLength:(SInt32)msg.data.length]];
+    }
+  }
+
+  return msgHdrs;
+}
+
+-(Msg *) fetch:(Id *)msgId error:(NSError *__autoreleasing *)__thriftError
+{
+  @synchronized(_server) {
+    return _account.waitingMsgs[msgId.UUIDString];
+  }
+}
+
+-(BOOL) ack:(Id *)msgId sent:(TimeStamp)sent error:(NSError *__autoreleasing *)__thriftError
+{
+  StandInServer *server = _server;
+
+  @synchronized(server) {
+    [_account.waitingMsgs removeObjectForKey:msgId.UUIDString];
+  }
+
+  [server recordAckOfMsgId:msgId];
+
+  return YES;
+}
+
+-(NSNumber *) send:(MsgPack *)msgPack error:(NSError *__autoreleasing *)__thriftError
+{
+  StandInServer *server = _server;
+
+  @synchronized(server) {
+
+    if (![_account.aliases containsObject:msgPack.sender]) {
+      __thriftError && (*__thriftError = [InvalidSender.alloc initWithOffender:msgPack.sender]);
+      return nil;
+    }
+
+    for (Envelope *envelope in msgPack.envelopes) {
+      if (![server accountWithAlias:envelope.recipient] && ![server isPeerAlias:envelope.recipient]) {
+        __thriftError && (*__thriftError = [InvalidRecipient.alloc initWithOffender:envelope.recipient]);
+        return nil;
+      }
+    }
+  }
+
+  TimeStamp sent = StandInNow();
+
+  Group *group = msgPack.chat ? [Group.alloc initWithChat:msgPack.chat members:[NSSet setWithArray:[msgPack.envelopes valueForKey:@"recipient"]]] : nil;
+
+  for (Envelope *envelope in msgPack.envelopes) {
+
+    StandInAccount *recipientAccount = [server accountWithAlias:envelope.recipient];
+
+    if (recipientAccount) {
+
+      BOOL cc = recipientAccount == _account;
+
+      Msg *msg = [Msg.alloc initWithId:msgPack.id
+                                  type:msgPack.type
+                                sender:msgPack.sender
+                             recipient:envelope.recipient
+                                 group:group
+                                   key:envelope.key
+                             signature:envelope.signature
+                                  data:msgPack.data
+                              metaData:msgPack.metaData
+                                  sent:sent
+                                 flags:cc ? MsgFlagCC : 0];
+
+      if (cc) {
+        // Copies only go to the sender's other connected devices
+        [server pushToAccount:_account excludingDevice:_deviceId build:^(DeviceServiceClient *client) {
+          [client msgDelivery:msg error:NULL];
+        }];
+      }
+      else {
+        [server deliverMsg:msg toAccount:recipientAccount viaFetch:NO];
+      }
+    }
+    else {
+
+      // Peers acknowledge as soon as they receive
+      [server pushToAccount:_account excludingDevice:nil build:^(DeviceServiceClient *client) {
+        [client msgDelivered:msgPack.id recipient:envelope.recipient error:NULL];
+      }];
+    }
+  }
+
+  [server recordSend];
+
+  return @(sent);
+}
+
+-(BOOL) sendUserStatus:(Alias)sender recipient:(Alias)recipient status:(UserStatus)status error:(NSError *__autoreleasing *)__thriftError
+{
+  return YES;
+}
+
+-(BOOL) sendGroupStatus:(Alias)sender group:(Group *)group status:(UserStatus)status error:(NSError *__autoreleasing *)__thriftError
+{
+  return YES;
+}
+
+-(BOOL) sendDirect:(Id *)msgId msgType:(NSString *)msgType msgData:(NSData *)msgData sender:(NSString *)sender envelopes:(DirectEnvelopeList)envelopes
+             error:(NSError *__autoreleasing *)__thriftError
+{
+  return YES;
+}
+
+-(AliasSet) updateConnections:(NSSet<NSData *> *)newPeers oldPeers:(NSSet<NSData *> *)oldPeers error:(NSError *__autoreleasing *)__thriftError
+{
+  return [NSSet set];
+}
+
+-(BOOL) clearConnections:(NSError *__autoreleasing *)__thriftError
+{
+  return YES;
+}
+
+-(Invite *) generateInvite:(NSString *)inviteeAlias inviteeName:(NSString *)inviteeName params:(NSDictionary<NSString *, NSString *> *)params
+                     error:(NSError *__autoreleasing *)__thriftError
+{
+  __thriftError && (*__thriftError = [NSError errorWithType:TApplicationErrorUnknownMethod reason:@"Invites are not supported"]);
+  return nil;
+}
+
+@end
+
+
+
+@implementation StandInIdentity
+
+@end
+
+
+
+@implementation StandInAccount
+
+-(UserInfo *) userInfo
+{
+  return [UserInfo.alloc initWithId:_userId
+                            aliases:[_aliases copy]
+                     encryptionCert:_encryptionCert
+                        signingCert:_signingCert
+                             avatar:nil];
+}
+
+-(UserProfile *) userProfile
+{
+  return [UserProfile.alloc initWithId:_userId
+                               aliases:[_aliases copy]
+                        encryptionCert:_encryptionCert
+                           signingCert:_signingCert
+                               devices:[_devices copy]
+                                avatar:nil];
+}
+
+-(DeviceInfo *) deviceWithId:(Id *)deviceId
+{
+  for (DeviceInfo *device in _devices) {
+    if ([device.id isEqual:deviceId]) {
+      return device;
+    }
+  }
+  return nil;
+}
+
+@end
+
+
+
+@interface StandInConnection () {
+  int _socket;
+  NSMutableData *_buffer;
+}
+
+@end
+
+
+@implementation StandInConnection
+
+-(instancetype) initWithSocket:(int)socket
+{
+  self = [super init];
+  if (self) {
+    _socket = socket;
+    _buffer = [NSMutableData data];
+  }
+  return self;
+}
+
+-(void) dealloc
+{
+  close(_socket);
+}
+
+-(BOOL) fillBufferToLength:(NSUInteger)length
+{
+  while (_buffer.length < length) {
+
+    UInt8 bytes[4096];
+    ssize_t count = recv(_socket, bytes, sizeof(bytes), 0);
+    if (count <= 0) {
+      return NO;
+    }
+
+    [_buffer appendBytes:bytes length:count];
+  }
+
+  return YES;
+}
+
+-(NSData *) readLength:(NSUInteger)length
+{
+  if (![self fillBufferToLength:length]) {
+    return nil;
+  }
+
+  NSData *data = [_buffer subdataWithRange:NSMakeRange(0, length)];
+  [_buffer replaceBytesInRange:NSMakeRange(0, length) withBytes:NULL length:0];
+
+  return data;
+}
+
+-(NSString *) readHead
+{
+  NSData *separator = [@"\r\n\r\n" dataUsingEncoding:NSASCIIStringEncoding];
+
+  NSRange headEnd;
+  while ((headEnd = [_buffer rangeOfData:separator options:0 range:NSMakeRange(0, _buffer.length)]).location == NSNotFound) {
+    if (![self fillBufferToLength:_buffer.length + 1]) {
+      return nil;
+    }
+  }
+
+  NSData *head = [self readLength:NSMaxRange(headEnd)];
+
+  return [[NSString.alloc initWithData:head encoding:NSASCIIStringEncoding] stringByTrimmingCharactersInSet:NSCharacterSet.newlineCharacterSet];
+}
+
+-(BOOL) sendData:(NSData *)data
+{
+  // Replies & pushes are written from many threads
+  @synchronized(self) {
+
+    const UInt8 *bytes = data.bytes;
+    NSUInteger sent = 0;
+    while (sent < data.length) {
+      ssize_t count = send(_socket, bytes + sent, data.length - sent, 0);
+      if (count <= 0) {
+        return NO;
+      }
+      sent += count;
+    }
+
+    return YES;
+  }
+}
+
+-(BOOL) sendStatus:(int)status headers:(NSDictionary<NSString *, NSString *> *)headers body:(NSData *)body
+{
+  NSMutableString *head = [NSMutableString stringWithFormat:@"HTTP/1.1 %d %@\r\n", status, [NSHTTPURLResponse localizedStringForStatusCode:status]];
+  for (NSString *name in headers) {
+    [head appendFormat:@"%@: %@\r\n", name, headers[name]];
+  }
+  [head appendFormat:@"Content-Length: %lu\r\n\r\n", (unsigned long)body.length];
+
+  NSMutableData *response = [[head dataUsingEncoding:NSASCIIStringEncoding] mutableCopy];
+  [response appendData:body];
+
+  return [self sendData:response];
+}
+
+-(BOOL) sendFrame:(NSData *)payload opcode:(Opcode)opcode
+{
+  NSMutableData *frame = [NSMutableData data];
+
+  UInt8 first = 0x80 | opcode;
+  [frame appendBytes:&first length:1];
+
+  if (payload.length < 126) {
+    UInt8 length = payload.length;
+    [frame appendBytes:&length length:1];
+  }
+  else if (payload.length <= UINT16_MAX) {
+    UInt8 length[3] = {126, payload.length >> 8, payload.length & 0xFF};
+    [frame appendBytes:length length:3];
+  }
+  else {
+    UInt8 length[9] = {127};
+    for (int c = 0; c < 8; ++c) {
+      length[8 - c] = ((UInt64)payload.length >> (c * 8)) & 0xFF;
+    }
+    [frame appendBytes:length length:9];
+  }
+
+  [frame appendData:payload];
+
+  return [self sendData:frame];
+}
+
+-(void) close
+{
+  // Wakes the reading thread, the socket is closed on dealloc
+  shutdown(_socket, SHUT_RDWR);
+}
+
+@end
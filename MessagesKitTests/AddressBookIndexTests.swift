@@ -69,5 +69,14 @@ class AddressBookIndexTests : XCTestCase {
     
   }
   
+  // Without external changes an update only compares modification dates
+  func testIndexUpdatePerformance() {
+    
+    measureBlock {
+      self.index.updateIndex()
+    }
+    
+  }
+  
   
 }
\ No newline at end of file
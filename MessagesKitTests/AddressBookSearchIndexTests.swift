@@ -0,0 +1,160 @@
+//
+//  AddressBookSearchIndexTests.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import XCTest
+import AddressBook
+@testable import MessagesKit
+
+
+class AddressBookSearchIndexTests: XCTestCase {
+
+  struct Record {
+    let systemId : ABRecordID
+    let names : Set<String>
+    let aliases : Set<String>
+  }
+
+  static let firstNames = ["Emma", "Olivia", "Sophia", "Isabella", "Ava", "Mia", "Émilie", "Abigail", "Madison", "Charlotte",
+                           "Noah", "Liam", "Mason", "Jacob", "William", "Ethan", "Michael", "Alexander", "James", "Daniel"]
+  static let lastNames = ["Smith", "Johnson", "Williams", "Brown", "Jones", "Garcia", "Miller", "Davis", "Rodriguez", "Martinez",
+                          "Hernández", "Lopez", "Gonzalez", "Wilson", "Anderson", "Thomas", "Taylor", "Moore", "Jackson", "Martin"]
+  static let organizations = ["", "Acme", "Globex", "Initech", "Umbrella", "Hooli"]
+
+  // Synthetic address book with a deterministic mix of names, phones & emails
+  static func syntheticRecords(count: Int) -> [Record] {
+
+    var seed : UInt32 = 42
+    func next(bound: Int) -> Int {
+      seed = seed &* 1664525 &+ 1013904223
+      return Int((seed >> 8) % UInt32(bound))
+    }
+
+    return (0..<count).map { c in
+      let first = firstNames[next(firstNames.count)]
+      let last = lastNames[next(lastNames.count)]
+      let organization = organizations[next(organizations.count)]
+      let phone = String(format: "+1555%07d", c)
+      let email = "\(first).\(last)\(c)@example.com"
+      return Record(systemId: ABRecordID(c), names: [first, last, organization], aliases: [phone, email])
+    }
+  }
+
+  static func buildIndex(records: [Record]) -> AddressBookSearchIndex {
+    var index = AddressBookSearchIndex()
+    for record in records {
+      index.addRecord(record.systemId, names: record.names, aliases: record.aliases)
+    }
+    return index
+  }
+
+  // Matches the previous full scan, a word at a time
+  static func scan(records: [Record], query: String) -> Set<ABRecordID> {
+    let words = query.componentsSeparatedByCharactersInSet(NSCharacterSet.whitespaceCharacterSet()).filter { !$0.isEmpty }
+    if words.isEmpty {
+      return []
+    }
+    return Set(records.filter { record in
+      let terms = record.names.union(record.aliases)
+      return !words.contains { word in
+        !terms.contains { $0.rangeOfString(word, options: [.CaseInsensitiveSearch, .DiacriticInsensitiveSearch], range: nil, locale: NSLocale.currentLocale()) != nil }
+      }
+    }.map { $0.systemId })
+  }
+
+  func testSearchMatchesScan() {
+
+    let records = AddressBookSearchIndexTests.syntheticRecords(2000)
+    let index = AddressBookSearchIndexTests.buildIndex(records)
+
+    for query in ["e", "EM", "emi", "emilie", "hernandez", "smith", "son", "Liam Mart", "acme", "555000", "example.com", "xyz", "", "  "] {
+      XCTAssertEqual(index.recordsMatchingQuery(query), AddressBookSearchIndexTests.scan(records, query: query), "\"\(query)\"")
+    }
+  }
+
+  func testLookupByAlias() {
+
+    let records = AddressBookSearchIndexTests.syntheticRecords(100)
+    let index = AddressBookSearchIndexTests.buildIndex(records)
+
+    let record = records[42]
+    let email = record.aliases.filter { $0.containsString("@") }.first!
+
+    XCTAssertEqual(index.recordsWithAliases([email]), [record.systemId])
+    XCTAssertEqual(index.recordsWithAliases([" \(email.uppercaseString) "]), [record.systemId])
+    XCTAssertEqual(index.recordsWithAliases(["+15550000042", "+15550000007"]), [42, 7])
+    XCTAssertTrue(index.recordsWithAliases(["nobody@example.com"]).isEmpty)
+  }
+
+  func testReplaceAndRemoveRecord() {
+
+    var index = AddressBookSearchIndex()
+    index.addRecord(1, names: ["Emma", "Smith"], aliases: ["emma@example.com"])
+    index.addRecord(2, names: ["Noah", "Smith"], aliases: ["noah@example.com"])
+
+    let snapshot = index
+
+    index.addRecord(1, names: ["Emma", "Jones"], aliases: ["emma@example.org"])
+
+    XCTAssertEqual(index.count, 2)
+    XCTAssertEqual(index.recordsMatchingQuery("smith"), [2])
+    XCTAssertEqual(index.recordsMatchingQuery("jones"), [1])
+    XCTAssertTrue(index.recordsWithAliases(["emma@example.com"]).isEmpty)
+    XCTAssertEqual(index.recordsWithAliases(["emma@example.org"]), [1])
+
+    index.removeRecord(2)
+
+    XCTAssertEqual(index.count, 1)
+    XCTAssertTrue(index.recordsMatchingQuery("noah").isEmpty)
+    XCTAssertTrue(index.recordsMatchingQuery("smi").isEmpty)
+
+    // Copies taken before the updates are unaffected
+    XCTAssertEqual(snapshot.recordsMatchingQuery("smith"), [1, 2])
+    XCTAssertEqual(snapshot.recordsWithAliases(["emma@example.com"]), [1])
+  }
+
+  // Build & query times for a 20k contact book; the scan is the cost each query had before indexing
+  func testBenchmark20kContacts() {
+
+    let records = AddressBookSearchIndexTests.syntheticRecords(20_000)
+
+    var start = CFAbsoluteTimeGetCurrent()
+    let index = AddressBookSearchIndexTests.buildIndex(records)
+    let buildTime = CFAbsoluteTimeGetCurrent() - start
+
+    let queries = ["e", "em", "emm", "emma", "emma smi", "hernan", "globex", "+15550012", "zzz"]
+
+    start = CFAbsoluteTimeGetCurrent()
+    for query in queries {
+      index.recordsMatchingQuery(query)
+    }
+    let queryTime = (CFAbsoluteTimeGetCurrent() - start) / Double(queries.count)
+
+    start = CFAbsoluteTimeGetCurrent()
+    for query in queries {
+      AddressBookSearchIndexTests.scan(records, query: query)
+    }
+    let scanTime = (CFAbsoluteTimeGetCurrent() - start) / Double(queries.count)
+
+    start = CFAbsoluteTimeGetCurrent()
+    for c in 0..<1000 {
+      index.recordsWithAliases([String(format: "+1555%07d", c * 20)])
+    }
+    let aliasTime = (CFAbsoluteTimeGetCurrent() - start) / 1000
+
+    NSLog("20k contacts: build %.3fs, query %.3fms (scan %.3fms), alias lookup %.3fms",
+          buildTime, queryTime * 1e3, scanTime * 1e3, aliasTime * 1e3)
+
+    measureBlock {
+      for query in queries {
+        index.recordsMatchingQuery(query)
+      }
+    }
+  }
+
+}
+
@@ -337,6 +337,64 @@
   XCTAssertTrue([_updated containsObject:chat.id]);
 }
 
+-(void) testChatMessageCounters
+{
+  UserChat *chat = [self newUserChat];
+  chat.lastMessage = nil;
+
+  XCTAssertTrue([self.chatDAO insertChat:chat error:nil]);
+
+  Message *msg1 = [self newMessage];
+  msg1.chat = chat;
+  msg1.unreadFlag = YES;
+  XCTAssertTrue([self.msgDAO insertMessage:msg1 error:nil]);
+
+  Message *msg2 = [self newMessage];
+  msg2.chat = chat;
+  msg2.unreadFlag = YES;
+  XCTAssertTrue([self.msgDAO insertMessage:msg2 error:nil]);
+
+  Message *msg3 = [self newMessage];
+  msg3.chat = chat;
+  XCTAssertTrue([self.msgDAO insertMessage:msg3 error:nil]);
+
+  XCTAssertEqual([self.chatDAO countOfMessagesForChat:chat], 3);
+  XCTAssertEqual([self.chatDAO countOfUnreadMessagesForChat:chat], 2);
+  XCTAssertEqual([self.chatDAO countOfUnreadMessages], 2);
+
+  XCTAssertTrue([self.msgDAO updateMessage:msg1 withFlags:0 error:nil]);
+  XCTAssertEqual([self.chatDAO countOfUnreadMessagesForChat:chat], 1);
+
+  XCTAssertTrue([self.msgDAO deleteMessage:msg2 error:nil]);
+  XCTAssertEqual([self.chatDAO countOfMessagesForChat:chat], 2);
+  XCTAssertEqual([self.chatDAO countOfUnreadMessagesForChat:chat], 0);
+
+  XCTAssertTrue([self.chatDAO updateChat:chat error:nil]);
+  XCTAssertEqual([self.chatDAO countOfMessagesForChat:chat], 2);
+}
+
+-(void) testChatMessageCountersRebuild
+{
+  UserChat *chat = [self newUserChat];
+
+  XCTAssertTrue([self.chatDAO insertChat:chat error:nil]);
+  chat.lastMessage.unreadFlag = YES;
+  XCTAssertTrue([self.msgDAO insertMessage:chat.lastMessage error:nil]);
+
+  [self.dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+    [db executeUpdate:@"UPDATE chat SET messageCount = 7, unreadCount = 5"];
+  }];
+
+  int corrected = 0;
+  XCTAssertTrue([self.chatDAO rebuildMessageCountsReturningCorrected:&corrected error:nil]);
+  XCTAssertEqual(corrected, 1);
+  XCTAssertEqual([self.chatDAO countOfMessagesForChat:chat], 1);
+  XCTAssertEqual([self.chatDAO countOfUnreadMessagesForChat:chat], 1);
+
+  XCTAssertTrue([self.chatDAO rebuildMessageCountsReturningCorrected:&corrected error:nil]);
+  XCTAssertEqual(corrected, 0);
+}
+
 -(void) modelObject:(Model *)model insertedInDAO:(DAO *)dao
 {
   [_inserted addObject:model.id];
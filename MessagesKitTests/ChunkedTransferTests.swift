@@ -0,0 +1,269 @@
+//
+//  ChunkedTransferTests.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import XCTest
+@testable import MessagesKit
+
+
+class ChunkedTransferTests: XCTestCase {
+
+  var server : TestHTTPServer!
+  var session : NSURLSession!
+  var fileURL : NSURL!
+
+  override func setUp() {
+    super.setUp()
+
+    server = TestHTTPServer()
+    try! server.start()
+
+    session = NSURLSession(configuration: NSURLSessionConfiguration.ephemeralSessionConfiguration())
+
+    fileURL = NSURL(fileURLWithPath: NSTemporaryDirectory()).URLByAppendingPathComponent(NSUUID().UUIDString).URLByAppendingPathExtension("send")
+  }
+
+  override func tearDown() {
+
+    server.stop()
+    session.invalidateAndCancel()
+
+    ChunkedUpload(fileURL: fileURL, length: 0, digest: nil).cleanup()
+    let _ = try? NSFileManager.defaultManager().removeItemAtURL(fileURL)
+
+    super.tearDown()
+  }
+
+  func writeFileOfLength(length: Int) -> NSData {
+    let data = NSData(randomBytesOfLength: length)
+    data.writeToURL(fileURL, atomically: true)
+    return data
+  }
+
+  func send(upload: ChunkedUpload) -> ChunkedUpload.Result? {
+
+    let baseRequest = NSMutableURLRequest(URL: server.URL)
+    baseRequest.HTTPMethod = "POST"
+
+    let (request, bodyURL) = try! upload.nextRequest(baseRequest)
+
+    var result : ChunkedUpload.Result?
+
+    let x = expectationWithDescription("chunk")
+
+    session.uploadTaskWithRequest(request, fromFile: bodyURL) { data, response, error in
+
+      if let response = response as? NSHTTPURLResponse where error == nil {
+        result = try! upload.processResponse(response, data: data ?? NSData())
+      }
+      else {
+        upload.interrupted()
+      }
+
+      x.fulfill()
+
+    }.resume()
+
+    waitForExpectationsWithTimeout(5, handler: nil)
+
+    return result
+  }
+
+  func sendAll(upload: ChunkedUpload, maxRequests: Int = 100) -> NSData? {
+
+    for _ in 0..<maxRequests {
+      if case .Some(.Complete(let data)) = send(upload) {
+        return data
+      }
+    }
+
+    return nil
+  }
+
+  func testOffsetFollowingRange() throws {
+
+    XCTAssertEqual(try ChunkedUpload.offsetFollowingRange("bytes=0-0"), 1)
+    XCTAssertEqual(try ChunkedUpload.offsetFollowingRange("bytes=0-1023"), 1024)
+
+    XCTAssertThrowsError(try ChunkedUpload.offsetFollowingRange("bytes=10-1023"))
+    XCTAssertThrowsError(try ChunkedUpload.offsetFollowingRange("bytes=0-"))
+    XCTAssertThrowsError(try ChunkedUpload.offsetFollowingRange("0-1023"))
+  }
+
+  func testUploadSendsFileAsIs() {
+
+    let data = writeFileOfLength(100 * 1024 + 17)
+
+    server.uploadResponseData = "done".dataUsingEncoding(NSUTF8StringEncoding)!
+
+    let upload = ChunkedUpload(fileURL: fileURL, length: UInt64(data.length), digest: data.sha256())
+
+    XCTAssertEqual(sendAll(upload), server.uploadResponseData)
+
+    // One request, with the file itself as the body
+    XCTAssertEqual(server.receivedData, data)
+    XCTAssertEqual(server.requestCount, 1)
+    XCTAssertFalse(NSFileManager.defaultManager().fileExistsAtPath(upload.progressURL.path!))
+    XCTAssertFalse(NSFileManager.defaultManager().fileExistsAtPath(upload.chunkURL.path!))
+  }
+
+  func testUploadWithPreamble() {
+
+    let data = writeFileOfLength(40 * 1024)
+    let preamble = NSData(randomBytesOfLength: 20 * 1024)
+
+    let upload = ChunkedUpload(fileURL: fileURL, length: UInt64(preamble.length + data.length), digest: data.sha256(), preamble: preamble)
+
+    XCTAssertNotNil(sendAll(upload))
+
+    // Preamble, then the file
+    let expected = NSMutableData(data: preamble)
+    expected.appendData(data)
+
+    XCTAssertEqual(server.receivedData, expected)
+    XCTAssertEqual(server.requestCount, 2)
+    XCTAssertEqual(server.receivedBodyBytes, expected.length)
+  }
+
+  func testUploadWithPreambleResumesAfterRestart() {
+
+    let data = writeFileOfLength(40 * 1024)
+    let preamble = NSData(randomBytesOfLength: 1024)
+    let length = UInt64(preamble.length + data.length)
+
+    do {
+      let upload = ChunkedUpload(fileURL: fileURL, length: length, digest: data.sha256(), preamble: preamble)
+
+      if case .Some(.Incomplete(let offset)) = send(upload) {
+        XCTAssertEqual(offset, UInt64(preamble.length))
+      }
+      else {
+        XCTFail("Preamble not confirmed")
+      }
+    }
+
+    // Preamble is restored from the persisted progress
+    let upload = ChunkedUpload(fileURL: fileURL, length: length, digest: data.sha256())
+
+    XCTAssertEqual(upload.preamble, preamble)
+    XCTAssertEqual(upload.confirmedOffset, UInt64(preamble.length))
+  }
+
+  func testUploadResumesAfterDroppedConnection() {
+
+    let data = writeFileOfLength(200 * 1024)
+
+    let upload = ChunkedUpload(fileURL: fileURL, length: UInt64(data.length), digest: data.sha256())
+
+    server.dropConnectionAfterBodyBytes = 60 * 1024
+
+    XCTAssertNil(send(upload))
+    XCTAssertFalse(upload.confirmed)
+
+    // Resumes with a status query, then only the remaining bytes
+
+    XCTAssertNotNil(sendAll(upload))
+
+    XCTAssertEqual(server.receivedData, data)
+    XCTAssertEqual(server.receivedBodyBytes, data.length)
+    XCTAssertEqual(server.requestCount, 3)
+    XCTAssertFalse(NSFileManager.defaultManager().fileExistsAtPath(upload.chunkURL.path!))
+  }
+
+  func testUploadResumesAfterRestart() {
+
+    let data = writeFileOfLength(200 * 1024)
+
+    do {
+      let upload = ChunkedUpload(fileURL: fileURL, length: UInt64(data.length), digest: data.sha256())
+
+      server.dropConnectionAfterBodyBytes = 64 * 1024
+
+      XCTAssertNil(send(upload))
+    }
+
+    // A new instance (e.g. after relaunch) asks where to continue before sending
+
+    let upload = ChunkedUpload(fileURL: fileURL, length: UInt64(data.length), digest: data.sha256())
+
+    XCTAssertFalse(upload.confirmed)
+
+    let (request, _) = try! upload.nextRequest(NSURLRequest(URL: server.URL))
+    XCTAssertEqual(request.valueForHTTPHeaderField("Content-Range"), "bytes */\(data.length)")
+
+    XCTAssertNotNil(sendAll(upload))
+
+    XCTAssertEqual(server.receivedData, data)
+    XCTAssertEqual(server.receivedBodyBytes, data.length)
+  }
+
+  func testUploadIgnoresProgressOfOtherPayload() {
+
+    let data = writeFileOfLength(200 * 1024)
+
+    do {
+      let upload = ChunkedUpload(fileURL: fileURL, length: UInt64(data.length), digest: data.sha256())
+
+      server.dropConnectionAfterBodyBytes = 64 * 1024
+
+      XCTAssertNil(send(upload))
+      XCTAssertNotNil(send(upload))
+      XCTAssertEqual(upload.confirmedOffset, 64 * 1024)
+    }
+
+    // Same message re-encrypted
+
+    let other = writeFileOfLength(200 * 1024)
+
+    let upload = ChunkedUpload(fileURL: fileURL, length: UInt64(other.length), digest: other.sha256())
+
+    XCTAssertEqual(upload.confirmedOffset, 0)
+
+    let (_, bodyURL) = try! upload.nextRequest(NSURLRequest(URL: server.URL))
+    XCTAssertEqual(bodyURL, fileURL)
+  }
+
+  func testDownloadResumesWithRange() {
+
+    let data = NSData(randomBytesOfLength: 512 * 1024)
+
+    server.downloadData = data
+    server.dropConnectionAfterBodyBytes = 300 * 1024
+
+    var resumeData : NSData?
+
+    do {
+      let x = expectationWithDescription("download")
+
+      session.downloadTaskWithURL(server.URL) { location, response, error in
+        resumeData = error?.userInfo[NSURLSessionDownloadTaskResumeData] as? NSData
+        x.fulfill()
+      }.resume()
+
+      waitForExpectationsWithTimeout(5, handler: nil)
+    }
+
+    XCTAssertNotNil(resumeData)
+
+    do {
+      let x = expectationWithDescription("resume")
+
+      session.downloadTaskWithResumeData(resumeData!) { location, response, error in
+
+        XCTAssertEqual((response as? NSHTTPURLResponse)?.statusCode, 206)
+        XCTAssertEqual(location.flatMap { NSData(contentsOfURL: $0) }, data)
+
+        x.fulfill()
+      }.resume()
+
+      waitForExpectationsWithTimeout(5, handler: nil)
+    }
+
+    XCTAssertEqual(server.requestCount, 2)
+  }
+
+}
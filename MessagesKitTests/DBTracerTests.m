@@ -0,0 +1,142 @@
+//
+//  DBTracerTests.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+@import XCTest;
+@import MessagesKit;
+
+
+@interface DBTracerTests : XCTestCase
+
+@property (strong, nonatomic) NSString *dbPath;
+@property (strong, nonatomic) DBManager *dbManager;
+
+@end
+
+
+@implementation DBTracerTests
+
+-(void) setUp
+{
+  [super setUp];
+
+  self.dbPath = [NSTemporaryDirectory() stringByAppendingString:@"temp-trace.sqlite"];
+  [NSFileManager.defaultManager removeItemAtPath:self.dbPath error:nil];
+
+  self.dbManager = [DBManager.alloc initWithPath:self.dbPath kind:@"Message" daoClasses:@[[MessageDAO class], [ChatDAO class]] error:nil];
+
+  [self.dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+    XCTAssertTrue([db executeStatements:@"CREATE TABLE trace_test(value INTEGER)"]);
+    for (int c = 0; c < 1000; ++c) {
+      XCTAssertTrue([db executeUpdate:@"INSERT INTO trace_test(value) VALUES (?)" valuesArray:@[@(c)] error:nil]);
+    }
+  }];
+}
+
+-(void) tearDown
+{
+  [self.dbManager shutdown];
+  self.dbManager = nil;
+
+  [NSFileManager.defaultManager removeItemAtPath:self.dbPath error:nil];
+  [NSFileManager.defaultManager removeItemAtPath:[NSTemporaryDirectory() stringByAppendingString:@"temp-trace-schema.plist"] error:nil];
+
+  [super tearDown];
+}
+
+-(NSUInteger) countMatchingValue:(int)value
+{
+  __block NSUInteger count = 0;
+  [self.dbManager.pool inReadableDatabase:^(FMDatabase *db) {
+    count = [db longForQuery:@"SELECT COUNT(*) FROM trace_test WHERE value = ?", @(value)];
+  }];
+  return count;
+}
+
+-(void) testDisabledRecordsNothing
+{
+  [self countMatchingValue:1];
+
+  XCTAssertEqual(self.dbManager.tracer.statementStats.count, 0);
+  XCTAssertEqual([self.dbManager.tracer waitTimingsForAccess:DBTracerAccessRead].count, 0);
+}
+
+-(void) testRecordsStatementsAndWaits
+{
+  DBTracer *tracer = self.dbManager.tracer;
+  tracer.enabled = YES;
+
+  for (int c = 0; c < 10; ++c) {
+    XCTAssertEqual([self countMatchingValue:c], 1);
+  }
+
+  [self.dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+    [db executeUpdate:@"DELETE FROM trace_test WHERE value = ?" valuesArray:@[@0] error:nil];
+  }];
+
+  DBStatementStats *selectStats = [tracer.statementStats filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"sql BEGINSWITH 'SELECT COUNT'"]].firstObject;
+  XCTAssertNotNil(selectStats);
+  XCTAssertEqual(selectStats.timings.count, 10);
+  // Each count scans the whole (unindexed) table
+  XCTAssertGreaterThanOrEqual(selectStats.fullScanSteps, 10 * 1000);
+
+  XCTAssertEqual([tracer waitTimingsForAccess:DBTracerAccessRead].count, 10);
+  XCTAssertEqual([tracer holdTimingsForAccess:DBTracerAccessRead].count, 10);
+  XCTAssertEqual([tracer waitTimingsForAccess:DBTracerAccessTransaction].count, 1);
+
+  XCTAssertTrue([tracer.report containsString:@"SELECT COUNT"]);
+
+  [tracer reset];
+  XCTAssertEqual(tracer.statementStats.count, 0);
+
+  tracer.enabled = NO;
+  [self countMatchingValue:1];
+  XCTAssertEqual(tracer.statementStats.count, 0);
+}
+
+-(void) testSlowQueryIncludesPlan
+{
+  DBTracer *tracer = self.dbManager.tracer;
+  tracer.slowQueryThreshold = 0;
+  tracer.slowQueryLimit = 5;
+  tracer.enabled = YES;
+
+  for (int c = 0; c < 10; ++c) {
+    [self countMatchingValue:c];
+  }
+
+  XCTAssertEqual(tracer.slowQueries.count, 5);
+
+  DBSlowQuery *slowQuery = tracer.slowQueries.lastObject;
+  XCTAssertTrue([slowQuery.sql hasPrefix:@"SELECT COUNT"]);
+
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+  while (!slowQuery.queryPlan && timeout.timeIntervalSinceNow > 0) {
+    [NSThread sleepForTimeInterval:0.01];
+  }
+
+  XCTAssertTrue([slowQuery.queryPlan containsString:@"trace_test"], @"%@", slowQuery.queryPlan);
+}
+
+-(void) testHistogramPercentiles
+{
+  DBTimingHistogram *histogram = [DBTimingHistogram new];
+  XCTAssertEqual([histogram percentile:0.5], 0);
+
+  for (int c = 0; c < 99; ++c) {
+    [histogram addTiming:0.0003];
+  }
+  [histogram addTiming:0.2];
+
+  XCTAssertEqual(histogram.count, 100);
+  XCTAssertEqualWithAccuracy(histogram.maximum, 0.2, 1e-9);
+  XCTAssertEqualWithAccuracy([histogram percentile:0.5], 0.0005, 1e-9);
+  XCTAssertEqualWithAccuracy([histogram percentile:1.0], 0.2, 1e-9);
+  XCTAssertEqual([[histogram.bucketCounts valueForKeyPath:@"@sum.self"] unsignedIntegerValue], 100);
+}
+
+@end
@@ -174,6 +174,47 @@
 
 }
 
+-(void) testBatchUpdateInsertsNewlyMatching
+{
+  FetchRequest *request = [FetchRequest new];
+  request.resultClass = [Message class];
+  request.includeSubentities = YES;
+  request.predicate = [NSPredicate predicateWithFormat:@"chat = %@ AND status = %d", self.chat, MessageStatusViewed];
+  request.sortDescriptors = @[[NSSortDescriptor sortDescriptorWithKey:@"sent" ascending:NO]];
+
+  FetchedResultsController *controller = [[FetchedResultsController alloc] initWithDBManager:self.dbManager
+                                                                                         request:request];
+  controller.delegate = self;
+
+  [controller executeAndReturnError:nil];
+
+  // Received & unviewed, so not matching until viewed
+  for (int c=0; c < 10; ++c) {
+    Message *msg = [self newTextMessage];
+    msg.sender = self.chat.alias;
+    msg.sent = [NSDate dateWithTimeIntervalSinceNow:-(c+1)];
+    msg.status = MessageStatusDelivered;
+    [self.messageDAO insertObject:msg error:nil];
+  }
+
+  [self flush];
+
+  XCTAssertEqual(controller.numberOfObjects, 0);
+
+  for (int c=0; c < 10; ++c) {
+    [self.expectations addObject:[self expectationWithDescription:@"Insert"]];
+  }
+
+  XCTAssertTrue([self.messageDAO viewAllMessagesForChat:self.chat before:[NSDate date] error:nil]);
+
+  [self waitForExpectationsWithTimeout:10 handler:NULL];
+
+  XCTAssertEqual(controller.numberOfObjects, 10);
+  XCTAssertEqual(_inserted.count, 10);
+
+  [self assertSorted:controller];
+}
+
 -(void) testThreaded
 {
   FetchRequest *request = [FetchRequest new];
@@ -12,11 +12,19 @@
 
 @import XCTest;
 @import CocoaLumberjack;
+@import HTMLReader;
 
 
 MK_DECLARE_LOG_LEVEL()
 
 
+@interface HTMLTextParser (Testing)
+
+-(NSUInteger) cacheCostOfAttributedString:(NSAttributedString *)string;
+
+@end
+
+
 @interface HTMLTextTests : XCTestCase
 
 @end
@@ -27,6 +35,8 @@ MK_DECLARE_LOG_LEVEL()
 -(void) setUp
 {
   [super setUp];
+
+  [HTMLTextParser purgeCache];
 }
 
 -(void) tearDown
@@ -44,4 +54,138 @@ MK_DECLARE_LOG_LEVEL()
   DDLogDebug(@"Result %@", res);
 }
 
+-(void) testParserCachesResults
+{
+  NSData *data = [@"A <b>cached</b> result" dataUsingEncoding:NSUTF8StringEncoding];
+
+  HTMLTextParser *parser = [HTMLTextParser new];
+
+  NSAttributedString *res = [parser parseWithData:data];
+  XCTAssertEqualObjects(res.string, @"A cached result");
+  XCTAssertEqual([parser parseWithData:[data mutableCopy]], res);
+  XCTAssertEqual([[HTMLTextParser new] parseWithData:data], res);
+
+  // Attributes depend on the default font
+  HTMLTextParser *largeParser = [[HTMLTextParser alloc] initWithDefaultFont:[UIFont systemFontOfSize:40]];
+  NSAttributedString *largeRes = [largeParser parseWithData:data];
+  XCTAssertNotEqual(largeRes, res);
+  XCTAssertEqualObjects(largeRes.string, res.string);
+}
+
+-(void) testCacheCostIncludesAttachments
+{
+  NSData *imageData = [NSMutableData dataWithLength:64 * 1024];
+
+  NSMutableAttributedString *string = [[NSMutableAttributedString alloc] initWithString:@"An image "];
+  NSTextAttachment *attachment = [[NSTextAttachment alloc] initWithData:imageData ofType:@"public.png"];
+  [string appendAttributedString:[NSAttributedString attributedStringWithAttachment:attachment]];
+
+  NSUInteger cost = [[HTMLTextParser new] cacheCostOfAttributedString:string];
+  XCTAssertEqual(cost, string.length * sizeof(unichar) + imageData.length);
+}
+
+-(void) testExtractTextMatchesDocument
+{
+  for (NSData *data in self.corpus) {
+    NSString *expected = [HTMLDocument documentWithData:data contentTypeHeader:@"text/html"].textContent;
+    XCTAssertEqualObjects([HTMLTextParser extractText:data], expected);
+  }
+}
+
+-(void) testExtractTextDeclaredEncoding
+{
+  NSString *html = @"<html><head><meta charset=\"utf-8\"></head><body>Caf\u00e9 \u2615</body></html>";
+  NSData *data = [html dataUsingEncoding:NSUTF8StringEncoding];
+
+  XCTAssertEqualObjects([HTMLTextParser extractText:data], @"Caf\u00e9 \u2615");
+  XCTAssertEqualObjects([HTMLTextParser extractText:data], [HTMLDocument documentWithData:data contentTypeHeader:@"text/html"].textContent);
+
+  html = @"<meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\">Na\u00efve";
+  data = [html dataUsingEncoding:NSUTF8StringEncoding];
+
+  XCTAssertEqualObjects([HTMLTextParser extractText:data], @"Na\u00efve");
+}
+
+// Extraction times over the corpus for the document parser, the tokenizer & the cache
+-(void) testBenchmarkExtractText
+{
+  NSArray<NSData *> *corpus = self.corpus;
+  NSUInteger iterations = 50;
+
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger c = 0; c < iterations; ++c) {
+    for (NSData *data in corpus) {
+      @autoreleasepool {
+        (void)[HTMLDocument documentWithData:data contentTypeHeader:@"text/html"].textContent;
+      }
+    }
+  }
+  CFAbsoluteTime documentTime = CFAbsoluteTimeGetCurrent() - start;
+
+  start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger c = 0; c < iterations; ++c) {
+    [HTMLTextParser purgeCache];
+    for (NSData *data in corpus) {
+      @autoreleasepool {
+        [HTMLTextParser extractText:data];
+      }
+    }
+  }
+  CFAbsoluteTime tokenizerTime = CFAbsoluteTimeGetCurrent() - start;
+
+  start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger c = 0; c < iterations; ++c) {
+    for (NSData *data in corpus) {
+      [HTMLTextParser extractText:data];
+    }
+  }
+  CFAbsoluteTime cachedTime = CFAbsoluteTimeGetCurrent() - start;
+
+  DDLogInfo(@"Extract text (%lu bodies x %lu): document %.3fs, tokenizer %.3fs, cached %.3fs",
+            (unsigned long)corpus.count, (unsigned long)iterations, documentTime, tokenizerTime, cachedTime);
+
+  [self measureBlock:^{
+    [HTMLTextParser purgeCache];
+    for (NSData *data in corpus) {
+      [HTMLTextParser extractText:data];
+    }
+  }];
+}
+
+// Representative HTML message bodies: composer output, pasted web & email content
+-(NSArray<NSData *> *) corpus
+{
+  NSMutableArray<NSString *> *bodies = [NSMutableArray arrayWithArray:@[
+    @"Running late, be there in <b>20</b> minutes",
+    @"This <i>is a <b>bold</b> test</i> with a <a href=\"yo:test\">link</a><br>and a second line",
+    @"<u>Reminder</u>: dinner at <b>Luigi&#39;s</b> &amp; drinks after &mdash; bring &lt;cash&gt;&nbsp;&#x1F37B;",
+    @"<div>Lunch?</div><div><br></div><div>I&rsquo;m free after <i>12:30</i></div>",
+    @"<img data=\"iVBORw0KGgoAAAANSUhEUgAAAAEAAAABCAYAAAAfFcSJAAAADUlEQVR42mNkYPhfDwAChwGA60e6kgAAAABJRU5ErkJggg==\" type=\"image/png\" width=\"1\" height=\"1\"> Look at this!",
+    @"<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>Fwd: Itinerary</title>\n"
+    @"<style type=\"text/css\">p { margin: 0 } a > b { color: #333 }</style>\n"
+    @"<script>if (a < b && c > d) { document.write(\"<p>nope</p>\"); }</script>\n</head>\n"
+    @"<body>\n<p>Flight <b>UA 123</b> departs 8:05am</p>\n<!-- tracking pixel -->\n"
+    @"<table><tr><td>SFO</td><td>&rarr;</td><td>JFK</td></tr>\n<tr><td>Seat</td><td></td><td>14C</td></tr></table>\n"
+    @"<pre>\n  indented\n    code</pre>\n<ul><li>One<li>Two</ul>\n</body>\n</html>\n",
+    @"<blockquote type=\"cite\"><div>On Oct 19, 2016, at 9:41 AM, Emma wrote:</div><br>"
+    @"<div><span style=\"font-family: Helvetica\">Are we still on for tomorrow?</span></div></blockquote>"
+    @"<div>Yes! <a href=\"https://example.com/maps?q=cafe&amp;z=14\">Here</a> at 10</div>",
+  ]];
+
+  // Newsletter sized body
+  NSMutableString *large = [NSMutableString stringWithString:@"<html><head><title>Weekly</title></head><body>"];
+  for (int c = 0; c < 200; ++c) {
+    [large appendFormat:@"<p style=\"font-family: Helvetica; color: #333333\">Paragraph %d of a <b>formatted</b> "
+                        @"<i>message</i> body with a <a href=\"https://example.com/%d\">link</a> &amp; more.</p>\n", c, c];
+  }
+  [large appendString:@"</body></html>"];
+  [bodies addObject:large];
+
+  NSMutableArray<NSData *> *corpus = [NSMutableArray new];
+  for (NSString *body in bodies) {
+    [corpus addObject:[body dataUsingEncoding:NSUTF8StringEncoding]];
+  }
+  return corpus;
+}
+
 @end
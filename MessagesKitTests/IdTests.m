@@ -0,0 +1,145 @@
+//
+//  IdTests.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "Messages+Exts.h"
+#import "TBase+Utils.h"
+#import "NSData+Random.h"
+
+@import Thrift;
+
+
+@interface IdTests : XCTestCase
+
+@end
+
+
+@implementation IdTests
+
+-(void) testEquality
+{
+  NSData *data = [NSData dataWithRandomBytesOfLength:16];
+
+  Id *a = [Id idWithData:data];
+  Id *b = [Id.alloc initWithBytes:data.bytes];
+
+  XCTAssertEqualObjects(a, b);
+  XCTAssertEqual(a.hash, b.hash);
+  XCTAssertEqualObjects(b.data, data);
+  XCTAssertEqualObjects([a copy], a);
+
+  XCTAssertNotEqualObjects(a, [Id generate]);
+  XCTAssertNotEqualObjects([Id null], [Id new]);
+}
+
+-(void) testDataView
+{
+  Id *id = [Id generate];
+
+  // Created once & kept, so repeated binds share it
+  XCTAssertEqual(id.data, id.data);
+  XCTAssertEqual(id.data.length, (NSUInteger)16);
+  XCTAssertEqual(memcmp(id.data.bytes, id.bytes, 16), 0);
+
+  // Immutable data is kept as the view
+  NSData *data = [[NSData dataWithRandomBytesOfLength:16] copy];
+  XCTAssertEqual([Id idWithData:data].data, data);
+}
+
+-(void) testNilData
+{
+  Id *id = [Id.alloc initWithData:nil];
+
+  XCTAssertTrue(id.dataIsSet);
+  XCTAssertNil(id.data);
+  XCTAssertNil([id copy].data);
+  XCTAssertNotEqualObjects(id, [Id null]);
+
+  id.data = [Id generate].data;
+  id.data = nil;
+  XCTAssertNil(id.data);
+}
+
+-(void) testInvalidLengthsRejected
+{
+  XCTAssertNil([Id.alloc initWithData:[NSData dataWithRandomBytesOfLength:8]]);
+  XCTAssertNil([Id.alloc initWithData:[NSData dataWithRandomBytesOfLength:17]]);
+
+  Id *generated = [Id generate];
+  XCTAssertThrowsSpecificNamed(generated.data = [NSData dataWithRandomBytesOfLength:15], NSException, NSInvalidArgumentException);
+
+  // Deserializing fails rather than padding or truncating
+  TMemoryBuffer *buffer = [TMemoryBuffer new];
+  id<TProtocol> protocol = [TCompactProtocolFactory.sharedFactory newProtocolOnTransport:buffer];
+  XCTAssertTrue([protocol writeStructBeginWithName:@"Id" error:nil]);
+  XCTAssertTrue([protocol writeFieldBeginWithName:@"data" type:TTypeSTRING fieldID:1 error:nil]);
+  XCTAssertTrue([protocol writeBinary:[NSData dataWithRandomBytesOfLength:20] error:nil]);
+  XCTAssertTrue([protocol writeFieldEnd:nil]);
+  XCTAssertTrue([protocol writeFieldStop:nil]);
+  XCTAssertTrue([protocol writeStructEnd:nil]);
+
+  NSError *error;
+  XCTAssertNil([TBaseUtils deserialize:[Id new] fromData:buffer.buffer usingProtocolFactory:TCompactProtocolFactory.sharedFactory error:&error]);
+  XCTAssertEqualObjects(error.domain, TProtocolErrorDomain);
+  XCTAssertEqual(error.code, (NSInteger)TProtocolErrorInvalidData);
+}
+
+-(void) testCompareMatchesByteOrder
+{
+  for (int c = 0; c < 1000; ++c) {
+
+    Id *a = [Id idWithData:[NSData dataWithRandomBytesOfLength:16]];
+    Id *b = [Id idWithData:[NSData dataWithRandomBytesOfLength:16]];
+
+    // Only the last byte differs for some, exercising the second word
+    if (c % 2) {
+      NSMutableData *data = [a.data mutableCopy];
+      ((UInt8 *)data.mutableBytes)[15] ^= 0x01;
+      b = [Id idWithData:data];
+    }
+
+    int res = memcmp(a.bytes, b.bytes, 16);
+    NSComparisonResult expected = res < 0 ? NSOrderedAscending : (res > 0 ? NSOrderedDescending : NSOrderedSame);
+
+    XCTAssertEqual([a compare:b], expected);
+    XCTAssertEqual([b compare:a], (NSComparisonResult)-expected);
+  }
+
+  Id *id = [Id generate];
+  XCTAssertEqual([id compare:[id copy]], NSOrderedSame);
+}
+
+-(void) testStrings
+{
+  Id *id = [Id generate];
+
+  XCTAssertEqualObjects([Id idWithString:id.UUIDString], id);
+  XCTAssertEqualObjects([Id idWithUUID:[NSUUID.alloc initWithUUIDString:id.UUIDString]], id);
+
+  XCTAssertTrue([Id idWithString:@"not a uuid"].isNull);
+  XCTAssertTrue([Id idWithData:[NSData dataWithRandomBytesOfLength:8]].isNull);
+  XCTAssertFalse(id.isNull);
+}
+
+-(void) testSerialization
+{
+  Id *id = [Id generate];
+
+  NSError *error;
+  NSData *data = [TBaseUtils serializeToData:id usingProtocolFactory:TCompactProtocolFactory.sharedFactory error:&error];
+  XCTAssertNotNil(data, @"Error: %@", error);
+
+  Id *read = [TBaseUtils deserialize:[Id new] fromData:data usingProtocolFactory:TCompactProtocolFactory.sharedFactory error:&error];
+  XCTAssertEqualObjects(read, id, @"Error: %@", error);
+
+  Id *decoded = [NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:id]];
+  XCTAssertEqualObjects(decoded, id);
+}
+
+@end
@@ -173,5 +173,16 @@ class MessageAPITest: XCTestCase {
     
     waitForExpectationsWithTimeout(15, handler: nil)
   }
+  
+  func testWebSocketBearerRefreshUpdatesAccessToken() {
+    
+    expectationForNotification(MessageAPIAccessTokenRefreshed, object: api, handler: nil)
+    
+    api.webSocket(api.webSocket, didReceiveBearerRefresh: "refreshed-token")
+    
+    waitForExpectationsWithTimeout(5, handler: nil)
+    
+    XCTAssertEqual(api.accessToken, "refreshed-token")
+  }
 
 }
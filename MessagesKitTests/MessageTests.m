@@ -10,6 +10,8 @@
 @import MessagesKit;
 @import CoreGraphics;
 
+#import "DAO+Internal.h"
+
 
 @interface MessageTests : XCTestCase <DBManagerDelegate> {
   UserChat *userChat;
@@ -33,6 +35,28 @@
 @end
 
 
+@interface StaleSnapshotFileOwner : NSObject <ExternalFileOwner>
+
+@property (weak, nonatomic) MessageDAO *dao;
+
+@end
+
+
+@implementation StaleSnapshotFileOwner
+
+-(NSSet<NSString *> *) referencedExternalFileNamesInDatabase:(FMDatabase *)db error:(NSError **)error
+{
+  return [NSSet set];
+}
+
+-(NSSet<NSString *> *) referencedExternalFileNamesInArray:(NSArray<NSString *> *)fileNames inDatabase:(FMDatabase *)db error:(NSError **)error
+{
+  return [_dao referencedExternalFileNamesInArray:fileNames inDatabase:db error:error];
+}
+
+@end
+
+
 @implementation MessageTests
 
 -(void) setUp
@@ -68,6 +92,9 @@
   self.dbManager = nil;
   
   [[NSFileManager defaultManager] removeItemAtPath:self.dbPath error:nil];
+  [[NSFileManager defaultManager] removeItemAtPath:[NSTemporaryDirectory() stringByAppendingString:@"temp-files"] error:nil];
+  [[NSFileManager defaultManager] removeItemAtPath:[NSTemporaryDirectory() stringByAppendingString:@"temp-deleted.filter"] error:nil];
+  [[NSFileManager defaultManager] removeItemAtPath:[NSTemporaryDirectory() stringByAppendingString:@"temp-schema.plist"] error:nil];
   
   [super tearDown];
 }
@@ -326,6 +353,51 @@
   XCTAssertEqual(4, [dao fetchUnsentMessagesAndReturnError:nil].count);
 }
 
+-(void) testMessageFetchUnsentPaged
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+
+  NSDate *base = [NSDate date];
+
+  NSMutableArray<Id *> *expected = [NSMutableArray array];
+
+  for (int c=0; c < 25; ++c) {
+    Message *msg = [self newTextMessage];
+    msg.sent = [base dateByAddingTimeInterval:c / 2];  // pairs share a sent time
+    msg.status = (c % 5 == 0) ? MessageStatusSent : MessageStatusUnsent;
+    XCTAssertTrue([dao insertMessage:msg error:nil]);
+    if (msg.status < MessageStatusSending) {
+      [expected addObject:msg.id];
+    }
+  }
+
+  NSMutableArray<Message *> *fetched = [NSMutableArray array];
+  Message *last = nil;
+
+  while (YES) {
+    NSError *error;
+    NSArray<Message *> *page = [dao fetchUnsentMessagesAfter:last limit:3 error:&error];
+    XCTAssertNotNil(page, @"Error: %@", error);
+    if (page.count == 0) {
+      break;
+    }
+    XCTAssertLessThanOrEqual(page.count, 3);
+
+    // Updating a fetched message does not disturb later pages
+    [dao updateMessage:page.firstObject withStatus:MessageStatusFailed error:nil];
+
+    [fetched addObjectsFromArray:page];
+    last = page.lastObject;
+  }
+
+  XCTAssertEqual(fetched.count, expected.count);
+  XCTAssertEqualObjects([NSSet setWithArray:[fetched valueForKey:@"id"]], [NSSet setWithArray:expected]);
+
+  for (NSUInteger c=1; c < fetched.count; ++c) {
+    XCTAssertLessThanOrEqual([fetched[c-1].sent compare:fetched[c].sent], NSOrderedSame);
+  }
+}
+
 -(void) testMessageDelete
 {
   Message *msg = [self newTextMessage];
@@ -467,6 +539,74 @@
   XCTAssertEqual(_updated.count, 5);
 }
 
+-(void) testMessageReadAllForChatPatchesCachedOnly
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+
+  Message *cached = [self newTextMessage];
+  cached.unreadFlag = YES;
+  XCTAssertTrue([dao insertMessage:cached error:nil]);
+
+  Message *uncached = [self newTextMessage];
+  uncached.unreadFlag = YES;
+  XCTAssertTrue([dao insertMessage:uncached error:nil]);
+
+  [dao.objectCache removeObjectForKey:uncached.dbId];
+
+  XCTAssertTrue([dao readAllMessagesForChat:userChat error:nil]);
+
+  XCTAssertFalse(cached.unreadFlag);
+  XCTAssertTrue(uncached.unreadFlag);
+  XCTAssertNil([dao.objectCache objectForKey:uncached.dbId]);
+
+  XCTAssertTrue([_updated containsObject:cached.id]);
+  XCTAssertTrue([_updated containsObject:uncached.id]);
+
+  XCTAssertFalse([dao fetchMessageWithId:uncached.id].unreadFlag);
+}
+
+// Loaded rows are cached under their Id, never an intermediate NSData
+-(void) testLoadedMessagesCachedById
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+
+  Message *msg = [self newTextMessage];
+  XCTAssertTrue([dao insertMessage:msg error:nil]);
+
+  [dao clearCache];
+
+  Message *loaded = [dao fetchMessageWithId:msg.id];
+  XCTAssertNotNil(loaded);
+  XCTAssertNotEqual(loaded, msg);
+  XCTAssertEqualObjects(loaded, msg);
+  XCTAssertEqual(loaded.hash, msg.hash);
+
+  XCTAssertTrue([loaded.dbId isKindOfClass:[Id class]]);
+  XCTAssertEqual([dao.objectCache objectForKey:[Id idWithData:msg.id.data]], loaded);
+
+  NSArray *all = [dao fetchAllObjectsWithDbIds:@[msg.id] error:nil];
+  XCTAssertEqual(all.count, 1);
+  XCTAssertEqual(all.firstObject, loaded);
+}
+
+-(void) testMessageDeleteAllForChat
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+
+  Message *msg1 = [self newTextMessage];
+  XCTAssertTrue([dao insertMessage:msg1 error:nil]);
+
+  Message *msg2 = [self newImageMessage];
+  XCTAssertTrue([dao insertMessage:msg2 error:nil]);
+
+  XCTAssertTrue([dao deleteAllMessagesForChat:userChat error:nil]);
+
+  XCTAssertNil([dao fetchMessageWithId:msg1.id]);
+  XCTAssertNil([dao fetchMessageWithId:msg2.id]);
+  XCTAssertTrue([_deleted containsObject:msg1.id]);
+  XCTAssertTrue([_deleted containsObject:msg2.id]);
+}
+
 -(BOOL) payloadRoundtripForMessage:(Message *)message
 {
   Message *copy = [message copy];
@@ -501,30 +641,32 @@
 
 -(void) testImageMessageDataDeletion
 {
+  MessageDAO *dao = self.dbManager[@"Message"];
+
   ImageMessage *msg = [self newImageMessage];
+  [dao insertMessage:msg error:nil];
   NSURL *tmpURL = [(id)msg.data URL];
   msg.data = [MemoryDataReference.alloc initWithData:NSData.data ofMIMEType:@""];
   
-  XCTAssertFalse([tmpURL checkResourceIsReachableAndReturnError:nil]);
-  
-  msg = [self newImageMessage];
-  [self.dbManager[@"Message"] insertMessage:msg error:nil];
-  tmpURL = [(id)msg.data URL];
-  msg.data = [MemoryDataReference.alloc initWithData:NSData.data ofMIMEType:@""];
+  // Replaced data is kept until the replacement is saved & collected
+  XCTAssertTrue([tmpURL checkResourceIsReachableAndReturnError:nil]);
   
+  XCTAssertTrue([dao updateMessage:msg error:nil]);
+  XCTAssertTrue([dao.externalFileCollector collectAndReturnError:nil]);
   XCTAssertFalse([tmpURL checkResourceIsReachableAndReturnError:nil]);
-
+  
   msg = [self newImageMessage];
-  [self.dbManager[@"Message"] insertMessage:msg error:nil];
-  [self.dbManager[@"Message"] clearCache];
-  msg = [self.dbManager[@"Message"] fetchMessageWithId:msg.id];
+  [dao insertMessage:msg error:nil];
+  [dao clearCache];
+  msg = [dao fetchMessageWithId:msg.id];
   
   XCTAssertNotNil(msg.data);
   
   tmpURL = [(id)msg.data URL];
   XCTAssertTrue([tmpURL checkResourceIsReachableAndReturnError:nil]);
   
-  msg.data = [MemoryDataReference.alloc initWithData:NSData.data ofMIMEType:@""];
+  XCTAssertTrue([dao deleteMessage:msg error:nil]);
+  XCTAssertTrue([dao.externalFileCollector collectAndReturnError:nil]);
   XCTAssertFalse([tmpURL checkResourceIsReachableAndReturnError:nil]);
 }
 
@@ -537,30 +679,32 @@
 
 -(void) testAudioMessageDataDeletion
 {
+  MessageDAO *dao = self.dbManager[@"Message"];
+
   AudioMessage *msg = [self newAudioMessage];
+  [dao insertMessage:msg error:nil];
   NSURL *tmpURL = [(id)msg.data URL];
   msg.data = [MemoryDataReference.alloc initWithData:NSData.data ofMIMEType:@""];
   
-  XCTAssertFalse([tmpURL checkResourceIsReachableAndReturnError:nil]);
-  
-  msg = [self newAudioMessage];
-  [self.dbManager[@"Message"] insertMessage:msg error:nil];
-  tmpURL = [(id)msg.data URL];
-  msg.data = [MemoryDataReference.alloc initWithData:NSData.data ofMIMEType:@""];
+  // Replaced data is kept until the replacement is saved & collected
+  XCTAssertTrue([tmpURL checkResourceIsReachableAndReturnError:nil]);
   
+  XCTAssertTrue([dao updateMessage:msg error:nil]);
+  XCTAssertTrue([dao.externalFileCollector collectAndReturnError:nil]);
   XCTAssertFalse([tmpURL checkResourceIsReachableAndReturnError:nil]);
   
   msg = [self newAudioMessage];
-  [self.dbManager[@"Message"] insertMessage:msg error:nil];
-  [self.dbManager[@"Message"] clearCache];
-  msg = [self.dbManager[@"Message"] fetchMessageWithId:msg.id];
+  [dao insertMessage:msg error:nil];
+  [dao clearCache];
+  msg = [dao fetchMessageWithId:msg.id];
   
   XCTAssertNotNil(msg.data);
   
   tmpURL = [(id)msg.data URL];
   XCTAssertTrue([tmpURL checkResourceIsReachableAndReturnError:nil]);
   
-  msg.data = [MemoryDataReference.alloc initWithData:NSData.data ofMIMEType:@""];
+  XCTAssertTrue([dao deleteMessage:msg error:nil]);
+  XCTAssertTrue([dao.externalFileCollector collectAndReturnError:nil]);
   XCTAssertFalse([tmpURL checkResourceIsReachableAndReturnError:nil]);
 }
 
@@ -573,33 +717,354 @@
 
 -(void) testVideoMessageDataDeletion
 {
-  AudioMessage *msg = [self newAudioMessage];
+  MessageDAO *dao = self.dbManager[@"Message"];
+
+  VideoMessage *msg = [self newVideoMessage];
+  [dao insertMessage:msg error:nil];
   NSURL *tmpURL = [(id)msg.data URL];
   msg.data = [MemoryDataReference.alloc initWithData:NSData.data ofMIMEType:@""];
   
-  XCTAssertFalse([tmpURL checkResourceIsReachableAndReturnError:nil]);
-  
-  msg = [self newAudioMessage];
-  [self.dbManager[@"Message"] insertMessage:msg error:nil];
-  tmpURL = [(id)msg.data URL];
-  msg.data = [MemoryDataReference.alloc initWithData:NSData.data ofMIMEType:@""];
+  // Replaced data is kept until the replacement is saved & collected
+  XCTAssertTrue([tmpURL checkResourceIsReachableAndReturnError:nil]);
   
+  XCTAssertTrue([dao updateMessage:msg error:nil]);
+  XCTAssertTrue([dao.externalFileCollector collectAndReturnError:nil]);
   XCTAssertFalse([tmpURL checkResourceIsReachableAndReturnError:nil]);
   
-  msg = [self newAudioMessage];
-  [self.dbManager[@"Message"] insertMessage:msg error:nil];
-  [self.dbManager[@"Message"] clearCache];
-  msg = [self.dbManager[@"Message"] fetchMessageWithId:msg.id];
+  msg = [self newVideoMessage];
+  [dao insertMessage:msg error:nil];
+  [dao clearCache];
+  msg = [dao fetchMessageWithId:msg.id];
   
   XCTAssertNotNil(msg.data);
   
   tmpURL = [(id)msg.data URL];
   XCTAssertTrue([tmpURL checkResourceIsReachableAndReturnError:nil]);
   
-  msg.data = [MemoryDataReference.alloc initWithData:NSData.data ofMIMEType:@""];
+  XCTAssertTrue([dao deleteMessage:msg error:nil]);
+  XCTAssertTrue([dao.externalFileCollector collectAndReturnError:nil]);
   XCTAssertFalse([tmpURL checkResourceIsReachableAndReturnError:nil]);
 }
 
+-(void) testExternalFileJournalRollback
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+
+  ImageMessage *msg = [self newImageMessage];
+  [dao insertMessage:msg error:nil];
+  NSURL *dataURL = [(id)msg.data URL];
+  
+  [self.dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+    XCTAssertTrue([dao.externalFileCollector journalFileNamed:[(id)msg.data fileName] error:nil]);
+    *rollback = YES;
+  }];
+  
+  XCTAssertEqual([dao.externalFileCollector countOfPendingFiles], 0);
+  
+  XCTAssertTrue([dao.externalFileCollector collectAndReturnError:nil]);
+  XCTAssertTrue([dataURL checkResourceIsReachableAndReturnError:nil]);
+}
+
+-(void) testExternalFileCollectBatches
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+  dao.externalFileCollector.batchSize = 2;
+
+  NSMutableArray *URLs = [NSMutableArray array];
+  for (int c = 0; c < 5; ++c) {
+    // Distinct contents so each message stores its own file
+    AudioMessage *msg = [self newAudioMessage];
+    msg.data = [MemoryDataReference.alloc initWithData:[NSData dataWithBytes:&c length:sizeof(c)] ofMIMEType:@"audio/mpeg"];
+    [dao insertMessage:msg error:nil];
+    [URLs addObject:[(id)msg.data URL]];
+  }
+  
+  XCTAssertTrue([dao deleteAllMessagesForChat:userChat error:nil]);
+  XCTAssertTrue([dao.externalFileCollector collectAndReturnError:nil]);
+  
+  XCTAssertEqual([dao.externalFileCollector countOfPendingFiles], 0);
+  for (NSURL *URL in URLs) {
+    XCTAssertFalse([URL checkResourceIsReachableAndReturnError:nil]);
+  }
+  
+  ExternalFileCollectorMetrics *metrics = dao.externalFileCollector.metrics;
+  XCTAssertGreaterThanOrEqual(metrics.filesReclaimed, 5);
+  XCTAssertEqual(metrics.failures, 0);
+}
+
+-(void) testExternalFileStoreDeduplicates
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+
+  NSMutableArray *msgs = [NSMutableArray array];
+  for (int c = 0; c < 3; ++c) {
+    ImageMessage *msg = [self newImageMessage];
+    XCTAssertTrue([dao insertMessage:msg error:nil]);
+    [msgs addObject:msg];
+  }
+  
+  NSString *fileName = [[msgs[0] data] fileName];
+  XCTAssertEqualObjects([[msgs[1] data] fileName], fileName);
+  XCTAssertEqualObjects([[msgs[2] data] fileName], fileName);
+  XCTAssertEqual([dao.externalFileStore referenceCountForFileNamed:fileName], 3);
+  
+  unsigned long long size = [[[msgs[0] data] dataSizeAndReturnError:nil] unsignedLongLongValue];
+  XCTAssertEqual([dao.externalFileStore bytesSavedByDeduplication], size * 2);
+  
+  NSURL *dataURL = [[msgs[0] data] URL];
+  
+  XCTAssertTrue([dao deleteMessage:msgs[0] error:nil]);
+  XCTAssertTrue([dao deleteMessage:msgs[1] error:nil]);
+  XCTAssertTrue([dao.externalFileCollector collectAndReturnError:nil]);
+  
+  XCTAssertEqual([dao.externalFileStore referenceCountForFileNamed:fileName], 1);
+  XCTAssertTrue([dataURL checkResourceIsReachableAndReturnError:nil]);
+  
+  XCTAssertTrue([dao deleteMessage:msgs[2] error:nil]);
+  XCTAssertTrue([dao.externalFileCollector collectAndReturnError:nil]);
+  
+  XCTAssertEqual([dao.externalFileStore referenceCountForFileNamed:fileName], 0);
+  XCTAssertFalse([dataURL checkResourceIsReachableAndReturnError:nil]);
+}
+
+-(void) testExternalFileStoreStagesDuplicatesWithoutWriting
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+
+  MemoryDataReference *data = [MemoryDataReference.alloc initWithData:[NSData dataWithBytes:"staged" length:6] ofMIMEType:@"application/octet-stream"];
+
+  StagedExternalFile *first = [dao.externalFileStore stageDataReference:data error:nil];
+  XCTAssertNotNil(first.tempURL);
+  XCTAssertNotNil([dao.externalFileStore storeStagedFile:first error:nil]);
+  XCTAssertNil(first.tempURL);
+
+  StagedExternalFile *duplicate = [dao.externalFileStore stageDataReference:data error:nil];
+  XCTAssertEqualObjects(duplicate.fileName, first.fileName);
+  XCTAssertNil(duplicate.tempURL);
+  XCTAssertNotNil([dao.externalFileStore storeStagedFile:duplicate error:nil]);
+
+  XCTAssertEqual([dao.externalFileStore referenceCountForFileNamed:first.fileName], 2);
+
+  NSArray *URLs = [NSFileManager.defaultManager contentsOfDirectoryAtURL:dao.externalFileCollector.directoryURL includingPropertiesForKeys:nil options:0 error:nil];
+  XCTAssertEqual(URLs.count, 1);
+}
+
+-(void) testExternalFileStoreReusesPendingFile
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+
+  ImageMessage *msg = [self newImageMessage];
+  XCTAssertTrue([dao insertMessage:msg error:nil]);
+  NSURL *dataURL = [(id)msg.data URL];
+  
+  // Re-storing identical data before collection must keep the file
+  [self.dbManager.pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+    
+    XCTAssertTrue([dao deleteMessage:msg error:nil]);
+    
+    ImageMessage *msg2 = [self newImageMessage];
+    XCTAssertTrue([dao insertMessage:msg2 error:nil]);
+    
+  }];
+  
+  XCTAssertEqual([dao.externalFileCollector countOfPendingFiles], 0);
+  XCTAssertTrue([dao.externalFileCollector collectAndReturnError:nil]);
+  XCTAssertTrue([dataURL checkResourceIsReachableAndReturnError:nil]);
+}
+
+-(void) testExternalFileReconcile
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+  dao.externalFileCollector.orphanGracePeriod = 0;
+
+  VideoMessage *msg = [self newVideoMessage];
+  [dao insertMessage:msg error:nil];
+  NSURL *dataURL = [(id)msg.data URL];
+  
+  NSString *orphanName = [dao.externalFileCollector newFileNameWithExtension:@"mp4" error:nil];
+  NSURL *orphanURL = [NSURL URLWithString:orphanName relativeToURL:self.dbManager.URL];
+  XCTAssertTrue([[NSData dataWithBytes:"orphan" length:6] writeToURL:orphanURL atomically:NO]);
+  
+  NSURL *otherURL = [dao.externalFileCollector.directoryURL URLByAppendingPathComponent:@"other.txt"];
+  XCTAssertTrue([[NSData dataWithBytes:"other" length:5] writeToURL:otherURL atomically:NO]);
+  
+  XCTAssertTrue([dao.externalFileCollector reconcileAndReturnError:nil]);
+  
+  XCTAssertTrue([dataURL checkResourceIsReachableAndReturnError:nil]);
+  XCTAssertTrue([otherURL checkResourceIsReachableAndReturnError:nil]);
+  XCTAssertFalse([orphanURL checkResourceIsReachableAndReturnError:nil]);
+  
+  ExternalFileCollectorMetrics *metrics = dao.externalFileCollector.metrics;
+  XCTAssertEqual(metrics.orphansReclaimed, 1);
+  XCTAssertEqual(metrics.bytesReclaimed, 6);
+  XCTAssertNotNil(metrics.lastReconciled);
+
+  // Kept across launches, so reconcileIfNeeded does not rescan on each one
+  ExternalFileCollector *relaunched = [ExternalFileCollector.alloc initWithDBManager:self.dbManager];
+  XCTAssertEqualWithAccuracy(relaunched.lastReconciled.timeIntervalSinceReferenceDate, metrics.lastReconciled.timeIntervalSinceReferenceDate, 0.001);
+}
+
+-(void) testExternalFileReconcileSparesRelinkedFiles
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+
+  NSData *data = [NSData dataWithBytes:"relinked" length:8];
+  NSString *fileName = [dao.externalFileStore storeDataReference:[MemoryDataReference.alloc initWithData:data ofMIMEType:@"application/octet-stream"] error:nil];
+  XCTAssertNotNil(fileName);
+  NSURL *URL = [NSURL URLWithString:fileName relativeToURL:self.dbManager.URL];
+
+  // The snapshot misses the file, as when it is stored again between the scan & the unlink
+  StaleSnapshotFileOwner *owner = [StaleSnapshotFileOwner new];
+  owner.dao = dao;
+
+  ExternalFileCollector *collector = [ExternalFileCollector.alloc initWithDBManager:self.dbManager];
+  collector.owner = owner;
+  collector.orphanGracePeriod = 0;
+
+  XCTAssertTrue([collector reconcileAndReturnError:nil]);
+  XCTAssertTrue([URL checkResourceIsReachableAndReturnError:nil]);
+  XCTAssertEqual(collector.metrics.orphansReclaimed, 0);
+}
+
+-(void) testDeletedMessageFilter
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+
+  NSMutableArray<Id *> *deletedIds = [NSMutableArray array];
+  for (int c = 0; c < 200; ++c) {
+    Id *msgId = [Id generate];
+    [dao markMessageDeletedWithId:msgId];
+    [deletedIds addObject:msgId];
+  }
+
+  for (Id *msgId in deletedIds) {
+    XCTAssertTrue([dao isMessageDeletedWithId:msgId]);
+  }
+
+  for (int c = 0; c < 1000; ++c) {
+    XCTAssertFalse([dao isMessageDeletedWithId:[Id generate]]);
+  }
+
+  // Only possible tombstones reach the database
+  DeletedMessageFilterMetrics *metrics = dao.deletedMessageFilter.metrics;
+  XCTAssertEqual(metrics.lookups, 1200);
+  XCTAssertEqual(metrics.databaseLookups, 200 + metrics.falsePositives);
+  XCTAssertLessThan(metrics.falsePositives, 50);
+
+  XCTAssertTrue([dao.deletedMessageFilter rebuildAndVerifyReturningError:nil]);
+}
+
+-(void) testDeletedMessageFilterCatchesUpAfterReopen
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+
+  Id *savedId = [Id generate];
+  [dao markMessageDeletedWithId:savedId];
+  XCTAssertTrue([dao.deletedMessageFilter saveAndReturnError:nil]);
+
+  // Marked after the last save
+  Id *unsavedId = [Id generate];
+  [dao markMessageDeletedWithId:unsavedId];
+
+  [self.dbManager shutdown];
+  self.dbManager = [DBManager.alloc initWithPath:self.dbPath
+                                            kind:@"Message"
+                                      daoClasses:@[[MessageDAO class],
+                                                   [ChatDAO class]]
+                                           error:nil];
+  dao = self.dbManager[@"Message"];
+
+  XCTAssertTrue([dao isMessageDeletedWithId:savedId]);
+  XCTAssertTrue([dao isMessageDeletedWithId:unsavedId]);
+  XCTAssertEqual(dao.deletedMessageFilter.count, 2);
+  XCTAssertEqual(dao.deletedMessageFilter.metrics.rebuilds, 0);
+}
+
+-(void) testDeletedMessageFilterCompact
+{
+  MessageDAO *dao = self.dbManager[@"Message"];
+
+  Id *msgId = [Id generate];
+  [dao markMessageDeletedWithId:msgId];
+  XCTAssertTrue([dao isMessageDeletedWithId:msgId]);
+
+  dao.deletedMessageFilter.retentionInterval = 60;
+  XCTAssertTrue([dao.deletedMessageFilter compactAndReturnError:nil]);
+  XCTAssertTrue([dao isMessageDeletedWithId:msgId]);
+
+  dao.deletedMessageFilter.retentionInterval = 0;
+  XCTAssertTrue([dao.deletedMessageFilter compactAndReturnError:nil]);
+  XCTAssertFalse([dao isMessageDeletedWithId:msgId]);
+
+  DeletedMessageFilterMetrics *metrics = dao.deletedMessageFilter.metrics;
+  XCTAssertEqual(metrics.tombstonesCompacted, 1);
+  XCTAssertNotNil(metrics.lastCompacted);
+  XCTAssertEqual(dao.deletedMessageFilter.count, 0);
+}
+
+-(void) testSchemaCacheReusedAfterReopen
+{
+  NSURL *schemaCacheURL = self.dbManager.schemaCacheURL;
+  XCTAssertTrue([NSFileManager.defaultManager fileExistsAtPath:schemaCacheURL.path]);
+
+  NSDictionary *messageTableInfo = [self.dbManager[@"Message"] tableInfo].propertyList;
+  NSDictionary *chatTableInfo = [self.dbManager[@"Chat"] tableInfo].propertyList;
+
+  NSData *schemaCache = [NSData dataWithContentsOfURL:schemaCacheURL];
+
+  [self.dbManager shutdown];
+
+  StartupTrace *trace = [StartupTrace.alloc initWithName:@"Test"];
+  self.dbManager = [DBManager.alloc initWithPath:self.dbPath
+                                            kind:@"Message"
+                                      daoClasses:@[[MessageDAO class],
+                                                   [ChatDAO class]]
+                                           trace:trace
+                                           error:nil];
+  XCTAssertNotNil(self.dbManager);
+
+  XCTAssertEqualObjects([self.dbManager[@"Message"] tableInfo].propertyList, messageTableInfo);
+  XCTAssertEqualObjects([self.dbManager[@"Chat"] tableInfo].propertyList, chatTableInfo);
+
+  // Served from the cache, so it was not rewritten
+  XCTAssertEqualObjects([NSData dataWithContentsOfURL:schemaCacheURL], schemaCache);
+
+  for (NSString *phase in @[@"db.open", @"db.migrate", @"db.schema", @"db.daos"]) {
+    XCTAssertNotNil(trace.phaseDurations[phase], @"%@", phase);
+  }
+}
+
+-(void) testSchemaCacheInvalidatedBySchemaChange
+{
+  [self.dbManager.pool inWritableDatabase:^(FMDatabase *db) {
+    XCTAssertTrue([db executeStatements:@"ALTER TABLE message ADD COLUMN extra TEXT"]);
+  }];
+
+  [self.dbManager shutdown];
+  self.dbManager = [DBManager.alloc initWithPath:self.dbPath
+                                            kind:@"Message"
+                                      daoClasses:@[[MessageDAO class],
+                                                   [ChatDAO class]]
+                                           error:nil];
+
+  XCTAssertTrue([[self.dbManager[@"Message"] tableInfo].fieldNames containsObject:@"extra"]);
+
+  // Corrupt caches are ignored & replaced
+  XCTAssertTrue([[@"garbage" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:self.dbManager.schemaCacheURL atomically:YES]);
+
+  [self.dbManager shutdown];
+  self.dbManager = [DBManager.alloc initWithPath:self.dbPath
+                                            kind:@"Message"
+                                      daoClasses:@[[MessageDAO class],
+                                                   [ChatDAO class]]
+                                           error:nil];
+
+  XCTAssertTrue([[self.dbManager[@"Message"] tableInfo].fieldNames containsObject:@"extra"]);
+
+  NSData *schemaCache = [NSData dataWithContentsOfURL:self.dbManager.schemaCacheURL];
+  XCTAssertNotNil([NSPropertyListSerialization propertyListWithData:schemaCache options:0 format:NULL error:nil]);
+}
+
 -(void) testLocationMessagePayload
 {
   XCTestExpectation *expectation = [self expectationWithDescription:@"Location Message"];
@@ -652,4 +1117,14 @@
   [_deleted addObject:model.id];
 }
 
+-(void) modelObjectsWithDbIds:(NSArray *)dbIds updatedInDAO:(DAO *)dao
+{
+  [_updated addObjectsFromArray:dbIds];
+}
+
+-(void) modelObjectsWithDbIds:(NSArray *)dbIds deletedInDAO:(DAO *)dao
+{
+  [_deleted addObjectsFromArray:dbIds];
+}
+
 @end
@@ -2,3 +2,7 @@
 //  Use this file to import your target's public headers that you would like to expose to Swift.
 //
 
+
+#import "NSData+Random.h"
+#import "NSData+CommonDigest.h"
+#import "TestHTTPServer.h"
@@ -9,6 +9,11 @@
 #import <XCTest/XCTest.h>
 
 #import "MsgCipher.h"
+#import "DataReferences.h"
+#import "MemoryDataReference.h"
+#import "NSData+CommonDigest.h"
+#import "NSData+Random.h"
+#import "NSURL+Utils.h"
 
 
 @interface MsgCipherTests : XCTestCase
@@ -46,4 +51,65 @@
   XCTAssertEqualObjects(src, dst, @"Round Trip Failed");
 }
 
+-(void) testStreamEncryptToURL
+{
+  MsgCipher *cipher = [MsgCipher cipherForEncryptionType:EncryptionTypeVer1_AES256_CBC];
+  
+  NSData *key = [cipher randomKeyWithError:nil];
+  
+  NSData *src = [NSData dataWithRandomBytesOfLength:300 * 1024 + 7];
+  MemoryDataReference *srcRef = [MemoryDataReference.alloc initWithData:src ofMIMEType:@"application/octet-stream"];
+  
+  NSURL *dstURL = [NSURL URLForTemporaryFileWithExtension:@"send"];
+  
+  unsigned long long length = 0;
+  NSData *digest;
+  NSError *error;
+  URLDataReference *dstRef = [DataReferences filterReference:srcRef
+                                                       toURL:dstURL
+                                                 usingFilter:^BOOL(id<DataInputStream> ins, id<DataOutputStream> outs, NSError **error) {
+                                                   return [cipher encryptFromStream:ins toStream:outs withKey:key error:error];
+                                                 }
+                                                      length:&length
+                                                      digest:&digest
+                                                       error:&error];
+  XCTAssertNotNil(dstRef, @"Error: %@", error);
+  
+  NSData *cipherText = [NSData dataWithContentsOfURL:dstURL];
+  XCTAssertEqual(length, cipherText.length);
+  XCTAssertEqualObjects(digest, cipherText.sha256);
+  XCTAssertEqualObjects([cipher decryptData:cipherText withKey:key error:nil], src);
+  
+  [NSFileManager.defaultManager removeItemAtURL:dstURL error:nil];
+}
+
+-(void) testStreamEncryptToURLPerformance
+{
+  MsgCipher *cipher = [MsgCipher cipherForEncryptionType:EncryptionTypeVer1_AES256_CBC];
+  
+  NSData *key = [cipher randomKeyWithError:nil];
+  
+  NSURL *srcURL = [NSURL URLForTemporaryFileWithExtension:@"bin"];
+  [[NSData dataWithRandomBytesOfLength:32 * 1024 * 1024] writeToURL:srcURL atomically:NO];
+  URLDataReference *srcRef = [URLDataReference.alloc initWithURL:srcURL];
+  
+  [self measureBlock:^{
+    
+    NSURL *dstURL = [NSURL URLForTemporaryFileWithExtension:@"send"];
+    
+    [DataReferences filterReference:srcRef
+                              toURL:dstURL
+                        usingFilter:^BOOL(id<DataInputStream> ins, id<DataOutputStream> outs, NSError **error) {
+                          return [cipher encryptFromStream:ins toStream:outs withKey:key error:error];
+                        }
+                             length:NULL
+                             digest:NULL
+                              error:nil];
+    
+    [NSFileManager.defaultManager removeItemAtURL:dstURL error:nil];
+  }];
+  
+  [NSFileManager.defaultManager removeItemAtURL:srcURL error:nil];
+}
+
 @end
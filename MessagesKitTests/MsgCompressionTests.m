@@ -0,0 +1,213 @@
+//
+//  MsgCompressionTests.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MsgCompression.h"
+#import "MsgCipher.h"
+#import "NSData+Random.h"
+
+
+@interface MsgCompressionTests : XCTestCase
+
+@end
+
+
+@implementation MsgCompressionTests
+
+-(NSData *) resourceNamed:(NSString *)name withExtension:(NSString *)extension
+{
+  return [NSData dataWithContentsOfURL:[[NSBundle bundleForClass:self.class] URLForResource:name withExtension:extension]];
+}
+
+-(NSData *) htmlPayload
+{
+  NSMutableString *html = [NSMutableString stringWithString:@"<html><body>"];
+  for (int c = 0; c < 40; ++c) {
+    [html appendFormat:@"<p style=\"font-family: Helvetica; color: #333333\">Paragraph %d of a formatted <b>message</b> body.</p>", c];
+  }
+  [html appendString:@"</body></html>"];
+  return [html dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+-(NSData *) textPayload
+{
+  return [@"Running late, be there in about twenty minutes. Grab us a table near the window if you can, and order the usual for me. "
+          "If they are out of the usual just pick something, I trust you. See you soon!" dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+-(void) testRoundTrip
+{
+  NSData *src = self.htmlPayload;
+
+  NSError *error;
+  NSData *deflated = [MsgCompression deflateData:src error:&error];
+  XCTAssertNotNil(deflated, @"Error: %@", error);
+  XCTAssertLessThan(deflated.length, src.length);
+
+  XCTAssertEqualObjects([MsgCompression inflateData:deflated error:nil], src);
+}
+
+-(void) testRoundTripLarge
+{
+  // Larger than the internal buffers in both directions
+  NSMutableData *src = [NSMutableData data];
+  for (int c = 0; c < 64; ++c) {
+    [src appendData:self.htmlPayload];
+  }
+  [src appendData:[NSData dataWithRandomBytesOfLength:32 * 1024]];
+
+  NSData *deflated = [MsgCompression deflateData:src error:nil];
+
+  XCTAssertEqualObjects([MsgCompression inflateData:deflated error:nil], src);
+}
+
+-(void) testTruncated
+{
+  NSData *deflated = [MsgCompression deflateData:self.htmlPayload error:nil];
+
+  NSError *error;
+  XCTAssertNil([MsgCompression inflateData:[deflated subdataWithRange:NSMakeRange(0, deflated.length / 2)] error:&error]);
+  XCTAssertEqualObjects(error.domain, MsgCompressionErrorDomain);
+  XCTAssertEqual(error.code, MsgCompressionErrorTruncated);
+}
+
+-(void) testInflateSizeLimit
+{
+  // Highly compressible, the deflated bytes are a tiny fraction of the inflated
+  NSData *src = [NSMutableData dataWithLength:4 * 1024 * 1024];
+  NSData *deflated = [MsgCompression deflateData:src error:nil];
+  XCTAssertLessThan(deflated.length, src.length / 512);
+
+  NSOutputStream *outStream = [NSOutputStream outputStreamToMemory];
+  [outStream open];
+
+  MsgInflatingOutputStream *inflateStream = [MsgInflatingOutputStream.alloc initWithOutputStream:outStream maximumLength:src.length - 1];
+
+  NSError *error;
+  XCTAssertFalse([inflateStream writeBytesFromBuffer:deflated.bytes length:deflated.length error:&error]);
+  XCTAssertEqualObjects(error.domain, MsgCompressionErrorDomain);
+  XCTAssertEqual(error.code, MsgCompressionErrorSizeLimit);
+
+  // Output stops at the limit rather than after inflating everything
+  XCTAssertLessThan([[outStream propertyForKey:NSStreamDataWrittenToMemoryStreamKey] length], src.length);
+
+  // Exactly at the limit succeeds
+  outStream = [NSOutputStream outputStreamToMemory];
+  [outStream open];
+
+  inflateStream = [MsgInflatingOutputStream.alloc initWithOutputStream:outStream maximumLength:src.length];
+
+  XCTAssertTrue([inflateStream writeBytesFromBuffer:deflated.bytes length:deflated.length error:&error], @"Error: %@", error);
+  XCTAssertTrue([inflateStream finishAndReturnError:&error], @"Error: %@", error);
+}
+
+-(void) testMaximumInflatedSizeForCompressedSize
+{
+  XCTAssertEqual([MsgCompression maximumInflatedSizeForCompressedSize:100], 100 * 1032);
+  XCTAssertEqual([MsgCompression maximumInflatedSizeForCompressedSize:UINT64_MAX], MsgCompression.maximumInflatedSize);
+}
+
+-(void) testCompressThenEncrypt
+{
+  MsgCipher *cipher = [MsgCipher defaultCipher];
+  NSData *key = [cipher randomKeyWithError:nil];
+
+  NSData *src = [self resourceNamed:@"test" withExtension:@"vcf"];
+
+  NSInputStream *inStream = [NSInputStream inputStreamWithData:src];
+  [inStream open];
+
+  NSOutputStream *encryptedStream = [NSOutputStream outputStreamToMemory];
+  [encryptedStream open];
+
+  NSError *error;
+  XCTAssertTrue([cipher encryptFromStream:[MsgDeflatingInputStream.alloc initWithInputStream:inStream]
+                                 toStream:encryptedStream
+                                  withKey:key
+                                    error:&error], @"Error: %@", error);
+
+  NSData *encrypted = [encryptedStream propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+
+  NSInputStream *decryptStream = [NSInputStream inputStreamWithData:encrypted];
+  [decryptStream open];
+
+  NSOutputStream *outStream = [NSOutputStream outputStreamToMemory];
+  [outStream open];
+
+  MsgInflatingOutputStream *inflateStream = [MsgInflatingOutputStream.alloc initWithOutputStream:outStream];
+
+  XCTAssertTrue([cipher decryptFromStream:decryptStream toStream:inflateStream withKey:key error:&error], @"Error: %@", error);
+  XCTAssertTrue([inflateStream finishAndReturnError:&error], @"Error: %@", error);
+
+  XCTAssertEqualObjects([outStream propertyForKey:NSStreamDataWrittenToMemoryStreamKey], src);
+}
+
+-(void) testShouldCompress
+{
+  XCTAssertFalse([MsgCompression shouldCompressPayloadOfType:MsgTypeText size:MsgCompression.minimumCompressibleSize - 1]);
+  XCTAssertTrue([MsgCompression shouldCompressPayloadOfType:MsgTypeText size:MsgCompression.minimumCompressibleSize]);
+  XCTAssertTrue([MsgCompression shouldCompressPayloadOfType:MsgTypeContact size:64 * 1024]);
+  XCTAssertFalse([MsgCompression shouldCompressPayloadOfType:MsgTypeImage size:64 * 1024]);
+}
+
+// Bytes saved against CPU cost for each payload type; results are logged
+-(void) testBenchmarkPayloadTypes
+{
+  NSDictionary<NSString *, NSData *> *payloads = @{@"text/plain": self.textPayload,
+                                                   @"text/html": self.htmlPayload,
+                                                   @"text/vcard": [self resourceNamed:@"test" withExtension:@"vcf"],
+                                                   @"image/png": [self resourceNamed:@"test" withExtension:@"png"]};
+
+  MsgCipher *cipher = [MsgCipher defaultCipher];
+  NSData *key = [cipher randomKeyWithError:nil];
+
+  const int iterations = 200;
+
+  for (NSString *type in [payloads.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+
+    NSData *payload = payloads[type];
+
+    NSData *deflated = [MsgCompression deflateData:payload error:nil];
+    NSData *plainCipherText = [cipher encryptData:payload withKey:key error:nil];
+    NSData *deflatedCipherText = [cipher encryptData:deflated withKey:key error:nil];
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (int c = 0; c < iterations; ++c) {
+      [MsgCompression deflateData:payload error:nil];
+    }
+    CFAbsoluteTime deflateTime = (CFAbsoluteTimeGetCurrent() - start) / iterations;
+
+    start = CFAbsoluteTimeGetCurrent();
+    for (int c = 0; c < iterations; ++c) {
+      [MsgCompression inflateData:deflated error:nil];
+    }
+    CFAbsoluteTime inflateTime = (CFAbsoluteTimeGetCurrent() - start) / iterations;
+
+    NSLog(@"%-10@ %7lu bytes -> %7lu wire bytes (saved %6ld, %5.1f%%), deflate %7.1fus, inflate %7.1fus",
+          type, (unsigned long)payload.length, (unsigned long)deflatedCipherText.length,
+          (long)plainCipherText.length - (long)deflatedCipherText.length,
+          100.0 * (1.0 - (double)deflatedCipherText.length / plainCipherText.length),
+          deflateTime * 1e6, inflateTime * 1e6);
+
+    XCTAssertEqualObjects([MsgCompression inflateData:deflated error:nil], payload);
+  }
+}
+
+-(void) testDeflatePerformance
+{
+  NSData *src = self.htmlPayload;
+
+  [self measureBlock:^{
+    for (int c = 0; c < 100; ++c) {
+      [MsgCompression deflateData:src error:nil];
+    }
+  }];
+}
+
+@end
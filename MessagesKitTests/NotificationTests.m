@@ -9,6 +9,7 @@
 #import <XCTest/XCTest.h>
 
 #import "NotificationDAO.h"
+#import "UserChat.h"
 #import "Messages+Exts.h"
 
 
@@ -149,6 +150,65 @@
   XCTAssertTrue([_deleted containsObject:not2.id]);
 }
 
+-(void) testNotificationFetchFiringOnOrBefore
+{
+  UserChat *chat = [UserChat new];
+  chat.id = [Id generate];
+
+  NSDate *now = [NSDate date];
+
+  SavedNotification *fired = [SavedNotification new];
+  fired.msgId = [Id generate];
+  fired.chatId = chat.id;
+  fired.fireDate = [now dateByAddingTimeInterval:-60];
+
+  SavedNotification *pending = [SavedNotification new];
+  pending.msgId = [Id generate];
+  pending.chatId = chat.id;
+  pending.fireDate = [now dateByAddingTimeInterval:60];
+
+  SavedNotification *unindexed = [SavedNotification new];
+  unindexed.msgId = [Id generate];
+  unindexed.chatId = chat.id;
+
+  SavedNotification *otherChat = [SavedNotification new];
+  otherChat.msgId = [Id generate];
+  otherChat.chatId = [Id generate];
+  otherChat.fireDate = fired.fireDate;
+
+  for (SavedNotification *not in @[fired, pending, unindexed, otherChat]) {
+    XCTAssertTrue([self.dao insertNotification:not error:nil]);
+  }
+
+  NSArray *matched = [self.dao fetchAllNotificationsForChat:chat firingOnOrBefore:now error:nil];
+  XCTAssertEqualObjects([NSSet setWithArray:[matched valueForKey:@"msgId"]], ([NSSet setWithObjects:fired.msgId, unindexed.msgId, nil]));
+}
+
+-(void) testNotificationDeleteAllWithIds
+{
+  NSMutableArray *ids = [NSMutableArray array];
+  for (int c = 0; c < 300; ++c) {
+    SavedNotification *not = [SavedNotification new];
+    not.msgId = [Id generate];
+    not.chatId = [Id generate];
+    not.fireDate = [NSDate date];
+    XCTAssertTrue([self.dao insertNotification:not error:nil]);
+    [ids addObject:not.msgId];
+  }
+
+  SavedNotification *kept = [SavedNotification new];
+  kept.msgId = [Id generate];
+  kept.chatId = [Id generate];
+  XCTAssertTrue([self.dao insertNotification:kept error:nil]);
+
+  XCTAssertTrue([self.dao deleteAllNotificationsWithIds:ids error:nil]);
+  XCTAssertTrue([_deleted isSupersetOfSet:[NSSet setWithArray:ids]]);
+
+  NSArray *remaining = [self.dao fetchAllNotificationsMatching:nil parameters:nil error:nil];
+  XCTAssertEqual(remaining.count, 1);
+  XCTAssertEqualObjects([remaining.firstObject msgId], kept.msgId);
+}
+
 -(void) modelObject:(Model *)model insertedInDAO:(DAO *)dao
 {
   [_inserted addObject:model.id];
@@ -164,4 +224,9 @@
   [_deleted addObject:model.id];
 }
 
-@end
+-(void) modelObjectsWithDbIds:(NSArray *)dbIds deletedInDAO:(DAO *)dao
+{
+  [_deleted addObjectsFromArray:dbIds];
+}
+
+@end
\ No newline at end of file
@@ -0,0 +1,124 @@
+//
+//  OperationLanesTests.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import XCTest
+import PSOperations
+@testable import MessagesKit
+
+
+class OperationLanesTests: XCTestCase {
+
+  func testBacklogDoesNotDelayInteractive() {
+
+    let lanes = OperationLanes(name: "Test")
+
+    // Maintenance backlog, holding every slot of the lane
+    let release = dispatch_semaphore_create(0)
+    for _ in 0..<20 {
+      lanes.addOperation(BlockOperation { continuation in
+        dispatch_semaphore_wait(release, DISPATCH_TIME_FOREVER)
+        continuation()
+      }, lane: .Maintenance)
+    }
+
+    let interactive = expectationWithDescription("interactive")
+    lanes.addOperationWithBlock(lane: .Interactive) {
+      interactive.fulfill()
+    }
+
+    waitForExpectationsWithTimeout(1, handler: nil)
+
+    for _ in 0..<20 {
+      dispatch_semaphore_signal(release)
+    }
+
+    lanes[.Maintenance].waitUntilAllOperationsAreFinished()
+
+    XCTAssertEqual(lanes.statisticsForLane(.Maintenance).started, 20)
+  }
+
+  func testConcurrencyLimits() {
+
+    let lanes = OperationLanes(name: "Test")
+
+    for lane in OperationLane.all {
+
+      var running = 0
+      var maxRunning = 0
+      let lock = NSLock()
+
+      for _ in 0..<(lane.maxConcurrentOperationCount * 3) {
+        lanes.addOperationWithBlock(lane: lane) {
+          lock.lock(); running += 1; maxRunning = max(maxRunning, running); lock.unlock()
+          NSThread.sleepForTimeInterval(0.02)
+          lock.lock(); running -= 1; lock.unlock()
+        }
+      }
+
+      lanes[lane].waitUntilAllOperationsAreFinished()
+
+      XCTAssertLessThanOrEqual(maxRunning, lane.maxConcurrentOperationCount, "\(lane.name)")
+    }
+  }
+
+  func testWaitStatistics() {
+
+    let lanes = OperationLanes(name: "Test")
+
+    // Last operation waits for the others to release the lane
+    let count = OperationLane.Maintenance.maxConcurrentOperationCount + 1
+    for _ in 0..<count {
+      lanes.addOperationWithBlock(lane: .Maintenance) {
+        NSThread.sleepForTimeInterval(0.2)
+      }
+    }
+
+    lanes[.Maintenance].waitUntilAllOperationsAreFinished()
+
+    let statistics = lanes.statisticsForLane(.Maintenance)
+    XCTAssertEqual(statistics.started, count)
+    XCTAssertGreaterThanOrEqual(statistics.maxWait, 0.15)
+    XCTAssertLessThan(statistics.averageWait, statistics.maxWait)
+  }
+
+  func testAgingRaisesWaitingOperations() {
+
+    let lanes = OperationLanes(name: "Test", agingInterval: 0.2)
+
+    let release = dispatch_semaphore_create(0)
+    for _ in 0..<OperationLane.Maintenance.maxConcurrentOperationCount {
+      lanes.addOperation(BlockOperation { continuation in
+        dispatch_semaphore_wait(release, DISPATCH_TIME_FOREVER)
+        continuation()
+      }, lane: .Maintenance)
+    }
+
+    let waiting = BlockOperation { continuation in continuation() }
+    lanes.addOperation(waiting, lane: .Maintenance)
+
+    NSThread.sleepForTimeInterval(0.7)
+
+    XCTAssertEqual(waiting.qualityOfService, NSQualityOfService.UserInitiated)
+    XCTAssertTrue(waiting.queuePriority.rawValue > NSOperationQueuePriority.Normal.rawValue)
+
+    for _ in 0..<OperationLane.Maintenance.maxConcurrentOperationCount {
+      dispatch_semaphore_signal(release)
+    }
+
+    lanes[.Maintenance].waitUntilAllOperationsAreFinished()
+  }
+
+  func testRaisedLadders() {
+
+    XCTAssertEqual(OperationLanes.qualityOfServiceRaised(.Background, steps: 1), NSQualityOfService.Utility)
+    XCTAssertEqual(OperationLanes.qualityOfServiceRaised(.Background, steps: 10), NSQualityOfService.UserInitiated)
+    XCTAssertEqual(OperationLanes.priorityRaised(.Normal, steps: 1), NSOperationQueuePriority.High)
+    XCTAssertEqual(OperationLanes.priorityRaised(.Normal, steps: 10), NSOperationQueuePriority.VeryHigh)
+  }
+
+}
@@ -0,0 +1,162 @@
+//
+//  OperationTracerTests.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import XCTest
+import PSOperations
+@testable import MessagesKit
+
+
+class OperationTracerTests: XCTestCase {
+
+  let queue = OperationQueue()
+
+  let tracer = OperationTracer()
+
+  override func setUp() {
+    super.setUp()
+
+    tracer.enabled = true
+  }
+
+  func run(operation: Operation) {
+
+    let finished = expectationWithDescription("finished")
+    operation.addObserver(BlockObserver(finishHandler: { op, errs in
+      finished.fulfill()
+    }))
+
+    queue.addOperation(operation)
+
+    waitForExpectationsWithTimeout(10, handler: nil)
+  }
+
+  func sleepingOperation(interval: NSTimeInterval) -> Operation {
+    return BlockOperation(block: { completion in
+      NSThread.sleepForTimeInterval(interval)
+      completion()
+    })
+  }
+
+  func testDisabledBeginsNoTrace() {
+
+    tracer.enabled = false
+
+    XCTAssertNil(tracer.beginTrace("test"))
+  }
+
+  func testStagesRecordWaitAndExecution() {
+
+    let trace = tracer.beginTrace("test")!
+
+    let first = sleepingOperation(0.1)
+    let second = sleepingOperation(0.05)
+    second.addDependency(first)
+
+    let group = GroupOperation(operations: [])
+    trace.addStage(group, named: "group")
+    trace.addStage(first, named: "first")
+    trace.addStage(second, named: "second")
+    group.addOperation(first)
+    group.addOperation(second)
+
+    run(group)
+
+    let spans = tracer.spansForTraceId("test")
+    XCTAssertEqual(spans.map { $0.stage }.sort(), ["first", "group", "second"])
+
+    let firstSpan = spans.filter { $0.stage == "first" }.first!
+    let secondSpan = spans.filter { $0.stage == "second" }.first!
+    let groupSpan = spans.filter { $0.stage == "group" }.first!
+
+    XCTAssertGreaterThanOrEqual(firstSpan.executionTime, 0.1)
+    XCTAssertLessThan(firstSpan.waitTime, 0.05)
+
+    // Second waits on first, then runs
+    XCTAssertGreaterThanOrEqual(secondSpan.waitTime, 0.09)
+    XCTAssertGreaterThanOrEqual(secondSpan.executionTime, 0.05)
+    XCTAssertGreaterThanOrEqual(secondSpan.started, firstSpan.finished)
+
+    XCTAssertGreaterThanOrEqual(groupSpan.executionTime, 0.15)
+    XCTAssertFalse(spans.contains { $0.failed })
+
+    let timings = tracer.stageTimings
+    XCTAssertEqual(timings["second"]?.execution.count, 1)
+    XCTAssertEqual(timings["second"]?.failures, 0)
+
+    XCTAssertTrue(tracer.report().containsString("second: wait"))
+
+    tracer.reset()
+    XCTAssertTrue(tracer.recentSpans.isEmpty)
+    XCTAssertTrue(tracer.stageTimings.isEmpty)
+  }
+
+  func testRetryAttemptsAreTraced() {
+
+    let trace = tracer.beginTrace("retry")!
+
+    var attempts = 0
+
+    let retry = RetryOperation(maxAttempts: 3) {
+      attempts += 1
+      return attempts < 3 ? TracedFailingOperation() : BlockOperation(block: { $0() })
+    }
+    retry.budget = RetryBudget(capacity: 10, successDeposit: 0)
+    retry.backoff = RetryBackoff(baseDelay: 0.1, maxDelay: 1)
+
+    trace.addStage(retry, named: "transmit")
+    retry.traceAttempts(trace, stage: "transmit")
+
+    run(retry)
+
+    let spans = tracer.spansForTraceId("retry")
+    let attemptSpans = spans.filter { $0.attempt > 0 }.sort { $0.attempt < $1.attempt }
+
+    XCTAssertEqual(attemptSpans.map { $0.attempt }, [1, 2, 3])
+    XCTAssertEqual(attemptSpans.map { $0.failed }, [true, true, false])
+
+    // Backoff is attributed to the retried attempts' wait
+    XCTAssertGreaterThanOrEqual(attemptSpans[1].waitTime, 0.05)
+    XCTAssertGreaterThanOrEqual(attemptSpans[2].waitTime, 0.1)
+
+    let timings = tracer.stageTimings
+    XCTAssertEqual(timings["transmit"]?.execution.count, 1)
+    XCTAssertEqual(timings["transmit.attempt"]?.execution.count, 3)
+    XCTAssertEqual(timings["transmit.attempt"]?.failures, 2)
+  }
+
+  func testChromeTrace() throws {
+
+    let trace = tracer.beginTrace("chrome")!
+
+    let operation = sleepingOperation(0.01)
+    trace.addStage(operation, named: "only")
+
+    run(operation)
+
+    let json = try NSJSONSerialization.JSONObjectWithData(try tracer.chromeTrace(), options: []) as! [String: AnyObject]
+    let events = json["traceEvents"] as! [[String: AnyObject]]
+
+    let executions = events.filter { $0["ph"] as? String == "X" && $0["cat"] as? String == "execute" }
+    XCTAssertEqual(executions.count, 1)
+    XCTAssertEqual(executions.first?["name"] as? String, "only")
+    XCTAssertGreaterThanOrEqual(executions.first?["dur"] as? Double ?? 0, 10_000)
+
+    let processNames = events.filter { $0["name"] as? String == "process_name" }
+    XCTAssertEqual((processNames.first?["args"] as? [String: AnyObject])?["name"] as? String, "chrome")
+  }
+
+}
+
+
+private class TracedFailingOperation : Operation {
+
+  override func execute() {
+    finishWithError(NSError(domain: NSURLErrorDomain, code: NSURLErrorTimedOut, userInfo: nil))
+  }
+
+}
@@ -0,0 +1,110 @@
+//
+//  ReceiveWatermarkTests.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import XCTest
+@testable import MessagesKit
+
+
+class ReceiveWatermarkTests: XCTestCase {
+
+  var fileURL : NSURL!
+
+  override func setUp() {
+    super.setUp()
+
+    fileURL = NSURL(fileURLWithPath: NSTemporaryDirectory()).URLByAppendingPathComponent(NSUUID().UUIDString + ".watermark")
+  }
+
+  override func tearDown() {
+
+    let _ = try? NSFileManager.defaultManager().removeItemAtURL(fileURL)
+
+    super.tearDown()
+  }
+
+  func testOutOfOrderCompletionHoldsBelowPending() {
+
+    let watermark = ReceiveWatermark(fileURL: fileURL)
+    XCTAssertEqual(watermark.value, 0)
+
+    let a = Id.generate(), b = Id.generate(), c = Id.generate()
+
+    watermark.begin(a, sent: 100)
+    watermark.begin(b, sent: 200)
+    watermark.begin(c, sent: 300)
+
+    // Held below the oldest pending message
+    watermark.complete(c, sent: 300)
+    XCTAssertEqual(watermark.value, 99)
+
+    watermark.complete(a, sent: 100)
+    XCTAssertEqual(watermark.value, 199)
+
+    watermark.complete(b, sent: 200)
+    XCTAssertEqual(watermark.value, 300)
+  }
+
+  func testFailedMessageHoldsUntilReceivedAgain() {
+
+    let watermark = ReceiveWatermark(fileURL: fileURL)
+
+    let failed = Id.generate(), later = Id.generate()
+
+    watermark.begin(failed, sent: 100)
+    watermark.begin(later, sent: 200)
+
+    // `failed` is never completed
+    watermark.complete(later, sent: 200)
+    XCTAssertEqual(watermark.value, 99)
+
+    // Fetched & processed again
+    watermark.begin(failed, sent: nil)
+    XCTAssertEqual(watermark.value, 99)
+
+    watermark.complete(failed, sent: 100)
+    XCTAssertEqual(watermark.value, 200)
+  }
+
+  func testHeaderHoldsUntilProcessed() {
+
+    let watermark = ReceiveWatermark(fileURL: fileURL)
+
+    let first = Id.generate(), announced = Id.generate(), delivered = Id.generate()
+
+    watermark.begin(first, sent: 100)
+    watermark.complete(first, sent: 100)
+
+    // Sent time unknown until fetched
+    watermark.begin(announced, sent: nil)
+    watermark.begin(delivered, sent: 300)
+    watermark.complete(delivered, sent: 300)
+    XCTAssertEqual(watermark.value, 100)
+
+    watermark.complete(announced, sent: 200)
+    XCTAssertEqual(watermark.value, 300)
+  }
+
+  func testSavedForColdStart() {
+
+    let watermark = ReceiveWatermark(fileURL: fileURL)
+
+    let a = Id.generate(), b = Id.generate()
+
+    watermark.begin(a, sent: 100)
+    watermark.begin(b, sent: 200)
+    watermark.complete(b, sent: 200)
+
+    // Pending messages are not saved past
+    XCTAssertEqual(ReceiveWatermark(fileURL: fileURL).value, 99)
+
+    watermark.complete(a, sent: 100)
+
+    XCTAssertEqual(ReceiveWatermark(fileURL: fileURL).value, 200)
+  }
+
+}
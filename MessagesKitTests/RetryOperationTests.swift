@@ -0,0 +1,274 @@
+//
+//  RetryOperationTests.swift
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+import XCTest
+import PSOperations
+import Thrift
+@testable import MessagesKit
+
+
+class RetryOperationTests: XCTestCase {
+
+  let queue = OperationQueue()
+
+  let failure = NSError(domain: NSURLErrorDomain, code: NSURLErrorTimedOut, userInfo: nil)
+
+  override func setUp() {
+    super.setUp()
+
+    RetryStatistics.reset()
+  }
+
+  func runRetry(retry: RetryOperation) -> [NSError] {
+
+    var errors = [NSError]()
+
+    let finished = expectationWithDescription("finished")
+    retry.addObserver(BlockObserver(finishHandler: { op, errs in
+      errors = errs
+      finished.fulfill()
+    }))
+
+    queue.addOperation(retry)
+
+    waitForExpectationsWithTimeout(10, handler: nil)
+
+    return errors
+  }
+
+  func testRetriesAreDelayed() {
+
+    var attemptTimes = [CFAbsoluteTime]()
+
+    let retry = RetryOperation(maxAttempts: 3) {
+      return FailingOperation(error: self.failure) {
+        attemptTimes.append(CFAbsoluteTimeGetCurrent())
+      }
+    }
+    retry.budget = RetryBudget(capacity: 10, successDeposit: 0)
+    retry.backoff = RetryBackoff(baseDelay: 0.1, maxDelay: 1)
+
+    XCTAssertFalse(runRetry(retry).isEmpty)
+
+    // Backoff of at least 0.05s, then 0.1s, between the three attempts
+    XCTAssertEqual(attemptTimes.count, 3)
+    XCTAssertGreaterThanOrEqual(attemptTimes[1] - attemptTimes[0], 0.05)
+    XCTAssertGreaterThanOrEqual(attemptTimes[2] - attemptTimes[1], 0.1)
+
+    let statistics = RetryStatistics.current
+    XCTAssertEqual(statistics.retries, 2)
+    XCTAssertGreaterThanOrEqual(statistics.waitTime, 0.15)
+  }
+
+  func testSuccessIsNotRetried() {
+
+    var attempts = 0
+
+    let retry = RetryOperation(maxAttempts: 3, retryBlock: { completion in
+      attempts += 1
+      completion()
+    })
+
+    XCTAssertTrue(runRetry(retry).isEmpty)
+    XCTAssertEqual(attempts, 1)
+    XCTAssertEqual(RetryStatistics.current.retries, 0)
+  }
+
+  func testBackoffGrowsWithinBounds() {
+
+    let backoff = RetryBackoff(baseDelay: 1, maxDelay: 30)
+
+    for retry in UInt(0)..<10 {
+      let ceiling = min(30, pow(2, Double(retry)))
+      for _ in 0..<100 {
+        let delay = backoff.delayForRetry(retry)
+        XCTAssertGreaterThanOrEqual(delay, ceiling / 2)
+        XCTAssertLessThanOrEqual(delay, ceiling)
+      }
+    }
+  }
+
+  func testBudgetLimitsRetries() {
+
+    let budget = RetryBudget(capacity: 1, successDeposit: 0.5)
+
+    let retry = RetryOperation(maxAttempts: 5) {
+      return FailingOperation(error: self.failure)
+    }
+    retry.budget = budget
+    retry.backoff = RetryBackoff(baseDelay: 0.01, maxDelay: 0.01)
+
+    XCTAssertFalse(runRetry(retry).isEmpty)
+
+    let statistics = RetryStatistics.current
+    XCTAssertEqual(statistics.retries, 1)
+    XCTAssertEqual(statistics.budgetExhausted, 1)
+
+    budget.recordSuccess()
+    budget.recordSuccess()
+    XCTAssertTrue(budget.withdraw())
+    XCTAssertFalse(budget.withdraw())
+  }
+
+  func testBreakerOpensAndProbes() {
+
+    let breaker = CircuitBreaker(name: "test", failureThreshold: 3, cooldown: RetryBackoff(baseDelay: 0.2, maxDelay: 0.2))
+
+    for _ in 0..<3 {
+      XCTAssertTrue(breaker.allowRequest())
+      breaker.recordFailure()
+    }
+
+    XCTAssertTrue(breaker.isOpen)
+    XCTAssertFalse(breaker.allowRequest())
+
+    NSThread.sleepForTimeInterval(0.25)
+
+    // Single probe while half-open
+    XCTAssertTrue(breaker.allowRequest())
+    XCTAssertFalse(breaker.allowRequest())
+
+    breaker.recordSuccess()
+
+    XCTAssertFalse(breaker.isOpen)
+    XCTAssertTrue(breaker.allowRequest())
+    XCTAssertEqual(RetryStatistics.current.breakerTrips, 1)
+  }
+
+  func testOpenBreakerShedsLoad() {
+
+    let breaker = CircuitBreaker(name: "test", failureThreshold: 1)
+
+    var attempts = 0
+
+    let retry = RetryOperation(maxAttempts: 3) {
+      return FailingOperation(error: self.failure) { attempts += 1 }
+    }
+    retry.breaker = breaker
+    retry.budget = RetryBudget(capacity: 10, successDeposit: 0)
+    retry.backoff = RetryBackoff(baseDelay: 0.01, maxDelay: 0.01)
+
+    let errors = runRetry(retry)
+
+    // First failure trips the breaker, the retry is rejected without running
+    XCTAssertEqual(attempts, 1)
+    XCTAssertEqual(errors.last?.code, MessageAPIError.ServiceUnavailable.rawValue)
+    XCTAssertEqual(RetryStatistics.current.breakerRejections, 1)
+  }
+
+  func testCancelledProbeIsReleased() {
+
+    let breaker = CircuitBreaker(name: "test", failureThreshold: 1, cooldown: RetryBackoff(baseDelay: 0.1, maxDelay: 0.1))
+
+    XCTAssertTrue(breaker.allowRequest())
+    breaker.recordFailure()
+
+    NSThread.sleepForTimeInterval(0.15)
+
+    let started = expectationWithDescription("started")
+
+    let retry = RetryOperation(maxAttempts: 3) {
+      return HangingOperation { started.fulfill() }
+    }
+    retry.breaker = breaker
+
+    queue.addOperation(retry)
+
+    waitForExpectationsWithTimeout(10, handler: nil)
+
+    // Cancel the probe mid-flight
+    let finished = expectationWithDescription("finished")
+    retry.addObserver(BlockObserver(finishHandler: { _, _ in
+      finished.fulfill()
+    }))
+
+    retry.cancel()
+
+    waitForExpectationsWithTimeout(10, handler: nil)
+
+    // The probe neither closed nor reopened the breaker, another may go through
+    XCTAssertFalse(breaker.isOpen)
+    XCTAssertTrue(breaker.allowRequest())
+  }
+
+  func testApplicationErrorsDoNotCount() {
+
+    let breaker = CircuitBreaker(name: "test", failureThreshold: 1, cooldown: RetryBackoff(baseDelay: 0.1, maxDelay: 0.1))
+
+    XCTAssertTrue(breaker.allowRequest())
+    breaker.recordFailure()
+
+    NSThread.sleepForTimeInterval(0.15)
+
+    let authError = NSError(code: .AuthenticationError, userInfo: nil)
+
+    let retry = RetryOperation(maxAttempts: 3, failureErrors: [MessageAPIErrorDomain: MessageAPIError.AuthenticationError.rawValue], generator: {
+      return FailingOperation(error: authError)
+    })
+    retry.breaker = breaker
+
+    XCTAssertFalse(runRetry(retry).isEmpty)
+
+    // Probe released without reopening
+    XCTAssertFalse(breaker.isOpen)
+    XCTAssertTrue(breaker.allowRequest())
+    XCTAssertEqual(RetryStatistics.current.breakerTrips, 1)
+
+    XCTAssertFalse(CircuitBreaker.isEndpointFailure(NSError(code: .NetworkError, userInfo: [
+      NSUnderlyingErrorKey: NSError(domain: TTransportErrorDomain, code: 0, userInfo: ["statusCode": 404])])))
+    XCTAssertTrue(CircuitBreaker.isEndpointFailure(NSError(code: .NetworkError, userInfo: [
+      NSUnderlyingErrorKey: NSError(domain: TTransportErrorDomain, code: 0, userInfo: ["statusCode": 503])])))
+    XCTAssertTrue(CircuitBreaker.isEndpointFailure(failure))
+  }
+
+  func testBreakersSharedPerEndpoint() {
+
+    let url = NSURL(string: "https://example.com/api/user")!
+
+    XCTAssertTrue(CircuitBreaker.breakerForEndpoint(url) === CircuitBreaker.breakerForEndpoint(url))
+    XCTAssertFalse(CircuitBreaker.breakerForEndpoint(url) === CircuitBreaker.breakerForEndpoint(url.URLByAppendingPathComponent("send")))
+  }
+
+}
+
+
+// Runs the attempt block then fails with the given error
+private class FailingOperation : Operation {
+
+  let error : NSError
+  let attempt : () -> Void
+
+  init(error: NSError, attempt: () -> Void = {}) {
+    self.error = error
+    self.attempt = attempt
+    super.init()
+  }
+
+  override func execute() {
+    attempt()
+    finishWithError(error)
+  }
+
+}
+
+
+// Runs the attempt block then never finishes, unless cancelled
+private class HangingOperation : Operation {
+
+  let attempt : () -> Void
+
+  init(attempt: () -> Void) {
+    self.attempt = attempt
+    super.init()
+  }
+
+  override func execute() {
+    attempt()
+  }
+
+}
@@ -78,5 +78,21 @@ MK_DECLARE_LOG_LEVEL()
   DDLogDebug(@"%@", [sqlBuilder processPredicate:predicate sortedBy:nil offset:0 limit:0]);
 }
 
+-(void) testInBindsEachElement
+{
+  Id *a = [Id generate], *b = [Id generate];
+
+  NSPredicate *predicate = [NSPredicate predicateWithFormat:@"id IN %@", @[a, b]];
+
+  SQLBuilder *sqlBuilder = [[SQLBuilder alloc] initWithRootClass:@"Message" tableNames:@{@"Chat" : @"chat",
+                                                                                               @"Message" : @"message"}];
+
+  NSString *sql = [sqlBuilder processPredicate:predicate sortedBy:nil offset:0 limit:0];
+
+  XCTAssertTrue([sql containsString:@"IN (:0,:1)"], @"%@", sql);
+  XCTAssertEqualObjects(sqlBuilder.parameters[@"0"], a.data);
+  XCTAssertEqualObjects(sqlBuilder.parameters[@"1"], b.data);
+}
+
 @end
 
@@ -68,13 +68,16 @@ public class TestClient: NSObject {
       request.addHTTPBearerAuthorizationWithToken(accessToken)
     }
     
-    public func webSocket(webSocket: WebSocket, didReceiveUserStatus sender: String, recipient: String, status: UserStatus) {
+    public func webSocket(webSocket: WebSocket, didReceiveUserStatuses userStatuses: [WebSocketUserStatus]) {
       
-      let pair = ("\(sender):\(recipient)",status)
-      receivedUserStatuses.append(pair)
-      receivedUserStatusQueue.put(pair)
-      
-      print("Device \(deviceInfo.name): User Status: \(pair.0) @ \(pair.1)")
+      for userStatus in userStatuses {
+        
+        let pair = ("\(userStatus.sender):\(userStatus.recipient)",userStatus.status)
+        receivedUserStatuses.append(pair)
+        receivedUserStatusQueue.put(pair)
+        
+        print("Device \(deviceInfo.name): User Status: \(pair.0) @ \(pair.1)")
+      }
     }
     
     public func webSocket(webSocket: WebSocket, didReceiveGroupStatus sender: String, chatId: Id, status: UserStatus) {
@@ -140,13 +143,21 @@ public class TestClient: NSObject {
       print("Device \(deviceInfo.name): Direct: \(msg.id)")
     }
     
-    public func webSocket(webSocket: WebSocket, didReceiveMsgDelivered msgId: Id, recipient: String) {
+    public func webSocket(webSocket: WebSocket, didReceiveMsgsDelivered msgsDelivered: [WebSocketMsgDelivered]) {
 
-      let receipt = "\(msgId.description)-\(recipient)"
-      receivedReceipts.append(receipt)
-      receivedReceiptQueue.put(receipt)
+      for msgDelivered in msgsDelivered {
+        
+        let receipt = "\(msgDelivered.msgId.description)-\(msgDelivered.recipient)"
+        receivedReceipts.append(receipt)
+        receivedReceiptQueue.put(receipt)
+        
+        print("Delivered: \(msgDelivered.msgId) @ \(msgDelivered.recipient)")
+      }
+    }
+    
+    public func webSocket(webSocket: WebSocket, didReconnectResumed resumed: Bool) {
       
-      print("Delivered: \(msgId) @ \(recipient)")
+      print("Device \(deviceInfo.name): Reconnected (resumed=\(resumed))")
     }
     
     func verifyDecryptAndAddMsg(msg: Msg) throws {
@@ -0,0 +1,52 @@
+//
+//  TestHTTPServer.h
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+@import Foundation;
+
+
+NS_ASSUME_NONNULL_BEGIN
+
+
+/*
+ * TestHTTPServer
+ *
+ * Minimal loopback HTTP server standing in for the media transfer
+ * endpoints. Uploads follow the resumable protocol used by ChunkedUpload
+ * (Content-Range requests acknowledged with 308 & Range), downloads
+ * honor byte range requests. Connections can be dropped part way
+ * through a request or response to simulate network failures.
+ */
+@interface TestHTTPServer : NSObject
+
+@property (readonly, nonatomic) NSURL *URL;
+
+// Upload state; bytes received before a dropped connection are kept
+@property (readonly, nonatomic) NSData *receivedData;
+@property (readonly, nonatomic) NSUInteger receivedBodyBytes;
+@property (readonly, nonatomic) NSUInteger requestCount;
+
+// Body returned when an upload completes
+@property (copy, nonatomic) NSData *uploadResponseData;
+
+// Answers POSTs without a Content-Range (e.g. Thrift requests) when set
+@property (copy, nonatomic, nullable) NSData *(^requestHandler)(NSData *body);
+
+// Data served for GET requests
+@property (copy, nonatomic, nullable) NSData *downloadData;
+
+// Drops the connection of the next request after this many body bytes are
+// read (uploads) or written (downloads); one shot, NSNotFound disables
+@property (assign, nonatomic) NSUInteger dropConnectionAfterBodyBytes;
+
+-(BOOL) startAndReturnError:(NSError **)error;
+-(void) stop;
+
+@end
+
+
+NS_ASSUME_NONNULL_END
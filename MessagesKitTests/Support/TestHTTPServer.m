@@ -0,0 +1,354 @@
+//
+//  TestHTTPServer.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "TestHTTPServer.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+
+@interface TestHTTPServer () {
+  int _listenSocket;
+  dispatch_queue_t _queue;
+  NSMutableData *_receivedData;
+}
+
+@end
+
+
+@implementation TestHTTPServer
+
+-(instancetype) init
+{
+  self = [super init];
+  if (self) {
+    _listenSocket = -1;
+    _queue = dispatch_queue_create("TestHTTPServer Queue", DISPATCH_QUEUE_SERIAL);
+    _receivedData = [NSMutableData data];
+    _uploadResponseData = [NSData data];
+    _dropConnectionAfterBodyBytes = NSNotFound;
+  }
+  return self;
+}
+
+-(void) dealloc
+{
+  [self stop];
+}
+
+-(NSData *) receivedData
+{
+  @synchronized(self) {
+    return [_receivedData copy];
+  }
+}
+
+-(BOOL) startAndReturnError:(NSError **)error
+{
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock < 0) {
+    if (error) {
+      *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+    }
+    return NO;
+  }
+
+  int on = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  struct sockaddr_in addr = {0};
+  addr.sin_len = sizeof(addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+
+  socklen_t addrLen = sizeof(addr);
+
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(sock, 8) != 0 ||
+      getsockname(sock, (struct sockaddr *)&addr, &addrLen) != 0)
+  {
+    if (error) {
+      *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+    }
+    close(sock);
+    return NO;
+  }
+
+  _listenSocket = sock;
+  _URL = [NSURL URLWithString:[NSString stringWithFormat:@"http://127.0.0.1:%d/", ntohs(addr.sin_port)]];
+
+  dispatch_async(_queue, ^{
+
+    while (YES) {
+
+      int conn = accept(sock, NULL, NULL);
+      if (conn < 0) {
+        break;
+      }
+
+      int noSigPipe = 1;
+      setsockopt(conn, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+
+      [self handleConnection:conn];
+
+      close(conn);
+    }
+
+  });
+
+  return YES;
+}
+
+-(void) stop
+{
+  if (_listenSocket >= 0) {
+    shutdown(_listenSocket, SHUT_RDWR);
+    close(_listenSocket);
+    _listenSocket = -1;
+  }
+}
+
+-(BOOL) takeDropAfterBodyBytes:(NSUInteger *)dropAfter
+{
+  @synchronized(self) {
+    *dropAfter = _dropConnectionAfterBodyBytes;
+    _dropConnectionAfterBodyBytes = NSNotFound;
+  }
+  return *dropAfter != NSNotFound;
+}
+
+-(void) handleConnection:(int)conn
+{
+  // Read head
+
+  NSMutableData *buffer = [NSMutableData data];
+  NSRange headEnd = NSMakeRange(NSNotFound, 0);
+  NSData *separator = [@"\r\n\r\n" dataUsingEncoding:NSASCIIStringEncoding];
+
+  while (headEnd.location == NSNotFound) {
+
+    UInt8 bytes[4096];
+    ssize_t count = recv(conn, bytes, sizeof(bytes), 0);
+    if (count <= 0) {
+      return;
+    }
+
+    [buffer appendBytes:bytes length:count];
+
+    headEnd = [buffer rangeOfData:separator options:0 range:NSMakeRange(0, buffer.length)];
+  }
+
+  NSString *head = [NSString.alloc initWithData:[buffer subdataWithRange:NSMakeRange(0, headEnd.location)]
+                                       encoding:NSASCIIStringEncoding];
+
+  NSArray<NSString *> *lines = [head componentsSeparatedByString:@"\r\n"];
+  NSString *method = [lines.firstObject componentsSeparatedByString:@" "].firstObject;
+
+  NSMutableDictionary<NSString *, NSString *> *headers = [NSMutableDictionary dictionary];
+  for (NSString *line in [lines subarrayWithRange:NSMakeRange(1, lines.count - 1)]) {
+    NSRange colon = [line rangeOfString:@":"];
+    if (colon.location != NSNotFound) {
+      NSString *name = [line substringToIndex:colon.location].lowercaseString;
+      NSString *value = [[line substringFromIndex:colon.location + 1] stringByTrimmingCharactersInSet:NSCharacterSet.whitespaceCharacterSet];
+      headers[name] = value;
+    }
+  }
+
+  @synchronized(self) {
+    _requestCount += 1;
+  }
+
+  NSUInteger dropAfter = NSNotFound;
+  BOOL drop = [self takeDropAfterBodyBytes:&dropAfter];
+
+  if ([method isEqualToString:@"GET"]) {
+    [self handleDownloadWithHeaders:headers connection:conn dropAfter:drop ? dropAfter : NSNotFound];
+    return;
+  }
+
+  // Read body
+
+  NSUInteger contentLength = (NSUInteger)[headers[@"content-length"] longLongValue];
+
+  NSMutableData *body = [[buffer subdataWithRange:NSMakeRange(NSMaxRange(headEnd), buffer.length - NSMaxRange(headEnd))] mutableCopy];
+
+  while (body.length < contentLength) {
+
+    if (drop && body.length >= dropAfter) {
+      break;
+    }
+
+    UInt8 bytes[4096];
+    ssize_t count = recv(conn, bytes, MIN(sizeof(bytes), contentLength - body.length), 0);
+    if (count <= 0) {
+      break;
+    }
+
+    [body appendBytes:bytes length:count];
+  }
+
+  @synchronized(self) {
+    _receivedBodyBytes += body.length;
+  }
+
+  if (drop || body.length < contentLength) {
+    // Bytes received before the connection dropped are kept, as a resumable upload server would
+    [self storeUploadWithHeaders:headers body:body];
+    return;
+  }
+
+  [self handleUploadWithHeaders:headers body:body connection:conn];
+}
+
+-(void) handleUploadWithHeaders:(NSDictionary<NSString *, NSString *> *)headers body:(NSData *)body connection:(int)conn
+{
+  NSString *contentRange = headers[@"content-range"];
+
+  NSData *(^requestHandler)(NSData *) = self.requestHandler;
+  if (!contentRange && requestHandler) {
+    [self sendStatus:200 headers:@{} body:requestHandler(body) connection:conn];
+    return;
+  }
+
+  unsigned long long start = 0, total = body.length;
+  BOOL query = NO;
+
+  if (contentRange) {
+
+    NSScanner *scanner = [NSScanner scannerWithString:contentRange];
+    [scanner scanString:@"bytes" intoString:nil];
+
+    if ([scanner scanString:@"*" intoString:nil]) {
+      query = YES;
+    }
+    else {
+      [scanner scanUnsignedLongLong:&start];
+      [scanner scanString:@"-" intoString:nil];
+      [scanner scanUnsignedLongLong:NULL];
+    }
+
+    [scanner scanString:@"/" intoString:nil];
+    [scanner scanUnsignedLongLong:&total];
+  }
+  else {
+    @synchronized(self) {
+      _receivedData.length = 0;
+    }
+  }
+
+  NSUInteger received;
+
+  @synchronized(self) {
+
+    if (!query) {
+      [self storeUploadWithHeaders:headers body:body];
+    }
+
+    received = _receivedData.length;
+  }
+
+  if (received >= total) {
+    [self sendStatus:200 headers:@{} body:_uploadResponseData connection:conn];
+  }
+  else {
+    NSDictionary *rangeHeaders = received ? @{@"Range": [NSString stringWithFormat:@"bytes=0-%lu", (unsigned long)received - 1]} : @{};
+    [self sendStatus:308 headers:rangeHeaders body:[NSData data] connection:conn];
+  }
+}
+
+-(void) storeUploadWithHeaders:(NSDictionary<NSString *, NSString *> *)headers body:(NSData *)body
+{
+  NSString *contentRange = headers[@"content-range"];
+  if (!contentRange) {
+    return;
+  }
+
+  unsigned long long start = 0;
+
+  NSScanner *scanner = [NSScanner scannerWithString:contentRange];
+  [scanner scanString:@"bytes" intoString:nil];
+  if (![scanner scanUnsignedLongLong:&start]) {
+    // Status query
+    return;
+  }
+
+  @synchronized(self) {
+
+    // Requests must continue exactly where the stored data ends
+    if (start == _receivedData.length) {
+      [_receivedData appendData:body];
+    }
+
+  }
+}
+
+-(void) handleDownloadWithHeaders:(NSDictionary<NSString *, NSString *> *)headers connection:(int)conn dropAfter:(NSUInteger)dropAfter
+{
+  NSData *data = self.downloadData;
+  if (!data) {
+    [self sendStatus:404 headers:@{} body:[NSData data] connection:conn];
+    return;
+  }
+
+  unsigned long long start = 0;
+
+  NSString *range = headers[@"range"];
+  if (range) {
+    NSScanner *scanner = [NSScanner scannerWithString:range];
+    [scanner scanString:@"bytes=" intoString:nil];
+    [scanner scanUnsignedLongLong:&start];
+  }
+
+  NSMutableDictionary *responseHeaders = [@{@"Accept-Ranges": @"bytes",
+                                            @"ETag": @"\"test\"",
+                                            @"Last-Modified": @"Wed, 19 Oct 2016 00:00:00 GMT",
+                                            @"Content-Type": @"application/octet-stream"} mutableCopy];
+
+  NSData *body = data;
+  int status = 200;
+
+  if (start > 0 && start < data.length) {
+    status = 206;
+    body = [data subdataWithRange:NSMakeRange(start, data.length - start)];
+    responseHeaders[@"Content-Range"] = [NSString stringWithFormat:@"bytes %llu-%lu/%lu", start, (unsigned long)data.length - 1, (unsigned long)data.length];
+  }
+
+  [self sendStatus:status headers:responseHeaders body:body connection:conn dropAfter:dropAfter];
+}
+
+-(void) sendStatus:(int)status headers:(NSDictionary *)headers body:(NSData *)body connection:(int)conn
+{
+  [self sendStatus:status headers:headers body:body connection:conn dropAfter:NSNotFound];
+}
+
+-(void) sendStatus:(int)status headers:(NSDictionary *)headers body:(NSData *)body connection:(int)conn dropAfter:(NSUInteger)dropAfter
+{
+  NSMutableString *head = [NSMutableString stringWithFormat:@"HTTP/1.1 %d %@\r\n", status, [NSHTTPURLResponse localizedStringForStatusCode:status]];
+  for (NSString *name in headers) {
+    [head appendFormat:@"%@: %@\r\n", name, headers[name]];
+  }
+  [head appendFormat:@"Content-Length: %lu\r\nConnection: close\r\n\r\n", (unsigned long)body.length];
+
+  NSMutableData *response = [[head dataUsingEncoding:NSASCIIStringEncoding] mutableCopy];
+  [response appendData:[body subdataWithRange:NSMakeRange(0, MIN(body.length, dropAfter))]];
+
+  const UInt8 *bytes = response.bytes;
+  NSUInteger sent = 0;
+  while (sent < response.length) {
+    ssize_t count = send(conn, bytes + sent, response.length - sent, 0);
+    if (count <= 0) {
+      return;
+    }
+    sent += count;
+  }
+}
+
+@end
@@ -0,0 +1,51 @@
+//
+//  TestWebSocketServer.h
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+@import Foundation;
+
+
+NS_ASSUME_NONNULL_BEGIN
+
+
+/*
+ * TestWebSocketServer
+ *
+ * Minimal loopback WebSocket server standing in for the user connect
+ * endpoint. Accepts one connection at a time, negotiates the given
+ * sub-protocol and answers each binary frame with the frame returned
+ * by the frame handler (if any).
+ */
+@interface TestWebSocketServer : NSObject
+
+@property (readonly, nonatomic) NSURL *URL;
+
+@property (copy, nonatomic) NSString *protocolName;
+
+@property (copy, nonatomic, nullable) NSData *_Nullable (^frameHandler)(NSData *frame);
+
+// Sent as a text message ahead of each reply
+@property (copy, atomic, nullable) NSString *replyHeader;
+
+@property (readonly, nonatomic) NSUInteger frameCount;
+@property (readonly, nonatomic) NSUInteger connectionCount;
+
+// Ignoring pings simulates a half-open connection
+@property (assign, nonatomic) BOOL respondsToPings;
+
+// Echoes the resume header of reconnecting clients
+@property (assign, nonatomic) BOOL acceptsResume;
+
+@property (readonly, nonatomic, nullable) NSString *lastResumeAfter;
+
+-(BOOL) startAndReturnError:(NSError **)error;
+-(void) stop;
+
+@end
+
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,316 @@
+//
+//  TestWebSocketServer.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import "TestWebSocketServer.h"
+
+#import "NSData+CommonDigest.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+
+static NSString *const WebSocketGUID = @"258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+typedef NS_ENUM(UInt8, Opcode) {
+  OpcodeText    = 0x1,
+  OpcodeBinary  = 0x2,
+  OpcodeClose   = 0x8,
+  OpcodePing    = 0x9,
+  OpcodePong    = 0xA,
+};
+
+
+@interface TestWebSocketServer () {
+  int _listenSocket;
+  dispatch_queue_t _queue;
+}
+
+@end
+
+
+@implementation TestWebSocketServer
+
+-(instancetype) init
+{
+  self = [super init];
+  if (self) {
+    _listenSocket = -1;
+    _queue = dispatch_queue_create("TestWebSocketServer Queue", DISPATCH_QUEUE_SERIAL);
+    _protocolName = @"compact";
+    _respondsToPings = YES;
+  }
+  return self;
+}
+
+-(void) dealloc
+{
+  [self stop];
+}
+
+-(BOOL) startAndReturnError:(NSError **)error
+{
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock < 0) {
+    if (error) {
+      *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+    }
+    return NO;
+  }
+
+  int on = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  struct sockaddr_in addr = {0};
+  addr.sin_len = sizeof(addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+
+  socklen_t addrLen = sizeof(addr);
+
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(sock, 8) != 0 ||
+      getsockname(sock, (struct sockaddr *)&addr, &addrLen) != 0)
+  {
+    if (error) {
+      *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+    }
+    close(sock);
+    return NO;
+  }
+
+  _listenSocket = sock;
+  _URL = [NSURL URLWithString:[NSString stringWithFormat:@"ws://127.0.0.1:%d/", ntohs(addr.sin_port)]];
+
+  dispatch_async(_queue, ^{
+
+    while (YES) {
+
+      int conn = accept(sock, NULL, NULL);
+      if (conn < 0) {
+        break;
+      }
+
+      int noSigPipe = 1;
+      setsockopt(conn, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+
+      int noDelay = 1;
+      setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+      [self handleConnection:conn];
+
+      close(conn);
+    }
+
+  });
+
+  return YES;
+}
+
+-(void) stop
+{
+  if (_listenSocket >= 0) {
+    shutdown(_listenSocket, SHUT_RDWR);
+    close(_listenSocket);
+    _listenSocket = -1;
+  }
+}
+
+-(BOOL) readBytes:(UInt8 *)bytes length:(NSUInteger)length connection:(int)conn
+{
+  NSUInteger total = 0;
+  while (total < length) {
+    ssize_t count = recv(conn, bytes + total, length - total, 0);
+    if (count <= 0) {
+      return NO;
+    }
+    total += count;
+  }
+  return YES;
+}
+
+-(BOOL) sendData:(NSData *)data connection:(int)conn
+{
+  const UInt8 *bytes = data.bytes;
+  NSUInteger sent = 0;
+  while (sent < data.length) {
+    ssize_t count = send(conn, bytes + sent, data.length - sent, 0);
+    if (count <= 0) {
+      return NO;
+    }
+    sent += count;
+  }
+  return YES;
+}
+
+-(void) handleConnection:(int)conn
+{
+  // Handshake
+
+  NSMutableData *head = [NSMutableData data];
+  NSData *separator = [@"\r\n\r\n" dataUsingEncoding:NSASCIIStringEncoding];
+
+  while ([head rangeOfData:separator options:0 range:NSMakeRange(0, head.length)].location == NSNotFound) {
+    UInt8 byte;
+    if (![self readBytes:&byte length:1 connection:conn]) {
+      return;
+    }
+    [head appendBytes:&byte length:1];
+  }
+
+  @synchronized(self) {
+    _connectionCount += 1;
+  }
+
+  NSString *key;
+  NSString *resumeAfter;
+  for (NSString *line in [[NSString.alloc initWithData:head encoding:NSASCIIStringEncoding] componentsSeparatedByString:@"\r\n"]) {
+    if ([line.lowercaseString hasPrefix:@"sec-websocket-key:"]) {
+      key = [[line substringFromIndex:18] stringByTrimmingCharactersInSet:NSCharacterSet.whitespaceCharacterSet];
+    }
+    else if ([line.lowercaseString hasPrefix:@"x-resume-after:"]) {
+      resumeAfter = [[line substringFromIndex:15] stringByTrimmingCharactersInSet:NSCharacterSet.whitespaceCharacterSet];
+    }
+  }
+
+  NSData *acceptDigest = [[key stringByAppendingString:WebSocketGUID] dataUsingEncoding:NSASCIIStringEncoding].sha1;
+
+  _lastResumeAfter = resumeAfter;
+
+  NSString *resumeHeader = @"";
+  if (_acceptsResume && resumeAfter) {
+    resumeHeader = [NSString stringWithFormat:@"X-Resume-After: %@\r\n", resumeAfter];
+  }
+
+  NSString *response = [NSString stringWithFormat:@"HTTP/1.1 101 Switching Protocols\r\n"
+                                                   "Upgrade: websocket\r\n"
+                                                   "Connection: Upgrade\r\n"
+                                                   "Sec-WebSocket-Accept: %@\r\n"
+                                                   "Sec-WebSocket-Protocol: %@\r\n%@\r\n",
+                        [acceptDigest base64EncodedStringWithOptions:0], _protocolName, resumeHeader];
+
+  if (![self sendData:[response dataUsingEncoding:NSASCIIStringEncoding] connection:conn]) {
+    return;
+  }
+
+  // Frames (clients always mask, servers never do)
+
+  while (YES) {
+
+    UInt8 header[2];
+    if (![self readBytes:header length:2 connection:conn]) {
+      return;
+    }
+
+    Opcode opcode = header[0] & 0x0F;
+    UInt64 length = header[1] & 0x7F;
+
+    if (length == 126) {
+      UInt8 ext[2];
+      if (![self readBytes:ext length:2 connection:conn]) {
+        return;
+      }
+      length = ((UInt64)ext[0] << 8) | ext[1];
+    }
+    else if (length == 127) {
+      UInt8 ext[8];
+      if (![self readBytes:ext length:8 connection:conn]) {
+        return;
+      }
+      length = 0;
+      for (int c = 0; c < 8; ++c) {
+        length = (length << 8) | ext[c];
+      }
+    }
+
+    UInt8 mask[4];
+    if (![self readBytes:mask length:4 connection:conn]) {
+      return;
+    }
+
+    NSMutableData *payload = [NSMutableData dataWithLength:(NSUInteger)length];
+    UInt8 *payloadBytes = payload.mutableBytes;
+    if (![self readBytes:payloadBytes length:payload.length connection:conn]) {
+      return;
+    }
+
+    for (NSUInteger c = 0; c < payload.length; ++c) {
+      payloadBytes[c] ^= mask[c % 4];
+    }
+
+    switch (opcode) {
+    case OpcodeBinary: {
+
+      @synchronized(self) {
+        _frameCount += 1;
+      }
+
+      NSData *reply = self.frameHandler ? self.frameHandler(payload) : nil;
+      if (!reply) {
+        break;
+      }
+
+      NSString *replyHeader = self.replyHeader;
+      if (replyHeader && ![self sendFrame:[replyHeader dataUsingEncoding:NSUTF8StringEncoding] opcode:OpcodeText connection:conn]) {
+        return;
+      }
+
+      if (![self sendFrame:reply opcode:OpcodeBinary connection:conn]) {
+        return;
+      }
+      break;
+    }
+
+    case OpcodePing:
+      if (_respondsToPings) {
+        [self sendFrame:payload opcode:OpcodePong connection:conn];
+      }
+      break;
+
+    case OpcodeClose:
+      [self sendFrame:payload opcode:OpcodeClose connection:conn];
+      return;
+
+    default:
+      break;
+    }
+  }
+}
+
+-(BOOL) sendFrame:(NSData *)payload opcode:(Opcode)opcode connection:(int)conn
+{
+  NSMutableData *frame = [NSMutableData data];
+
+  UInt8 first = 0x80 | opcode;
+  [frame appendBytes:&first length:1];
+
+  if (payload.length < 126) {
+    UInt8 length = payload.length;
+    [frame appendBytes:&length length:1];
+  }
+  else if (payload.length <= UINT16_MAX) {
+    UInt8 length[3] = {126, payload.length >> 8, payload.length & 0xFF};
+    [frame appendBytes:length length:3];
+  }
+  else {
+    UInt8 length[9] = {127};
+    for (int c = 0; c < 8; ++c) {
+      length[8 - c] = ((UInt64)payload.length >> (c * 8)) & 0xFF;
+    }
+    [frame appendBytes:length length:9];
+  }
+
+  [frame appendData:payload];
+
+  return [self sendData:frame connection:conn];
+}
+
+@end
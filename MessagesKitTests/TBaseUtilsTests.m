@@ -0,0 +1,144 @@
+//
+//  TBaseUtilsTests.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "TBase+Utils.h"
+#import "Messages+Exts.h"
+#import "NSData+Random.h"
+
+@import Thrift;
+
+
+@interface TBaseUtilsTests : XCTestCase
+
+@end
+
+
+@implementation TBaseUtilsTests
+
+-(MsgPack *) msgPackWithEnvelopeCount:(int)envelopeCount
+{
+  NSMutableArray<Envelope *> *envelopes = [NSMutableArray array];
+  for (int c = 0; c < envelopeCount; ++c) {
+    [envelopes addObject:[Envelope.alloc initWithRecipient:[NSString stringWithFormat:@"recipient%d@example.com", c]
+                                                       key:[NSData dataWithRandomBytesOfLength:256]
+                                                 signature:[NSData dataWithRandomBytesOfLength:256]
+                                               fingerprint:[NSData dataWithRandomBytesOfLength:32]]];
+  }
+
+  return [MsgPack.alloc initWithId:[Id generate]
+                              type:MsgTypeText
+                            sender:@"sender@example.com"
+                         envelopes:envelopes
+                              chat:nil
+                          metaData:@{@"compression": @"deflate"}
+                              data:nil];
+}
+
+-(void) testProtocolNames
+{
+  XCTAssertEqualObjects(TBaseUtils.protocolNames.firstObject, ThriftCompactProtocolName);
+
+  XCTAssertTrue([[TBaseUtils protocolFactoryNamed:ThriftCompactProtocolName] isKindOfClass:TCompactProtocolFactory.class]);
+  XCTAssertTrue([[TBaseUtils protocolFactoryNamed:ThriftBinaryProtocolName] isKindOfClass:TBinaryProtocolFactory.class]);
+  XCTAssertNil([TBaseUtils protocolFactoryNamed:@"json"]);
+}
+
+-(void) testCompactRoundTrip
+{
+  MsgPack *msgPack = [self msgPackWithEnvelopeCount:3];
+
+  NSError *error;
+  NSData *data = [TBaseUtils serializeToData:msgPack usingProtocolFactory:TCompactProtocolFactory.sharedFactory error:&error];
+  XCTAssertNotNil(data, @"Error: %@", error);
+
+  MsgPack *read = [TBaseUtils deserialize:[MsgPack new] fromData:data usingProtocolFactory:TCompactProtocolFactory.sharedFactory error:&error];
+  XCTAssertEqualObjects(read, msgPack, @"Error: %@", error);
+}
+
+-(void) testPreambleRoundTrip
+{
+  MsgPack *msgPack = [self msgPackWithEnvelopeCount:3];
+  NSData *trailer = [NSData dataWithRandomBytesOfLength:1024];
+
+  NSMutableData *body = [[TBaseUtils serializeToPreamble:msgPack usingProtocolFactory:TCompactProtocolFactory.sharedFactory error:nil] mutableCopy];
+  [body appendData:trailer];
+
+  NSInputStream *inStream = [NSInputStream inputStreamWithData:body];
+  [inStream open];
+
+  NSError *error;
+  MsgPack *read = [TBaseUtils deserialize:[MsgPack new] fromPreambleOfStream:inStream usingProtocolFactory:TCompactProtocolFactory.sharedFactory error:&error];
+  XCTAssertEqualObjects(read, msgPack, @"Error: %@", error);
+
+  // Stream is left positioned at the data following the preamble
+  UInt8 buffer[2048];
+  NSInteger remaining = [inStream read:buffer maxLength:sizeof(buffer)];
+  XCTAssertEqualObjects([NSData dataWithBytes:buffer length:remaining], trailer);
+}
+
+-(void) testPreambleTruncated
+{
+  NSData *preamble = [TBaseUtils serializeToPreamble:[self msgPackWithEnvelopeCount:1] usingProtocolFactory:TCompactProtocolFactory.sharedFactory error:nil];
+
+  NSInputStream *inStream = [NSInputStream inputStreamWithData:[preamble subdataWithRange:NSMakeRange(0, preamble.length - 10)]];
+  [inStream open];
+
+  NSError *error;
+  XCTAssertNil([TBaseUtils deserialize:[MsgPack new] fromPreambleOfStream:inStream usingProtocolFactory:TCompactProtocolFactory.sharedFactory error:&error]);
+  XCTAssertEqualObjects(error.domain, TTransportErrorDomain);
+  XCTAssertEqual(error.code, TTransportErrorEndOfFile);
+}
+
+// Size & encode time of the Msg-Info header against the compact body preamble; results are logged
+-(void) testBenchmarkHeaderVersusPreamble
+{
+  const int iterations = 200;
+
+  for (NSNumber *envelopeCount in @[@1, @10, @100]) {
+
+    MsgPack *msgPack = [self msgPackWithEnvelopeCount:envelopeCount.intValue];
+
+    NSString *header = [TBaseUtils serializeToBase64String:msgPack error:nil];
+    NSData *preamble = [TBaseUtils serializeToPreamble:msgPack usingProtocolFactory:TCompactProtocolFactory.sharedFactory error:nil];
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (int c = 0; c < iterations; ++c) {
+      [TBaseUtils serializeToBase64String:msgPack error:nil];
+    }
+    CFAbsoluteTime headerTime = (CFAbsoluteTimeGetCurrent() - start) / iterations;
+
+    start = CFAbsoluteTimeGetCurrent();
+    for (int c = 0; c < iterations; ++c) {
+      [TBaseUtils serializeToPreamble:msgPack usingProtocolFactory:TCompactProtocolFactory.sharedFactory error:nil];
+    }
+    CFAbsoluteTime preambleTime = (CFAbsoluteTimeGetCurrent() - start) / iterations;
+
+    NSLog(@"%3d envelopes: header %7lu bytes %7.1fus, preamble %7lu bytes %7.1fus (saved %5.1f%%)",
+          envelopeCount.intValue,
+          (unsigned long)header.length, headerTime * 1e6,
+          (unsigned long)preamble.length, preambleTime * 1e6,
+          100.0 * (1.0 - (double)preamble.length / header.length));
+
+    XCTAssertLessThan(preamble.length, header.length);
+  }
+}
+
+-(void) testPreambleSerializePerformance
+{
+  MsgPack *msgPack = [self msgPackWithEnvelopeCount:100];
+
+  [self measureBlock:^{
+    for (int c = 0; c < 100; ++c) {
+      [TBaseUtils serializeToPreamble:msgPack usingProtocolFactory:TCompactProtocolFactory.sharedFactory error:nil];
+    }
+  }];
+}
+
+@end
@@ -0,0 +1,302 @@
+//
+//  WebSocketTests.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "WebSocket.h"
+#import "TBase+Utils.h"
+#import "Messages+Exts.h"
+#import "TestWebSocketServer.h"
+
+@import Thrift;
+
+
+@interface WebSocket (Testing)
+
+@property (readonly, nonatomic) dispatch_queue_t processingQueue;
+
+-(void) _startProcessingWithProtocolNamed:(NSString *)protocolName;
+-(void) _processFrame:(NSData *)frame;
+
++(NSTimeInterval) reconnectIntervalForAttempt:(uint)attempt;
+
+@end
+
+
+@interface WebSocketTests : XCTestCase <WebSocketDelegate>
+
+@property (strong, nonatomic) WebSocket *webSocket;
+@property (strong, nonatomic) NSMutableArray<NSString *> *events;
+@property (assign, nonatomic) NSUInteger userStatusBatches;
+@property (assign, nonatomic) NSUInteger expectedNotifications;
+@property (strong, nonatomic) XCTestExpectation *notificationsReceived;
+@property (strong, nonatomic) TestWebSocketServer *server;
+@property (strong, nonatomic) XCTestExpectation *reconnected;
+@property (assign, nonatomic) BOOL resumed;
+@property (assign, nonatomic) TimeStamp reconnectResumeTimestamp;
+
+@end
+
+
+@implementation WebSocketTests
+
+-(void) setUp
+{
+  [super setUp];
+
+  _webSocket = [WebSocket.alloc initWithURL:[NSURL URLWithString:@"wss://localhost/"]];
+  _webSocket.delegate = self;
+
+  _events = [NSMutableArray array];
+}
+
+-(void) tearDown
+{
+  [_webSocket disconnect];
+  [_server stop];
+
+  [super tearDown];
+}
+
+// Connects to a local server that never answers pings, forcing a reconnect
+-(void) connectToUnresponsiveServer
+{
+  _server = [TestWebSocketServer new];
+  _server.respondsToPings = NO;
+  [_server startAndReturnError:nil];
+
+  _webSocket = [WebSocket.alloc initWithURL:_server.URL];
+  _webSocket.delegate = self;
+  _webSocket.heartbeatInterval = 0.2;
+  _webSocket.deadPeerTimeout = 0.5;
+
+  _reconnected = [self expectationWithDescription:@"reconnected"];
+
+  [_webSocket connect];
+}
+
+-(NSArray<NSData *> *) framesUsingProtocolFactory:(id<TProtocolFactory>)protocolFactory count:(int)count build:(void (^)(DeviceServiceClient *client, int index))build
+{
+  NSMutableArray<NSData *> *frames = [NSMutableArray array];
+
+  for (int c = 0; c < count; ++c) {
+
+    TMemoryBuffer *buffer = [TMemoryBuffer new];
+    DeviceServiceClient *client = [DeviceServiceClient.alloc initWithProtocol:[protocolFactory newProtocolOnTransport:buffer]];
+
+    build(client, c);
+
+    [frames addObject:buffer.buffer];
+  }
+
+  return frames;
+}
+
+-(void) processFrames:(NSArray<NSData *> *)frames protocolNamed:(NSString *)protocolName
+{
+  dispatch_async(_webSocket.processingQueue, ^{
+    [self.webSocket _startProcessingWithProtocolNamed:protocolName];
+    for (NSData *frame in frames) {
+      [self.webSocket _processFrame:frame];
+    }
+  });
+}
+
+-(void) testFramesProcessedInOrderWithBatching
+{
+  NSArray<NSData *> *frames = [self framesUsingProtocolFactory:TCompactProtocolFactory.sharedFactory count:5 build:^(DeviceServiceClient *client, int index) {
+    switch (index) {
+    case 0: [client userStatus:@"a" recipient:@"me" status:UserStatusTyping error:nil]; break;
+    case 1: [client userStatus:@"b" recipient:@"me" status:UserStatusTyping error:nil]; break;
+    case 2: [client msgDelivered:[Id generate] recipient:@"a" error:nil]; break;
+    case 3: [client groupStatus:@"c" chatId:[Id generate] status:UserStatusTyping error:nil]; break;
+    case 4: [client userStatus:@"a" recipient:@"me" status:UserStatusOnline error:nil]; break;
+    }
+  }];
+
+  _expectedNotifications = 5;
+  _notificationsReceived = [self expectationWithDescription:@"notifications"];
+
+  [self processFrames:frames protocolNamed:ThriftCompactProtocolName];
+
+  [self waitForExpectationsWithTimeout:5 handler:nil];
+
+  // Batched notifications before the group status are delivered ahead of it
+  NSArray *expected = @[@"status:a", @"status:b", @"delivered:a", @"group:c", @"status:a"];
+  XCTAssertEqualObjects(_events, expected);
+  XCTAssertEqual(_userStatusBatches, 2);
+}
+
+-(void) testInvalidFrameDoesNotAffectFollowing
+{
+  NSArray<NSData *> *frames = [self framesUsingProtocolFactory:TBinaryProtocolFactory.sharedFactory count:2 build:^(DeviceServiceClient *client, int index) {
+    [client userStatus:index ? @"b" : @"a" recipient:@"me" status:UserStatusTyping error:nil];
+  }];
+
+  NSData *truncated = [frames[0] subdataWithRange:NSMakeRange(0, frames[0].length - 4)];
+
+  _expectedNotifications = 1;
+  _notificationsReceived = [self expectationWithDescription:@"notifications"];
+
+  [self processFrames:@[truncated, frames[1]] protocolNamed:ThriftBinaryProtocolName];
+
+  [self waitForExpectationsWithTimeout:5 handler:nil];
+
+  XCTAssertEqualObjects(_events, @[@"status:b"]);
+}
+
+// Throughput of a status storm; results are logged
+-(void) testBenchmarkFramesPerSecond
+{
+  const int frameCount = 20000;
+
+  for (NSString *protocolName in TBaseUtils.protocolNames) {
+
+    NSArray<NSData *> *frames = [self framesUsingProtocolFactory:[TBaseUtils protocolFactoryNamed:protocolName] count:frameCount build:^(DeviceServiceClient *client, int index) {
+      [client userStatus:[NSString stringWithFormat:@"user%d@example.com", index % 50] recipient:@"me@example.com" status:UserStatusTyping error:nil];
+    }];
+
+    [_events removeAllObjects];
+    _userStatusBatches = 0;
+    _expectedNotifications = frameCount;
+    _notificationsReceived = [self expectationWithDescription:protocolName];
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+
+    [self processFrames:frames protocolNamed:protocolName];
+
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+
+    NSLog(@"%-8@ %d frames in %.3fs: %.0f frames/s, %lu delegate calls",
+          protocolName, frameCount, elapsed, frameCount / elapsed, (unsigned long)_userStatusBatches);
+  }
+}
+
+-(void) testReconnectIntervalBackoff
+{
+  for (uint attempt = 0; attempt < 12; ++attempt) {
+
+    NSTimeInterval ceiling = MIN(60.0, 0.5 * pow(2, attempt));
+
+    for (int c = 0; c < 100; ++c) {
+      NSTimeInterval interval = [WebSocket reconnectIntervalForAttempt:attempt];
+      XCTAssertGreaterThanOrEqual(interval, ceiling / 2);
+      XCTAssertLessThanOrEqual(interval, ceiling);
+    }
+  }
+
+  // Capped, even for absurd attempt counts
+  XCTAssertLessThanOrEqual([WebSocket reconnectIntervalForAttempt:UINT_MAX], 60.0);
+}
+
+-(void) testDeadPeerReconnects
+{
+  [self connectToUnresponsiveServer];
+
+  [self waitForExpectationsWithTimeout:10 handler:nil];
+
+  XCTAssertEqual(_server.connectionCount, 2);
+  XCTAssertNil(_server.lastResumeAfter);
+  XCTAssertFalse(_resumed);
+}
+
+-(void) testReconnectResumes
+{
+  [self connectToUnresponsiveServer];
+
+  _server.acceptsResume = YES;
+  _reconnectResumeTimestamp = 1234;
+
+  [self waitForExpectationsWithTimeout:10 handler:nil];
+
+  XCTAssertEqual(_server.connectionCount, 2);
+  XCTAssertEqualObjects(_server.lastResumeAfter, @"1234");
+  XCTAssertTrue(_resumed);
+}
+
+// A saved watermark resumes the first connection, e.g. after a cold start
+-(void) testConnectResumes
+{
+  _server = [TestWebSocketServer new];
+  _server.acceptsResume = YES;
+  [_server startAndReturnError:nil];
+
+  _webSocket = [WebSocket.alloc initWithURL:_server.URL];
+  _webSocket.delegate = self;
+  _webSocket.resumeTimestamp = 1234;
+
+  _reconnected = [self expectationWithDescription:@"resumed"];
+
+  [_webSocket connect];
+
+  [self waitForExpectationsWithTimeout:10 handler:nil];
+
+  XCTAssertEqual(_server.connectionCount, 1);
+  XCTAssertEqualObjects(_server.lastResumeAfter, @"1234");
+  XCTAssertTrue(_resumed);
+}
+
+-(void) recordEvent:(NSString *)event
+{
+  [_events addObject:event];
+
+  if (_events.count == _expectedNotifications) {
+    [_notificationsReceived fulfill];
+  }
+}
+
+-(void) webSocket:(WebSocket *)webSocket willConnect:(NSMutableURLRequest *)request
+{
+  // Connecting is asynchronous, so the timestamp is applied once the first connection was made
+  if (_reconnectResumeTimestamp && _server.connectionCount > 0) {
+    webSocket.resumeTimestamp = _reconnectResumeTimestamp;
+  }
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReceiveUserStatuses:(NSArray<WebSocketUserStatus *> *)userStatuses
+{
+  _userStatusBatches += 1;
+  for (WebSocketUserStatus *userStatus in userStatuses) {
+    [self recordEvent:[@"status:" stringByAppendingString:userStatus.sender]];
+  }
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReceiveGroupStatus:(NSString *)sender chatId:(Id *)chatId status:(enum UserStatus)status
+{
+  [self recordEvent:[@"group:" stringByAppendingString:sender]];
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReceiveMsgReady:(MsgHdr *)msgHdr
+{
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReceiveMsgDelivery:(Msg *)msg
+{
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReceiveMsgsDelivered:(NSArray<WebSocketMsgDelivered *> *)msgsDelivered
+{
+  for (WebSocketMsgDelivered *msgDelivered in msgsDelivered) {
+    [self recordEvent:[@"delivered:" stringByAppendingString:msgDelivered.recipient]];
+  }
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReceiveMsgDirect:(DirectMsg *)msg
+{
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReconnectResumed:(BOOL)resumed
+{
+  _resumed = resumed;
+  [_reconnected fulfill];
+  _reconnected = nil;
+}
+
+@end
@@ -0,0 +1,310 @@
+//
+//  WebSocketTransportTests.m
+//  MessagesKit
+//
+//  Created by Kevin Wooten on 10/19/16.
+//  Copyright © 2016 reTXT Labs LLC. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "WebSocketTransportFactory.h"
+#import "TBase+Utils.h"
+#import "Messages+Exts.h"
+#import "NSData+Random.h"
+#import "TestHTTPServer.h"
+#import "TestWebSocketServer.h"
+
+@import Thrift;
+
+
+// Answers UserAPI send requests with the length of the message's data as the
+// "sent" timestamp, allowing responses to be matched to requests
+static NSData *ReplyToSendRequest(NSData *request)
+{
+  id<TProtocolFactory> protocolFactory = TCompactProtocolFactory.sharedFactory;
+
+  id<TProtocol> inProtocol = [protocolFactory newProtocolOnTransport:[TMemoryBuffer.alloc initWithData:request]];
+
+  NSString *name;
+  SInt32 sequenceID;
+  [inProtocol readMessageBeginReturningName:&name type:NULL sequenceID:&sequenceID error:nil];
+
+  MsgPack *msgPack = [MsgPack new];
+  [inProtocol readStructBeginReturningName:NULL error:nil];
+  SInt32 fieldType;
+  [inProtocol readFieldBeginReturningName:NULL type:&fieldType fieldID:NULL error:nil];
+  [msgPack read:inProtocol error:nil];
+
+  TMemoryBuffer *reply = [TMemoryBuffer new];
+  id<TProtocol> outProtocol = [protocolFactory newProtocolOnTransport:reply];
+
+  [outProtocol writeMessageBeginWithName:name type:TMessageTypeREPLY sequenceID:sequenceID error:nil];
+  [outProtocol writeStructBeginWithName:@"UserAPI_send_result" error:nil];
+  [outProtocol writeFieldBeginWithName:@"success" type:TTypeI64 fieldID:0 error:nil];
+  [outProtocol writeI64:msgPack.data.length error:nil];
+  [outProtocol writeFieldEnd:nil];
+  [outProtocol writeFieldStop:nil];
+  [outProtocol writeStructEnd:nil];
+  [outProtocol writeMessageEnd:nil];
+
+  return reply.buffer;
+}
+
+
+@interface WebSocketTransportTests : XCTestCase <WebSocketDelegate>
+
+@property (strong, nonatomic) TestWebSocketServer *webSocketServer;
+@property (strong, nonatomic) TestHTTPServer *httpServer;
+@property (strong, nonatomic) NSURLSession *session;
+@property (strong, nonatomic) WebSocket *webSocket;
+@property (strong, nonatomic) id<TAsyncTransportFactory> httpTransportFactory;
+@property (strong, nonatomic) WebSocketTransportFactory *webSocketTransportFactory;
+@property (copy, atomic) NSString *refreshedAccessToken;
+
+@end
+
+
+@implementation WebSocketTransportTests
+
+-(void) setUp
+{
+  [super setUp];
+
+  _webSocketServer = [TestWebSocketServer new];
+  _webSocketServer.frameHandler = ^NSData *(NSData *frame) {
+    return ReplyToSendRequest(frame);
+  };
+  [_webSocketServer startAndReturnError:nil];
+
+  _httpServer = [TestHTTPServer new];
+  _httpServer.requestHandler = ^NSData *(NSData *body) {
+    return ReplyToSendRequest(body);
+  };
+  [_httpServer startAndReturnError:nil];
+
+  _session = [NSURLSession sessionWithConfiguration:NSURLSessionConfiguration.ephemeralSessionConfiguration];
+
+  _httpTransportFactory = [THTTPSessionTransportFactory.alloc initWithSession:_session URL:_httpServer.URL];
+
+  _webSocket = [WebSocket.alloc initWithURL:_webSocketServer.URL];
+  _webSocket.delegate = self;
+
+  _webSocketTransportFactory = [WebSocketTransportFactory.alloc initWithWebSocket:_webSocket
+                                                                     protocolName:ThriftCompactProtocolName
+                                                         fallbackTransportFactory:_httpTransportFactory];
+}
+
+-(void) tearDown
+{
+  [_webSocket disconnect];
+  [_session invalidateAndCancel];
+  [_webSocketServer stop];
+  [_httpServer stop];
+
+  [super tearDown];
+}
+
+-(void) connect
+{
+  [_webSocket connect];
+
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+  while (!_webSocket.protocolName && [timeout timeIntervalSinceNow] > 0) {
+    [NSRunLoop.currentRunLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+
+  XCTAssertEqualObjects(_webSocket.protocolName, ThriftCompactProtocolName);
+}
+
+-(UserAPIClientAsync *) clientWithTransportFactory:(id<TAsyncTransportFactory>)transportFactory
+{
+  return [UserAPIClientAsync.alloc initWithProtocolFactory:TCompactProtocolFactory.sharedFactory transportFactory:transportFactory];
+}
+
+-(MsgPack *) msgPackWithDataLength:(NSUInteger)length
+{
+  return [MsgPack.alloc initWithId:[Id generate]
+                              type:MsgTypeText
+                            sender:@"sender@example.com"
+                         envelopes:@[]
+                              chat:nil
+                          metaData:@{}
+                              data:[NSData dataWithRandomBytesOfLength:length]];
+}
+
+// Sends messages concurrently, verifying each response is the one for its request
+-(void) sendCount:(NSUInteger)count withClient:(UserAPIClientAsync *)client
+{
+  XCTestExpectation *sent = [self expectationWithDescription:@"sent"];
+
+  __block NSUInteger remaining = count;
+
+  for (NSUInteger c = 0; c < count; ++c) {
+
+    NSUInteger length = 16 + c;
+
+    [client send:[self msgPackWithDataLength:length] response:^(TimeStamp sentAt) {
+
+      XCTAssertEqual(sentAt, (TimeStamp)length);
+
+      @synchronized(self) {
+        if (--remaining == 0) {
+          [sent fulfill];
+        }
+      }
+
+    } failure:^(NSError *error) {
+      XCTFail(@"Error: %@", error);
+    }];
+  }
+
+  [self waitForExpectationsWithTimeout:30 handler:nil];
+}
+
+-(void) testSendsOverOpenWebSocket
+{
+  [self connect];
+
+  [self sendCount:1 withClient:[self clientWithTransportFactory:_webSocketTransportFactory]];
+
+  XCTAssertEqual(_webSocketServer.frameCount, 1);
+  XCTAssertEqual(_httpServer.requestCount, 0);
+}
+
+-(void) testRepliesCorrelatedBySequenceID
+{
+  [self connect];
+
+  [self sendCount:50 withClient:[self clientWithTransportFactory:_webSocketTransportFactory]];
+
+  XCTAssertEqual(_webSocketServer.frameCount, 50);
+}
+
+-(void) testFallsBackToHTTPWhenClosed
+{
+  [self sendCount:1 withClient:[self clientWithTransportFactory:_webSocketTransportFactory]];
+
+  XCTAssertEqual(_webSocketServer.frameCount, 0);
+  XCTAssertEqual(_httpServer.requestCount, 1);
+}
+
+-(void) testFallsBackToHTTPForLargeRequests
+{
+  [self connect];
+
+  _webSocketTransportFactory.maxRequestSize = 16;
+
+  [self sendCount:1 withClient:[self clientWithTransportFactory:_webSocketTransportFactory]];
+
+  XCTAssertEqual(_webSocketServer.frameCount, 0);
+  XCTAssertEqual(_httpServer.requestCount, 1);
+}
+
+-(void) testRequestTimesOut
+{
+  [self connect];
+
+  _webSocketServer.frameHandler = nil;
+  _webSocketTransportFactory.requestTimeout = 0.2;
+
+  XCTestExpectation *failed = [self expectationWithDescription:@"failed"];
+
+  [[self clientWithTransportFactory:_webSocketTransportFactory] send:[self msgPackWithDataLength:16] response:^(TimeStamp sentAt) {
+    XCTFail(@"Unexpected reply");
+  } failure:^(NSError *error) {
+    XCTAssertEqualObjects(error.domain, TTransportErrorDomain);
+    XCTAssertEqual(error.code, TTransportErrorTimedOut);
+    [failed fulfill];
+  }];
+
+  [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+// Refreshed tokens must be applied before the reply they accompany is handled
+-(void) testBearerRefreshDeliveredBeforeReply
+{
+  _webSocketServer.replyHeader = @"X-Bearer-Refresh: refreshed-token";
+
+  [self connect];
+
+  XCTestExpectation *sent = [self expectationWithDescription:@"sent"];
+
+  [[self clientWithTransportFactory:_webSocketTransportFactory] send:[self msgPackWithDataLength:16] response:^(TimeStamp sentAt) {
+    XCTAssertEqualObjects(self.refreshedAccessToken, @"refreshed-token");
+    [sent fulfill];
+  } failure:^(NSError *error) {
+    XCTFail(@"Error: %@", error);
+  }];
+
+  [self waitForExpectationsWithTimeout:5 handler:nil];
+
+  XCTAssertEqual(_httpServer.requestCount, 0);
+}
+
+// Latency (sequential) & throughput (concurrent) of small sends over each path; results are logged
+-(void) testBenchmarkWebSocketVersusHTTP
+{
+  [self connect];
+
+  const NSUInteger count = 200;
+
+  NSDictionary<NSString *, id<TAsyncTransportFactory>> *paths = @{@"websocket": _webSocketTransportFactory,
+                                                                  @"http": _httpTransportFactory};
+
+  for (NSString *path in @[@"websocket", @"http"]) {
+
+    UserAPIClientAsync *client = [self clientWithTransportFactory:paths[path]];
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger c = 0; c < count; ++c) {
+      [self sendCount:1 withClient:client];
+    }
+    CFAbsoluteTime latency = (CFAbsoluteTimeGetCurrent() - start) / count;
+
+    start = CFAbsoluteTimeGetCurrent();
+    [self sendCount:count withClient:client];
+    CFAbsoluteTime throughput = count / (CFAbsoluteTimeGetCurrent() - start);
+
+    NSLog(@"%-9@ latency %7.3fms, throughput %7.0f sends/s", path, latency * 1e3, throughput);
+  }
+}
+
+-(void) webSocket:(WebSocket *)webSocket willConnect:(NSMutableURLRequest *)request
+{
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReceiveUserStatuses:(NSArray<WebSocketUserStatus *> *)userStatuses
+{
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReceiveGroupStatus:(NSString *)sender chatId:(Id *)chatId status:(enum UserStatus)status
+{
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReceiveMsgReady:(MsgHdr *)msgHdr
+{
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReceiveMsgDelivery:(Msg *)msg
+{
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReceiveMsgsDelivered:(NSArray<WebSocketMsgDelivered *> *)msgsDelivered
+{
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReceiveMsgDirect:(DirectMsg *)msg
+{
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReconnectResumed:(BOOL)resumed
+{
+}
+
+-(void) webSocket:(WebSocket *)webSocket didReceiveBearerRefresh:(NSString *)accessToken
+{
+  self.refreshedAccessToken = accessToken;
+}
+
+@end
@@ -0,0 +1,6 @@
+
+ALTER TABLE notification ADD COLUMN fireDate datetime;
+
+DROP INDEX notification_chat_idx;
+
+CREATE INDEX notification_chat_fire_idx ON notification (chatId, fireDate);
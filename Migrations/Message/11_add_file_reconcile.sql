@@ -0,0 +1,2 @@
+
+CREATE TABLE file_reconcile (reconciled datetime NOT NULL);
@@ -0,0 +1,37 @@
+ALTER TABLE chat ADD COLUMN unreadCount integer NOT NULL DEFAULT 0;
+ALTER TABLE chat ADD COLUMN messageCount integer NOT NULL DEFAULT 0;
+
+CREATE INDEX message_chat_unread_idx ON message (chat) WHERE flags & 2;
+
+UPDATE chat SET
+  messageCount = (SELECT COUNT(id) FROM message WHERE message.chat = chat.id),
+  unreadCount = (SELECT COUNT(id) FROM message WHERE message.chat = chat.id AND flags & 2);
+
+CREATE TRIGGER message_counters_insert AFTER INSERT ON message
+BEGIN
+  UPDATE chat SET
+    messageCount = messageCount + 1,
+    unreadCount = unreadCount + ((ifnull(NEW.flags, 0) & 2) != 0)
+  WHERE id = NEW.chat;
+END;
+
+CREATE TRIGGER message_counters_delete AFTER DELETE ON message
+BEGIN
+  UPDATE chat SET
+    messageCount = messageCount - 1,
+    unreadCount = unreadCount - ((ifnull(OLD.flags, 0) & 2) != 0)
+  WHERE id = OLD.chat;
+END;
+
+CREATE TRIGGER message_counters_update AFTER UPDATE OF chat, flags ON message
+WHEN OLD.chat IS NOT NEW.chat OR (ifnull(OLD.flags, 0) & 2) != (ifnull(NEW.flags, 0) & 2)
+BEGIN
+  UPDATE chat SET
+    messageCount = messageCount - 1,
+    unreadCount = unreadCount - ((ifnull(OLD.flags, 0) & 2) != 0)
+  WHERE id = OLD.chat;
+  UPDATE chat SET
+    messageCount = messageCount + 1,
+    unreadCount = unreadCount + ((ifnull(NEW.flags, 0) & 2) != 0)
+  WHERE id = NEW.chat;
+END;
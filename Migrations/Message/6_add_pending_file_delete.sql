@@ -0,0 +1,2 @@
+
+CREATE TABLE pending_file_delete (fileName varchar PRIMARY KEY NOT NULL, queued datetime NOT NULL);
@@ -0,0 +1,9 @@
+
+DROP TABLE IF EXISTS blob;
+
+CREATE TABLE blob (
+  id integer PRIMARY KEY,
+  fileName varchar UNIQUE NOT NULL,
+  size integer NOT NULL,
+  refs integer NOT NULL DEFAULT 0
+);
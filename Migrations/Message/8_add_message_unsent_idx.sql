@@ -0,0 +1,2 @@
+
+CREATE INDEX message_unsent_idx ON message (sent, id) WHERE status < 0;
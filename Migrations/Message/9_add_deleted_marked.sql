@@ -0,0 +1,6 @@
+
+ALTER TABLE deleted ADD COLUMN marked datetime;
+
+UPDATE deleted SET marked = CAST(strftime('%s', 'now') AS REAL);
+
+CREATE INDEX deleted_marked_idx ON deleted (marked);